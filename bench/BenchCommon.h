@@ -0,0 +1,217 @@
+// Helpers shared by the headless CPU benchmarks.
+//
+// Provides the randomly refined trees that the CBT benchmarks run on (only
+// if cbt.h was included before this file), the parsing of comma-separated
+// command line lists, and the CSV or JSON report that each benchmark
+// writes its results to.
+#ifndef BENCH_COMMON_H
+#define BENCH_COMMON_H
+
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#define LOG(fmt, ...) fprintf(stderr, fmt "\n", ##__VA_ARGS__); fflush(stderr);
+
+// -----------------------------------------------------------------------------
+/**
+ * Random Refinement
+ *
+ * Each round splits half of the leaves, picked with a hash of their ID, so
+ * the leaves end up spread over many depths as they would in an adaptive
+ * subdivision.
+ */
+static inline uint32_t Hash(uint64_t x)
+{
+    x^= x >> 33;
+    x*= 0xff51afd7ed558ccdull;
+    x^= x >> 33;
+    x*= 0xc4ceb9fe1a85ec53ull;
+    x^= x >> 33;
+
+    return (uint32_t)x;
+}
+
+#ifdef CBT_INCLUDE_CBT_H
+static inline void
+SplitCallback(cbt_Tree *cbt, const cbt_Node node, const void *userData)
+{
+    const int round = *(const int *)userData;
+
+    if ((int64_t)node.depth < cbt_MaxDepth(cbt)
+        && (Hash(node.id * 64u + node.depth + ((uint64_t)round << 60)) & 1u)) {
+        cbt_SplitNode(cbt, node);
+    }
+}
+
+static inline cbt_Tree *CreateRefinedTree(int maxDepth, int64_t leafCount)
+{
+    cbt_Tree *cbt = cbt_CreateAtDepth(maxDepth, 1);
+
+    for (int round = 0; round < 8 * maxDepth && cbt_NodeCount(cbt) < leafCount; ++round)
+        cbt_Update(cbt, &SplitCallback, &round);
+
+    return cbt;
+}
+#endif // CBT_INCLUDE_CBT_H
+
+// -----------------------------------------------------------------------------
+/**
+ * Report Output
+ *
+ * Each result is a row of named fields, written either as a line of CSV or
+ * as an object of a JSON array. The CSV header lists the field names of
+ * the first row, so every row must write the same fields in the same order.
+ */
+struct BenchReport {
+    FILE *stream;
+    bool json;
+    int rowCount;
+    std::string names;      // fields of the row being written
+    std::string values;
+};
+
+static inline void WriteHeader(BenchReport *report, FILE *stream, bool json)
+{
+    report->stream = stream;
+    report->json = json;
+    report->rowCount = 0;
+    report->names.clear();
+    report->values.clear();
+
+    if (json)
+        fprintf(stream, "[\n");
+}
+
+static inline void
+WriteField(BenchReport *report, const char *name, const char *format, ...)
+{
+    char buffer[256];
+    va_list args;
+
+    va_start(args, format);
+    vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+
+    if (report->json) {
+        report->values+= report->values.empty() ? "{\"" : ", \"";
+        report->values+= name;
+        report->values+= "\": ";
+    } else {
+        if (!report->names.empty()) {
+            report->names+= ",";
+            report->values+= ",";
+        }
+        report->names+= name;
+    }
+    report->values+= buffer;
+}
+
+// strings are quoted and booleans spelled out in JSON only
+static inline void WriteString(BenchReport *report, const char *name, const char *value)
+{
+    WriteField(report, name, report->json ? "\"%s\"" : "%s", value);
+}
+
+static inline void WriteBool(BenchReport *report, const char *name, bool value)
+{
+    if (report->json)
+        WriteField(report, name, "%s", value ? "true" : "false");
+    else
+        WriteField(report, name, "%i", value ? 1 : 0);
+}
+
+static inline void WriteInt(BenchReport *report, const char *name, int64_t value)
+{
+    WriteField(report, name, "%lli", (long long)value);
+}
+
+// ends the row whose fields were just written
+static inline void WriteResult(BenchReport *report)
+{
+    if (report->json) {
+        fprintf(report->stream, "%s  %s}",
+                report->rowCount > 0 ? ",\n" : "", report->values.c_str());
+    } else {
+        if (report->rowCount == 0)
+            fprintf(report->stream, "%s\n", report->names.c_str());
+        fprintf(report->stream, "%s\n", report->values.c_str());
+    }
+    fflush(report->stream);
+
+    report->names.clear();
+    report->values.clear();
+    ++report->rowCount;
+}
+
+static inline void WriteFooter(BenchReport *report)
+{
+    if (report->json)
+        fprintf(report->stream, "\n]\n");
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Command Line Parsing
+ */
+static inline bool
+ParseIntList(const char *str, int minValue, int maxValue, std::vector<int> *out)
+{
+    std::string s(str);
+    size_t pos = 0;
+
+    out->clear();
+    while (pos <= s.size()) {
+        size_t end = s.find(',', pos);
+        std::string token = s.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+        int value = atoi(token.c_str());
+
+        if (token.empty() || value < minValue || value > maxValue)
+            return false;
+        out->push_back(value);
+
+        if (end == std::string::npos)
+            break;
+        pos = end + 1;
+    }
+
+    return !out->empty();
+}
+
+static inline bool
+ParseNameList(const char *str, const char **names, int nameCount, std::vector<int> *out)
+{
+    std::string s(str);
+    size_t pos = 0;
+
+    out->clear();
+    while (pos <= s.size()) {
+        size_t end = s.find(',', pos);
+        std::string token = s.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+        int value = -1;
+
+        for (int i = 0; i < nameCount; ++i)
+            if (token == names[i])
+                value = i;
+        if (value < 0)
+            return false;
+        out->push_back(value);
+
+        if (end == std::string::npos)
+            break;
+        pos = end + 1;
+    }
+
+    return !out->empty();
+}
+
+// the report options are common to all the benchmarks
+static inline void Usage(const char *app, const char *options)
+{
+    LOG("usage: %s %s [--format csv|json] [--output file]", app, options);
+}
+
+#endif // BENCH_COMMON_H
@@ -0,0 +1,300 @@
+// Headless CPU benchmark for leaf enumeration.
+//
+// Compares per-handle cbt_DecodeNode calls against the depth-first leaf
+// enumeration of CbtLeaves.h on randomly refined trees, and reports
+// throughput figures as CSV or JSON.
+//
+// usage: leaf_bench [options]
+//   --depths 16,20,25      CBT max depths to test (each in [6, 30])
+//   --leaves 1048576       number of leaves of the refined trees
+//   --methods decode,iterator,chunked
+//   --threads 1,2,4,8      OpenMP thread counts (ignored by 'iterator')
+//   --repeat 8             number of timed enumerations per configuration
+//   --format csv|json
+//   --output file          (default: stdout)
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <vector>
+
+#ifdef _OPENMP
+#   include <omp.h>
+#endif
+
+#define CBT_IMPLEMENTATION
+#include "cbt.h"
+
+#define CBTR_IMPLEMENTATION
+#include "CbtReduction.h"
+#define CBTL_IMPLEMENTATION
+#include "CbtLeaves.h"
+
+#include "BenchCommon.h"
+
+enum {
+    METHOD_DECODE,      // one cbt_DecodeNode call per handle
+    METHOD_ITERATOR,    // single traversal with a cbtl_Iterator
+    METHOD_CHUNKED,     // one traversal per chunk of CBTL_CHUNK_SIZE leaves
+
+    METHOD_COUNT
+};
+static const char *s_methodNames[METHOD_COUNT] = {
+    "decode", "iterator", "chunked"
+};
+
+struct BenchConfig {
+    std::vector<int> depths;
+    std::vector<int> methods;
+    std::vector<int> threads;
+    int64_t leafCount;
+    int repeatCount;
+    bool json;
+    const char *output;
+} g_bench = {
+    {16, 20, 25},
+    {METHOD_DECODE, METHOD_ITERATOR, METHOD_CHUNKED},
+    {1},
+    1 << 20,
+    8,
+    false,
+    NULL
+};
+
+struct BenchResult {
+    int maxDepth;
+    int method;
+    int threadCount;
+    int64_t leafCount;
+    int64_t heapByteSize;
+    double bestSeconds, averageSeconds;
+    double leavesPerSecond;
+    double nsPerLeaf;
+    bool isValid;   // true if the leaves match those of cbt_DecodeNode
+};
+
+// -----------------------------------------------------------------------------
+/**
+ * Enumeration Methods
+ */
+static void Enumerate(const cbt_Tree *cbt, int method, cbt_Node *nodes)
+{
+    const int64_t nodeCount = cbt_NodeCount(cbt);
+
+    if (method == METHOD_DECODE) {
+#pragma omp parallel for
+        for (int64_t handle = 0; handle < nodeCount; ++handle)
+            nodes[handle] = cbt_DecodeNode(cbt, handle);
+    } else if (method == METHOD_ITERATOR) {
+        cbtl_Iterator it;
+
+        cbtl_IteratorInit(&it, cbt, 0, nodeCount);
+        while (cbtl_IteratorNext(&it))
+            nodes[it.handle] = it.node;
+    } else {
+        const int64_t chunkCount = (nodeCount + CBTL_CHUNK_SIZE - 1) / CBTL_CHUNK_SIZE;
+
+#pragma omp parallel for
+        for (int64_t chunkID = 0; chunkID < chunkCount; ++chunkID) {
+            int64_t firstHandle = chunkID * CBTL_CHUNK_SIZE;
+
+            cbtl_DecodeLeaves(cbt, firstHandle, CBTL_CHUNK_SIZE, &nodes[firstHandle]);
+        }
+    }
+}
+
+static bool
+NodesEqual(const cbt_Node *nodes1, const cbt_Node *nodes2, int64_t nodeCount)
+{
+    for (int64_t i = 0; i < nodeCount; ++i)
+        if (nodes1[i].id != nodes2[i].id || nodes1[i].depth != nodes2[i].depth)
+            return false;
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Run a Single Configuration
+ *
+ * The enumerated leaves are checked against those of cbt_DecodeNode
+ * before the timed runs.
+ */
+static BenchResult
+RunBenchmark(
+    const cbt_Tree *cbt,
+    const std::vector<cbt_Node> &reference,
+    int method,
+    int threadCount
+) {
+    typedef std::chrono::steady_clock clock;
+    const int64_t nodeCount = cbt_NodeCount(cbt);
+    std::vector<cbt_Node> nodes(nodeCount);
+    double totalSeconds = 0.0;
+    BenchResult result;
+
+#ifdef _OPENMP
+    omp_set_num_threads(threadCount);
+#endif
+
+    result.maxDepth = (int)cbt_MaxDepth(cbt);
+    result.method = method;
+    result.threadCount = method == METHOD_ITERATOR ? 1 : threadCount;
+    result.leafCount = nodeCount;
+    result.heapByteSize = cbt_HeapByteSize(cbt);
+    result.bestSeconds = 1e9;
+
+    // warmup and validation
+    Enumerate(cbt, method, &nodes[0]);
+    result.isValid = NodesEqual(&nodes[0], &reference[0], nodeCount);
+
+    for (int i = 0; i < g_bench.repeatCount; ++i) {
+        clock::time_point start = clock::now();
+        double dt;
+
+        Enumerate(cbt, method, &nodes[0]);
+        dt = std::chrono::duration<double>(clock::now() - start).count();
+
+        totalSeconds+= dt;
+        if (dt < result.bestSeconds)
+            result.bestSeconds = dt;
+    }
+
+    result.averageSeconds = totalSeconds / g_bench.repeatCount;
+    result.leavesPerSecond = nodeCount / result.averageSeconds;
+    result.nsPerLeaf = result.averageSeconds * 1e9 / nodeCount;
+
+    return result;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Report Output
+ */
+static void WriteResult(BenchReport *report, const BenchResult &r)
+{
+    WriteString(report, "method", s_methodNames[r.method]);
+    WriteInt(report, "maxDepth", r.maxDepth);
+    WriteInt(report, "leaves", r.leafCount);
+    WriteInt(report, "heapBytes", r.heapByteSize);
+    WriteInt(report, "threads", r.threadCount);
+    WriteBool(report, "valid", r.isValid);
+    WriteField(report, "bestMs", "%.6f", r.bestSeconds * 1e3);
+    WriteField(report, "averageMs", "%.6f", r.averageSeconds * 1e3);
+    WriteField(report, "leavesPerSec", "%.1f", r.leavesPerSecond);
+    WriteField(report, "nsPerLeaf", "%.4f", r.nsPerLeaf);
+    WriteResult(report);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Command Line Parsing
+ */
+static bool ParseCommandLine(int argc, char **argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        bool ok = (value != NULL);
+
+        if (!strcmp(arg, "--depths") && ok) {
+            ok = ParseIntList(value, 6, 30, &g_bench.depths);
+        } else if (!strcmp(arg, "--leaves") && ok) {
+            g_bench.leafCount = atoll(value);
+            ok = g_bench.leafCount > 0;
+        } else if (!strcmp(arg, "--methods") && ok) {
+            ok = ParseNameList(value, s_methodNames, METHOD_COUNT, &g_bench.methods);
+        } else if (!strcmp(arg, "--threads") && ok) {
+            ok = ParseIntList(value, 1, 1024, &g_bench.threads);
+        } else if (!strcmp(arg, "--repeat") && ok) {
+            g_bench.repeatCount = atoi(value);
+            ok = g_bench.repeatCount > 0;
+        } else if (!strcmp(arg, "--format") && ok) {
+            ok = !strcmp(value, "csv") || !strcmp(value, "json");
+            g_bench.json = !strcmp(value, "json");
+        } else if (!strcmp(arg, "--output") && ok) {
+            g_bench.output = value;
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            LOG("leaf_bench: invalid argument '%s'", arg);
+            return false;
+        }
+        ++i;
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+    FILE *pf = stdout;
+    BenchReport report;
+    bool isValid = true;
+
+    if (!ParseCommandLine(argc, argv)) {
+        Usage(argv[0], "[--depths 6,..,30] [--leaves N] [--methods decode,iterator,chunked] "
+                       "[--threads 1,2,..] [--repeat N]");
+
+        return EXIT_FAILURE;
+    }
+
+#ifndef _OPENMP
+    LOG("leaf_bench: built without OpenMP, thread counts are ignored");
+#endif
+
+    if (g_bench.output) {
+        pf = fopen(g_bench.output, "w");
+
+        if (!pf) {
+            LOG("leaf_bench: failed to open '%s'", g_bench.output);
+
+            return EXIT_FAILURE;
+        }
+    }
+
+    WriteHeader(&report, pf, g_bench.json);
+    for (size_t i = 0; i < g_bench.depths.size(); ++i) {
+        cbt_Tree *cbt = CreateRefinedTree(g_bench.depths[i], g_bench.leafCount);
+        const int64_t nodeCount = cbt_NodeCount(cbt);
+        std::vector<cbt_Node> reference(nodeCount);
+
+        for (int64_t handle = 0; handle < nodeCount; ++handle)
+            reference[handle] = cbt_DecodeNode(cbt, handle);
+
+        for (size_t j = 0; j < g_bench.methods.size(); ++j)
+        for (size_t k = 0; k < g_bench.threads.size(); ++k) {
+            // the iterator is single-threaded
+            if (g_bench.methods[j] == METHOD_ITERATOR && k > 0)
+                break;
+
+            LOG("Running {depth %i, %lli leaves, %s, %i thread(s)}",
+                g_bench.depths[i], (long long)nodeCount,
+                s_methodNames[g_bench.methods[j]], g_bench.threads[k]);
+            BenchResult result = RunBenchmark(cbt,
+                                              reference,
+                                              g_bench.methods[j],
+                                              g_bench.threads[k]);
+
+            WriteResult(&report, result);
+            isValid&= result.isValid;
+        }
+
+        cbt_Release(cbt);
+    }
+    WriteFooter(&report);
+
+    if (pf != stdout)
+        fclose(pf);
+
+    if (!isValid) {
+        LOG("leaf_bench: enumerated leaves differ from cbt_DecodeNode");
+
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,388 @@
+// Headless CPU benchmark for the per-frame leaf cache.
+//
+// Models the GPU passes of a frame that enumerate the leaves of a CBT
+// (the update and render passes; the batch pass only reads the node
+// count). The 'decode' method calls cbt_DecodeNode in every pass, as the
+// shaders do without CbtLeafCache.glsl; the 'cache' method decodes the
+// leaves once into an array of heap indices that the passes then read, as
+// CbtLeafCacheWriter.glsl does. Besides timings, the benchmark reports the
+// 32-bit words each method reads or writes per frame, counting the heap
+// words touched by the descent of cbt_DecodeNode, which is the heap
+// traffic the cache saves on the GPU.
+//
+// usage: leaf_cache_bench [options]
+//   --depths 20,25,30      CBT max depths to test (each in [6, 30])
+//   --leaves 1048576       number of leaves of the refined trees
+//   --passes 2             passes that enumerate the leaves per frame
+//   --methods decode,cache
+//   --threads 1,2,4,8      OpenMP thread counts
+//   --repeat 8             number of timed frames per configuration
+//   --format csv|json
+//   --output file          (default: stdout)
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <vector>
+
+#ifdef _OPENMP
+#   include <omp.h>
+#endif
+
+#define CBT_IMPLEMENTATION
+#include "cbt.h"
+
+#include "BenchCommon.h"
+
+enum {
+    METHOD_DECODE,      // one cbt_DecodeNode call per leaf and pass
+    METHOD_CACHE,       // one cbt_DecodeNode call per leaf, then cached IDs
+
+    METHOD_COUNT
+};
+static const char *s_methodNames[METHOD_COUNT] = {
+    "decode", "cache"
+};
+
+struct BenchConfig {
+    std::vector<int> depths;
+    std::vector<int> methods;
+    std::vector<int> threads;
+    int64_t leafCount;
+    int passCount;
+    int repeatCount;
+    bool json;
+    const char *output;
+} g_bench = {
+    {20, 25, 30},
+    {METHOD_DECODE, METHOD_CACHE},
+    {1},
+    1 << 20,
+    2,
+    8,
+    false,
+    NULL
+};
+
+struct BenchResult {
+    int maxDepth;
+    int method;
+    int threadCount;
+    int64_t leafCount;
+    double bestSeconds, averageSeconds;
+    double nsPerLeafPass;
+    int64_t wordCount;      // 32-bit words read or written per frame
+    double savedRatio;      // words saved relative to the decode method
+    bool isValid;           // true if the leaves match those of cbt_DecodeNode
+};
+
+// -----------------------------------------------------------------------------
+/**
+ * Heap Traffic Model
+ *
+ * A node at depth d is stored on D - d + 1 bits at bit 2^(d+1) + id (D - d + 1)
+ * of the heap, D being the max depth of the CBT. The descent of
+ * cbt_DecodeNode reads each node it visits and its left child, and reads the
+ * leaf once more before it stops; every read touches the 32-bit words its
+ * bits span.
+ */
+static int64_t HeapReadWordCount(const cbt_Tree *cbt, const cbt_Node node)
+{
+    int64_t bitSize = cbt_MaxDepth(cbt) - (int64_t)node.depth + 1;
+    int64_t bitID = (2LL << node.depth) + (int64_t)node.id * bitSize;
+
+    return ((bitID + bitSize - 1) >> 5) - (bitID >> 5) + 1;
+}
+
+static int64_t DecodeWordCount(const cbt_Tree *cbt, int64_t handle)
+{
+    cbt_Node node = cbt_CreateNode(1u, 0);
+    int64_t wordCount = HeapReadWordCount(cbt, node);
+
+    while (cbt_HeapRead(cbt, node) > 1u) {
+        cbt_Node leftChild = cbt_LeftChildNode(node);
+        uint64_t cmp = cbt_HeapRead(cbt, leftChild);
+        uint64_t b = (uint64_t)handle < cmp ? 0u : 1u;
+
+        wordCount+= HeapReadWordCount(cbt, leftChild);
+        node = leftChild;
+        node.id|= b;
+        handle-= cmp * b;
+        wordCount+= HeapReadWordCount(cbt, node);
+    }
+
+    return wordCount;
+}
+
+static int64_t DecodeWordCount(const cbt_Tree *cbt)
+{
+    const int64_t nodeCount = cbt_NodeCount(cbt);
+    int64_t wordCount = 0;
+
+#pragma omp parallel for reduction(+:wordCount)
+    for (int64_t handle = 0; handle < nodeCount; ++handle)
+        wordCount+= DecodeWordCount(cbt, handle);
+
+    return wordCount;
+}
+
+static int64_t FrameWordCount(int method, int64_t decodeWordCount, int64_t nodeCount)
+{
+    if (method == METHOD_DECODE)
+        return decodeWordCount * g_bench.passCount;
+
+    // one decode and one write per leaf, then one read per leaf and pass
+    return decodeWordCount + nodeCount * (1 + g_bench.passCount);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Frame Methods
+ *
+ * Each pass writes the leaves it enumerates to the node array, which stands
+ * for the per-leaf work of the GPU passes.
+ */
+static int FindMSB(uint32_t x)
+{
+#ifdef __GNUC__
+    return 31 - __builtin_clz(x);
+#else
+    int msb = 0;
+
+    while (x >>= 1)
+        ++msb;
+
+    return msb;
+#endif
+}
+
+static void
+RunFrame(const cbt_Tree *cbt, int method, uint32_t *leafIDs, cbt_Node *nodes)
+{
+    const int64_t nodeCount = cbt_NodeCount(cbt);
+
+    if (method == METHOD_DECODE) {
+        for (int passID = 0; passID < g_bench.passCount; ++passID) {
+#pragma omp parallel for
+            for (int64_t handle = 0; handle < nodeCount; ++handle)
+                nodes[handle] = cbt_DecodeNode(cbt, handle);
+        }
+    } else {
+#pragma omp parallel for
+        for (int64_t handle = 0; handle < nodeCount; ++handle)
+            leafIDs[handle] = (uint32_t)cbt_DecodeNode(cbt, handle).id;
+
+        for (int passID = 0; passID < g_bench.passCount; ++passID) {
+#pragma omp parallel for
+            for (int64_t handle = 0; handle < nodeCount; ++handle) {
+                uint32_t id = leafIDs[handle];
+
+                nodes[handle] = cbt_CreateNode(id, FindMSB(id));
+            }
+        }
+    }
+}
+
+static bool
+NodesEqual(const cbt_Node *nodes1, const cbt_Node *nodes2, int64_t nodeCount)
+{
+    for (int64_t i = 0; i < nodeCount; ++i)
+        if (nodes1[i].id != nodes2[i].id || nodes1[i].depth != nodes2[i].depth)
+            return false;
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Run a Single Configuration
+ *
+ * The leaves of the last pass are checked against those of cbt_DecodeNode
+ * before the timed runs.
+ */
+static BenchResult
+RunBenchmark(
+    const cbt_Tree *cbt,
+    const std::vector<cbt_Node> &reference,
+    int64_t decodeWordCount,
+    int method,
+    int threadCount
+) {
+    typedef std::chrono::steady_clock clock;
+    const int64_t nodeCount = cbt_NodeCount(cbt);
+    std::vector<uint32_t> leafIDs(method == METHOD_CACHE ? nodeCount : 0);
+    std::vector<cbt_Node> nodes(nodeCount);
+    uint32_t *leafIDData = leafIDs.empty() ? NULL : &leafIDs[0];
+    double totalSeconds = 0.0;
+    BenchResult result;
+
+#ifdef _OPENMP
+    omp_set_num_threads(threadCount);
+#endif
+
+    result.maxDepth = (int)cbt_MaxDepth(cbt);
+    result.method = method;
+    result.threadCount = threadCount;
+    result.leafCount = nodeCount;
+    result.bestSeconds = 1e9;
+    result.wordCount = FrameWordCount(method, decodeWordCount, nodeCount);
+    result.savedRatio = 1.0 - (double)result.wordCount
+                      / FrameWordCount(METHOD_DECODE, decodeWordCount, nodeCount);
+
+    // warmup and validation
+    RunFrame(cbt, method, leafIDData, &nodes[0]);
+    result.isValid = NodesEqual(&nodes[0], &reference[0], nodeCount);
+
+    for (int i = 0; i < g_bench.repeatCount; ++i) {
+        clock::time_point start = clock::now();
+        double dt;
+
+        RunFrame(cbt, method, leafIDData, &nodes[0]);
+        dt = std::chrono::duration<double>(clock::now() - start).count();
+
+        totalSeconds+= dt;
+        if (dt < result.bestSeconds)
+            result.bestSeconds = dt;
+    }
+
+    result.averageSeconds = totalSeconds / g_bench.repeatCount;
+    result.nsPerLeafPass = result.averageSeconds * 1e9
+                         / ((double)nodeCount * g_bench.passCount);
+
+    return result;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Report Output
+ */
+static void WriteResult(BenchReport *report, const BenchResult &r)
+{
+    WriteString(report, "method", s_methodNames[r.method]);
+    WriteInt(report, "maxDepth", r.maxDepth);
+    WriteInt(report, "leaves", r.leafCount);
+    WriteInt(report, "passes", g_bench.passCount);
+    WriteInt(report, "threads", r.threadCount);
+    WriteBool(report, "valid", r.isValid);
+    WriteField(report, "bestMs", "%.6f", r.bestSeconds * 1e3);
+    WriteField(report, "averageMs", "%.6f", r.averageSeconds * 1e3);
+    WriteField(report, "nsPerLeafPass", "%.4f", r.nsPerLeafPass);
+    WriteInt(report, "wordsPerFrame", r.wordCount);
+    WriteField(report, "modeledMBPerFrame", "%.3f", r.wordCount * 4.0 / (1 << 20));
+    WriteField(report, "savedPercent", "%.2f", r.savedRatio * 1e2);
+    WriteResult(report);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Command Line Parsing
+ */
+static bool ParseCommandLine(int argc, char **argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        bool ok = (value != NULL);
+
+        if (!strcmp(arg, "--depths") && ok) {
+            ok = ParseIntList(value, 6, 30, &g_bench.depths);
+        } else if (!strcmp(arg, "--leaves") && ok) {
+            g_bench.leafCount = atoll(value);
+            ok = g_bench.leafCount > 0;
+        } else if (!strcmp(arg, "--passes") && ok) {
+            g_bench.passCount = atoi(value);
+            ok = g_bench.passCount > 0;
+        } else if (!strcmp(arg, "--methods") && ok) {
+            ok = ParseNameList(value, s_methodNames, METHOD_COUNT, &g_bench.methods);
+        } else if (!strcmp(arg, "--threads") && ok) {
+            ok = ParseIntList(value, 1, 1024, &g_bench.threads);
+        } else if (!strcmp(arg, "--repeat") && ok) {
+            g_bench.repeatCount = atoi(value);
+            ok = g_bench.repeatCount > 0;
+        } else if (!strcmp(arg, "--format") && ok) {
+            ok = !strcmp(value, "csv") || !strcmp(value, "json");
+            g_bench.json = !strcmp(value, "json");
+        } else if (!strcmp(arg, "--output") && ok) {
+            g_bench.output = value;
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            LOG("leaf_cache_bench: invalid argument '%s'", arg);
+            return false;
+        }
+        ++i;
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+    FILE *pf = stdout;
+    BenchReport report;
+    bool isValid = true;
+
+    if (!ParseCommandLine(argc, argv)) {
+        Usage(argv[0], "[--depths 6,..,30] [--leaves N] [--passes N] [--methods decode,cache] "
+                       "[--threads 1,2,..] [--repeat N]");
+
+        return EXIT_FAILURE;
+    }
+
+#ifndef _OPENMP
+    LOG("leaf_cache_bench: built without OpenMP, thread counts are ignored");
+#endif
+
+    if (g_bench.output) {
+        pf = fopen(g_bench.output, "w");
+
+        if (!pf) {
+            LOG("leaf_cache_bench: failed to open '%s'", g_bench.output);
+
+            return EXIT_FAILURE;
+        }
+    }
+
+    WriteHeader(&report, pf, g_bench.json);
+    for (size_t i = 0; i < g_bench.depths.size(); ++i) {
+        cbt_Tree *cbt = CreateRefinedTree(g_bench.depths[i], g_bench.leafCount);
+        const int64_t nodeCount = cbt_NodeCount(cbt);
+        const int64_t decodeWordCount = DecodeWordCount(cbt);
+        std::vector<cbt_Node> reference(nodeCount);
+
+        for (int64_t handle = 0; handle < nodeCount; ++handle)
+            reference[handle] = cbt_DecodeNode(cbt, handle);
+
+        for (size_t j = 0; j < g_bench.methods.size(); ++j)
+        for (size_t k = 0; k < g_bench.threads.size(); ++k) {
+            LOG("Running {depth %i, %lli leaves, %s, %i thread(s)}",
+                g_bench.depths[i], (long long)nodeCount,
+                s_methodNames[g_bench.methods[j]], g_bench.threads[k]);
+            BenchResult result = RunBenchmark(cbt,
+                                              reference,
+                                              decodeWordCount,
+                                              g_bench.methods[j],
+                                              g_bench.threads[k]);
+
+            WriteResult(&report, result);
+            isValid&= result.isValid;
+        }
+
+        cbt_Release(cbt);
+    }
+    WriteFooter(&report);
+
+    if (pf != stdout)
+        fclose(pf);
+
+    if (!isValid) {
+        LOG("leaf_cache_bench: cached leaves differ from cbt_DecodeNode");
+
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
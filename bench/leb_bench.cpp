@@ -0,0 +1,510 @@
+// Headless CPU benchmark for the subdivision demo's split/merge loop.
+//
+// Runs the same ping-pong update as subdivision.cpp (one split pass, then
+// one merge pass, alternating every frame) without creating any OpenGL
+// context, and reports throughput figures as CSV or JSON.
+//
+// usage: leb_bench [options]
+//   --depths 6,10,20       CBT max depths to test (each in [6, 30])
+//   --modes triangle,square
+//   --trajectories static,circle,lissajous,sweep
+//   --threads 1,2,4,8      OpenMP thread counts
+//   --frames 256           number of timed frames per configuration
+//   --period 128           trajectory period in frames
+//   --points 0             refine around N random points instead of the target
+//   --batched              use lebs_UpdateBatched instead of lebs_Update, whose
+//                          callbacks run on the leaves cbtl_Update enumerates
+//   --sparse               use lebs_UpdateSparse (worklist-driven update)
+//   --incremental          reduce only the dirty blocks of the CBT
+//   --verify               check the reduction against cbt_ComputeSumReduction
+//                          and, with --batched or --sparse, the tree against
+//                          that of lebs_Update after every update (exits with
+//                          an error on mismatch)
+//   --format csv|json
+//   --output file          (default: stdout)
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <vector>
+
+#ifdef _OPENMP
+#   include <omp.h>
+#endif
+
+#define CBT_IMPLEMENTATION
+#include "cbt.h"
+
+#define CBTR_IMPLEMENTATION
+#include "CbtReduction.h"
+
+#define LEB_IMPLEMENTATION
+#include "leb.h"
+
+#define LEBS_IMPLEMENTATION
+#define LEBC_IMPLEMENTATION
+#define CBTL_IMPLEMENTATION
+#include "LebSubdivision.h"
+
+#include "BenchCommon.h"
+
+#define CBT_INIT_MAX_DEPTH 1
+#define SPARSE_FULL_SWEEP_PERIOD 64
+
+enum {
+    TRAJECTORY_STATIC,
+    TRAJECTORY_CIRCLE,
+    TRAJECTORY_LISSAJOUS,
+    TRAJECTORY_SWEEP,
+
+    TRAJECTORY_COUNT
+};
+static const char *s_trajectoryNames[TRAJECTORY_COUNT] = {
+    "static", "circle", "lissajous", "sweep"
+};
+static const char *s_modeNames[] = {"triangle", "square"};
+
+struct BenchConfig {
+    std::vector<int> depths;
+    std::vector<int> modes;
+    std::vector<int> trajectories;
+    std::vector<int> threads;
+    int frameCount;
+    int period;
+    int pointCount;
+    bool batched;
+    bool sparse;
+    bool incremental;
+    bool verify;
+    bool json;
+    const char *output;
+} g_bench = {
+    {10, 15, 20},
+    {MODE_TRIANGLE, MODE_SQUARE},
+    {TRAJECTORY_STATIC, TRAJECTORY_CIRCLE},
+    {1},
+    256,
+    128,
+    0,
+    false,
+    false,
+    false,
+    false,
+    false,
+    NULL
+};
+
+struct BenchResult {
+    int maxDepth;
+    int mode;
+    int trajectory;
+    int threadCount;
+    int frameCount;
+    int convergenceFrames;  // -1 if the tree did not reach a fixed point
+    int64_t peakNodeCount;
+    int64_t heapByteSize;   // allocated for the max depth, whatever the node count
+    double splitSeconds, mergeSeconds;
+    double nodesPerSecond;
+    double nsPerNode;
+    int64_t mismatchCount;  // updates that failed --verify
+};
+
+// -----------------------------------------------------------------------------
+/**
+ * Target Trajectories
+ *
+ * Each trajectory stays within the unit square; the static one uses the
+ * same default target as the interactive demo.
+ */
+static void EvalTrajectory(int trajectory, int frameID, int period, float target[2])
+{
+    const float pi = 3.14159265358979f;
+    float u = (float)(frameID % period) / (float)period;
+
+    switch (trajectory) {
+    case TRAJECTORY_CIRCLE:
+        target[0] = 0.5f + 0.3f * cosf(2.0f * pi * u);
+        target[1] = 0.5f + 0.3f * sinf(2.0f * pi * u);
+        break;
+    case TRAJECTORY_LISSAJOUS:
+        target[0] = 0.5f + 0.4f * sinf(2.0f * pi * 3.0f * u + 0.5f * pi);
+        target[1] = 0.5f + 0.4f * sinf(2.0f * pi * 2.0f * u);
+        break;
+    case TRAJECTORY_SWEEP: {
+        float t = u < 0.5f ? 2.0f * u : 2.0f - 2.0f * u;
+
+        target[0] = 0.05f + 0.9f * t;
+        target[1] = 0.05f + 0.9f * t;
+    } break;
+    default:
+        target[0] = 0.49951f;
+        target[1] = 0.41204f;
+        break;
+    }
+}
+
+static const char *UpdateName()
+{
+    if (g_bench.sparse)
+        return "sparse";
+    else if (g_bench.batched)
+        return "batched";
+    else
+        return "callback";
+}
+
+// returns the number of nodes visited by the update
+static int64_t
+Update(
+    cbt_Tree *cbt,
+    cbtr_DirtyMap *dirtyMap,
+    const lebs_Params *params,
+    int pingPong,
+    lebs_SparseState *sparseState
+) {
+    int64_t nodeCount = cbt_NodeCount(cbt);
+
+    if (g_bench.sparse) {
+        lebs_UpdateSparse(cbt, dirtyMap, params, pingPong, sparseState);
+        nodeCount = sparseState->visitedNodeCount;
+    } else if (g_bench.batched) {
+        lebs_UpdateBatched(cbt, dirtyMap, params, pingPong);
+    } else {
+        lebs_Update(cbt, dirtyMap, params, pingPong);
+    }
+
+    return nodeCount;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Verification
+ *
+ * The bitfield of the tree is copied into a scratch tree of the same depth
+ * and reduced with cbt_ComputeSumReduction; the two heaps must match. The
+ * batched and sparse updates must also produce the same tree as
+ * lebs_Update, which updates a reference tree alongside the benchmarked
+ * one with the same parameters.
+ */
+static bool VerifyReduction(const cbt_Tree *cbt, cbt_Tree *scratch)
+{
+    const int64_t byteSize = cbt_HeapByteSize(cbt);
+    char *heap = (char *)cbt_GetHeap(scratch);
+
+    memcpy(heap, cbt_GetHeap(cbt), byteSize);
+    cbt_ComputeSumReduction(scratch);
+
+    return memcmp(heap, cbt_GetHeap(cbt), byteSize) == 0;
+}
+
+// phase is "warmup" or "timed"; reference is NULL for the callback update
+static void
+Verify(
+    const cbt_Tree *cbt,
+    cbt_Tree *scratch,
+    cbt_Tree *reference,
+    const lebs_Params *params,
+    int pingPong,
+    const char *phase,
+    int frameID,
+    BenchResult *result
+) {
+    const char *error = NULL;
+
+    if (!VerifyReduction(cbt, scratch)) {
+        error = "the incremental reduction differs from the full reduction";
+    } else if (reference) {
+        lebs_Update(reference, NULL, params, pingPong);
+
+        if (memcmp(cbt_GetHeap(reference), cbt_GetHeap(cbt), cbt_HeapByteSize(cbt)))
+            error = "the tree differs from that of lebs_Update";
+    }
+
+    if (error) {
+        if (result->mismatchCount == 0) {
+            LOG("leb_bench: %s frame %i: %s", phase, frameID, error);
+        }
+        ++result->mismatchCount;
+    }
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Run a Single Configuration
+ *
+ * The tree is first refined towards the initial target until a split and
+ * a merge pass both leave the node count unchanged; the number of frames
+ * this takes is reported as the convergence time. The timed frames then
+ * follow the trajectory.
+ */
+static BenchResult
+RunBenchmark(int maxDepth, int mode, int trajectory, int threadCount)
+{
+    typedef std::chrono::steady_clock clock;
+    cbt_Tree *cbt = cbt_CreateAtDepth(maxDepth, CBT_INIT_MAX_DEPTH);
+    lebc_Criteria *criteria = NULL;
+    lebs_Params params = {mode, {0.0f, 0.0f}, NULL};
+    lebs_SparseState sparseState;
+    cbtr_DirtyMap dirtyMap;
+    cbtr_DirtyMap *dirtyMapPtr = NULL;
+    cbt_Tree *scratch = NULL;
+    cbt_Tree *reference = NULL;
+    BenchResult result;
+    int maxConvergenceFrames = 4 * maxDepth + 64;
+    int64_t nodeCount = cbt_NodeCount(cbt);
+    int64_t visitedNodeCount = 0;
+
+#ifdef _OPENMP
+    omp_set_num_threads(threadCount);
+#endif
+    lebs_SparseStateInit(&sparseState, SPARSE_FULL_SWEEP_PERIOD);
+    memset(&dirtyMap, 0, sizeof(dirtyMap));
+    if (g_bench.incremental) {
+        cbtr_DirtyMapInit(&dirtyMap, cbt);
+        dirtyMapPtr = &dirtyMap;
+    }
+    if (g_bench.verify) {
+        scratch = cbt_Create(maxDepth);
+        if (g_bench.batched || g_bench.sparse)
+            reference = cbt_CreateAtDepth(maxDepth, CBT_INIT_MAX_DEPTH);
+    }
+
+    if (g_bench.pointCount > 0) {
+        uint32_t seed = 1u;
+
+        criteria = lebc_Create();
+        for (int i = 0; i < g_bench.pointCount; ++i) {
+            float u, v;
+
+            seed = seed * 1664525u + 1013904223u; u = (seed >> 8) / 16777216.0f;
+            seed = seed * 1664525u + 1013904223u; v = (seed >> 8) / 16777216.0f;
+            lebc_AddPoint(criteria, u, v);
+        }
+        lebc_Build(criteria, 0);
+        params.criteria = criteria;
+    }
+
+    result.maxDepth = maxDepth;
+    result.mode = mode;
+    result.trajectory = trajectory;
+    result.threadCount = threadCount;
+    result.frameCount = g_bench.frameCount;
+    result.convergenceFrames = -1;
+    result.peakNodeCount = nodeCount;
+    result.heapByteSize = cbt_HeapByteSize(cbt);
+    result.splitSeconds = result.mergeSeconds = 0.0;
+    result.mismatchCount = 0;
+
+    // warmup: converge towards the initial target
+    EvalTrajectory(trajectory, 0, g_bench.period, params.target);
+    for (int frameID = 0; frameID < maxConvergenceFrames; frameID+= 2) {
+        int64_t prevNodeCount = cbt_NodeCount(cbt);
+
+        Update(cbt, dirtyMapPtr, &params, 0, &sparseState);
+        if (scratch)
+            Verify(cbt, scratch, reference, &params, 0, "warmup", frameID, &result);
+        int64_t splitNodeCount = cbt_NodeCount(cbt);
+        Update(cbt, dirtyMapPtr, &params, 1, &sparseState);
+        if (scratch)
+            Verify(cbt, scratch, reference, &params, 1, "warmup", frameID + 1, &result);
+        nodeCount = cbt_NodeCount(cbt);
+
+        if (splitNodeCount > result.peakNodeCount)
+            result.peakNodeCount = splitNodeCount;
+
+        if (splitNodeCount == prevNodeCount && nodeCount == prevNodeCount) {
+            result.convergenceFrames = frameID;
+            break;
+        }
+    }
+
+    // timed frames
+    for (int frameID = 0; frameID < g_bench.frameCount; ++frameID) {
+        int pingPong = frameID & 1;
+        clock::time_point start;
+        double dt;
+
+        EvalTrajectory(trajectory, frameID, g_bench.period, params.target);
+
+        start = clock::now();
+        visitedNodeCount+= Update(cbt, dirtyMapPtr, &params, pingPong, &sparseState);
+        dt = std::chrono::duration<double>(clock::now() - start).count();
+
+        if (scratch)
+            Verify(cbt, scratch, reference, &params, pingPong, "timed", frameID, &result);
+
+        if (pingPong == 0)
+            result.splitSeconds+= dt;
+        else
+            result.mergeSeconds+= dt;
+
+        nodeCount = cbt_NodeCount(cbt);
+        if (nodeCount > result.peakNodeCount)
+            result.peakNodeCount = nodeCount;
+    }
+
+    double totalSeconds = result.splitSeconds + result.mergeSeconds;
+
+    result.nodesPerSecond = totalSeconds > 0.0 ? visitedNodeCount / totalSeconds : 0.0;
+    result.nsPerNode = visitedNodeCount > 0 ? totalSeconds * 1e9 / visitedNodeCount : 0.0;
+
+    lebs_SparseStateRelease(&sparseState);
+    cbtr_DirtyMapRelease(&dirtyMap);
+    if (scratch)
+        cbt_Release(scratch);
+    if (reference)
+        cbt_Release(reference);
+    cbt_Release(cbt);
+    if (criteria)
+        lebc_Release(criteria);
+
+    return result;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Report Output
+ */
+static void WriteResult(BenchReport *report, const BenchResult &r)
+{
+    WriteString(report, "update", UpdateName());
+    WriteString(report, "mode", s_modeNames[r.mode]);
+    WriteInt(report, "maxDepth", r.maxDepth);
+    WriteString(report, "trajectory", s_trajectoryNames[r.trajectory]);
+    WriteInt(report, "points", g_bench.pointCount);
+    WriteInt(report, "threads", r.threadCount);
+    WriteInt(report, "frames", r.frameCount);
+    WriteInt(report, "convergenceFrames", r.convergenceFrames);
+    WriteInt(report, "peakNodes", r.peakNodeCount);
+    WriteInt(report, "heapBytes", r.heapByteSize);
+    WriteField(report, "splitMs", "%.6f", r.splitSeconds * 1e3);
+    WriteField(report, "mergeMs", "%.6f", r.mergeSeconds * 1e3);
+    WriteField(report, "nodesPerSec", "%.1f", r.nodesPerSecond);
+    WriteField(report, "nsPerNode", "%.4f", r.nsPerNode);
+    WriteResult(report);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Command Line Parsing
+ */
+static bool ParseCommandLine(int argc, char **argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        bool ok = (value != NULL);
+
+        if (!strcmp(arg, "--batched")) {
+            g_bench.batched = true;
+            continue;
+        } else if (!strcmp(arg, "--sparse")) {
+            g_bench.sparse = true;
+            continue;
+        } else if (!strcmp(arg, "--incremental")) {
+            g_bench.incremental = true;
+            continue;
+        } else if (!strcmp(arg, "--verify")) {
+            g_bench.verify = true;
+            continue;
+        }
+
+        if (!strcmp(arg, "--depths") && ok) {
+            ok = ParseIntList(value, 6, 30, &g_bench.depths);
+        } else if (!strcmp(arg, "--modes") && ok) {
+            ok = ParseNameList(value, s_modeNames, 2, &g_bench.modes);
+        } else if (!strcmp(arg, "--trajectories") && ok) {
+            ok = ParseNameList(value, s_trajectoryNames, TRAJECTORY_COUNT,
+                               &g_bench.trajectories);
+        } else if (!strcmp(arg, "--threads") && ok) {
+            ok = ParseIntList(value, 1, 1024, &g_bench.threads);
+        } else if (!strcmp(arg, "--frames") && ok) {
+            g_bench.frameCount = atoi(value);
+            ok = g_bench.frameCount > 0;
+        } else if (!strcmp(arg, "--points") && ok) {
+            g_bench.pointCount = atoi(value);
+            ok = g_bench.pointCount >= 0;
+        } else if (!strcmp(arg, "--period") && ok) {
+            g_bench.period = atoi(value);
+            ok = g_bench.period > 0;
+        } else if (!strcmp(arg, "--format") && ok) {
+            ok = !strcmp(value, "csv") || !strcmp(value, "json");
+            g_bench.json = !strcmp(value, "json");
+        } else if (!strcmp(arg, "--output") && ok) {
+            g_bench.output = value;
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            LOG("leb_bench: invalid argument '%s'", arg);
+            return false;
+        }
+        ++i;
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+    FILE *pf = stdout;
+    BenchReport report;
+    int64_t mismatchCount = 0;
+
+    if (!ParseCommandLine(argc, argv)) {
+        Usage(argv[0], "[--depths 6,..,30] [--modes triangle,square] "
+                       "[--trajectories static,circle,lissajous,sweep] [--threads 1,2,..] "
+                       "[--frames N] [--period N] [--points N] [--batched] [--sparse] "
+                       "[--incremental] [--verify]");
+
+        return EXIT_FAILURE;
+    }
+
+#ifndef _OPENMP
+    LOG("leb_bench: built without OpenMP, thread counts are ignored");
+#endif
+
+    if (g_bench.output) {
+        pf = fopen(g_bench.output, "w");
+
+        if (!pf) {
+            LOG("leb_bench: failed to open '%s'", g_bench.output);
+
+            return EXIT_FAILURE;
+        }
+    }
+
+    WriteHeader(&report, pf, g_bench.json);
+    for (size_t i = 0; i < g_bench.depths.size(); ++i)
+    for (size_t j = 0; j < g_bench.modes.size(); ++j)
+    for (size_t k = 0; k < g_bench.trajectories.size(); ++k)
+    for (size_t l = 0; l < g_bench.threads.size(); ++l) {
+        LOG("Running {depth %i, %s, %s, %i thread(s)}",
+            g_bench.depths[i],
+            s_modeNames[g_bench.modes[j]],
+            s_trajectoryNames[g_bench.trajectories[k]],
+            g_bench.threads[l]);
+        BenchResult result = RunBenchmark(g_bench.depths[i],
+                                          g_bench.modes[j],
+                                          g_bench.trajectories[k],
+                                          g_bench.threads[l]);
+
+        WriteResult(&report, result);
+        mismatchCount+= result.mismatchCount;
+    }
+    WriteFooter(&report);
+
+    if (pf != stdout)
+        fclose(pf);
+
+    if (mismatchCount > 0) {
+        LOG("leb_bench: %lli update(s) failed verification", (long long)mismatchCount);
+
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
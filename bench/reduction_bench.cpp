@@ -0,0 +1,291 @@
+// Headless CPU benchmark for the CBT sum reduction.
+//
+// Compares cbt_ComputeSumReduction against the subtree-parallel reduction
+// of CbtReduction.h on randomly refined trees, and reports timings and
+// heap bandwidth for each thread count as CSV or JSON.
+//
+// usage: reduction_bench [options]
+//   --depths 20,25,28      CBT max depths to test (each in [6, 30])
+//   --leaves 1048576       number of leaves of the refined trees
+//   --methods libcbt,parallel
+//   --threads 1,2,4,..,64  OpenMP thread counts
+//   --repeat 16            number of timed reductions per configuration
+//   --format csv|json
+//   --output file          (default: stdout)
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <vector>
+
+#ifdef _OPENMP
+#   include <omp.h>
+#endif
+
+#define CBT_IMPLEMENTATION
+#include "cbt.h"
+
+#define CBTR_IMPLEMENTATION
+#include "CbtReduction.h"
+
+#include "BenchCommon.h"
+
+enum {
+    METHOD_LIBCBT,      // cbt_ComputeSumReduction
+    METHOD_PARALLEL,    // cbtr_ComputeSumReduction
+
+    METHOD_COUNT
+};
+static const char *s_methodNames[METHOD_COUNT] = {
+    "libcbt", "parallel"
+};
+
+struct BenchConfig {
+    std::vector<int> depths;
+    std::vector<int> methods;
+    std::vector<int> threads;
+    int64_t leafCount;
+    int repeatCount;
+    bool json;
+    const char *output;
+} g_bench = {
+    {20, 25, 28},
+    {METHOD_LIBCBT, METHOD_PARALLEL},
+    {1, 2, 4, 8, 16, 32, 64},
+    1 << 20,
+    16,
+    false,
+    NULL
+};
+
+struct BenchResult {
+    int maxDepth;
+    int method;
+    int threadCount;
+    int64_t leafCount;
+    int64_t heapByteSize;
+    double bestSeconds, averageSeconds;
+    double heapGigabytesPerSecond;
+    double speedup;     // relative to the first thread count of the method
+    bool isValid;       // true if the heap matches that of libcbt
+};
+
+// -----------------------------------------------------------------------------
+/**
+ * Reduction Methods
+ *
+ * The reduction levels are cleared before the validation run, so that a
+ * method that skips some nodes cannot pass by reusing the sums computed
+ * by the refinement. They are stored from the root node, at bit
+ * maxDepth + 3, up to the bitfield, at bit 3 * 2^maxDepth; the bits below
+ * the root node encode the max depth.
+ */
+static void ClearSumReduction(cbt_Tree *cbt)
+{
+    uint64_t *heap = (uint64_t *)cbt_GetHeap(cbt);
+    const int64_t maxDepth = cbt_MaxDepth(cbt);
+    const int64_t bitFieldWordID = (3LL << maxDepth) >> 6;
+
+    heap[0]&= ~(~0ULL << (maxDepth + 3));
+    for (int64_t i = 1; i < bitFieldWordID; ++i)
+        heap[i] = 0u;
+}
+
+static void Reduce(cbt_Tree *cbt, int method)
+{
+    if (method == METHOD_LIBCBT) {
+        cbt_ComputeSumReduction(cbt);
+    } else {
+        cbtr_ComputeSumReduction(cbt);
+    }
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Run a Single Configuration
+ *
+ * The resulting heap is checked against that of cbt_ComputeSumReduction
+ * before the timed runs.
+ */
+static BenchResult
+RunBenchmark(
+    cbt_Tree *cbt,
+    const std::vector<char> &reference,
+    int method,
+    int threadCount
+) {
+    typedef std::chrono::steady_clock clock;
+    const int64_t heapByteSize = cbt_HeapByteSize(cbt);
+    double totalSeconds = 0.0;
+    BenchResult result;
+
+#ifdef _OPENMP
+    omp_set_num_threads(threadCount);
+#endif
+
+    result.maxDepth = (int)cbt_MaxDepth(cbt);
+    result.method = method;
+    result.threadCount = threadCount;
+    result.leafCount = cbt_NodeCount(cbt);
+    result.heapByteSize = heapByteSize;
+    result.bestSeconds = 1e9;
+    result.speedup = 1.0;
+
+    // warmup and validation
+    ClearSumReduction(cbt);
+    Reduce(cbt, method);
+    result.isValid = !memcmp(cbt_GetHeap(cbt), &reference[0], heapByteSize);
+
+    for (int i = 0; i < g_bench.repeatCount; ++i) {
+        clock::time_point start = clock::now();
+        double dt;
+
+        Reduce(cbt, method);
+        dt = std::chrono::duration<double>(clock::now() - start).count();
+
+        totalSeconds+= dt;
+        if (dt < result.bestSeconds)
+            result.bestSeconds = dt;
+    }
+
+    result.averageSeconds = totalSeconds / g_bench.repeatCount;
+    result.heapGigabytesPerSecond = heapByteSize / result.averageSeconds * 1e-9;
+
+    return result;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Report Output
+ */
+static void WriteResult(BenchReport *report, const BenchResult &r)
+{
+    WriteString(report, "method", s_methodNames[r.method]);
+    WriteInt(report, "maxDepth", r.maxDepth);
+    WriteInt(report, "leaves", r.leafCount);
+    WriteInt(report, "heapBytes", r.heapByteSize);
+    WriteInt(report, "threads", r.threadCount);
+    WriteBool(report, "valid", r.isValid);
+    WriteField(report, "bestMs", "%.6f", r.bestSeconds * 1e3);
+    WriteField(report, "averageMs", "%.6f", r.averageSeconds * 1e3);
+    WriteField(report, "heapGBPerSec", "%.3f", r.heapGigabytesPerSecond);
+    WriteField(report, "speedup", "%.3f", r.speedup);
+    WriteResult(report);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Command Line Parsing
+ */
+static bool ParseCommandLine(int argc, char **argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        bool ok = (value != NULL);
+
+        if (!strcmp(arg, "--depths") && ok) {
+            ok = ParseIntList(value, 6, 30, &g_bench.depths);
+        } else if (!strcmp(arg, "--leaves") && ok) {
+            g_bench.leafCount = atoll(value);
+            ok = g_bench.leafCount > 0;
+        } else if (!strcmp(arg, "--methods") && ok) {
+            ok = ParseNameList(value, s_methodNames, METHOD_COUNT, &g_bench.methods);
+        } else if (!strcmp(arg, "--threads") && ok) {
+            ok = ParseIntList(value, 1, 1024, &g_bench.threads);
+        } else if (!strcmp(arg, "--repeat") && ok) {
+            g_bench.repeatCount = atoi(value);
+            ok = g_bench.repeatCount > 0;
+        } else if (!strcmp(arg, "--format") && ok) {
+            ok = !strcmp(value, "csv") || !strcmp(value, "json");
+            g_bench.json = !strcmp(value, "json");
+        } else if (!strcmp(arg, "--output") && ok) {
+            g_bench.output = value;
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            LOG("reduction_bench: invalid argument '%s'", arg);
+            return false;
+        }
+        ++i;
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+    FILE *pf = stdout;
+    BenchReport report;
+    bool isValid = true;
+
+    if (!ParseCommandLine(argc, argv)) {
+        Usage(argv[0], "[--depths 6,..,30] [--leaves N] [--methods libcbt,parallel] "
+                       "[--threads 1,2,..] [--repeat N]");
+
+        return EXIT_FAILURE;
+    }
+
+#ifndef _OPENMP
+    LOG("reduction_bench: built without OpenMP, thread counts are ignored");
+#endif
+
+    if (g_bench.output) {
+        pf = fopen(g_bench.output, "w");
+
+        if (!pf) {
+            LOG("reduction_bench: failed to open '%s'", g_bench.output);
+
+            return EXIT_FAILURE;
+        }
+    }
+
+    WriteHeader(&report, pf, g_bench.json);
+    for (size_t i = 0; i < g_bench.depths.size(); ++i) {
+        cbt_Tree *cbt = CreateRefinedTree(g_bench.depths[i], g_bench.leafCount);
+        const int64_t heapByteSize = cbt_HeapByteSize(cbt);
+        std::vector<char> reference(heapByteSize);
+
+        ClearSumReduction(cbt);
+        cbt_ComputeSumReduction(cbt);
+        memcpy(&reference[0], cbt_GetHeap(cbt), heapByteSize);
+
+        for (size_t j = 0; j < g_bench.methods.size(); ++j) {
+            double firstAverageSeconds = 0.0;
+
+            for (size_t k = 0; k < g_bench.threads.size(); ++k) {
+                LOG("Running {depth %i, %lli leaves, %s, %i thread(s)}",
+                    g_bench.depths[i], (long long)cbt_NodeCount(cbt),
+                    s_methodNames[g_bench.methods[j]], g_bench.threads[k]);
+                BenchResult result = RunBenchmark(cbt,
+                                                  reference,
+                                                  g_bench.methods[j],
+                                                  g_bench.threads[k]);
+
+                if (k == 0)
+                    firstAverageSeconds = result.averageSeconds;
+                result.speedup = firstAverageSeconds / result.averageSeconds;
+
+                WriteResult(&report, result);
+                isValid&= result.isValid;
+            }
+        }
+
+        cbt_Release(cbt);
+    }
+    WriteFooter(&report);
+
+    if (pf != stdout)
+        fclose(pf);
+
+    if (!isValid) {
+        LOG("reduction_bench: reduced heap differs from cbt_ComputeSumReduction");
+
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
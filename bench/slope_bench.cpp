@@ -0,0 +1,363 @@
+// Headless CPU benchmark for slope map generation.
+//
+// Compares the scalar RG32F slope loop the terrain program used to run at
+// startup against the multithreaded SIMD RG16F kernel of SlopeMap.h on
+// synthetic 16-bit heightmaps, and reports timings, memory footprints and
+// conversion errors as CSV or JSON.
+//
+// usage: slope_bench [options]
+//   --sizes 4096,16384     heightmap resolutions to test
+//   --methods scalar,kernel
+//   --threads 1,2,4,8      OpenMP thread counts (ignored by 'scalar')
+//   --repeat 4             number of timed runs per configuration
+//   --format csv|json
+//   --output file          (default: stdout)
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#ifdef _OPENMP
+#   include <omp.h>
+#endif
+
+#define SMAP_IMPLEMENTATION
+#include "SlopeMap.h"
+
+#include "BenchCommon.h"
+
+enum {
+    METHOD_SCALAR,  // single-threaded loop writing RG32F texels
+    METHOD_KERNEL,  // smap_Compute16 writing RG16F texels
+
+    METHOD_COUNT
+};
+static const char *s_methodNames[METHOD_COUNT] = {
+    "scalar", "kernel"
+};
+
+struct BenchConfig {
+    std::vector<int> sizes;
+    std::vector<int> methods;
+    std::vector<int> threads;
+    int repeatCount;
+    bool json;
+    const char *output;
+} g_bench = {
+    {4096, 16384},
+    {METHOD_SCALAR, METHOD_KERNEL},
+    {1},
+    4,
+    false,
+    NULL
+};
+
+struct BenchResult {
+    int size;
+    int method;
+    int threadCount;
+    int64_t stagingBytes;   // CPU buffer holding the slope map
+    int64_t gpuBytes;       // slope map texture, mips included
+    double bestSeconds, averageSeconds;
+    double texelsPerSecond;
+    double maxRelativeError;
+    bool isValid;           // true if the slopes are within tolerance
+};
+
+// -----------------------------------------------------------------------------
+/**
+ * Synthetic Heightmap
+ *
+ * A few octaves of sine waves with hashed noise on top, which produces
+ * both smooth regions and steep, noisy ones.
+ */
+static std::vector<uint16_t> CreateHeightmap(int size)
+{
+    std::vector<uint16_t> texels((int64_t)size * size);
+
+#pragma omp parallel for
+    for (int j = 0; j < size; ++j)
+    for (int i = 0; i < size; ++i) {
+        float u = (float)i / size, v = (float)j / size, z = 0.5f;
+
+        for (int octave = 0; octave < 4; ++octave) {
+            float f = 3.0f * (float)(1 << (2 * octave));
+
+            z+= 0.15f / (octave + 1) * sinf(f * u + octave) * cosf(f * v - octave);
+        }
+        z+= (Hash((uint64_t)j * size + i) & 0xFF) / 65535.0f;
+        texels[(int64_t)i + (int64_t)size * j] =
+            (uint16_t)std::min(65535.0f, std::max(0.0f, z * 65535.0f));
+    }
+
+    return texels;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Slope Map Methods
+ *
+ * The scalar method is the loop of the former LoadNmapTexture16.
+ */
+static void
+ComputeScalar(const uint16_t *texels, int w, int h, std::vector<float> *smap)
+{
+    smap->resize((int64_t)w * h * 2);
+
+    for (int j = 0; j < h; ++j)
+        for (int i = 0; i < w; ++i) {
+            int i1 = std::max(0, i - 1);
+            int i2 = std::min(w - 1, i + 1);
+            int j1 = std::max(0, j - 1);
+            int j2 = std::min(h - 1, j + 1);
+            float z_l = (float)texels[i1 + (int64_t)w * j] / 65535.0f;
+            float z_r = (float)texels[i2 + (int64_t)w * j] / 65535.0f;
+            float z_b = (float)texels[i + (int64_t)w * j1] / 65535.0f;
+            float z_t = (float)texels[i + (int64_t)w * j2] / 65535.0f;
+
+            (*smap)[    2 * (i + (int64_t)w * j)] = (float)w * 0.5f * (z_r - z_l);
+            (*smap)[1 + 2 * (i + (int64_t)w * j)] = (float)h * 0.5f * (z_t - z_b);
+        }
+}
+
+static void
+ComputeKernel(const uint16_t *texels, int w, int h, std::vector<uint16_t> *smap)
+{
+    smap->resize((int64_t)w * h * 2);
+    smap_Compute16(texels, w, h, &(*smap)[0]);
+}
+
+// relative error of the slopes with respect to their exact values; the
+// error of the half floats should not exceed their rounding error (2^-11)
+static double SlopeValue(const uint16_t *texels, int size, int i, int j, int axis)
+{
+    int i1 = axis == 0 ? std::max(0, i - 1) : i;
+    int i2 = axis == 0 ? std::min(size - 1, i + 1) : i;
+    int j1 = axis == 1 ? std::max(0, j - 1) : j;
+    int j2 = axis == 1 ? std::min(size - 1, j + 1) : j;
+    double dz = (double)texels[i2 + (int64_t)size * j2]
+              - (double)texels[i1 + (int64_t)size * j1];
+
+    return 0.5 * size * dz / 65535.0;
+}
+
+template <typename T> static double ToDouble(T x);
+template <> double ToDouble(float x) {return x;}
+template <> double ToDouble(uint16_t x) {return smap_HalfToFloat(x);}
+
+template <typename T> static double
+MaxRelativeError(const std::vector<uint16_t> &texels, int size, const std::vector<T> &smap)
+{
+    double maxError = 0.0;
+
+#pragma omp parallel for reduction(max: maxError)
+    for (int j = 0; j < size; ++j)
+    for (int i = 0; i < size; ++i)
+    for (int axis = 0; axis < 2; ++axis) {
+        double x = ToDouble(smap[axis + 2 * (i + (int64_t)size * j)]);
+        double y = SlopeValue(&texels[0], size, i, j, axis);
+        double error = fabs(x - y) / std::max(fabs(y), 1.0 / 16384.0);
+
+        maxError = std::max(maxError, error);
+    }
+
+    return maxError;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Run a Single Configuration
+ */
+static int64_t MipChainBytes(int size, int bytesPerTexel)
+{
+    int64_t byteSize = 0;
+
+    for (int64_t s = size; s > 0; s/= 2)
+        byteSize+= s * s * bytesPerTexel;
+
+    return byteSize;
+}
+
+static BenchResult
+RunBenchmark(
+    const std::vector<uint16_t> &texels,
+    int size,
+    int method,
+    int threadCount
+) {
+    typedef std::chrono::steady_clock clock;
+    std::vector<float> smap32;
+    std::vector<uint16_t> smap16;
+    double totalSeconds = 0.0;
+    BenchResult result;
+
+#ifdef _OPENMP
+    omp_set_num_threads(threadCount);
+#endif
+
+    result.size = size;
+    result.method = method;
+    result.threadCount = method == METHOD_SCALAR ? 1 : threadCount;
+    result.bestSeconds = 1e9;
+
+    for (int i = 0; i < g_bench.repeatCount; ++i) {
+        clock::time_point start = clock::now();
+        double dt;
+
+        // the buffers are released so that each run pays for the allocation
+        std::vector<float>().swap(smap32);
+        std::vector<uint16_t>().swap(smap16);
+        if (method == METHOD_SCALAR)
+            ComputeScalar(&texels[0], size, size, &smap32);
+        else
+            ComputeKernel(&texels[0], size, size, &smap16);
+        dt = std::chrono::duration<double>(clock::now() - start).count();
+
+        totalSeconds+= dt;
+        if (dt < result.bestSeconds)
+            result.bestSeconds = dt;
+    }
+
+    result.averageSeconds = totalSeconds / g_bench.repeatCount;
+    result.texelsPerSecond = (double)size * size / result.averageSeconds;
+    if (method == METHOD_SCALAR) {
+        result.stagingBytes = sizeof(float) * smap32.size();
+        result.gpuBytes = MipChainBytes(size, 2 * sizeof(float));
+        result.maxRelativeError = MaxRelativeError(texels, size, smap32);
+    } else {
+        result.stagingBytes = sizeof(uint16_t) * smap16.size();
+        result.gpuBytes = MipChainBytes(size, 2 * sizeof(uint16_t));
+        result.maxRelativeError = MaxRelativeError(texels, size, smap16);
+    }
+    // the scalar loop normalizes the heights before it subtracts them, which
+    // costs it more precision than the half floats, so it is not checked
+    result.isValid = method == METHOD_SCALAR
+                  || result.maxRelativeError <= 1.0 / 1024.0;
+
+    return result;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Report Output
+ */
+static void WriteResult(BenchReport *report, const BenchResult &r)
+{
+    WriteString(report, "method", s_methodNames[r.method]);
+    WriteInt(report, "size", r.size);
+    WriteInt(report, "threads", r.threadCount);
+    WriteBool(report, "valid", r.isValid);
+    WriteField(report, "stagingMiB", "%.1f", r.stagingBytes / 1048576.0);
+    WriteField(report, "gpuMiB", "%.1f", r.gpuBytes / 1048576.0);
+    WriteField(report, "bestMs", "%.3f", r.bestSeconds * 1e3);
+    WriteField(report, "averageMs", "%.3f", r.averageSeconds * 1e3);
+    WriteField(report, "texelsPerSec", "%.1f", r.texelsPerSecond);
+    WriteField(report, "maxRelativeError", "%.3e", r.maxRelativeError);
+    WriteResult(report);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Command Line Parsing
+ */
+static bool ParseCommandLine(int argc, char **argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        bool ok = (value != NULL);
+
+        if (!strcmp(arg, "--sizes") && ok) {
+            ok = ParseIntList(value, 2, 1 << 16, &g_bench.sizes);
+        } else if (!strcmp(arg, "--methods") && ok) {
+            ok = ParseNameList(value, s_methodNames, METHOD_COUNT, &g_bench.methods);
+        } else if (!strcmp(arg, "--threads") && ok) {
+            ok = ParseIntList(value, 1, 1024, &g_bench.threads);
+        } else if (!strcmp(arg, "--repeat") && ok) {
+            g_bench.repeatCount = atoi(value);
+            ok = g_bench.repeatCount > 0;
+        } else if (!strcmp(arg, "--format") && ok) {
+            ok = !strcmp(value, "csv") || !strcmp(value, "json");
+            g_bench.json = !strcmp(value, "json");
+        } else if (!strcmp(arg, "--output") && ok) {
+            g_bench.output = value;
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            LOG("slope_bench: invalid argument '%s'", arg);
+            return false;
+        }
+        ++i;
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+    FILE *pf = stdout;
+    BenchReport report;
+    bool isValid = true;
+
+    if (!ParseCommandLine(argc, argv)) {
+        Usage(argv[0], "[--sizes N,..] [--methods scalar,kernel] "
+                       "[--threads 1,2,..] [--repeat N]");
+
+        return EXIT_FAILURE;
+    }
+
+#ifndef _OPENMP
+    LOG("slope_bench: built without OpenMP, thread counts are ignored");
+#endif
+
+    if (g_bench.output) {
+        pf = fopen(g_bench.output, "w");
+
+        if (!pf) {
+            LOG("slope_bench: failed to open '%s'", g_bench.output);
+
+            return EXIT_FAILURE;
+        }
+    }
+
+    WriteHeader(&report, pf, g_bench.json);
+    for (size_t i = 0; i < g_bench.sizes.size(); ++i) {
+        const int size = g_bench.sizes[i];
+        std::vector<uint16_t> texels = CreateHeightmap(size);
+
+        for (size_t j = 0; j < g_bench.methods.size(); ++j)
+        for (size_t k = 0; k < g_bench.threads.size(); ++k) {
+            // the scalar loop is single-threaded
+            if (g_bench.methods[j] == METHOD_SCALAR && k > 0)
+                break;
+
+            LOG("Running {%ix%i texels, %s, %i thread(s)}",
+                size, size, s_methodNames[g_bench.methods[j]], g_bench.threads[k]);
+            BenchResult result = RunBenchmark(texels,
+                                              size,
+                                              g_bench.methods[j],
+                                              g_bench.threads[k]);
+
+            WriteResult(&report, result);
+            isValid&= result.isValid;
+        }
+    }
+    WriteFooter(&report);
+
+    if (pf != stdout)
+        fclose(pf);
+
+    if (!isValid) {
+        LOG("slope_bench: slopes exceed the error tolerance");
+
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,652 @@
+// Headless CPU benchmark for the terrain LoD update.
+//
+// Refines the CBT of LebTerrain.h until it reaches a fixed point
+// (lebt_Converge) for fixed cameras over synthetic heightmaps, without any
+// OpenGL context, and reports the passes, leaves and culled leaves of each
+// camera as CSV or JSON.
+//
+// usage: terrain_bench [options]
+//   --depths 16,20         CBT max depths to test (each in [6, 30])
+//   --dmaps flat,hills,noisy
+//   --metrics variance,error
+//                          LoD metric: edge length with the variance test,
+//                          or the geometric error table
+//   --size 512             heightmap resolution
+//   --cameras 8            number of fixed cameras per configuration
+//   --verify               check that the tree converges, that converging
+//                          again yields the same heap, that a split and a
+//                          merge pass leave the converged heap unchanged,
+//                          and that the culling tests only cull hidden
+//                          triangles (exits with an error on failure)
+//   --format csv|json
+//   --output file          (default: stdout)
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <chrono>
+#include <vector>
+#include <algorithm>
+
+#define CBT_IMPLEMENTATION
+#include "cbt.h"
+
+#define CBTR_IMPLEMENTATION
+#include "CbtReduction.h"
+
+#define LEB_IMPLEMENTATION
+#include "leb.h"
+
+#define CBTL_IMPLEMENTATION
+#define LEBT_IMPLEMENTATION
+#include "LebTerrain.h"
+
+#include "BenchCommon.h"
+
+// camera and viewport of the terrain program, in the local space of the
+// terrain, whose extent is the unit square
+#define CAMERA_FOVY_DEGREES 55.0f
+#define CAMERA_ASPECT (16.0f / 9.0f)
+#define CAMERA_NEAR 1e-4f
+#define CAMERA_FAR 4.0f
+#define SCREEN_HEIGHT 1080.0f
+#define PATCH_SUBD_LEVEL 3
+#define PRIMITIVE_PIXEL_LENGTH_TARGET 7.0f
+#define PIXEL_ERROR_TARGET 1.0f
+#define MIN_LOD_STDEV 0.1f
+#define DMAP_FACTOR 0.05f
+
+enum {
+    DMAP_FLAT,
+    DMAP_HILLS,
+    DMAP_NOISY,
+
+    DMAP_COUNT
+};
+static const char *s_dmapNames[DMAP_COUNT] = {"flat", "hills", "noisy"};
+
+enum {
+    METRIC_VARIANCE,
+    METRIC_ERROR,
+
+    METRIC_COUNT
+};
+static const char *s_metricNames[METRIC_COUNT] = {"variance", "error"};
+
+struct BenchConfig {
+    std::vector<int> depths;
+    std::vector<int> dmaps;
+    std::vector<int> metrics;
+    int size;
+    int cameraCount;
+    bool verify;
+    bool json;
+    const char *output;
+} g_bench = {
+    {16, 20},
+    {DMAP_HILLS, DMAP_NOISY},
+    {METRIC_VARIANCE, METRIC_ERROR},
+    512,
+    8,
+    false,
+    false,
+    NULL
+};
+
+struct BenchResult {
+    int maxDepth;
+    int dmap;
+    int metric;
+    int camera;
+    bool isConverged;
+    int passCount;
+    int64_t leafCount;
+    int64_t cullCounts[LEBT_CULL_COUNT];
+    double convergeSeconds;
+    int64_t failureCount;   // checks that failed --verify
+};
+
+// -----------------------------------------------------------------------------
+/**
+ * Synthetic Heightmaps
+ *
+ * The hills are a few octaves of sine waves, and the noisy heightmap adds
+ * hashed noise on top, which produces both smooth regions and steep, noisy
+ * ones.
+ */
+static std::vector<uint16_t> CreateHeightmap(int dmap, int size)
+{
+    std::vector<uint16_t> texels((int64_t)size * size);
+
+    for (int j = 0; j < size; ++j)
+    for (int i = 0; i < size; ++i) {
+        float u = (float)i / size, v = (float)j / size, z = 0.5f;
+
+        if (dmap != DMAP_FLAT) {
+            for (int octave = 0; octave < 4; ++octave) {
+                float f = 3.0f * (float)(1 << (2 * octave));
+
+                z+= 0.3f / (octave + 1) * sinf(f * u + octave) * cosf(f * v - octave);
+            }
+        }
+        if (dmap == DMAP_NOISY)
+            z+= (Hash((uint64_t)j * size + i) & 0xFFF) / 65535.0f;
+
+        texels[(int64_t)i + (int64_t)size * j] =
+            (uint16_t)std::min(65535.0f, std::max(0.0f, z * 65535.0f));
+    }
+
+    return texels;
+}
+
+// height of the terrain at (u, v), filtered as by the GL_LINEAR sampler of
+// the dmap with its coordinates clamped to the edge
+static float
+SampleHeight(const std::vector<uint16_t> &texels, int size, float u, float v)
+{
+    float x = u * size - 0.5f, y = v * size - 0.5f;
+    int i0 = (int)floorf(x), j0 = (int)floorf(y);
+    float ax = x - i0, ay = y - j0;
+    int i1 = std::min(std::max(i0 + 1, 0), size - 1);
+    int j1 = std::min(std::max(j0 + 1, 0), size - 1);
+
+    i0 = std::min(std::max(i0, 0), size - 1);
+    j0 = std::min(std::max(j0, 0), size - 1);
+
+    float z00 = texels[i0 + (int64_t)size * j0], z10 = texels[i1 + (int64_t)size * j0];
+    float z01 = texels[i0 + (int64_t)size * j1], z11 = texels[i1 + (int64_t)size * j1];
+    float z0 = z00 + ax * (z10 - z00), z1 = z01 + ax * (z11 - z01);
+
+    return DMAP_FACTOR * (z0 + ay * (z1 - z0)) / 65535.0f;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Fixed Cameras
+ *
+ * Each camera is placed above a hashed point of the terrain, at an
+ * altitude low enough for the hills to hide one another, and looks
+ * slightly downwards in a hashed direction. The matrices are row-major,
+ * as lebt_Params expects, and follow the OpenGL conventions.
+ */
+static float HashFloat(uint64_t x, float a, float b)
+{
+    return a + (b - a) * (Hash(x) & 0xFFFFFF) / 16777216.0f;
+}
+
+static void
+Multiply(const float a[4][4], const float b[4][4], float out[4][4])
+{
+    for (int i = 0; i < 4; ++i)
+    for (int j = 0; j < 4; ++j) {
+        out[i][j] = 0.0f;
+        for (int k = 0; k < 4; ++k)
+            out[i][j]+= a[i][k] * b[k][j];
+    }
+}
+
+static void
+LoadCamera(
+    int camera,
+    int metric,
+    const std::vector<uint16_t> &texels,
+    int size,
+    const lebt_Dmap *dmap,
+    const lebt_NodeErrors *nodeErrors,
+    lebt_Params *params
+) {
+    const float pi = 3.14159265358979f;
+    uint64_t seed = (uint64_t)camera * 8u;
+    float x = HashFloat(seed + 0u, 0.1f, 0.9f);
+    float y = HashFloat(seed + 1u, 0.1f, 0.9f);
+    float altitude = HashFloat(seed + 2u, 0.002f, 0.02f);
+    float yaw = HashFloat(seed + 3u, 0.0f, 2.0f * pi);
+    float pitch = HashFloat(seed + 4u, -0.3f, 0.0f);
+    float eye[3] = {x, y, SampleHeight(texels, size, x, y) + altitude};
+    float f[3] = {cosf(pitch) * cosf(yaw), cosf(pitch) * sinf(yaw), sinf(pitch)};
+    float r[3] = {f[1], -f[0], 0.0f};
+    float rnrm = sqrtf(r[0] * r[0] + r[1] * r[1]);
+    float tanHalfFovy = tanf(CAMERA_FOVY_DEGREES * pi / 360.0f);
+    float fy = 1.0f / tanHalfFovy;
+    float n = CAMERA_NEAR, fr = CAMERA_FAR;
+    float projection[4][4] = {
+        {fy / CAMERA_ASPECT, 0.0f, 0.0f, 0.0f},
+        {0.0f, fy, 0.0f, 0.0f},
+        {0.0f, 0.0f, (n + fr) / (n - fr), 2.0f * n * fr / (n - fr)},
+        {0.0f, 0.0f, -1.0f, 0.0f}
+    };
+    float mvp[4][4];
+
+    r[0]/= rnrm; r[1]/= rnrm;
+    float u[3] = {
+        r[1] * f[2] - r[2] * f[1],
+        r[2] * f[0] - r[0] * f[2],
+        r[0] * f[1] - r[1] * f[0]
+    };
+    const float *axes[3] = {r, u, f};
+
+    for (int i = 0; i < 3; ++i) {
+        float sign = i == 2 ? -1.0f : 1.0f;
+
+        params->modelView[i][3] = 0.0f;
+        for (int k = 0; k < 3; ++k) {
+            params->modelView[i][k] = sign * axes[i][k];
+            params->modelView[i][3]-= sign * axes[i][k] * eye[k];
+        }
+    }
+    for (int k = 0; k < 4; ++k)
+        params->modelView[3][k] = k == 3 ? 1.0f : 0.0f;
+    Multiply(projection, params->modelView, mvp);
+    lebt_LoadFrustumPlanes(mvp, params->frustumPlanes);
+
+    // same as computeLodFactor and computeErrorFactor of terrain.cpp
+    params->lodFactor = -2.0f * log2f(2.0f * tanHalfFovy / SCREEN_HEIGHT
+                                      * (1 << PATCH_SUBD_LEVEL)
+                                      * PRIMITIVE_PIXEL_LENGTH_TARGET) + 2.0f;
+    params->errorFactor = SCREEN_HEIGHT / (2.0f * tanHalfFovy * PIXEL_ERROR_TARGET);
+    params->dmapFactor = DMAP_FACTOR;
+    params->minLodVariance = (MIN_LOD_STDEV / 64.0f / DMAP_FACTOR)
+                           * (MIN_LOD_STDEV / 64.0f / DMAP_FACTOR);
+    for (int k = 0; k < 3; ++k)
+        params->cameraPosition[k] = eye[k];
+    params->projection = LEBT_PROJECTION_RECTILINEAR;
+    params->displace = true;
+    params->cull = true;
+    params->horizon = true;
+    params->dmap = dmap;
+    params->nodeErrors = metric == METRIC_ERROR ? nodeErrors : NULL;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Verification
+ *
+ * A second tree converges from scratch for the same camera and must reach
+ * the same heap. The split and merge passes are then run once more on the
+ * converged tree, each through cbt_Update, which visits the leaves as the
+ * GPU does instead of through the enumeration of lebt_Update; neither pass
+ * may modify the heap.
+ */
+static void Fail(BenchResult *result, const char *error)
+{
+    if (result->failureCount == 0) {
+        LOG("terrain_bench: depth %i, %s, %s, camera %i: %s",
+            result->maxDepth,
+            s_dmapNames[result->dmap],
+            s_metricNames[result->metric],
+            result->camera,
+            error);
+    }
+    ++result->failureCount;
+}
+
+/*
+ * The culling tests are checked by brute force on each leaf they cull. No
+ * point of a leaf culled by the frustum test may lie inside the frustum;
+ * the points are its displaced vertices and the displaced texels whose
+ * center lies within it. The center of a leaf culled by the horizon test
+ * must be hidden by the terrain, which the ray going from the camera to
+ * the center finds by marching the heightfield. The ray is sampled twice
+ * per texel, as well as at the parameters of the horizon test, and the
+ * samples within a texel of the center are skipped so the terrain around
+ * the center does not hide it.
+ */
+static bool
+IsInsideFrustum(const lebt_Params *params, float x, float y, float z)
+{
+    for (int i = 0; i < 6; ++i) {
+        const float *plane = params->frustumPlanes[i];
+
+        if (plane[0] * x + plane[1] * y + plane[2] * z + plane[3] <= 1e-6f)
+            return false;
+    }
+
+    return true;
+}
+
+static bool
+IsInsideTriangle(const float triangleVertices[3][4], float u, float v)
+{
+    float area = 0.0f, edges[3];
+
+    for (int i = 0; i < 3; ++i) {
+        const float *a = triangleVertices[i], *b = triangleVertices[(i + 1) % 3];
+
+        edges[i] = (b[0] - a[0]) * (v - a[1]) - (b[1] - a[1]) * (u - a[0]);
+        area+= edges[i];
+    }
+
+    for (int i = 0; i < 3; ++i)
+        if (edges[i] * area < 0.0f)
+            return false;
+
+    return true;
+}
+
+static bool
+IsFrustumCullingConservative(
+    const lebt_Params *params,
+    const std::vector<uint16_t> &texels,
+    int size,
+    const float triangleVertices[3][4]
+) {
+    int texelMin[2], texelMax[2];
+
+    for (int i = 0; i < 3; ++i)
+        if (IsInsideFrustum(params, triangleVertices[i][0],
+                                    triangleVertices[i][1],
+                                    triangleVertices[i][2]))
+            return false;
+
+    for (int k = 0; k < 2; ++k) {
+        float bmin = std::min(std::min(triangleVertices[0][k], triangleVertices[1][k]), triangleVertices[2][k]);
+        float bmax = std::max(std::max(triangleVertices[0][k], triangleVertices[1][k]), triangleVertices[2][k]);
+
+        texelMin[k] = std::max(0, (int)floorf(bmin * size));
+        texelMax[k] = std::min(size, (int)ceilf(bmax * size));
+    }
+
+    for (int j = texelMin[1]; j < texelMax[1]; ++j)
+    for (int i = texelMin[0]; i < texelMax[0]; ++i) {
+        float u = (i + 0.5f) / size, v = (j + 0.5f) / size;
+        float z = DMAP_FACTOR * texels[i + (int64_t)size * j] / 65535.0f;
+
+        if (IsInsideTriangle(triangleVertices, u, v) && IsInsideFrustum(params, u, v, z))
+            return false;
+    }
+
+    return true;
+}
+
+static bool
+IsCenterHidden(
+    const lebt_Params *params,
+    const std::vector<uint16_t> &texels,
+    int size,
+    const float triangleVertices[3][4]
+) {
+    const float *eye = params->cameraPosition;
+    float center[3] = {
+        (triangleVertices[0][0] + triangleVertices[1][0] + triangleVertices[2][0]) / 3.0f,
+        (triangleVertices[0][1] + triangleVertices[1][1] + triangleVertices[2][1]) / 3.0f,
+        0.0f
+    };
+    float dx = center[0] - eye[0], dy = center[1] - eye[1];
+    int stepCount = 2 * (int)ceilf(sqrtf(dx * dx + dy * dy) * size) + 1;
+
+    center[2] = SampleHeight(texels, size, center[0], center[1]);
+
+    for (int i = 1; i < stepCount + LEBT_HORIZON_SAMPLE_COUNT + 1; ++i) {
+        bool isHorizonSample = (i >= stepCount);
+        float t = isHorizonSample
+                ? (float)(i - stepCount + 1) / (float)(LEBT_HORIZON_SAMPLE_COUNT + 1)
+                : (float)i / (float)stepCount;
+        float p[3];
+
+        for (int k = 0; k < 3; ++k)
+            p[k] = eye[k] + t * (center[k] - eye[k]);
+
+        if (!isHorizonSample && (1.0f - t) * sqrtf(dx * dx + dy * dy) * size < 1.0f)
+            continue;
+
+        if (p[2] < SampleHeight(texels, size, p[0], p[1]) - 1e-6f)
+            return true;
+    }
+
+    return false;
+}
+
+static void
+VerifyCulling(
+    const cbt_Tree *cbt,
+    const lebt_Params *params,
+    const std::vector<uint16_t> &texels,
+    int size,
+    BenchResult *result
+) {
+    int64_t counts[LEBT_CULL_COUNT] = {0};
+    bool isFrustumConservative = true, isHorizonConservative = true;
+    cbtl_Iterator it;
+
+    cbtl_IteratorInit(&it, cbt, 0, cbt_NodeCount(cbt));
+    while (cbtl_IteratorNext(&it)) {
+        float triangleVertices[3][4];
+        int32_t cull;
+
+        lebt_DecodeTriangleVertices(params, it.node, triangleVertices);
+        cull = lebt_CullingTest(params, triangleVertices);
+        ++counts[cull];
+
+        if (cull == LEBT_CULL_FRUSTUM)
+            isFrustumConservative&= IsFrustumCullingConservative(params, texels, size, triangleVertices);
+        else if (cull == LEBT_CULL_HORIZON)
+            isHorizonConservative&= IsCenterHidden(params, texels, size, triangleVertices);
+    }
+
+    for (int i = 0; i < LEBT_CULL_COUNT; ++i)
+        if (counts[i] != result->cullCounts[i])
+            Fail(result, "lebt_CountCulledLeaves disagrees with lebt_CullingTest");
+
+    if (!isFrustumConservative)
+        Fail(result, "the frustum test culls a triangle that lies inside the frustum");
+
+    if (!isHorizonConservative)
+        Fail(result, "the horizon test culls a triangle whose center is visible");
+}
+
+static void
+Verify(
+    const cbt_Tree *cbt,
+    const lebt_Params *params,
+    const std::vector<uint16_t> &texels,
+    int size,
+    int passBudget,
+    BenchResult *result
+) {
+    const int64_t byteSize = cbt_HeapByteSize(cbt);
+    cbt_Tree *tree = cbt_CreateAtDepth(cbt_MaxDepth(cbt), 1);
+
+    if (!result->isConverged)
+        Fail(result, "the tree did not reach a fixed point");
+
+    lebt_Converge(tree, params, passBudget, NULL);
+    if (memcmp(cbt_GetHeap(tree), cbt_GetHeap(cbt), byteSize))
+        Fail(result, "converging twice yields different heaps");
+
+    cbt_SetHeap(tree, cbt_GetHeap(cbt));
+    cbt_Update(tree, &lebt_SplitCallback, params);
+    if (memcmp(cbt_GetHeap(tree), cbt_GetHeap(cbt), byteSize))
+        Fail(result, "a split pass modifies the converged heap");
+
+    cbt_SetHeap(tree, cbt_GetHeap(cbt));
+    cbt_Update(tree, &lebt_MergeCallback, params);
+    if (memcmp(cbt_GetHeap(tree), cbt_GetHeap(cbt), byteSize))
+        Fail(result, "a merge pass modifies the converged heap");
+
+    cbt_Release(tree);
+
+    VerifyCulling(cbt, params, texels, size, result);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Run a Single Configuration
+ *
+ * The pass budget is that of the CPU reference of the terrain program.
+ */
+static BenchResult
+RunBenchmark(
+    int maxDepth,
+    int dmap,
+    int metric,
+    int camera,
+    const std::vector<uint16_t> &texels,
+    const lebt_Dmap *lebtDmap,
+    const lebt_NodeErrors *nodeErrors
+) {
+    typedef std::chrono::steady_clock clock;
+    const int passBudget = 8 * (maxDepth + 1);
+    cbt_Tree *cbt = cbt_CreateAtDepth(maxDepth, 1);
+    lebt_Params params;
+    BenchResult result;
+    clock::time_point start;
+
+    LoadCamera(camera, metric, texels, g_bench.size, lebtDmap, nodeErrors, &params);
+
+    result.maxDepth = maxDepth;
+    result.dmap = dmap;
+    result.metric = metric;
+    result.camera = camera;
+    result.failureCount = 0;
+
+    start = clock::now();
+    result.isConverged = lebt_Converge(cbt, &params, passBudget, &result.passCount);
+    result.convergeSeconds = std::chrono::duration<double>(clock::now() - start).count();
+    result.leafCount = cbt_NodeCount(cbt);
+    lebt_CountCulledLeaves(cbt, &params, result.cullCounts);
+
+    if (g_bench.verify)
+        Verify(cbt, &params, texels, g_bench.size, passBudget, &result);
+
+    cbt_Release(cbt);
+
+    return result;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Report Output
+ */
+static void WriteResult(BenchReport *report, const BenchResult &r)
+{
+    WriteString(report, "dmap", s_dmapNames[r.dmap]);
+    WriteString(report, "metric", s_metricNames[r.metric]);
+    WriteInt(report, "maxDepth", r.maxDepth);
+    WriteInt(report, "size", g_bench.size);
+    WriteInt(report, "camera", r.camera);
+    WriteBool(report, "converged", r.isConverged);
+    WriteInt(report, "passes", r.passCount);
+    WriteInt(report, "leaves", r.leafCount);
+    WriteInt(report, "frustumCulled", r.cullCounts[LEBT_CULL_FRUSTUM]);
+    WriteInt(report, "horizonCulled", r.cullCounts[LEBT_CULL_HORIZON]);
+    WriteField(report, "convergeMs", "%.6f", r.convergeSeconds * 1e3);
+    WriteResult(report);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Command Line Parsing
+ */
+static bool ParseCommandLine(int argc, char **argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        const char *arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+        bool ok = (value != NULL);
+
+        if (!strcmp(arg, "--verify")) {
+            g_bench.verify = true;
+            continue;
+        }
+
+        if (!strcmp(arg, "--depths") && ok) {
+            ok = ParseIntList(value, 6, 30, &g_bench.depths);
+        } else if (!strcmp(arg, "--dmaps") && ok) {
+            ok = ParseNameList(value, s_dmapNames, DMAP_COUNT, &g_bench.dmaps);
+        } else if (!strcmp(arg, "--metrics") && ok) {
+            ok = ParseNameList(value, s_metricNames, METRIC_COUNT, &g_bench.metrics);
+        } else if (!strcmp(arg, "--size") && ok) {
+            g_bench.size = atoi(value);
+            ok = g_bench.size >= 16;
+        } else if (!strcmp(arg, "--cameras") && ok) {
+            g_bench.cameraCount = atoi(value);
+            ok = g_bench.cameraCount > 0;
+        } else if (!strcmp(arg, "--format") && ok) {
+            ok = !strcmp(value, "csv") || !strcmp(value, "json");
+            g_bench.json = !strcmp(value, "json");
+        } else if (!strcmp(arg, "--output") && ok) {
+            g_bench.output = value;
+        } else {
+            ok = false;
+        }
+
+        if (!ok) {
+            LOG("terrain_bench: invalid argument '%s'", arg);
+            return false;
+        }
+        ++i;
+    }
+
+    return true;
+}
+
+// -----------------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+    FILE *pf = stdout;
+    BenchReport report;
+    int64_t failureCount = 0;
+
+    if (!ParseCommandLine(argc, argv)) {
+        Usage(argv[0], "[--depths 6,..,30] [--dmaps flat,hills,noisy] "
+                       "[--metrics variance,error] [--size N] [--cameras N] [--verify]");
+
+        return EXIT_FAILURE;
+    }
+
+    if (g_bench.output) {
+        pf = fopen(g_bench.output, "w");
+
+        if (!pf) {
+            LOG("terrain_bench: failed to open '%s'", g_bench.output);
+
+            return EXIT_FAILURE;
+        }
+    }
+
+    WriteHeader(&report, pf, g_bench.json);
+    for (size_t i = 0; i < g_bench.dmaps.size(); ++i) {
+        int dmap = g_bench.dmaps[i];
+        std::vector<uint16_t> texels = CreateHeightmap(dmap, g_bench.size);
+        lebt_Dmap *lebtDmap = lebt_CreateDmap(&texels[0], g_bench.size, g_bench.size);
+        lebt_NodeErrors *nodeErrors = lebt_CreateNodeErrors(&texels[0], 1,
+                                                            g_bench.size, g_bench.size);
+        lebt_NodeErrors *patchErrors = lebt_CreatePatchErrors(nodeErrors, PATCH_SUBD_LEVEL);
+
+        for (size_t j = 0; j < g_bench.metrics.size(); ++j)
+        for (size_t k = 0; k < g_bench.depths.size(); ++k)
+        for (int camera = 0; camera < g_bench.cameraCount; ++camera) {
+            LOG("Running {depth %i, %s, %s, camera %i}",
+                g_bench.depths[k],
+                s_dmapNames[dmap],
+                s_metricNames[g_bench.metrics[j]],
+                camera);
+            BenchResult result = RunBenchmark(g_bench.depths[k],
+                                              dmap,
+                                              g_bench.metrics[j],
+                                              camera,
+                                              texels,
+                                              lebtDmap,
+                                              patchErrors);
+
+            WriteResult(&report, result);
+            failureCount+= result.failureCount;
+        }
+
+        lebt_ReleaseNodeErrors(patchErrors);
+        lebt_ReleaseNodeErrors(nodeErrors);
+        lebt_ReleaseDmap(lebtDmap);
+    }
+    WriteFooter(&report);
+
+    if (pf != stdout)
+        fclose(pf);
+
+    if (failureCount > 0) {
+        LOG("terrain_bench: %lli check(s) failed verification", (long long)failureCount);
+
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -9,6 +9,7 @@
 
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <utility>
 #include <stdexcept>
 #include <vector>
@@ -36,6 +37,9 @@
 
 #include "CatmullClarkTessellation.h"
 
+#define CBTS_IMPLEMENTATION
+#include "CbtSnapshot.h"
+
 #define SCATTER_IMPLEMENTATION 1
 
 #define LOG(fmt, ...)  fprintf(stdout, fmt "\n", ##__VA_ARGS__); fflush(stdout);
@@ -57,6 +61,13 @@
 
 #define PATH_TO_ASSET_DIRECTORY PATH_TO_SRC_DIRECTORY "./assets/"
 
+// levels of the CBT sum reduction computed per dispatch (see CbtSumReduction.glsl)
+#define CBT_SUM_REDUCTION_LEVEL_COUNT 8
+
+// leaves cached by CbtLeafCacheWriter.glsl and workgroups that write them
+#define CBT_LEAF_CACHE_MAX_CAPACITY (1 << 22)
+#define CBT_LEAF_CACHE_MAX_GROUP_COUNT 1024
+
 ////////////////////////////////////////////////////////////////////////////////
 // Global Variables
 //
@@ -157,6 +168,17 @@ struct MeshManager {
     int method;
     int shading;
     float primitivePixelLengthTarget;
+    struct {
+        bool enabled;           // skips the update once the view is static
+        int fullSweepPeriod;    // frames between two full sweeps
+        int pendingFrameCount;  // update frames left before going idle
+        int frameCount;         // frames since the last full sweep
+        float viewKey[24];      // view and LoD parameters of the last update
+    } staticSkip;
+    struct {
+        bool enabled;           // render and update passes read cached leaves
+        bool isStale;           // the CBT changed since the cache was written
+    } leafCache;
 } g_mesh = {
     {NULL, NULL, 4, 1, 0, 6},
     {NULL, 48, 0.0f},
@@ -164,7 +186,9 @@ struct MeshManager {
     RENDERER_CAGE,
     METHOD_CS,
     SHADING_SHADED,
-    9.0f
+    9.0f,
+    {false, 64, 0, 0, {0.0f}},
+    {false, true}
 };
 
 
@@ -183,6 +207,10 @@ struct AppManager {
     struct {
         int on, frame, capture;
     } recorder;
+    struct {
+        const char *path;
+        bool warmStart;
+    } snapshot;
     int frame, frameLimit;
 } g_app = {
     /*dir*/     {
@@ -195,6 +223,7 @@ struct AppManager {
                    2.2f, 0.4f
                 },
     /*record*/  {false, 0, 0},
+    /*snapshot*/{NULL, false},
     /*frame*/   0, -1
 };
 
@@ -207,6 +236,7 @@ enum {
     CLOCK_TESSELLATION,
     CLOCK_SUBD,
     CLOCK_RENDER,
+    CLOCK_LEAF_CACHE,
     CLOCK_REDUCTION,
     CLOCK_REDUCTION00,
     CLOCK_REDUCTION01,
@@ -266,6 +296,7 @@ enum {
     BUFFER_CBT_DISPATCH,
     BUFFER_CCT_DRAW,
     BUFFER_CCT_FACE_COUNT,
+    BUFFER_CBT_LEAF_CACHE,
 
     BUFFER_COUNT
 };
@@ -304,6 +335,7 @@ enum {
     PROGRAM_CBT_REDUCTION,
     PROGRAM_CBT_REDUCTION_PREPASS,
     PROGRAM_CBT_DISPATCHER,
+    PROGRAM_CBT_LEAF_CACHE,
     PROGRAM_CCT_DISPATCHER,
     PROGRAM_CCT_SPLIT,
     PROGRAM_CCT_MERGE,
@@ -629,6 +661,25 @@ static void LoadConcurrentBinaryTreeLibrary(djg_program *djp, bool writeAccess)
     djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./submodules/libcbt/glsl/cbt.glsl");
 }
 
+static int CbtLeafCacheCapacity()
+{
+    int depth = cct__MaxBisectorDepth(g_mesh.subd.subd)
+              + cct__MinCbtDepth(g_mesh.subd.subd);
+
+    return std::min(1 << depth, CBT_LEAF_CACHE_MAX_CAPACITY);
+}
+
+// must be pushed right after LoadConcurrentBinaryTreeLibrary
+static void LoadCbtLeafCacheLibrary(djg_program *djp)
+{
+    if (!g_mesh.leafCache.enabled)
+        return;
+
+    djgp_push_string(djp, "#define CBT_LEAF_CACHE_BUFFER_BINDING %i\n", BUFFER_CBT_LEAF_CACHE);
+    djgp_push_string(djp, "#define CBT_LEAF_CACHE_CAPACITY %i\n", CbtLeafCacheCapacity());
+    djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./common/shaders/CbtLeafCache.glsl");
+}
+
 bool LoadCageRenderProgram()
 {
     djg_program *djp = djgp_create();
@@ -731,6 +782,7 @@ bool LoadAdaptiveLodRenderProgram()
 
     LoadCatmullClarkLibrary(djp, false, false, false);
     LoadConcurrentBinaryTreeLibrary(djp, false);
+    LoadCbtLeafCacheLibrary(djp);
 
     if (g_mesh.shading == SHADING_SHADED)
         djgp_push_string(djp, "#define SHADING_SHADED 1\n");
@@ -790,8 +842,9 @@ bool LoadCbtReductionProgram()
     GLuint *glp = &g_gl.programs[PROGRAM_CBT_REDUCTION];
 
     LOG("Loading {Reduction-Program}");
+    djgp_push_string(djp, "#define CBT_SUM_REDUCTION_LEVEL_COUNT %i\n", CBT_SUM_REDUCTION_LEVEL_COUNT);
     LoadConcurrentBinaryTreeLibrary(djp, true);
-    djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./submodules/libcbt/glsl/cbt_SumReduction.glsl");
+    djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./common/shaders/CbtSumReduction.glsl");
     djgp_push_string(djp, "#ifdef COMPUTE_SHADER\n#endif");
 
     if (!djgp_to_gl(djp, 450, false, true, glp)) {
@@ -843,6 +896,38 @@ bool LoadCbtDispatchProgram()
     return (glGetError() == GL_NO_ERROR);
 }
 
+// -----------------------------------------------------------------------------
+/**
+ * Load the Leaf Cache Program
+ *
+ * This program writes the leaves of the CBT once per change, so that the
+ * tessellation and render passes no longer decode them from the heap.
+ */
+bool LoadCbtLeafCacheProgram()
+{
+    djg_program *djp;
+    GLuint *glp = &g_gl.programs[PROGRAM_CBT_LEAF_CACHE];
+
+    if (!g_mesh.leafCache.enabled)
+        return true;
+
+    djp = djgp_create();
+    LOG("Loading {CBT-Leaf-Cache-Program}");
+    djgp_push_string(djp, "#define CBT_LEAF_CACHE_WRITER\n");
+    LoadConcurrentBinaryTreeLibrary(djp, false);
+    LoadCbtLeafCacheLibrary(djp);
+    djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./common/shaders/CbtLeafCacheWriter.glsl");
+    djgp_push_string(djp, "#ifdef COMPUTE_SHADER\n#endif");
+    if (!djgp_to_gl(djp, 450, false, true, glp)) {
+        djgp_release(djp);
+
+        return false;
+    }
+    djgp_release(djp);
+
+    return (glGetError() == GL_NO_ERROR);
+}
+
 bool LoadCctDispatchProgram()
 {
     djg_program *djp = djgp_create();
@@ -873,6 +958,7 @@ bool LoadTessellationProgram(GLuint *glp, const char *flag, GLuint uniformOffset
     LOG("Loading {CCT-Program}");
     LoadCatmullClarkLibrary(djp, false, false, false);
     LoadConcurrentBinaryTreeLibrary(djp, false);
+    LoadCbtLeafCacheLibrary(djp);
 
     if (!g_mesh.flags.freeze)
         djgp_push_string(djp, flag);
@@ -1194,6 +1280,7 @@ bool LoadPrograms()
     if (success) success = LoadCbtReductionPrepassProgram();
     if (success) success = LoadCbtReductionProgram();
     if (success) success = LoadCbtDispatchProgram();
+    if (success) success = LoadCbtLeafCacheProgram();
     if (success) success = LoadCctDispatchProgram();
     if (success) success = LoadTessellationPrograms();
     if (success) success = LoadSubdDisplaceProgram();
@@ -1455,30 +1542,171 @@ bool LoadSubdMaxDepthBuffer(const cc_Subd *subd)
                                   0);
 }
 
+// -----------------------------------------------------------------------------
+/**
+ * Static Update Skipping
+ *
+ * Once the view stops moving, the subdivision settles after at most one
+ * split and one merge pass per level of the CBT. With "Skip Static
+ * Updates" on, the tessellation passes are skipped from then on, except
+ * for a periodic full sweep. Animated meshes are always updated.
+ */
+void InvalidateStaticSkip()
+{
+    const int32_t cbtDepth = cct__MinCbtDepth(g_mesh.subd.subd)
+                           + cct__MaxBisectorDepth(g_mesh.subd.subd);
+
+    g_mesh.staticSkip.pendingFrameCount = 2 * (cbtDepth + 1);
+}
+
+bool ShouldUpdateTessellation()
+{
+    const float viewKey[24] = {
+        g_camera.pos.x, g_camera.pos.y, g_camera.pos.z,
+        g_camera.upAngle, g_camera.sideAngle,
+        g_camera.fovy, g_camera.zNear, g_camera.zFar,
+        (float)g_camera.projection,
+        g_camera.frameZoom.x, g_camera.frameZoom.y, g_camera.frameZoom.factor,
+        (float)g_framebuffer.w, (float)g_framebuffer.h,
+        g_mesh.primitivePixelLengthTarget,
+        (float)g_mesh.flags.displace,
+        (float)g_mesh.flags.freeze,
+        (float)g_mesh.subd.maxDepth
+    };
+
+    if (!g_mesh.staticSkip.enabled || g_mesh.flags.animate)
+        return true;
+
+    if (memcmp(viewKey, g_mesh.staticSkip.viewKey, sizeof(viewKey)) != 0) {
+        memcpy(g_mesh.staticSkip.viewKey, viewKey, sizeof(viewKey));
+        InvalidateStaticSkip();
+    } else if (++g_mesh.staticSkip.frameCount >= g_mesh.staticSkip.fullSweepPeriod) {
+        g_mesh.staticSkip.pendingFrameCount = std::max(2, g_mesh.staticSkip.pendingFrameCount);
+    }
+
+    if (g_mesh.staticSkip.pendingFrameCount > 0) {
+        --g_mesh.staticSkip.pendingFrameCount;
+        g_mesh.staticSkip.frameCount = 0;
+
+        return true;
+    }
+
+    return false;
+}
+
 // -----------------------------------------------------------------------------
 /**
  * Load CBT Buffer
  *
- * This procedure initializes the CBT buffer.
+ * This procedure initializes the CBT buffer. The first time the buffer gets
+ * loaded, the tessellation saved at the last exit is restored from its
+ * snapshot (if any) provided it was produced for a mesh with the same
+ * root bisectors.
+ */
+bool LoadCbtBufferFromSnapshot(const cbt_Tree *cbt)
+{
+    cbts_Snapshot snapshot;
+    bool success = false;
+
+    if (!cbts_Map(g_app.snapshot.path, &snapshot, true))
+        return false;
+
+    if (snapshot.header->mode == CBTS_MODE_CATMULL_CLARK
+        && snapshot.header->rootCount == cct_RootBisectorCount(g_mesh.subd.subd)
+        && snapshot.header->maxDepth == cbt_MaxDepth(cbt)) {
+        LOG("Loading {Subd-Buffer-Snapshot}");
+        glBufferStorage(GL_SHADER_STORAGE_BUFFER,
+                        snapshot.header->heapByteSize,
+                        snapshot.heap,
+                        0);
+        success = true;
+    }
+
+    cbts_Unmap(&snapshot);
+
+    return success;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Load the Leaf Cache Buffer
+ *
+ * The buffer holds the heap index of the first leaves of the CBT; it is
+ * reallocated with the CBT since its capacity depends on the CBT depth.
  */
+bool LoadCbtLeafCacheBuffer()
+{
+    GLsizeiptr byteSize = g_mesh.leafCache.enabled
+                        ? sizeof(uint32_t) * CbtLeafCacheCapacity()
+                        : sizeof(uint32_t);
+
+    LOG("Loading {CBT-Leaf-Cache-Buffer}");
+    g_mesh.leafCache.isStale = true;
+    if (glIsBuffer(g_gl.buffers[BUFFER_CBT_LEAF_CACHE]))
+        glDeleteBuffers(1, &g_gl.buffers[BUFFER_CBT_LEAF_CACHE]);
+    glGenBuffers(1, &g_gl.buffers[BUFFER_CBT_LEAF_CACHE]);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_gl.buffers[BUFFER_CBT_LEAF_CACHE]);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER, byteSize, NULL, 0);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,
+                     BUFFER_CBT_LEAF_CACHE,
+                     g_gl.buffers[BUFFER_CBT_LEAF_CACHE]);
+
+    return (glGetError() == GL_NO_ERROR);
+}
+
 bool LoadCbtBuffer()
 {
     cbt_Tree *cbt = cct_Create(g_mesh.subd.subd);
+    bool warmStart = g_app.snapshot.warmStart
+                  && !glIsBuffer(g_gl.buffers[BUFFER_CBT]);
 
     LOG("Loading {Subd-Buffer}");
+    InvalidateStaticSkip();
     if (glIsBuffer(g_gl.buffers[BUFFER_CBT]))
         glDeleteBuffers(1, &g_gl.buffers[BUFFER_CBT]);
     glGenBuffers(1, &g_gl.buffers[BUFFER_CBT]);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_gl.buffers[BUFFER_CBT]);
-    glBufferStorage(GL_SHADER_STORAGE_BUFFER,
-                    cbt_HeapByteSize(cbt),
-                    cbt_GetHeap(cbt),
-                    0);
+    if (!warmStart || !LoadCbtBufferFromSnapshot(cbt)) {
+        glBufferStorage(GL_SHADER_STORAGE_BUFFER,
+                        cbt_HeapByteSize(cbt),
+                        cbt_GetHeap(cbt),
+                        0);
+    }
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 
     cbt_Release(cbt);
 
-    return (glGetError() == GL_NO_ERROR);
+    return (glGetError() == GL_NO_ERROR) && LoadCbtLeafCacheBuffer();
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Save CBT Buffer
+ *
+ * This procedure reads back the CBT buffer and writes it to disk.
+ */
+bool SaveCbtBuffer()
+{
+    GLint64 byteSize = 0;
+    char *heap;
+    bool success;
+
+    LOG("Saving {Subd-Buffer-Snapshot}");
+    glGetNamedBufferParameteri64v(g_gl.buffers[BUFFER_CBT],
+                                  GL_BUFFER_SIZE,
+                                  &byteSize);
+    heap = (char *)malloc(byteSize);
+    glGetNamedBufferSubData(g_gl.buffers[BUFFER_CBT], 0, byteSize, heap);
+    success = (glGetError() == GL_NO_ERROR);
+    if (success) success = cbts_Write(g_app.snapshot.path,
+                                      heap,
+                                      byteSize,
+                                      CBTS_MODE_CATMULL_CLARK,
+                                      cct_RootBisectorCount(g_mesh.subd.subd));
+    free(heap);
+
+    return success;
 }
 
 bool LoadCbtDispatchBuffer()
@@ -1858,6 +2086,9 @@ void Release()
 {
     int i;
 
+    if (g_app.snapshot.warmStart && glIsBuffer(g_gl.buffers[BUFFER_CBT]))
+        SaveCbtBuffer();
+
     for (i = 0; i < CLOCK_COUNT; ++i)
         if (g_gl.clocks[i])
             djgc_release(g_gl.clocks[i]);
@@ -2144,20 +2375,55 @@ void CbtReductionPass()
         it-= 5;
     }
 
+    // each pass reads the nodes at depth it and writes the levels above
     glUseProgram(g_gl.programs[PROGRAM_CBT_REDUCTION]);
-    while (--it >= 0) {
+    while (it > 0) {
         int loc = glGetUniformLocation(g_gl.programs[PROGRAM_CBT_REDUCTION], "u_PassID");
-        int cnt = 1 << it;
-        int numGroup = (cnt >= 256) ? (cnt >> 8) : 1;
+        int numGroup = std::max((1 << it) >> CBT_SUM_REDUCTION_LEVEL_COUNT, 1);
+        int numGroupX = std::min(numGroup, 1 << 15);
 
-        djgc_start(g_gl.clocks[CLOCK_REDUCTION00 + it]);
+        djgc_start(g_gl.clocks[CLOCK_REDUCTION00 + it - 1]);
         glUniform1i(loc, it);
-        glDispatchCompute(numGroup, 1, 1);
+        glDispatchCompute(numGroupX, 1, numGroup / numGroupX);
         glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
-        djgc_stop(g_gl.clocks[CLOCK_REDUCTION00 + it]);
+        djgc_stop(g_gl.clocks[CLOCK_REDUCTION00 + it - 1]);
+
+        it-= CBT_SUM_REDUCTION_LEVEL_COUNT;
     }
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_CBT, 0);
     djgc_stop(g_gl.clocks[CLOCK_REDUCTION]);
+
+    g_mesh.leafCache.isStale = true;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Leaf Cache Pass
+ *
+ * Writes the leaves of the CBT into the leaf cache buffer. The pass is
+ * skipped while the cache is up to date, so it runs once per reduction
+ * whichever of the tessellation and render passes comes first.
+ */
+void CbtLeafCachePass()
+{
+    int numGroup;
+
+    if (!g_mesh.leafCache.enabled || !g_mesh.leafCache.isStale)
+        return;
+
+    numGroup = std::max(CbtLeafCacheCapacity() >> 8, 1);
+    numGroup = std::min(numGroup, CBT_LEAF_CACHE_MAX_GROUP_COUNT);
+
+    djgc_start(g_gl.clocks[CLOCK_LEAF_CACHE]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_CBT, g_gl.buffers[BUFFER_CBT]);
+    glUseProgram(g_gl.programs[PROGRAM_CBT_LEAF_CACHE]);
+        glDispatchCompute(numGroup, 1, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glUseProgram(0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_CBT, 0);
+    djgc_stop(g_gl.clocks[CLOCK_LEAF_CACHE]);
+
+    g_mesh.leafCache.isStale = false;
 }
 
 void CbtDispatchPass()
@@ -2288,12 +2554,16 @@ void RenderAdaptiveLod()
     LoadXformVariables();
 
     djgc_start(g_gl.clocks[CLOCK_TESSELLATION]);
-    CbtDispatchPass();
-    CbtUpdatePass();
-    CbtReductionPass();
-    CctDispatchPass();
+    if (ShouldUpdateTessellation()) {
+        CbtDispatchPass();
+        CbtLeafCachePass();
+        CbtUpdatePass();
+        CbtReductionPass();
+        CctDispatchPass();
+    }
     djgc_stop(g_gl.clocks[CLOCK_TESSELLATION]);
 
+    CbtLeafCachePass();
     djgc_start(g_gl.clocks[CLOCK_RENDER]);
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER,
                      BUFFER_CBT,
@@ -2443,6 +2713,16 @@ void RenderViewer()
             ImGui::Text("GPU: %.3f%s",
                 gpuDt < 1. ? gpuDt * 1e3 : gpuDt,
                 gpuDt < 1. ? "ms" : " s");
+            if (g_mesh.leafCache.enabled) {
+                djgc_ticks(g_gl.clocks[CLOCK_LEAF_CACHE], &cpuDt, &gpuDt);
+                ImGui::Text("Leaf Cache   -- CPU: %.3f%s",
+                    cpuDt < 1. ? cpuDt * 1e3 : cpuDt,
+                    cpuDt < 1. ? "ms" : " s");
+                ImGui::SameLine();
+                ImGui::Text("GPU: %.3f%s",
+                    gpuDt < 1. ? gpuDt * 1e3 : gpuDt,
+                    gpuDt < 1. ? "ms" : " s");
+            }
 #endif
         }
         ImGui::End();
@@ -2559,6 +2839,15 @@ void RenderViewer()
                 if (ImGui::Checkbox("Freeze", &g_mesh.flags.freeze)) {
                     LoadTessellationPrograms();
                 }
+                ImGui::SameLine();
+                if (ImGui::Checkbox("Skip Static Updates", &g_mesh.staticSkip.enabled)) {
+                    InvalidateStaticSkip();
+                }
+                ImGui::SameLine();
+                if (ImGui::Checkbox("Leaf Cache", &g_mesh.leafCache.enabled)) {
+                    LoadCbtLeafCacheBuffer();
+                    LoadPrograms();
+                }
                 if (ImGui::Combo("Shading", &g_mesh.shading, &shadings[0], BUFFER_SIZE(shadings))) {
                     LoadAdaptiveLodRenderProgram();
                 }
@@ -2771,8 +3060,40 @@ void ResizeCallback(GLFWwindow* window, int width, int height)
 
 
 // -----------------------------------------------------------------------------
+void Usage(const char *app)
+{
+    LOG("usage: %s [mesh.ccm maxDepth] [--snapshot catmullclark.cbts]", app);
+}
+
+// warm starting is opt-in, since it writes a file on exit; the options are
+// removed from argv, leaving the mesh arguments to Load
+bool ParseCommandLine(int *argc, char **argv)
+{
+    int argCount = 1;
+
+    for (int i = 1; i < *argc; ++i) {
+        if (!strcmp(argv[i], "--snapshot") && i + 1 < *argc) {
+            g_app.snapshot.path = argv[++i];
+            g_app.snapshot.warmStart = true;
+        } else if (!strncmp(argv[i], "--", 2)) {
+            return false;
+        } else {
+            argv[argCount++] = argv[i];
+        }
+    }
+    *argc = argCount;
+
+    return argCount == 1 || argCount == 3;
+}
+
 int main(int argc, char **argv)
 {
+    if (!ParseCommandLine(&argc, argv)) {
+        Usage(argv[0]);
+
+        return EXIT_FAILURE;
+    }
+
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
@@ -0,0 +1,228 @@
+#ifndef CBTL_INCLUDE_CBTL_H
+#define CBTL_INCLUDE_CBTL_H
+
+// cbt.h must be included before this file
+#include "CbtReduction.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef CBTL_STATIC
+#define CBTLDEF static
+#else
+#define CBTLDEF extern
+#endif
+
+// number of leaves decoded per traversal by cbtl_Update
+#ifndef CBTL_CHUNK_SIZE
+#define CBTL_CHUNK_SIZE 4096
+#endif
+
+// large enough for any CBT max depth
+#define CBTL_STACK_SIZE 64
+
+// enumerates a range of leaf nodes in handle order
+typedef struct {
+    const cbt_Tree *cbt;
+    cbt_Node node;                          // current leaf node
+    int64_t handle;                         // handle of the current leaf node
+    int64_t endHandle;
+    int32_t stackSize;
+    cbt_Node stack[CBTL_STACK_SIZE];        // subtrees left to traverse
+    uint64_t leafCounts[CBTL_STACK_SIZE];   // leaf count of each subtree
+} cbtl_Iterator;
+
+// iterator usage:
+//   cbtl_Iterator it;
+//   cbtl_IteratorInit(&it, cbt, 0, cbt_NodeCount(cbt));
+//   while (cbtl_IteratorNext(&it)) { ... it.node ... }
+CBTLDEF void cbtl_IteratorInit(cbtl_Iterator *it,
+                               const cbt_Tree *cbt,
+                               int64_t firstHandle,
+                               int64_t count);
+CBTLDEF bool cbtl_IteratorNext(cbtl_Iterator *it);
+
+// bulk counterpart of cbt_DecodeNode: writes the leaf nodes with handles
+// firstHandle to firstHandle + count - 1 and returns the number of nodes
+// written (less than count if the range overflows the node count)
+CBTLDEF int64_t cbtl_DecodeLeaves(const cbt_Tree *cbt,
+                                  int64_t firstHandle,
+                                  int64_t count,
+                                  cbt_Node *nodes);
+
+// cbt_Update counterpart that updates the reduction with
+// cbtr_UpdateSumReduction (dirtyMap may be NULL)
+CBTLDEF void cbtl_Update(cbt_Tree *cbt,
+                         cbtr_DirtyMap *dirtyMap,
+                         cbt_UpdateCallback updater,
+                         const void *userData);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+//
+//
+//// end header file ///////////////////////////////////////////////////////////
+#endif // CBTL_INCLUDE_CBTL_H
+
+#ifdef CBTL_IMPLEMENTATION
+
+/*******************************************************************************
+ * Leaf Enumeration
+ *
+ * cbt_DecodeNode descends from the root for each handle, so enumerating N
+ * leaves costs N * depth heap reads, most of which hit the same nodes
+ * again and again. The iterator instead walks the tree depth first and
+ * keeps the right subtrees it still has to visit on a stack. Each inner
+ * node is visited once, and only its left child is read from the heap:
+ * the leaf count of the right child is the difference between both.
+ *
+ * Like cbt_DecodeNode, the traversal relies on the sum reduction only, so
+ * it returns the same nodes while the bitfield is modified by split and
+ * merge operations.
+ *
+ */
+static void
+cbtl__IteratorPush(cbtl_Iterator *it, const cbt_Node node, uint64_t leafCount)
+{
+    it->stack[it->stackSize] = node;
+    it->leafCounts[it->stackSize] = leafCount;
+    ++it->stackSize;
+}
+
+
+/*******************************************************************************
+ * IteratorInit -- Locates the first leaf of the range
+ *
+ * The descent is the same as in cbt_DecodeNode, except that the right
+ * subtrees that lie after the first leaf get pushed on the stack.
+ *
+ */
+CBTLDEF void
+cbtl_IteratorInit(
+    cbtl_Iterator *it,
+    const cbt_Tree *cbt,
+    int64_t firstHandle,
+    int64_t count
+) {
+    const int64_t nodeCount = cbt_NodeCount(cbt);
+    cbt_Node node = cbt_CreateNode(1u, 0);
+    uint64_t leafCount = (uint64_t)nodeCount;
+    uint64_t bitID = (uint64_t)firstHandle;
+
+    it->cbt = cbt;
+    it->node = node;
+    it->handle = firstHandle - 1;
+    it->endHandle = firstHandle + count < nodeCount ? firstHandle + count : nodeCount;
+    it->stackSize = 0;
+
+    if (firstHandle < 0 || firstHandle >= it->endHandle)
+        return;
+
+    while (leafCount > 1u) {
+        cbt_Node leftChild = cbt_LeftChildNode(node);
+        uint64_t leftLeafCount = cbt_HeapRead(cbt, leftChild);
+
+        if (bitID < leftLeafCount) {
+            cbtl__IteratorPush(it, cbt_RightChildNode(node), leafCount - leftLeafCount);
+            node = leftChild;
+            leafCount = leftLeafCount;
+        } else {
+            bitID-= leftLeafCount;
+            node = cbt_RightChildNode(node);
+            leafCount-= leftLeafCount;
+        }
+    }
+
+    cbtl__IteratorPush(it, node, 1u);
+}
+
+
+/*******************************************************************************
+ * IteratorNext -- Advances to the next leaf of the range
+ *
+ * Returns false once the range is exhausted.
+ *
+ */
+CBTLDEF bool cbtl_IteratorNext(cbtl_Iterator *it)
+{
+    cbt_Node node;
+    uint64_t leafCount;
+
+    if (it->handle + 1 >= it->endHandle)
+        return false;
+
+    --it->stackSize;
+    node = it->stack[it->stackSize];
+    leafCount = it->leafCounts[it->stackSize];
+
+    while (leafCount > 1u) {
+        cbt_Node leftChild = cbt_LeftChildNode(node);
+        uint64_t leftLeafCount = cbt_HeapRead(it->cbt, leftChild);
+
+        cbtl__IteratorPush(it, cbt_RightChildNode(node), leafCount - leftLeafCount);
+        node = leftChild;
+        leafCount = leftLeafCount;
+    }
+
+    it->node = node;
+    ++it->handle;
+
+    return true;
+}
+
+
+/*******************************************************************************
+ * DecodeLeaves -- Decodes a range of leaf nodes with a single traversal
+ *
+ */
+CBTLDEF int64_t
+cbtl_DecodeLeaves(
+    const cbt_Tree *cbt,
+    int64_t firstHandle,
+    int64_t count,
+    cbt_Node *nodes
+) {
+    cbtl_Iterator it;
+    int64_t nodeID = 0;
+
+    cbtl_IteratorInit(&it, cbt, firstHandle, count);
+    while (cbtl_IteratorNext(&it))
+        nodes[nodeID++] = it.node;
+
+    return nodeID;
+}
+
+
+/*******************************************************************************
+ * Update -- Invokes a callback on each leaf node and updates the reduction
+ *
+ * The leaves are split into chunks of CBTL_CHUNK_SIZE consecutive handles,
+ * and each thread traverses its chunks with an iterator.
+ *
+ */
+CBTLDEF void
+cbtl_Update(
+    cbt_Tree *cbt,
+    cbtr_DirtyMap *dirtyMap,
+    cbt_UpdateCallback updater,
+    const void *userData
+) {
+    const int64_t nodeCount = cbt_NodeCount(cbt);
+    const int64_t chunkCount = (nodeCount + CBTL_CHUNK_SIZE - 1) / CBTL_CHUNK_SIZE;
+
+#pragma omp parallel for
+    for (int64_t chunkID = 0; chunkID < chunkCount; ++chunkID) {
+        cbtl_Iterator it;
+
+        cbtl_IteratorInit(&it, cbt, chunkID * CBTL_CHUNK_SIZE, CBTL_CHUNK_SIZE);
+        while (cbtl_IteratorNext(&it))
+            updater(cbt, it.node, userData);
+    }
+
+    cbtr_UpdateSumReduction(dirtyMap, cbt);
+}
+
+#endif // CBTL_IMPLEMENTATION
@@ -0,0 +1,589 @@
+#ifndef CBTR_INCLUDE_CBTR_H
+#define CBTR_INCLUDE_CBTR_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef CBTR_STATIC
+#define CBTRDEF static
+#else
+#define CBTRDEF extern
+#endif
+
+// the heap is split into about CBTR_SUBTREES_PER_THREAD subtrees per thread
+#ifndef CBTR_SUBTREES_PER_THREAD
+#define CBTR_SUBTREES_PER_THREAD 4
+#endif
+
+// dirty blocks hold 2^CBTR_BLOCK_LEAF_DEPTH nodes of the bitfield
+#ifndef CBTR_BLOCK_LEAF_DEPTH
+#define CBTR_BLOCK_LEAF_DEPTH 12
+#endif
+
+// flags the blocks of the bitfield modified since the last reduction
+typedef struct {
+    uint64_t *flags;            // one bit per block
+    int64_t *blockIDs;          // dirty blocks of the current reduction
+    int64_t maxDepth;
+    int64_t blockDepth;         // depth of the roots of the blocks
+    int64_t dirtyBlockCount;    // blocks modified by the last update, or -1
+    bool fullReduction;         // lists the dirty blocks but reduces the whole heap
+} cbtr_DirtyMap;
+
+// drop-in replacement for cbt_ComputeSumReduction
+CBTRDEF void cbtr_ComputeSumReduction(cbt_Tree *cbt);
+
+// creates a map for the blocks of a tree, or releases it
+CBTRDEF void cbtr_DirtyMapInit(cbtr_DirtyMap *map, const cbt_Tree *cbt);
+CBTRDEF void cbtr_DirtyMapRelease(cbtr_DirtyMap *map);
+
+// cbt_SplitNode and cbt_MergeNode counterparts that also flag the block
+// they modify in map, which may be NULL
+CBTRDEF void cbtr_SplitNode(cbtr_DirtyMap *map, cbt_Tree *cbt, const cbt_Node node);
+CBTRDEF void cbtr_MergeNode(cbtr_DirtyMap *map, cbt_Tree *cbt, const cbt_Node node);
+
+// reduces the blocks flagged in map and their ancestors, or the whole heap
+// if map is NULL; the flagged blocks are then listed in map->blockIDs
+CBTRDEF void cbtr_UpdateSumReduction(cbtr_DirtyMap *map, cbt_Tree *cbt);
+
+// copies the bytes of the heap that hold a list of blocks (e.g., the dirty
+// blocks of the last update) and the levels above them into dstHeap, an
+// older copy of the heap; returns the number of bytes copied
+CBTRDEF int64_t cbtr_CopyBlocks(const cbtr_DirtyMap *map,
+                                const cbt_Tree *cbt,
+                                const int64_t *blockIDs,
+                                int64_t blockCount,
+                                void *dstHeap);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+//
+//
+//// end header file ///////////////////////////////////////////////////////////
+#endif // CBTR_INCLUDE_CBTR_H
+
+// the implementation is compiled once, even though CbtLeaves.h and
+// LebSubdivision.h include this file as well
+#if defined(CBTR_IMPLEMENTATION) && !defined(CBTR__IMPLEMENTATION_DEFINED)
+#define CBTR__IMPLEMENTATION_DEFINED
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _OPENMP
+#   include <omp.h>
+#endif
+
+// more dirty blocks than this fraction of all blocks get a full reduction
+#ifndef CBTR_DIRTY_BLOCK_RATIO
+#define CBTR_DIRTY_BLOCK_RATIO 0.25
+#endif
+
+
+/*******************************************************************************
+ * Heap Layout
+ *
+ * The heap of a CBT of max depth D stores the nodes of each depth d one
+ * after the other on D - d + 1 bits, from bit 2^(d + 1) + id * (D - d + 1)
+ * on, where id in [2^d, 2^(d + 1)) is the heap index of the node. The
+ * bitfield (d = D) thus starts at bit 3 * 2^D, and the nodes that a subtree
+ * rooted at depth k holds at depth d >= k + 6 span whole 64-bit words that
+ * no other subtree of depth k touches.
+ *
+ */
+static inline int64_t
+cbtr__NodeBitID(int64_t maxDepth, int64_t depth, uint64_t id)
+{
+    return (2LL << depth) + (int64_t)id * (maxDepth - depth + 1);
+}
+
+static inline uint64_t cbtr__BitMask(int64_t bitCount)
+{
+    return bitCount < 64 ? ~(~0ULL << bitCount) : ~0ULL;
+}
+
+
+/*******************************************************************************
+ * Bit Streams -- Sequential access to the nodes of a heap level
+ *
+ * Reading and writing the nodes in order avoids the two-word read-modify-
+ * write that cbt_HeapRead and cbt_HeapWrite perform for each node. The
+ * first and last words of a writer are merged with the bits they already
+ * hold, so ranges need not be aligned.
+ *
+ */
+typedef struct {
+    const uint64_t *word;   // next word to load
+    uint64_t bits;          // bits loaded but not read yet
+    int64_t bitCount;
+} cbtr__BitReader;
+
+typedef struct {
+    uint64_t *word;         // word the pending bits go to
+    uint64_t bits;          // bits written but not stored yet
+    int64_t bitCount;
+} cbtr__BitWriter;
+
+static inline void
+cbtr__BitReaderInit(cbtr__BitReader *reader, const uint64_t *heap, int64_t bitID)
+{
+    reader->word = &heap[bitID >> 6];
+    reader->bitCount = 64 - (bitID & 63);
+    reader->bits = *reader->word++ >> (bitID & 63);
+}
+
+// bitCount must be less than 64
+static inline uint64_t
+cbtr__BitReaderRead(cbtr__BitReader *reader, int64_t bitCount)
+{
+    uint64_t value = reader->bits;
+
+    if (reader->bitCount >= bitCount) {
+        reader->bits>>= bitCount;
+        reader->bitCount-= bitCount;
+    } else {
+        uint64_t next = *reader->word++;
+        int64_t nextBitCount = bitCount - reader->bitCount;
+
+        value|= next << reader->bitCount;
+        reader->bits = next >> nextBitCount;
+        reader->bitCount = 64 - nextBitCount;
+    }
+
+    return value & cbtr__BitMask(bitCount);
+}
+
+static inline void
+cbtr__BitWriterInit(cbtr__BitWriter *writer, uint64_t *heap, int64_t bitID)
+{
+    writer->word = &heap[bitID >> 6];
+    writer->bitCount = bitID & 63;
+    writer->bits = *writer->word & cbtr__BitMask(writer->bitCount);
+}
+
+// value must fit on bitCount bits
+static inline void
+cbtr__BitWriterWrite(cbtr__BitWriter *writer, uint64_t value, int64_t bitCount)
+{
+    writer->bits|= value << writer->bitCount;
+    writer->bitCount+= bitCount;
+
+    if (writer->bitCount >= 64) {
+        *writer->word++ = writer->bits;
+        writer->bitCount-= 64;
+        writer->bits = writer->bitCount > 0
+                     ? value >> (bitCount - writer->bitCount) : 0u;
+    }
+}
+
+static inline void cbtr__BitWriterFlush(cbtr__BitWriter *writer)
+{
+    if (writer->bitCount > 0) {
+        uint64_t mask = cbtr__BitMask(writer->bitCount);
+
+        *writer->word = (*writer->word & ~mask) | writer->bits;
+    }
+}
+
+
+/*******************************************************************************
+ * ReduceLevel -- Sums the children of a range of nodes of the same depth
+ *
+ */
+static void
+cbtr__ReduceLevel(
+    uint64_t *heap,
+    int64_t maxDepth,
+    int64_t depth,
+    uint64_t firstID,
+    int64_t count
+) {
+    const int64_t bitCount = maxDepth - depth + 1;
+    cbtr__BitReader reader;
+    cbtr__BitWriter writer;
+
+    cbtr__BitReaderInit(&reader, heap, cbtr__NodeBitID(maxDepth, depth + 1, firstID << 1));
+    cbtr__BitWriterInit(&writer, heap, cbtr__NodeBitID(maxDepth, depth, firstID));
+
+    for (int64_t i = 0; i < count; ++i) {
+        uint64_t x0 = cbtr__BitReaderRead(&reader, bitCount - 1);
+        uint64_t x1 = cbtr__BitReaderRead(&reader, bitCount - 1);
+
+        cbtr__BitWriterWrite(&writer, x0 + x1, bitCount);
+    }
+
+    cbtr__BitWriterFlush(&writer);
+}
+
+
+/*******************************************************************************
+ * ReduceBitField -- Computes the 6 levels above the bitfield of a subtree
+ *
+ * Each 64-bit word of the bitfield is reduced in place with SWAR adds: the
+ * word first holds 32 sums of 2 bits, then 16 sums of 4 bits, and so on
+ * up to the popcount of the word. The lanes of each step are the nodes
+ * of the next level up, which are then packed into the heap. The 2-bit
+ * lanes have the same width as the nodes above the bitfield, so these
+ * are stored a word at a time.
+ *
+ */
+static void
+cbtr__ReduceBitField(
+    uint64_t *heap,
+    int64_t maxDepth,
+    int64_t rootDepth,
+    uint64_t rootID,
+    int64_t levelCount
+) {
+    static const uint64_t masks[6] = {
+        0x5555555555555555ULL, 0x3333333333333333ULL, 0x0F0F0F0F0F0F0F0FULL,
+        0x00FF00FF00FF00FFULL, 0x0000FFFF0000FFFFULL, 0x00000000FFFFFFFFULL
+    };
+    const int64_t leafDepth = maxDepth - rootDepth;
+    const int64_t bitFieldID = cbtr__NodeBitID(maxDepth, maxDepth, rootID << leafDepth);
+    const uint64_t *bitField = &heap[bitFieldID >> 6];
+    const int64_t wordCount = (1LL << leafDepth) >> 6;
+    cbtr__BitWriter writers[6];
+
+    for (int64_t j = 1; j <= levelCount; ++j) {
+        int64_t bitID = cbtr__NodeBitID(maxDepth,
+                                        maxDepth - j,
+                                        rootID << (leafDepth - j));
+
+        cbtr__BitWriterInit(&writers[j - 1], heap, bitID);
+    }
+
+    for (int64_t i = 0; i < wordCount; ++i) {
+        uint64_t x = bitField[i];
+
+        for (int64_t j = 1; j <= levelCount; ++j) {
+            const int64_t laneBitCount = 1LL << (j - 1);
+            const uint64_t mask = masks[j - 1];
+
+            x = (x & mask) + ((x >> laneBitCount) & mask);
+
+            if (j == 1) {
+                cbtr__BitWriterWrite(&writers[0], x, 64);
+            } else {
+                const int64_t laneCount = 64 >> j;
+
+                for (int64_t k = 0; k < laneCount; ++k) {
+                    uint64_t sum = (x >> (k << j)) & cbtr__BitMask(j + 1);
+
+                    cbtr__BitWriterWrite(&writers[j - 1], sum, j + 1);
+                }
+            }
+        }
+    }
+
+    for (int64_t j = 1; j <= levelCount; ++j)
+        cbtr__BitWriterFlush(&writers[j - 1]);
+}
+
+
+/*******************************************************************************
+ * ReduceSubtree -- Reduces a subtree from the bitfield up to depth k + 6
+ *
+ * The subtree is rooted at depth k and must be at least 7 levels high, so
+ * that the levels it writes span whole words (see Heap Layout).
+ *
+ */
+static void
+cbtr__ReduceSubtree(
+    uint64_t *heap,
+    int64_t maxDepth,
+    int64_t rootDepth,
+    uint64_t rootID
+) {
+    const int64_t firstLevel = maxDepth - 1;
+    const int64_t lastLevel = rootDepth + 6;
+    const int64_t bitFieldLevelCount = firstLevel - lastLevel + 1 < 6
+                                     ? firstLevel - lastLevel + 1 : 6;
+
+    cbtr__ReduceBitField(heap, maxDepth, rootDepth, rootID, bitFieldLevelCount);
+
+    for (int64_t depth = firstLevel - bitFieldLevelCount; depth >= lastLevel; --depth) {
+        cbtr__ReduceLevel(heap,
+                          maxDepth,
+                          depth,
+                          rootID << (depth - rootDepth),
+                          1LL << (depth - rootDepth));
+    }
+}
+
+
+/*******************************************************************************
+ * ComputeSumReduction -- Parallel bottom-up reduction of the heap
+ *
+ * The tree is split into the subtrees rooted at some depth k, and each
+ * thread reduces whole subtrees from the bitfield up to depth k + 6, so
+ * that it works in its own cache lines and no barrier is needed between
+ * two levels. Above depth k + 6, nodes of neighboring subtrees share
+ * words, so these few levels are reduced serially once all the subtrees
+ * are done. k grows with the thread count; the serial part is at most
+ * 2^(k + 6) nodes.
+ *
+ */
+CBTRDEF void cbtr_ComputeSumReduction(cbt_Tree *cbt)
+{
+    uint64_t *heap = (uint64_t *)cbt_GetHeap(cbt);
+    const int64_t maxDepth = cbt_MaxDepth(cbt);
+    int64_t subtreeCount = CBTR_SUBTREES_PER_THREAD;
+    int64_t rootDepth = 0;
+    int64_t serialDepth = maxDepth - 1;
+
+#ifdef _OPENMP
+    subtreeCount*= omp_get_max_threads();
+#endif
+    while ((1LL << rootDepth) < subtreeCount)
+        ++rootDepth;
+
+    if (rootDepth > maxDepth - 7)
+        rootDepth = maxDepth - 7;
+
+    if (rootDepth >= 0) {
+        const int64_t rootCount = 1LL << rootDepth;
+
+#pragma omp parallel for
+        for (int64_t i = 0; i < rootCount; ++i)
+            cbtr__ReduceSubtree(heap, maxDepth, rootDepth, (uint64_t)(rootCount + i));
+
+        serialDepth = rootDepth + 5;
+    }
+
+    for (int64_t depth = serialDepth; depth >= 0; --depth)
+        cbtr__ReduceLevel(heap, maxDepth, depth, 1ULL << depth, 1LL << depth);
+}
+
+
+/*******************************************************************************
+ * DirtyMapInit -- Allocates the flags of the blocks of a tree
+ *
+ * The blocks are the subtrees rooted at depth maxDepth -
+ * CBTR_BLOCK_LEAF_DEPTH, or the whole tree if it is not as deep. The sum
+ * reduction of the tree must be up to date.
+ *
+ */
+CBTRDEF void cbtr_DirtyMapInit(cbtr_DirtyMap *map, const cbt_Tree *cbt)
+{
+    const int64_t maxDepth = cbt_MaxDepth(cbt);
+    const int64_t blockDepth = maxDepth > CBTR_BLOCK_LEAF_DEPTH
+                             ? maxDepth - CBTR_BLOCK_LEAF_DEPTH : 0;
+    const int64_t blockCount = 1LL << blockDepth;
+
+    map->flags = (uint64_t *)calloc((blockCount + 63) / 64, sizeof(uint64_t));
+    map->blockIDs = (int64_t *)malloc(blockCount * sizeof(int64_t));
+    map->maxDepth = maxDepth;
+    map->blockDepth = blockDepth;
+    map->dirtyBlockCount = 0;
+    map->fullReduction = false;
+}
+
+
+/*******************************************************************************
+ * DirtyMapRelease -- Releases a map
+ *
+ * Releasing a map that was zero-initialized is fine.
+ *
+ */
+CBTRDEF void cbtr_DirtyMapRelease(cbtr_DirtyMap *map)
+{
+    free(map->flags);
+    free(map->blockIDs);
+    memset(map, 0, sizeof(*map));
+}
+
+
+/*******************************************************************************
+ * Split and Merge -- Flags the block of the bit that a split or merge writes
+ *
+ * cbt_SplitNode sets the bit of the right child of a node, and
+ * cbt_MergeNode clears the bit of the right sibling of a node; in both
+ * cases the bit is that of the leftmost node of the bitfield below it.
+ * The flags are tested before they are set, since most splits and merges
+ * land in blocks that are already dirty.
+ *
+ */
+static void
+cbtr__MarkBitFieldNode(cbtr_DirtyMap *map, const cbt_Node node)
+{
+    const uint64_t bitID = (uint64_t)node.id << (map->maxDepth - node.depth);
+    const int64_t blockID = (int64_t)(bitID >> (map->maxDepth - map->blockDepth))
+                          - (1LL << map->blockDepth);
+    const uint64_t mask = 1ULL << (blockID & 63);
+    uint64_t *flags = &map->flags[blockID >> 6];
+
+    if ((*flags & mask) == 0u) {
+#pragma omp atomic
+        *flags|= mask;
+    }
+}
+
+CBTRDEF void
+cbtr_SplitNode(cbtr_DirtyMap *map, cbt_Tree *cbt, const cbt_Node node)
+{
+    cbt_SplitNode(cbt, node);
+
+    if (map && (int64_t)node.depth < map->maxDepth)
+        cbtr__MarkBitFieldNode(map, cbt_RightChildNode(node));
+}
+
+CBTRDEF void
+cbtr_MergeNode(cbtr_DirtyMap *map, cbt_Tree *cbt, const cbt_Node node)
+{
+    cbt_MergeNode(cbt, node);
+
+    if (map && node.depth > 0)
+        cbtr__MarkBitFieldNode(map, cbt_RightSiblingNode(node));
+}
+
+
+/*******************************************************************************
+ * UpdateSumReduction -- Reduces the blocks modified since the last update
+ *
+ * The dirty blocks are reduced in parallel up to 6 levels below their
+ * roots, like the subtrees of cbtr_ComputeSumReduction. The remaining
+ * levels of the blocks share words with their neighbors, so they are
+ * reduced serially, followed by the ancestors of the blocks. The blocks
+ * are listed in order, so that the blocks that share an ancestor are
+ * consecutive and each ancestor is reduced once. The cost thus scales
+ * with the number of dirty blocks rather than with the size of the heap.
+ *
+ */
+CBTRDEF void cbtr_UpdateSumReduction(cbtr_DirtyMap *map, cbt_Tree *cbt)
+{
+    uint64_t *heap = (uint64_t *)cbt_GetHeap(cbt);
+    int64_t maxDepth, blockDepth, blockCount, dirtyBlockCount = 0;
+
+    if (!map
+        || map->maxDepth != cbt_MaxDepth(cbt)
+        || map->maxDepth - map->blockDepth < 7) {
+        cbtr_ComputeSumReduction(cbt);
+
+        if (map)
+            map->dirtyBlockCount = -1;
+
+        return;
+    }
+
+    maxDepth = map->maxDepth;
+    blockDepth = map->blockDepth;
+    blockCount = 1LL << blockDepth;
+
+    for (int64_t i = 0; i < (blockCount + 63) / 64; ++i) {
+        uint64_t flags = map->flags[i];
+
+        map->flags[i] = 0u;
+        for (int64_t j = 0; flags != 0u; ++j, flags>>= 1)
+            if (flags & 1u)
+                map->blockIDs[dirtyBlockCount++] = 64 * i + j;
+    }
+    map->dirtyBlockCount = dirtyBlockCount;
+
+    if (map->fullReduction || dirtyBlockCount > CBTR_DIRTY_BLOCK_RATIO * blockCount) {
+        cbtr_ComputeSumReduction(cbt);
+
+        return;
+    }
+
+#pragma omp parallel for
+    for (int64_t i = 0; i < dirtyBlockCount; ++i) {
+        const uint64_t rootID = (uint64_t)(blockCount + map->blockIDs[i]);
+
+        cbtr__ReduceSubtree(heap, maxDepth, blockDepth, rootID);
+    }
+
+    for (int64_t i = 0; i < dirtyBlockCount; ++i) {
+        const uint64_t rootID = (uint64_t)(blockCount + map->blockIDs[i]);
+
+        for (int64_t depth = blockDepth + 5; depth >= blockDepth; --depth) {
+            cbtr__ReduceLevel(heap,
+                              maxDepth,
+                              depth,
+                              rootID << (depth - blockDepth),
+                              1LL << (depth - blockDepth));
+        }
+    }
+
+    for (int64_t depth = blockDepth - 1; depth >= 0; --depth) {
+        uint64_t previousID = 0u;
+
+        for (int64_t i = 0; i < dirtyBlockCount; ++i) {
+            const uint64_t rootID = (uint64_t)(blockCount + map->blockIDs[i]);
+            const uint64_t nodeID = rootID >> (blockDepth - depth);
+
+            if (nodeID != previousID)
+                cbtr__ReduceLevel(heap, maxDepth, depth, nodeID, 1);
+            previousID = nodeID;
+        }
+    }
+}
+
+
+
+/*******************************************************************************
+ * CopyBlocks -- Copies the nodes of a list of blocks from one heap to another
+ *
+ * The nodes that a block holds at each depth span a contiguous range of
+ * bits (see Heap Layout), so a block is copied as one range per level, from
+ * its root down to the bitfield. The levels above the blocks come first,
+ * since they hold the ancestors of any block. Ranges are widened to whole
+ * bytes; the bits of the neighboring blocks that this copies along are
+ * current as well.
+ *
+ */
+static int64_t
+cbtr__CopyBits(char *dst, const char *src, int64_t beginBitID, int64_t endBitID)
+{
+    const int64_t begin = beginBitID >> 3;
+    const int64_t end = (endBitID + 7) >> 3;
+
+    memcpy(&dst[begin], &src[begin], end - begin);
+
+    return end - begin;
+}
+
+CBTRDEF int64_t
+cbtr_CopyBlocks(
+    const cbtr_DirtyMap *map,
+    const cbt_Tree *cbt,
+    const int64_t *blockIDs,
+    int64_t blockCount,
+    void *dstHeap
+) {
+    const char *heap = cbt_GetHeap(cbt);
+    char *dst = (char *)dstHeap;
+    const int64_t maxDepth = map->maxDepth;
+    const int64_t blockDepth = map->blockDepth;
+    const uint64_t firstRootID = 1ULL << blockDepth;
+    int64_t byteCount = 0;
+
+    if (blockCount == 0)
+        return 0;
+
+    byteCount+= cbtr__CopyBits(dst,
+                               heap,
+                               0,
+                               cbtr__NodeBitID(maxDepth, blockDepth, firstRootID));
+
+    for (int64_t i = 0; i < blockCount; ++i) {
+        const uint64_t rootID = firstRootID + (uint64_t)blockIDs[i];
+
+        for (int64_t depth = blockDepth; depth <= maxDepth; ++depth) {
+            const int64_t nodeCount = 1LL << (depth - blockDepth);
+            const int64_t beginBitID = cbtr__NodeBitID(maxDepth,
+                                                       depth,
+                                                       rootID << (depth - blockDepth));
+            const int64_t endBitID = beginBitID + nodeCount * (maxDepth - depth + 1);
+
+            byteCount+= cbtr__CopyBits(dst, heap, beginBitID, endBitID);
+        }
+    }
+
+    return byteCount;
+}
+
+#endif // CBTR_IMPLEMENTATION
@@ -0,0 +1,309 @@
+#ifndef CBTS_INCLUDE_CBTS_H
+#define CBTS_INCLUDE_CBTS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef CBTS_STATIC
+#define CBTSDEF static
+#else
+#define CBTSDEF extern
+#endif
+
+#define CBTS_VERSION 1
+
+// interpretation of the heap
+enum {
+    CBTS_MODE_LEB_TRIANGLE, // leb_* routines
+    CBTS_MODE_LEB_SQUARE,   // leb_*_Square routines
+    CBTS_MODE_CATMULL_CLARK // cct_* routines
+};
+
+// on-disk header; the raw heap immediately follows it
+typedef struct {
+    char magic[4];          // "CBTS"
+    uint32_t version;       // CBTS_VERSION
+    int32_t maxDepth;       // max depth of the CBT
+    int32_t mode;           // one of CBTS_MODE_*
+    int64_t rootCount;      // number of root triangles/bisectors
+    uint64_t heapByteSize;  // size of the heap that follows the header
+    uint64_t checksum;      // see cbts_Checksum
+    uint8_t reserved[24];   // pads the header to 64 bytes
+} cbts_Header;
+
+// memory-mapped snapshot
+typedef struct {
+    const cbts_Header *header;
+    const void *heap;
+    void *data;
+    int64_t byteSize;
+    void *handles[2];       // platform-specific file handles
+} cbts_Snapshot;
+
+// writes a snapshot of a CBT heap
+CBTSDEF bool cbts_Write(const char *path,
+                        const void *heap,
+                        int64_t heapByteSize,
+                        int32_t mode,
+                        int64_t rootCount);
+CBTSDEF bool cbts_WriteTree(const char *path,
+                            const cbt_Tree *cbt,
+                            int32_t mode,
+                            int64_t rootCount);
+
+// maps a snapshot in memory; the heap can then be sent to the GPU as is
+CBTSDEF bool cbts_Map(const char *path, cbts_Snapshot *snapshot, bool verifyChecksum);
+CBTSDEF void cbts_Unmap(cbts_Snapshot *snapshot);
+
+// creates a CPU tree and copies the heap of a mapped snapshot into it
+CBTSDEF cbt_Tree *cbts_CreateTree(const cbts_Snapshot *snapshot);
+
+// 64-bit FNV-1a hash computed over the 64-bit words of the heap
+CBTSDEF uint64_t cbts_Checksum(const void *heap, int64_t heapByteSize);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+//
+//
+//// end header file ///////////////////////////////////////////////////////////
+#endif // CBTS_INCLUDE_CBTS_H
+
+#ifdef CBTS_IMPLEMENTATION
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#   ifndef WIN32_LEAN_AND_MEAN
+#       define WIN32_LEAN_AND_MEAN
+#   endif
+#   ifndef NOMINMAX
+#       define NOMINMAX
+#   endif
+#   include <windows.h>
+#else
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#endif
+
+
+/*******************************************************************************
+ * Checksum -- Hashes a CBT heap
+ *
+ * The heap of a CBT is always a multiple of 8 bytes, so the hash is computed
+ * one 64-bit word at a time.
+ *
+ */
+CBTSDEF uint64_t cbts_Checksum(const void *heap, int64_t heapByteSize)
+{
+    const uint64_t *words = (const uint64_t *)heap;
+    int64_t wordCount = heapByteSize / (int64_t)sizeof(uint64_t);
+    uint64_t hash = 14695981039346656037ull;
+
+    for (int64_t i = 0; i < wordCount; ++i) {
+        hash^= words[i];
+        hash*= 1099511628211ull;
+    }
+
+    return hash;
+}
+
+
+/*******************************************************************************
+ * MaxDepthFromHeapByteSize -- Inverts cbt__HeapByteSize
+ *
+ */
+static int32_t cbts__MaxDepthFromHeapByteSize(int64_t heapByteSize)
+{
+    int32_t maxDepth = 1;
+
+    while ((1ll << (maxDepth - 1)) < heapByteSize)
+        ++maxDepth;
+
+    return maxDepth;
+}
+
+
+/*******************************************************************************
+ * Write -- Writes a heap and its header to disk
+ *
+ */
+CBTSDEF bool
+cbts_Write(
+    const char *path,
+    const void *heap,
+    int64_t heapByteSize,
+    int32_t mode,
+    int64_t rootCount
+) {
+    cbts_Header header;
+    FILE *pf = fopen(path, "wb");
+    bool success;
+
+    if (!pf)
+        return false;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "CBTS", 4);
+    header.version = CBTS_VERSION;
+    header.maxDepth = cbts__MaxDepthFromHeapByteSize(heapByteSize);
+    header.mode = mode;
+    header.rootCount = rootCount;
+    header.heapByteSize = (uint64_t)heapByteSize;
+    header.checksum = cbts_Checksum(heap, heapByteSize);
+
+    success = fwrite(&header, sizeof(header), 1, pf) == 1
+           && fwrite(heap, (size_t)heapByteSize, 1, pf) == 1;
+    success&= (fclose(pf) == 0);
+
+    return success;
+}
+
+CBTSDEF bool
+cbts_WriteTree(
+    const char *path,
+    const cbt_Tree *cbt,
+    int32_t mode,
+    int64_t rootCount
+) {
+    return cbts_Write(path,
+                      cbt_GetHeap(cbt),
+                      cbt_HeapByteSize(cbt),
+                      mode,
+                      rootCount);
+}
+
+
+/*******************************************************************************
+ * Map -- Maps a snapshot file in memory and validates its header
+ *
+ */
+CBTSDEF bool
+cbts_Map(const char *path, cbts_Snapshot *snapshot, bool verifyChecksum)
+{
+    const cbts_Header *header;
+
+    memset(snapshot, 0, sizeof(*snapshot));
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    HANDLE mapping;
+    LARGE_INTEGER size;
+
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    if (!GetFileSizeEx(file, &size) || size.QuadPart < (LONGLONG)sizeof(cbts_Header)) {
+        CloseHandle(file);
+
+        return false;
+    }
+
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL) {
+        CloseHandle(file);
+
+        return false;
+    }
+
+    snapshot->data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (snapshot->data == NULL) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+
+        return false;
+    }
+
+    snapshot->byteSize = (int64_t)size.QuadPart;
+    snapshot->handles[0] = (void *)file;
+    snapshot->handles[1] = (void *)mapping;
+#else
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    void *data;
+
+    if (fd < 0)
+        return false;
+
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(cbts_Header)) {
+        close(fd);
+
+        return false;
+    }
+
+    data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    snapshot->data = data;
+    snapshot->byteSize = (int64_t)st.st_size;
+#endif
+
+    header = (const cbts_Header *)snapshot->data;
+    if (memcmp(header->magic, "CBTS", 4) != 0
+        || header->version != CBTS_VERSION
+        || header->maxDepth < 1 || header->maxDepth > 58
+        || header->heapByteSize != (uint64_t)(1ll << (header->maxDepth - 1))
+        || header->heapByteSize + sizeof(cbts_Header) > (uint64_t)snapshot->byteSize) {
+        cbts_Unmap(snapshot);
+
+        return false;
+    }
+
+    snapshot->header = header;
+    snapshot->heap = (const uint8_t *)snapshot->data + sizeof(cbts_Header);
+
+    if (verifyChecksum
+        && cbts_Checksum(snapshot->heap, header->heapByteSize) != header->checksum) {
+        cbts_Unmap(snapshot);
+
+        return false;
+    }
+
+    return true;
+}
+
+
+/*******************************************************************************
+ * Unmap -- Releases a mapped snapshot
+ *
+ */
+CBTSDEF void cbts_Unmap(cbts_Snapshot *snapshot)
+{
+    if (snapshot->data == NULL)
+        return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(snapshot->data);
+    CloseHandle((HANDLE)snapshot->handles[1]);
+    CloseHandle((HANDLE)snapshot->handles[0]);
+#else
+    munmap(snapshot->data, (size_t)snapshot->byteSize);
+#endif
+
+    memset(snapshot, 0, sizeof(*snapshot));
+}
+
+
+/*******************************************************************************
+ * CreateTree -- Creates a CPU tree and copies the snapshot's heap into it
+ *
+ */
+CBTSDEF cbt_Tree *cbts_CreateTree(const cbts_Snapshot *snapshot)
+{
+    cbt_Tree *cbt = cbt_Create(snapshot->header->maxDepth);
+
+    cbt_SetHeap(cbt, (const char *)snapshot->heap);
+
+    return cbt;
+}
+
+#endif // CBTS_IMPLEMENTATION
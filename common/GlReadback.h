@@ -0,0 +1,201 @@
+#ifndef GLRB_INCLUDE_GLRB_H
+#define GLRB_INCLUDE_GLRB_H
+
+// the OpenGL 4.5 API (e.g., glad/glad.h) must be included before this file
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef GLRB_STATIC
+#define GLRBDEF static
+#else
+#define GLRBDEF extern
+#endif
+
+#define GLRB_MAX_SLOT_COUNT 8
+
+// ring of readback slots in a persistently mapped buffer; each slot that
+// is in flight is guarded by a fence, so the CPU never maps, waits on,
+// or reads a range the GPU may still write
+typedef struct {
+    GLuint buffer;
+    const uint8_t *data;                // persistent mapping of the buffer
+    GLsync fences[GLRB_MAX_SLOT_COUNT]; // NULL for the slots that are free
+    int64_t slotByteSize;
+    int32_t slotCount;
+    int32_t head;                       // slot the next copies go to
+    int32_t tail;                       // oldest slot in flight
+} glrb_Ring;
+
+// creates and releases a ring
+GLRBDEF bool glrb_Create(glrb_Ring *ring, int64_t slotByteSize, int32_t slotCount);
+GLRBDEF void glrb_Release(glrb_Ring *ring);
+
+// returns false while every slot is in flight, in which case the
+// statistics of the current frame should be skipped
+GLRBDEF bool glrb_CanWrite(const glrb_Ring *ring);
+
+// copies a range of a GPU buffer into the slot at the head of the ring;
+// shader writes to the source must be made visible beforehand with
+// glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT)
+GLRBDEF void glrb_Copy(glrb_Ring *ring,
+                       GLuint srcBuffer,
+                       int64_t srcOffset,
+                       int64_t dstOffset,
+                       int64_t byteSize);
+
+// fences the copies of the head slot and moves on to the next slot
+GLRBDEF void glrb_Submit(glrb_Ring *ring);
+
+// returns the most recent slot whose copies have completed, or NULL if
+// there is none; it never waits. The slots that complete are recycled, so
+// the returned data remains valid until the next call to glrb_Copy
+GLRBDEF const void *glrb_Read(glrb_Ring *ring);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+//
+//
+//// end header file ///////////////////////////////////////////////////////////
+#endif // GLRB_INCLUDE_GLRB_H
+
+#ifdef GLRB_IMPLEMENTATION
+
+#include <string.h>
+
+
+/*******************************************************************************
+ * Create -- Allocates the persistently mapped buffer of a ring
+ *
+ * The buffer is allocated in client memory when the driver supports it,
+ * which is where readbacks are the fastest to read from.
+ *
+ */
+GLRBDEF bool
+glrb_Create(glrb_Ring *ring, int64_t slotByteSize, int32_t slotCount)
+{
+    const GLbitfield flags = GL_MAP_READ_BIT
+                           | GL_MAP_PERSISTENT_BIT
+                           | GL_MAP_COHERENT_BIT;
+    int64_t byteSize = slotByteSize * slotCount;
+
+    memset(ring, 0, sizeof(*ring));
+    if (slotCount < 1 || slotCount > GLRB_MAX_SLOT_COUNT || slotByteSize < 1)
+        return false;
+
+    glCreateBuffers(1, &ring->buffer);
+    glNamedBufferStorage(ring->buffer,
+                         byteSize,
+                         NULL,
+                         flags | GL_CLIENT_STORAGE_BIT);
+    ring->data = (const uint8_t *)
+        glMapNamedBufferRange(ring->buffer, 0, byteSize, flags);
+    ring->slotByteSize = slotByteSize;
+    ring->slotCount = slotCount;
+
+    if (!ring->data) {
+        glrb_Release(ring);
+
+        return false;
+    }
+
+    return true;
+}
+
+
+/*******************************************************************************
+ * Release -- Releases a ring and the fences of its slots
+ *
+ * Deleting the buffer also releases its mapping. Releasing a ring that was
+ * zero-initialized is fine.
+ *
+ */
+GLRBDEF void glrb_Release(glrb_Ring *ring)
+{
+    for (int32_t i = 0; i < GLRB_MAX_SLOT_COUNT; ++i)
+        if (ring->fences[i])
+            glDeleteSync(ring->fences[i]);
+
+    if (glIsBuffer(ring->buffer))
+        glDeleteBuffers(1, &ring->buffer);
+
+    memset(ring, 0, sizeof(*ring));
+}
+
+
+/*******************************************************************************
+ * CanWrite -- Checks whether the head slot is free
+ *
+ * Slots complete in order, so the head slot is free unless the ring is full.
+ *
+ */
+GLRBDEF bool glrb_CanWrite(const glrb_Ring *ring)
+{
+    return ring->slotCount > 0 && ring->fences[ring->head] == NULL;
+}
+
+
+/*******************************************************************************
+ * Copy -- Copies a range of a GPU buffer into the head slot
+ *
+ */
+GLRBDEF void
+glrb_Copy(
+    glrb_Ring *ring,
+    GLuint srcBuffer,
+    int64_t srcOffset,
+    int64_t dstOffset,
+    int64_t byteSize
+) {
+    glCopyNamedBufferSubData(srcBuffer,
+                             ring->buffer,
+                             srcOffset,
+                             ring->slotByteSize * ring->head + dstOffset,
+                             byteSize);
+}
+
+
+/*******************************************************************************
+ * Submit -- Fences the head slot
+ *
+ */
+GLRBDEF void glrb_Submit(glrb_Ring *ring)
+{
+    ring->fences[ring->head] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    ring->head = (ring->head + 1) % ring->slotCount;
+}
+
+
+/*******************************************************************************
+ * Read -- Retrieves the most recent completed slot
+ *
+ * The fences are polled with a zero timeout from the oldest slot on. The
+ * first poll flushes the command stream, so that the fence is guaranteed to
+ * signal eventually even if the application never flushes it.
+ *
+ */
+GLRBDEF const void *glrb_Read(glrb_Ring *ring)
+{
+    const uint8_t *data = NULL;
+
+    while (ring->fences[ring->tail]) {
+        GLenum status = glClientWaitSync(ring->fences[ring->tail],
+                                         GL_SYNC_FLUSH_COMMANDS_BIT,
+                                         0);
+
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            break;
+
+        glDeleteSync(ring->fences[ring->tail]);
+        ring->fences[ring->tail] = NULL;
+        data = ring->data + ring->slotByteSize * ring->tail;
+        ring->tail = (ring->tail + 1) % ring->slotCount;
+    }
+
+    return data;
+}
+
+#endif // GLRB_IMPLEMENTATION
@@ -0,0 +1,111 @@
+/* CbtDirtyBlocks.glsl - public domain
+
+    Flags the blocks of the CBT bitfield that split and merge operations
+    modify, so that CbtDirtyReduction.glsl reduces these blocks only. A
+    block holds 2^CBTR_BLOCK_LEAF_DEPTH nodes of the bitfield (see
+    common/CbtReduction.h). The first operation that lands in a clean block
+    appends the block to the dirty list. The epoch counts the updates that
+    modified at least one block (see CbtDirtyDispatcher.glsl), so that a
+    readback of it tells whether the tree changed.
+
+    The blocks of all the CBTs share the flags and the list: the block
+    blockID of the CBT cbtID is the block (cbtID << blockDepth) + blockID
+    of the buffers, so the CBTs must share their max depth.
+
+    The cbt_SplitNode and cbt_MergeNode functions are redirected to their
+    flagging counterparts for the code that follows this file, so it must
+    be included between cbt.glsl and leb.glsl. Unlike common/CbtReduction.h,
+    which takes the dirty map as an argument, the redirection cannot be
+    avoided here: leb.glsl calls cbt_SplitNode and cbt_MergeNode itself,
+    and GLSL has neither function pointers nor a way to thread an extra
+    argument through it, whereas the flags and the list are global buffers
+    that need no argument.
+
+    This code has dependencies on the following GLSL sources:
+    - cbt.glsl
+*/
+
+#ifndef CBTR_BLOCK_LEAF_DEPTH
+#   define CBTR_BLOCK_LEAF_DEPTH 12
+#endif
+
+layout(std430, binding = CBT_DIRTY_BLOCK_FLAG_BUFFER_BINDING)
+buffer CbtDirtyBlockFlagBuffer {
+    uint u_CbtDirtyBlockFlags[];
+};
+
+layout(std430, binding = CBT_DIRTY_BLOCK_LIST_BUFFER_BINDING)
+buffer CbtDirtyBlockListBuffer {
+    uint u_CbtDirtyBlockDispatch[3];    // one workgroup per dirty block
+    uint u_CbtDirtyBlockCount;
+    uint u_CbtDirtyBlockEpoch;
+    uint u_CbtLeafCacheDispatch[3];     // no workgroups if no block is dirty
+    uint u_CbtDirtyBlockIDs[];
+};
+
+int cbtr_BlockDepth(const int cbtID)
+{
+    return max(cbt_MaxDepth(cbtID) - CBTR_BLOCK_LEAF_DEPTH, 0);
+}
+
+// block of the buffers from the block of a CBT, and vice versa
+uint cbtr_EncodeBlock(const int cbtID, uint blockID)
+{
+    return (uint(cbtID) << cbtr_BlockDepth(cbtID)) + blockID;
+}
+
+void cbtr_DecodeBlock(uint block, out int cbtID, out uint blockID)
+{
+    int blockDepth = cbtr_BlockDepth(0);
+
+    cbtID = int(block >> blockDepth);
+    blockID = block & ((1u << blockDepth) - 1u);
+}
+
+// flags the block of the bitfield node below a node
+void cbtr__MarkBitFieldNode(const int cbtID, in const cbt_Node node)
+{
+    int maxDepth = cbt_MaxDepth(cbtID);
+    int blockDepth = cbtr_BlockDepth(cbtID);
+    uint bitID = node.id << (maxDepth - node.depth);
+    uint blockID = (bitID >> (maxDepth - blockDepth)) - (1u << blockDepth);
+    uint block = cbtr_EncodeBlock(cbtID, blockID);
+
+    if (u_CbtDirtyBlockFlags[block] == 0u
+        && atomicExchange(u_CbtDirtyBlockFlags[block], 1u) == 0u) {
+        uint dirtyBlockID = atomicAdd(u_CbtDirtyBlockCount, 1u);
+
+        u_CbtDirtyBlockIDs[dirtyBlockID] = block;
+    }
+}
+
+// a split sets the bit of the right child of the node
+void cbtr_SplitNode_Fast(const int cbtID, in const cbt_Node node)
+{
+    cbt_SplitNode_Fast(cbtID, node);
+    cbtr__MarkBitFieldNode(cbtID, cbt_RightChildNode(node));
+}
+
+void cbtr_SplitNode(const int cbtID, in const cbt_Node node)
+{
+    if (!cbt_IsCeilNode(cbtID, node))
+        cbtr_SplitNode_Fast(cbtID, node);
+}
+
+// a merge clears the bit of the right sibling of the node
+void cbtr_MergeNode_Fast(const int cbtID, in const cbt_Node node)
+{
+    cbt_MergeNode_Fast(cbtID, node);
+    cbtr__MarkBitFieldNode(cbtID, cbt_RightSiblingNode(node));
+}
+
+void cbtr_MergeNode(const int cbtID, in const cbt_Node node)
+{
+    if (!cbt_IsRootNode(node))
+        cbtr_MergeNode_Fast(cbtID, node);
+}
+
+#define cbt_SplitNode_Fast cbtr_SplitNode_Fast
+#define cbt_SplitNode cbtr_SplitNode
+#define cbt_MergeNode_Fast cbtr_MergeNode_Fast
+#define cbt_MergeNode cbtr_MergeNode
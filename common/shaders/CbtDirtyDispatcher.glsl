@@ -0,0 +1,63 @@
+/* CbtDirtyDispatcher.glsl - public domain
+
+    Turns the dirty block list into the indirect dispatch of
+    CbtDirtyReduction.glsl, clears the flags of the listed blocks, and
+    empties the list for the next split or merge pass; the block IDs remain
+    valid until then. The epoch is incremented if the list was not empty.
+    It also writes the indirect dispatch of CbtLeafCacheWriter.glsl, which
+    launches CBT_LEAF_CACHE_GROUP_COUNT_X by CBT_LEAF_CACHE_GROUP_COUNT_Y
+    workgroups if the list was not empty, and none otherwise, so that the
+    leaf cache is rewritten exactly when the CBTs changed.
+
+    This code has dependencies on the following GLSL sources:
+    - cbt.glsl
+    - CbtDirtyBlocks.glsl
+*/
+
+#ifdef COMPUTE_SHADER
+#ifndef CBT_DIRTY_DISPATCHER_GROUP_SIZE
+#   define CBT_DIRTY_DISPATCHER_GROUP_SIZE 256
+#endif
+
+#ifndef CBT_LEAF_CACHE_GROUP_COUNT_X
+#   define CBT_LEAF_CACHE_GROUP_COUNT_X 0u
+#endif
+#ifndef CBT_LEAF_CACHE_GROUP_COUNT_Y
+#   define CBT_LEAF_CACHE_GROUP_COUNT_Y 1u
+#endif
+
+layout(local_size_x = CBT_DIRTY_DISPATCHER_GROUP_SIZE,
+       local_size_y = 1,
+       local_size_z = 1) in;
+
+shared uint s_DirtyBlockCount;
+
+void main()
+{
+    uint threadID = gl_LocalInvocationID.x;
+
+    if (threadID == 0u)
+        s_DirtyBlockCount = u_CbtDirtyBlockCount;
+
+    barrier();
+
+    uint blockCount = s_DirtyBlockCount;
+
+    for (uint i = threadID; i < blockCount; i+= CBT_DIRTY_DISPATCHER_GROUP_SIZE)
+        u_CbtDirtyBlockFlags[u_CbtDirtyBlockIDs[i]] = 0u;
+
+    if (threadID == 0u) {
+        u_CbtDirtyBlockDispatch[0] = blockCount;
+        u_CbtDirtyBlockDispatch[1] = 1u;
+        u_CbtDirtyBlockDispatch[2] = 1u;
+        u_CbtDirtyBlockCount = 0u;
+
+        u_CbtLeafCacheDispatch[0] = blockCount > 0u ? CBT_LEAF_CACHE_GROUP_COUNT_X : 0u;
+        u_CbtLeafCacheDispatch[1] = CBT_LEAF_CACHE_GROUP_COUNT_Y;
+        u_CbtLeafCacheDispatch[2] = 1u;
+
+        if (blockCount > 0u)
+            u_CbtDirtyBlockEpoch+= 1u;
+    }
+}
+#endif
@@ -0,0 +1,52 @@
+/* CbtDirtyReduction.glsl - public domain
+
+    Recomputes the sum reduction of the dirty blocks of the CBTs, from the
+    bitfield up to the roots of the blocks. Each workgroup reduces one
+    block of the dirty list, one level at a time, whichever CBT it belongs
+    to. The levels above the
+    roots of the blocks are left to CbtSumReduction.glsl, which then only
+    has to start at the depth of the roots.
+
+    This code has dependencies on the following GLSL sources:
+    - cbt.glsl
+    - CbtDirtyBlocks.glsl
+*/
+
+#ifdef COMPUTE_SHADER
+#ifndef CBT_DIRTY_REDUCTION_GROUP_SIZE
+#   define CBT_DIRTY_REDUCTION_GROUP_SIZE 256
+#endif
+
+layout (local_size_x = CBT_DIRTY_REDUCTION_GROUP_SIZE,
+        local_size_y = 1,
+        local_size_z = 1) in;
+
+void main(void)
+{
+    int cbtID;
+    uint blockID;
+
+    cbtr_DecodeBlock(u_CbtDirtyBlockIDs[gl_WorkGroupID.x], cbtID, blockID);
+
+    int maxDepth = cbt_MaxDepth(cbtID);
+    int blockDepth = cbtr_BlockDepth(cbtID);
+    uint rootID = (1u << blockDepth) + blockID;
+    uint threadID = gl_LocalInvocationID.x;
+
+    for (int depth = maxDepth - 1; depth >= blockDepth; --depth) {
+        uint nodeCount = 1u << (depth - blockDepth);
+        uint firstID = rootID << (depth - blockDepth);
+
+        for (uint i = threadID; i < nodeCount; i+= CBT_DIRTY_REDUCTION_GROUP_SIZE) {
+            uint id = firstID + i;
+            uint x0 = cbt_HeapRead(cbtID, cbt_CreateNode(id << 1u     , depth + 1));
+            uint x1 = cbt_HeapRead(cbtID, cbt_CreateNode(id << 1u | 1u, depth + 1));
+
+            cbt__HeapWrite(cbtID, cbt_CreateNode(id, depth), x0 + x1);
+        }
+
+        memoryBarrierBuffer();
+        barrier();
+    }
+}
+#endif
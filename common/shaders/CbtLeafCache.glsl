@@ -0,0 +1,53 @@
+/* CbtLeafCache.glsl - public domain
+
+    Leaves of the CBTs, cached once per frame by CbtLeafCacheWriter.glsl
+    after the sum reduction. The passes that enumerate the leaves then read
+    one word per leaf instead of walking down the sum reduction tree with
+    cbt_DecodeNode. A leaf is stored as its heap index, the depth of a node
+    being that of the most significant bit of its index. The first
+    CBT_LEAF_CACHE_CAPACITY leaves of each CBT are cached; the others are
+    still decoded from the heap.
+
+    The cbt_DecodeNode function is redirected to cbtl_DecodeNode for the
+    code that follows this file (except in the writer), so it must be
+    included right after cbt.glsl. The cache remains valid until the next
+    split or merge pass.
+
+    This code has dependencies on the following GLSL sources:
+    - cbt.glsl
+*/
+
+#ifndef CBT_LEAF_CACHE_BUFFER_BINDING
+#   error User must specify the binding of the leaf cache buffer
+#endif
+#ifndef CBT_LEAF_CACHE_CAPACITY
+#   error User must specify the number of leaves cached per CBT
+#endif
+
+layout(std430, binding = CBT_LEAF_CACHE_BUFFER_BINDING)
+#ifndef CBT_LEAF_CACHE_WRITER
+readonly
+#endif
+buffer CbtLeafCacheBuffer {
+    uint u_CbtLeafIDs[];
+};
+
+uint cbtl__LeafCacheID(const int cbtID, uint leafID)
+{
+    return uint(cbtID) * uint(CBT_LEAF_CACHE_CAPACITY) + leafID;
+}
+
+cbt_Node cbtl_DecodeNode(const int cbtID, uint leafID)
+{
+    if (leafID < uint(CBT_LEAF_CACHE_CAPACITY)) {
+        uint id = u_CbtLeafIDs[cbtl__LeafCacheID(cbtID, leafID)];
+
+        return cbt_CreateNode(id, findMSB(id));
+    }
+
+    return cbt_DecodeNode(cbtID, leafID);
+}
+
+#ifndef CBT_LEAF_CACHE_WRITER
+#define cbt_DecodeNode cbtl_DecodeNode
+#endif
@@ -0,0 +1,28 @@
+/* CbtLeafCacheWriter.glsl - public domain
+
+    Writes the leaf cache of CbtLeafCache.glsl, which must be included with
+    CBT_LEAF_CACHE_WRITER defined. Workgroup row y writes the leaves of the
+    CBT y; the rows hold a fixed number of workgroups that stride over the
+    leaves, so the dispatch does not depend on the leaf count of the frame.
+
+    This code has dependencies on the following GLSL sources:
+    - cbt.glsl
+    - CbtLeafCache.glsl
+*/
+
+#ifdef COMPUTE_SHADER
+layout(local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
+
+void main()
+{
+    const int cbtID = int(gl_WorkGroupID.y);
+    uint leafCount = min(cbt_NodeCount(cbtID), uint(CBT_LEAF_CACHE_CAPACITY));
+    uint threadCount = gl_NumWorkGroups.x * gl_WorkGroupSize.x;
+
+    for (uint leafID = gl_GlobalInvocationID.x; leafID < leafCount; leafID+= threadCount) {
+        cbt_Node node = cbt_DecodeNode(cbtID, leafID);
+
+        u_CbtLeafIDs[cbtl__LeafCacheID(cbtID, leafID)] = node.id;
+    }
+}
+#endif
@@ -0,0 +1,63 @@
+/* CbtSumReduction.glsl - public domain
+
+    Computes CBT_SUM_REDUCTION_LEVEL_COUNT levels of the sum reduction of
+    every CBT of the heap buffers in a single dispatch. Each workgroup reads
+    2^CBT_SUM_REDUCTION_LEVEL_COUNT consecutive nodes at depth u_PassID and
+    sums them pairwise in shared memory, writing each level it computes to
+    the heap; a pass close to the root writes the levels down to depth 0
+    only. Workgroup row y reduces the CBT y, so a single dispatch reduces
+    all the trees. The workgroups of a tree are laid out along the x and z
+    axes, so that deep levels fit the limits of the dispatch size.
+
+    This code has dependencies on the following GLSL sources:
+    - cbt.glsl
+*/
+
+#ifdef COMPUTE_SHADER
+#ifndef CBT_SUM_REDUCTION_LEVEL_COUNT
+#   define CBT_SUM_REDUCTION_LEVEL_COUNT 8
+#endif
+#define CBT_SUM_REDUCTION_GROUP_SIZE (1 << CBT_SUM_REDUCTION_LEVEL_COUNT)
+
+uniform int u_PassID;
+
+layout (local_size_x = CBT_SUM_REDUCTION_GROUP_SIZE,
+        local_size_y = 1,
+        local_size_z = 1) in;
+
+shared uint s_NodeSums[CBT_SUM_REDUCTION_GROUP_SIZE];
+
+void main(void)
+{
+    const int cbtID = int(gl_WorkGroupID.y);
+    uint groupID = gl_WorkGroupID.x + gl_NumWorkGroups.x * gl_WorkGroupID.z;
+    uint threadID = gl_LocalInvocationID.x;
+    uint nodeID = groupID * uint(CBT_SUM_REDUCTION_GROUP_SIZE) + threadID;
+    uint nodeCount = 1u << u_PassID;
+    int levelCount = min(u_PassID, CBT_SUM_REDUCTION_LEVEL_COUNT);
+
+    s_NodeSums[threadID] = nodeID < nodeCount
+        ? cbt_HeapRead(cbtID, cbt_CreateNode(nodeCount + nodeID, u_PassID))
+        : 0u;
+    barrier();
+
+    for (int levelID = 1; levelID <= levelCount; ++levelID) {
+        uint cnt = uint(CBT_SUM_REDUCTION_GROUP_SIZE) >> levelID;
+        int depth = u_PassID - levelID;
+        uint x = 0u;
+
+        if (threadID < cnt)
+            x = s_NodeSums[2u * threadID] + s_NodeSums[2u * threadID + 1u];
+        barrier();
+
+        if (threadID < cnt) {
+            uint id = groupID * cnt + threadID;
+
+            s_NodeSums[threadID] = x;
+            if (id < (1u << depth))
+                cbt__HeapWrite(cbtID, cbt_CreateNode((1u << depth) + id, depth), x);
+        }
+        barrier();
+    }
+}
+#endif
@@ -0,0 +1,910 @@
+#ifndef LEBS_INCLUDE_LEBS_H
+#define LEBS_INCLUDE_LEBS_H
+
+#if defined(__AVX2__)
+#   include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#   include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#   include <arm_neon.h>
+#endif
+
+#include "CbtReduction.h"
+#include "CbtLeaves.h"
+#include "RefinementCriteria.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef LEBS_STATIC
+#define LEBSDEF static
+#else
+#define LEBSDEF extern
+#endif
+
+enum {MODE_TRIANGLE, MODE_SQUARE};
+
+typedef struct {
+    int32_t mode;
+    float target[2];
+    const lebc_Criteria *criteria;  // refines around the target if NULL
+} lebs_Params;
+
+typedef struct {
+    cbt_Node *nodes;
+    int64_t count, capacity;
+} lebs_Worklist;
+
+// state of the sparse update
+typedef struct {
+    lebs_Worklist worklists[2];     // pending split and merge candidates
+    lebs_Worklist scratch;
+    lebs_Params params;             // parameters of the previous update
+    int32_t fullSweepPeriod;        // frames between two full sweeps
+    int32_t frameCounts[2];         // frames since the last full sweep
+    bool isValid[2];                // false if the next pass must be a full sweep
+    int64_t visitedNodeCount;       // nodes visited by the last update
+} lebs_SparseState;
+
+// point-in-triangle test against the refinement target
+LEBSDEF bool lebs_IsInside(const float faceVertices[][3], const float target[2]);
+
+// single split (pingPong == 0) or merge (pingPong == 1) pass; the update
+// functions flag the blocks they modify in dirtyMap and reduce these only,
+// or reduce the whole heap if dirtyMap is NULL (see CbtReduction.h)
+LEBSDEF void lebs_Update(cbt_Tree *cbt,
+                         cbtr_DirtyMap *dirtyMap,
+                         const lebs_Params *params,
+                         int pingPong);
+
+// same as lebs_Update, but classifies the leaf nodes in SIMD batches
+LEBSDEF void lebs_UpdateBatched(cbt_Tree *cbt,
+                                cbtr_DirtyMap *dirtyMap,
+                                const lebs_Params *params,
+                                int pingPong);
+
+// sparse counterpart of lebs_Update: only the nodes that changed during the
+// previous pass of the same kind are visited, except every fullSweepPeriod
+// frames or whenever the parameters change, where all the leaves are visited
+LEBSDEF void lebs_SparseStateInit(lebs_SparseState *state, int32_t fullSweepPeriod);
+LEBSDEF void lebs_SparseStateRelease(lebs_SparseState *state);
+LEBSDEF void lebs_SparseStateInvalidate(lebs_SparseState *state);
+LEBSDEF void lebs_UpdateSparse(cbt_Tree *cbt,
+                               cbtr_DirtyMap *dirtyMap,
+                               const lebs_Params *params,
+                               int pingPong,
+                               lebs_SparseState *state);
+
+// runs split and merge passes until no split or merge is pending, or until
+// passBudget passes were run; returns true if the tree reached a fixed point
+LEBSDEF bool lebs_Converge(cbt_Tree *cbt,
+                           cbtr_DirtyMap *dirtyMap,
+                           const lebs_Params *params,
+                           int32_t passBudget,
+                           int32_t *passCount);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+//
+//
+//// end header file ///////////////////////////////////////////////////////////
+#endif // LEBS_INCLUDE_LEBS_H
+
+#ifdef LEBS_IMPLEMENTATION
+
+/*******************************************************************************
+ * Wedge -- 2D cross product
+ *
+ */
+static inline float lebs__Wedge(const float *a, const float *b)
+{
+    return a[0] * b[1] - a[1] * b[0];
+}
+
+
+/*******************************************************************************
+ * IsInside -- Checks whether the target lies within a counter-clockwise face
+ *
+ * The face vertices are stored as {{x1, x2, x3}, {y1, y2, y3}}, which is
+ * the layout produced by leb_DecodeNodeAttributeArray.
+ *
+ */
+LEBSDEF bool lebs_IsInside(const float faceVertices[][3], const float target[2])
+{
+    float v1[2] = {faceVertices[0][0], faceVertices[1][0]};
+    float v2[2] = {faceVertices[0][1], faceVertices[1][1]};
+    float v3[2] = {faceVertices[0][2], faceVertices[1][2]};
+    float x1[2] = {v2[0] - v1[0], v2[1] - v1[1]};
+    float x2[2] = {v3[0] - v2[0], v3[1] - v2[1]};
+    float x3[2] = {v1[0] - v3[0], v1[1] - v3[1]};
+    float y1[2] = {target[0] - v1[0], target[1] - v1[1]};
+    float y2[2] = {target[0] - v2[0], target[1] - v2[1]};
+    float y3[2] = {target[0] - v3[0], target[1] - v3[1]};
+    float w1 = lebs__Wedge(x1, y1);
+    float w2 = lebs__Wedge(x2, y2);
+    float w3 = lebs__Wedge(x3, y3);
+
+    return (w1 >= 0.0f) && (w2 >= 0.0f) && (w3 >= 0.0f);
+}
+
+
+/*******************************************************************************
+ * IsRefined -- Checks whether a face overlaps the refinement criteria
+ *
+ */
+static bool
+lebs__IsRefined(const lebs_Params *params, const float faceVertices[][3])
+{
+    if (params->criteria) {
+        return lebc_Intersects(params->criteria, faceVertices);
+    } else {
+        return lebs_IsInside(faceVertices, params->target);
+    }
+}
+
+
+/*******************************************************************************
+ * SplitNode -- Conforming split that flags the blocks it modifies
+ *
+ * This is leb_SplitNode (or leb_SplitNode_Square) with each split of the
+ * CBT going through cbtr_SplitNode, so that the dirty map sees the nodes
+ * that the split propagates to.
+ *
+ */
+static cbt_Node lebs__EdgeNeighbor(const cbt_Node node, int32_t mode)
+{
+    const leb_SameDepthNeighborIDs neighborIDs = mode == MODE_TRIANGLE
+                                               ? leb_DecodeSameDepthNeighborIDs(node)
+                                               : leb_DecodeSameDepthNeighborIDs_Square(node);
+
+    return cbt_CreateNode(neighborIDs.edge, node.depth);
+}
+
+static void
+lebs__SplitNode(
+    cbtr_DirtyMap *dirtyMap,
+    cbt_Tree *cbt,
+    const cbt_Node node,
+    int32_t mode
+) {
+    if (!cbt_IsCeilNode(cbt, node)) {
+        cbt_Node nodeIterator = node;
+
+        cbtr_SplitNode(dirtyMap, cbt, nodeIterator);
+        nodeIterator = lebs__EdgeNeighbor(nodeIterator, mode);
+
+        while (nodeIterator.id > 1u) {
+            cbtr_SplitNode(dirtyMap, cbt, nodeIterator);
+            nodeIterator = cbt_ParentNode(nodeIterator);
+
+            if (nodeIterator.id > 1u) {
+                cbtr_SplitNode(dirtyMap, cbt, nodeIterator);
+                nodeIterator = lebs__EdgeNeighbor(nodeIterator, mode);
+            }
+        }
+    }
+}
+
+
+/*******************************************************************************
+ * MergeNode -- Diamond merge that flags the block it modifies
+ *
+ * This is leb_MergeNode (or leb_MergeNode_Square) with the merge of the
+ * CBT going through cbtr_MergeNode. The node is merged only if both
+ * halves of its diamond parent have at most two leaves, i.e., if the
+ * merge keeps the subdivision conforming.
+ *
+ */
+static void
+lebs__MergeNode(
+    cbtr_DirtyMap *dirtyMap,
+    cbt_Tree *cbt,
+    const cbt_Node node,
+    const leb_DiamondParent diamondParent,
+    int32_t mode
+) {
+    const int64_t minDepth = mode == MODE_TRIANGLE ? 1 : 2;
+
+    if ((int64_t)node.depth >= minDepth
+        && cbt_HeapRead(cbt, diamondParent.base) <= 2u
+        && cbt_HeapRead(cbt, diamondParent.top) <= 2u) {
+        cbtr_MergeNode(dirtyMap, cbt, node);
+    }
+}
+
+
+/*******************************************************************************
+ * SplitCallback -- Splits the leaf nodes that contain the target
+ *
+ * The callbacks are invoked through cbtl_Update, and userData points to an
+ * lebs__Pass.
+ *
+ */
+typedef struct {
+    const lebs_Params *params;
+    cbtr_DirtyMap *dirtyMap;
+} lebs__Pass;
+
+static void
+lebs__SplitCallback(cbt_Tree *cbt, const cbt_Node node, const void *userData)
+{
+    const lebs__Pass *pass = (const lebs__Pass *)userData;
+    const lebs_Params *params = pass->params;
+    float faceVertices[][3] = {
+        {0.0f, 0.0f, 1.0f},
+        {1.0f, 0.0f, 0.0f}
+    };
+
+    if (params->mode == MODE_TRIANGLE) {
+        leb_DecodeNodeAttributeArray(node, 2, faceVertices);
+    } else {
+        leb_DecodeNodeAttributeArray_Square(node, 2, faceVertices);
+    }
+
+    if (lebs__IsRefined(params, faceVertices)) {
+        lebs__SplitNode(pass->dirtyMap, cbt, node, params->mode);
+    }
+}
+
+
+/*******************************************************************************
+ * MergeCallback -- Merges the diamonds that do not contain the target
+ *
+ */
+static void
+lebs__MergeCallback(cbt_Tree *cbt, const cbt_Node node, const void *userData)
+{
+    const lebs__Pass *pass = (const lebs__Pass *)userData;
+    const lebs_Params *params = pass->params;
+    float baseFaceVertices[][3] = {
+        {0.0f, 0.0f, 1.0f},
+        {1.0f, 0.0f, 0.0f}
+    };
+    float topFaceVertices[][3] = {
+        {0.0f, 0.0f, 1.0f},
+        {1.0f, 0.0f, 0.0f}
+    };
+    leb_DiamondParent diamondParent;
+
+    if (params->mode == MODE_TRIANGLE) {
+        diamondParent = leb_DecodeDiamondParent(node);
+        leb_DecodeNodeAttributeArray(diamondParent.base, 2, baseFaceVertices);
+        leb_DecodeNodeAttributeArray(diamondParent.top, 2, topFaceVertices);
+    } else {
+        diamondParent = leb_DecodeDiamondParent_Square(node);
+        leb_DecodeNodeAttributeArray_Square(diamondParent.base, 2, baseFaceVertices);
+        leb_DecodeNodeAttributeArray_Square(diamondParent.top, 2, topFaceVertices);
+    }
+
+    if (!lebs__IsRefined(params, baseFaceVertices)
+        && !lebs__IsRefined(params, topFaceVertices)) {
+        lebs__MergeNode(pass->dirtyMap, cbt, node, diamondParent, params->mode);
+    }
+}
+
+
+/*******************************************************************************
+ * Update -- Runs a split or a merge pass over the leaf nodes of the CBT
+ *
+ * The application alternates between both passes from one frame to the
+ * next (see UpdateSubdivision in subdivision.cpp). The leaf nodes are
+ * enumerated with cbtl_Update rather than decoded one by one.
+ *
+ */
+LEBSDEF void
+lebs_Update(
+    cbt_Tree *cbt,
+    cbtr_DirtyMap *dirtyMap,
+    const lebs_Params *params,
+    int pingPong
+) {
+    const lebs__Pass pass = {params, dirtyMap};
+
+    if (pingPong == 0) {
+        cbtl_Update(cbt, dirtyMap, &lebs__SplitCallback, &pass);
+    } else {
+        cbtl_Update(cbt, dirtyMap, &lebs__MergeCallback, &pass);
+    }
+}
+
+
+/*******************************************************************************
+ * Worklist -- Growable array of nodes
+ *
+ */
+static void lebs__WorklistPush(lebs_Worklist *worklist, const cbt_Node node)
+{
+    if (worklist->count == worklist->capacity) {
+        worklist->capacity = worklist->capacity > 0 ? 2 * worklist->capacity : 256;
+        worklist->nodes = (cbt_Node *)realloc(worklist->nodes,
+                                              sizeof(cbt_Node) * worklist->capacity);
+    }
+
+    worklist->nodes[worklist->count++] = node;
+}
+
+static void lebs__WorklistPushLeaves(lebs_Worklist *worklist, const cbt_Tree *cbt)
+{
+    const int64_t nodeCount = cbt_NodeCount(cbt);
+
+    if (worklist->capacity < nodeCount) {
+        worklist->capacity = nodeCount;
+        worklist->nodes = (cbt_Node *)realloc(worklist->nodes,
+                                              sizeof(cbt_Node) * worklist->capacity);
+    }
+
+    worklist->count = cbtl_DecodeLeaves(cbt, 0, nodeCount, worklist->nodes);
+}
+
+// pushes the leaf nodes of the subtree rooted at node
+static void
+lebs__WorklistPushSubtreeLeaves(
+    lebs_Worklist *worklist,
+    const cbt_Tree *cbt,
+    const cbt_Node node
+) {
+    if (cbt_HeapRead(cbt, node) == 1u) {
+        lebs__WorklistPush(worklist, node);
+    } else {
+        lebs__WorklistPushSubtreeLeaves(worklist, cbt, cbt_LeftChildNode(node));
+        lebs__WorklistPushSubtreeLeaves(worklist, cbt, cbt_RightChildNode(node));
+    }
+}
+
+
+// pushes a leaf node along with the leaves that share its diamond parent
+static void
+lebs__WorklistPushDiamondLeaves(
+    lebs_Worklist *worklist,
+    const cbt_Tree *cbt,
+    int32_t mode,
+    const cbt_Node leaf
+) {
+    lebs__WorklistPush(worklist, leaf);
+
+    if (leaf.depth > 1) {
+        const leb_DiamondParent diamond = mode == MODE_TRIANGLE
+                                        ? leb_DecodeDiamondParent(leaf)
+                                        : leb_DecodeDiamondParent_Square(leaf);
+        const cbt_Node nodes[3] = {
+            cbt_SiblingNode(leaf),
+            cbt_LeftChildNode(diamond.top),
+            cbt_RightChildNode(diamond.top)
+        };
+
+        for (int i = 0; i < 3; ++i)
+            if (cbt_HeapRead(cbt, nodes[i]) == 1u)
+                lebs__WorklistPush(worklist, nodes[i]);
+    }
+}
+
+static int lebs__CompareNodeIDs(const void *a, const void *b)
+{
+    const uint64_t id1 = ((const cbt_Node *)a)->id;
+    const uint64_t id2 = ((const cbt_Node *)b)->id;
+
+    return (id1 > id2) - (id1 < id2);
+}
+
+// removes the nodes that are no longer leaves; the heap stores the value 1
+// for a leaf and its left descendants, so the parent is checked as well
+static void
+lebs__WorklistRemoveStaleNodes(lebs_Worklist *worklist, const cbt_Tree *cbt)
+{
+    int64_t count = 0;
+
+    for (int64_t i = 0; i < worklist->count; ++i) {
+        const cbt_Node node = worklist->nodes[i];
+
+        if (cbt_HeapRead(cbt, node) == 1u
+            && (node.depth == 0 || cbt_HeapRead(cbt, cbt_ParentNode(node)) > 1u)) {
+            worklist->nodes[count++] = node;
+        }
+    }
+
+    worklist->count = count;
+}
+
+// sorts the nodes by ID and removes duplicates
+static void lebs__WorklistSortUnique(lebs_Worklist *worklist)
+{
+    int64_t count = 0;
+
+    qsort(worklist->nodes, worklist->count, sizeof(cbt_Node), &lebs__CompareNodeIDs);
+
+    for (int64_t i = 0; i < worklist->count; ++i)
+        if (count == 0 || worklist->nodes[count - 1].id != worklist->nodes[i].id)
+            worklist->nodes[count++] = worklist->nodes[i];
+
+    worklist->count = count;
+}
+
+
+/*******************************************************************************
+ * ConvergePass -- Runs a split or a merge pass over the nodes of a worklist
+ *
+ * Once the pass is done and the sum reduction is updated, the worklist is
+ * replaced by the nodes that may still need processing:
+ * - for a split pass, the leaves of the nodes that got split. Nodes that
+ * were split only to keep the subdivision conforming do not need another
+ * visit, since their children cannot overlap the criteria if their parent
+ * did not.
+ * - for a merge pass, the nodes that became leaves, along with the leaves
+ * that share their diamond parent. Both halves of a diamond must be visited
+ * during the same pass for the merge to go through.
+ *
+ */
+static void
+lebs__ConvergePass(
+    cbt_Tree *cbt,
+    cbtr_DirtyMap *dirtyMap,
+    const lebs_Params *params,
+    int pingPong,
+    lebs_Worklist *worklist,
+    lebs_Worklist *nextWorklist
+) {
+    const int64_t nodeCount = worklist->count;
+    const lebs__Pass pass = {params, dirtyMap};
+
+#pragma omp parallel for
+    for (int64_t i = 0; i < nodeCount; ++i) {
+        if (pingPong == 0) {
+            lebs__SplitCallback(cbt, worklist->nodes[i], &pass);
+        } else {
+            lebs__MergeCallback(cbt, worklist->nodes[i], &pass);
+        }
+    }
+
+    cbtr_UpdateSumReduction(dirtyMap, cbt);
+
+    nextWorklist->count = 0;
+    for (int64_t i = 0; i < nodeCount; ++i) {
+        const cbt_Node node = worklist->nodes[i];
+
+        if (pingPong == 0) {
+            if (cbt_HeapRead(cbt, node) > 1u)
+                lebs__WorklistPushSubtreeLeaves(nextWorklist, cbt, node);
+        } else if (node.depth > 0) {
+            const cbt_Node parent = cbt_ParentNode(node);
+
+            if (cbt_HeapRead(cbt, parent) == 1u)
+                lebs__WorklistPushDiamondLeaves(nextWorklist, cbt, params->mode, parent);
+        }
+    }
+
+    if (pingPong == 1)
+        lebs__WorklistSortUnique(nextWorklist);
+}
+
+
+/*******************************************************************************
+ * Converge -- Updates the subdivision until it reaches a fixed point
+ *
+ * Each round starts with a split pass over all the leaf nodes, followed by
+ * split passes restricted to the nodes that changed in the previous pass;
+ * merges proceed the same way. The tree has converged once a round runs
+ * its two full passes without modifying the tree.
+ *
+ */
+LEBSDEF bool
+lebs_Converge(
+    cbt_Tree *cbt,
+    cbtr_DirtyMap *dirtyMap,
+    const lebs_Params *params,
+    int32_t passBudget,
+    int32_t *passCount
+) {
+    lebs_Worklist worklists[2] = {{NULL, 0, 0}, {NULL, 0, 0}};
+    int32_t passID = 0;
+    bool isConverged = false;
+
+    while (!isConverged && passID < passBudget) {
+        bool isModified = false;
+
+        for (int pingPong = 0; pingPong < 2; ++pingPong) {
+            if (passID == passBudget) {
+                isModified = true;
+                break;
+            }
+
+            lebs__WorklistPushLeaves(&worklists[0], cbt);
+
+            while (worklists[0].count > 0 && passID < passBudget) {
+                lebs__ConvergePass(cbt,
+                                   dirtyMap,
+                                   params,
+                                   pingPong,
+                                   &worklists[0],
+                                   &worklists[1]);
+                isModified|= (worklists[1].count > 0);
+                ++passID;
+
+                lebs_Worklist tmp = worklists[0];
+                worklists[0] = worklists[1];
+                worklists[1] = tmp;
+            }
+
+            // the budget ran out before the pending nodes were processed
+            if (worklists[0].count > 0)
+                isModified = true;
+        }
+
+        isConverged = !isModified;
+    }
+
+    free(worklists[0].nodes);
+    free(worklists[1].nodes);
+
+    if (passCount)
+        *passCount = passID;
+
+    return isConverged;
+}
+
+
+/*******************************************************************************
+ * Sparse Update
+ *
+ * Once the subdivision has settled, the worklists run dry and an update
+ * boils down to comparing the parameters against the previous ones. The
+ * periodic full sweep guards against nodes that were missed by the
+ * worklists, e.g., when the tree is modified externally without calling
+ * lebs_SparseStateInvalidate.
+ *
+ */
+LEBSDEF void
+lebs_SparseStateInit(lebs_SparseState *state, int32_t fullSweepPeriod)
+{
+    memset(state, 0, sizeof(*state));
+    state->fullSweepPeriod = fullSweepPeriod;
+}
+
+LEBSDEF void lebs_SparseStateRelease(lebs_SparseState *state)
+{
+    free(state->worklists[0].nodes);
+    free(state->worklists[1].nodes);
+    free(state->scratch.nodes);
+    lebs_SparseStateInit(state, state->fullSweepPeriod);
+}
+
+LEBSDEF void lebs_SparseStateInvalidate(lebs_SparseState *state)
+{
+    state->isValid[0] = state->isValid[1] = false;
+}
+
+static bool
+lebs__ParamsEqual(const lebs_Params *params1, const lebs_Params *params2)
+{
+    return params1->mode == params2->mode
+        && params1->target[0] == params2->target[0]
+        && params1->target[1] == params2->target[1]
+        && params1->criteria == params2->criteria;
+}
+
+LEBSDEF void
+lebs_UpdateSparse(
+    cbt_Tree *cbt,
+    cbtr_DirtyMap *dirtyMap,
+    const lebs_Params *params,
+    int pingPong,
+    lebs_SparseState *state
+) {
+    lebs_Worklist *worklist = &state->worklists[pingPong];
+
+    if (!lebs__ParamsEqual(params, &state->params)) {
+        lebs_SparseStateInvalidate(state);
+        state->params = *params;
+    }
+
+    if (!state->isValid[pingPong]
+        || ++state->frameCounts[pingPong] >= state->fullSweepPeriod) {
+        lebs__WorklistPushLeaves(worklist, cbt);
+        state->frameCounts[pingPong] = 0;
+        state->isValid[pingPong] = true;
+    } else {
+        // the pass of the other kind may have modified the tree since
+        lebs__WorklistRemoveStaleNodes(worklist, cbt);
+    }
+
+    state->visitedNodeCount = worklist->count;
+
+    if (worklist->count > 0) {
+        lebs_Worklist tmp;
+
+        lebs__ConvergePass(cbt, dirtyMap, params, pingPong, worklist, &state->scratch);
+        tmp = *worklist;
+        *worklist = state->scratch;
+        state->scratch = tmp;
+    }
+}
+
+
+/*******************************************************************************
+ * Batched Update
+ *
+ * The leaf nodes are processed in batches of LEBS_BATCH_SIZE: their faces
+ * are first decoded into SoA arrays, then classified against the target
+ * with SIMD instructions (AVX2, SSE2 or NEON, depending on the target
+ * architecture), and the split/merge decisions are applied last.
+ *
+ */
+#ifndef LEBS_BATCH_SIZE
+#   define LEBS_BATCH_SIZE 256
+#endif
+
+typedef struct {
+    float x[3][LEBS_BATCH_SIZE];
+    float y[3][LEBS_BATCH_SIZE];
+} lebs__FaceBatch;
+
+
+/*******************************************************************************
+ * DecodeFace -- Decodes the face of a node into the i-th slot of a batch
+ *
+ */
+static void
+lebs__DecodeFace(const cbt_Node node, int32_t mode, lebs__FaceBatch *batch, int64_t i)
+{
+    float faceVertices[][3] = {
+        {0.0f, 0.0f, 1.0f},
+        {1.0f, 0.0f, 0.0f}
+    };
+
+    if (mode == MODE_TRIANGLE) {
+        leb_DecodeNodeAttributeArray(node, 2, faceVertices);
+    } else {
+        leb_DecodeNodeAttributeArray_Square(node, 2, faceVertices);
+    }
+
+    for (int j = 0; j < 3; ++j) {
+        batch->x[j][i] = faceVertices[0][j];
+        batch->y[j][i] = faceVertices[1][j];
+    }
+}
+
+
+/*******************************************************************************
+ * ClassifyBatch -- Vectorized counterpart of lebs_IsInside
+ *
+ * Writes 1 in isInside[i] if the target lies within the i-th face of the
+ * batch, and 0 otherwise.
+ *
+ */
+static void
+lebs__ClassifyBatch(
+    const lebs__FaceBatch *batch,
+    int64_t count,
+    const float target[2],
+    uint8_t *isInside
+) {
+    const float *x1 = batch->x[0], *x2 = batch->x[1], *x3 = batch->x[2];
+    const float *y1 = batch->y[0], *y2 = batch->y[1], *y3 = batch->y[2];
+    int64_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256 tx = _mm256_set1_ps(target[0]);
+    const __m256 ty = _mm256_set1_ps(target[1]);
+    const __m256 zero = _mm256_setzero_ps();
+
+    for (; i + 8 <= count; i+= 8) {
+        __m256 ax = _mm256_loadu_ps(&x1[i]), ay = _mm256_loadu_ps(&y1[i]);
+        __m256 bx = _mm256_loadu_ps(&x2[i]), by = _mm256_loadu_ps(&y2[i]);
+        __m256 cx = _mm256_loadu_ps(&x3[i]), cy = _mm256_loadu_ps(&y3[i]);
+        __m256 w1 = _mm256_sub_ps(
+            _mm256_mul_ps(_mm256_sub_ps(bx, ax), _mm256_sub_ps(ty, ay)),
+            _mm256_mul_ps(_mm256_sub_ps(by, ay), _mm256_sub_ps(tx, ax)));
+        __m256 w2 = _mm256_sub_ps(
+            _mm256_mul_ps(_mm256_sub_ps(cx, bx), _mm256_sub_ps(ty, by)),
+            _mm256_mul_ps(_mm256_sub_ps(cy, by), _mm256_sub_ps(tx, bx)));
+        __m256 w3 = _mm256_sub_ps(
+            _mm256_mul_ps(_mm256_sub_ps(ax, cx), _mm256_sub_ps(ty, cy)),
+            _mm256_mul_ps(_mm256_sub_ps(ay, cy), _mm256_sub_ps(tx, cx)));
+        __m256 mask = _mm256_and_ps(
+            _mm256_and_ps(_mm256_cmp_ps(w1, zero, _CMP_GE_OQ),
+                          _mm256_cmp_ps(w2, zero, _CMP_GE_OQ)),
+            _mm256_cmp_ps(w3, zero, _CMP_GE_OQ));
+        int bits = _mm256_movemask_ps(mask);
+
+        for (int j = 0; j < 8; ++j)
+            isInside[i + j] = (bits >> j) & 1;
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    const __m128 tx = _mm_set1_ps(target[0]);
+    const __m128 ty = _mm_set1_ps(target[1]);
+    const __m128 zero = _mm_setzero_ps();
+
+    for (; i + 4 <= count; i+= 4) {
+        __m128 ax = _mm_loadu_ps(&x1[i]), ay = _mm_loadu_ps(&y1[i]);
+        __m128 bx = _mm_loadu_ps(&x2[i]), by = _mm_loadu_ps(&y2[i]);
+        __m128 cx = _mm_loadu_ps(&x3[i]), cy = _mm_loadu_ps(&y3[i]);
+        __m128 w1 = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(bx, ax), _mm_sub_ps(ty, ay)),
+                               _mm_mul_ps(_mm_sub_ps(by, ay), _mm_sub_ps(tx, ax)));
+        __m128 w2 = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(cx, bx), _mm_sub_ps(ty, by)),
+                               _mm_mul_ps(_mm_sub_ps(cy, by), _mm_sub_ps(tx, bx)));
+        __m128 w3 = _mm_sub_ps(_mm_mul_ps(_mm_sub_ps(ax, cx), _mm_sub_ps(ty, cy)),
+                               _mm_mul_ps(_mm_sub_ps(ay, cy), _mm_sub_ps(tx, cx)));
+        __m128 mask = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(w1, zero),
+                                            _mm_cmpge_ps(w2, zero)),
+                                 _mm_cmpge_ps(w3, zero));
+        int bits = _mm_movemask_ps(mask);
+
+        for (int j = 0; j < 4; ++j)
+            isInside[i + j] = (bits >> j) & 1;
+    }
+#elif defined(__ARM_NEON)
+    const float32x4_t tx = vdupq_n_f32(target[0]);
+    const float32x4_t ty = vdupq_n_f32(target[1]);
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+
+    for (; i + 4 <= count; i+= 4) {
+        float32x4_t ax = vld1q_f32(&x1[i]), ay = vld1q_f32(&y1[i]);
+        float32x4_t bx = vld1q_f32(&x2[i]), by = vld1q_f32(&y2[i]);
+        float32x4_t cx = vld1q_f32(&x3[i]), cy = vld1q_f32(&y3[i]);
+        float32x4_t w1 = vsubq_f32(vmulq_f32(vsubq_f32(bx, ax), vsubq_f32(ty, ay)),
+                                   vmulq_f32(vsubq_f32(by, ay), vsubq_f32(tx, ax)));
+        float32x4_t w2 = vsubq_f32(vmulq_f32(vsubq_f32(cx, bx), vsubq_f32(ty, by)),
+                                   vmulq_f32(vsubq_f32(cy, by), vsubq_f32(tx, bx)));
+        float32x4_t w3 = vsubq_f32(vmulq_f32(vsubq_f32(ax, cx), vsubq_f32(ty, cy)),
+                                   vmulq_f32(vsubq_f32(ay, cy), vsubq_f32(tx, cx)));
+        uint32x4_t mask = vandq_u32(vandq_u32(vcgeq_f32(w1, zero),
+                                              vcgeq_f32(w2, zero)),
+                                    vcgeq_f32(w3, zero));
+
+        isInside[i + 0] = vgetq_lane_u32(mask, 0) & 1;
+        isInside[i + 1] = vgetq_lane_u32(mask, 1) & 1;
+        isInside[i + 2] = vgetq_lane_u32(mask, 2) & 1;
+        isInside[i + 3] = vgetq_lane_u32(mask, 3) & 1;
+    }
+#endif
+
+    // remainder
+    for (; i < count; ++i) {
+        float faceVertices[][3] = {
+            {x1[i], x2[i], x3[i]},
+            {y1[i], y2[i], y3[i]}
+        };
+
+        isInside[i] = lebs_IsInside(faceVertices, target) ? 1 : 0;
+    }
+}
+
+
+/*******************************************************************************
+ * ClassifyFaces -- Classifies a batch against the refinement criteria
+ *
+ * Only the single-target criterion is vectorized; other criteria are
+ * evaluated face by face.
+ *
+ */
+static void
+lebs__ClassifyFaces(
+    const lebs_Params *params,
+    const lebs__FaceBatch *batch,
+    int64_t count,
+    uint8_t *isRefined
+) {
+    if (params->criteria == NULL) {
+        lebs__ClassifyBatch(batch, count, params->target, isRefined);
+
+        return;
+    }
+
+    for (int64_t i = 0; i < count; ++i) {
+        float faceVertices[][3] = {
+            {batch->x[0][i], batch->x[1][i], batch->x[2][i]},
+            {batch->y[0][i], batch->y[1][i], batch->y[2][i]}
+        };
+
+        isRefined[i] = lebc_Intersects(params->criteria, faceVertices) ? 1 : 0;
+    }
+}
+
+
+/*******************************************************************************
+ * SplitBatch -- Splits the leaf nodes of a batch that contain the target
+ *
+ */
+static void
+lebs__SplitBatch(
+    cbt_Tree *cbt,
+    cbtr_DirtyMap *dirtyMap,
+    const lebs_Params *params,
+    int64_t firstHandle,
+    int64_t count
+) {
+    cbt_Node nodes[LEBS_BATCH_SIZE];
+    lebs__FaceBatch faces = {{{0.0f}}, {{0.0f}}};
+    uint8_t isInside[LEBS_BATCH_SIZE];
+
+    cbtl_DecodeLeaves(cbt, firstHandle, count, nodes);
+    for (int64_t i = 0; i < count; ++i)
+        lebs__DecodeFace(nodes[i], params->mode, &faces, i);
+
+    lebs__ClassifyFaces(params, &faces, count, isInside);
+
+    for (int64_t i = 0; i < count; ++i) {
+        if (isInside[i])
+            lebs__SplitNode(dirtyMap, cbt, nodes[i], params->mode);
+    }
+}
+
+
+/*******************************************************************************
+ * MergeBatch -- Merges the diamonds of a batch that do not contain the target
+ *
+ */
+static void
+lebs__MergeBatch(
+    cbt_Tree *cbt,
+    cbtr_DirtyMap *dirtyMap,
+    const lebs_Params *params,
+    int64_t firstHandle,
+    int64_t count
+) {
+    cbt_Node nodes[LEBS_BATCH_SIZE];
+    leb_DiamondParent diamonds[LEBS_BATCH_SIZE];
+    lebs__FaceBatch baseFaces = {{{0.0f}}, {{0.0f}}};
+    lebs__FaceBatch topFaces = {{{0.0f}}, {{0.0f}}};
+    uint8_t isInsideBase[LEBS_BATCH_SIZE], isInsideTop[LEBS_BATCH_SIZE];
+
+    cbtl_DecodeLeaves(cbt, firstHandle, count, nodes);
+    for (int64_t i = 0; i < count; ++i) {
+        if (params->mode == MODE_TRIANGLE) {
+            diamonds[i] = leb_DecodeDiamondParent(nodes[i]);
+        } else {
+            diamonds[i] = leb_DecodeDiamondParent_Square(nodes[i]);
+        }
+
+        lebs__DecodeFace(diamonds[i].base, params->mode, &baseFaces, i);
+        lebs__DecodeFace(diamonds[i].top, params->mode, &topFaces, i);
+    }
+
+    lebs__ClassifyFaces(params, &baseFaces, count, isInsideBase);
+    lebs__ClassifyFaces(params, &topFaces, count, isInsideTop);
+
+    for (int64_t i = 0; i < count; ++i) {
+        if (!isInsideBase[i] && !isInsideTop[i])
+            lebs__MergeNode(dirtyMap, cbt, nodes[i], diamonds[i], params->mode);
+    }
+}
+
+
+/*******************************************************************************
+ * UpdateBatched -- Batched counterpart of lebs_Update
+ *
+ * Like cbt_Update, the leaf nodes are decoded against the sum reduction
+ * of the previous frame and the reduction is recomputed at the end.
+ *
+ */
+LEBSDEF void
+lebs_UpdateBatched(
+    cbt_Tree *cbt,
+    cbtr_DirtyMap *dirtyMap,
+    const lebs_Params *params,
+    int pingPong
+) {
+    const int64_t nodeCount = cbt_NodeCount(cbt);
+    const int64_t batchCount = (nodeCount + LEBS_BATCH_SIZE - 1) / LEBS_BATCH_SIZE;
+
+#pragma omp parallel for
+    for (int64_t batchID = 0; batchID < batchCount; ++batchID) {
+        int64_t firstHandle = batchID * LEBS_BATCH_SIZE;
+        int64_t count = nodeCount - firstHandle;
+
+        if (count > LEBS_BATCH_SIZE)
+            count = LEBS_BATCH_SIZE;
+
+        if (pingPong == 0) {
+            lebs__SplitBatch(cbt, dirtyMap, params, firstHandle, count);
+        } else {
+            lebs__MergeBatch(cbt, dirtyMap, params, firstHandle, count);
+        }
+    }
+
+    cbtr_UpdateSumReduction(dirtyMap, cbt);
+}
+
+#endif // LEBS_IMPLEMENTATION
@@ -0,0 +1,669 @@
+#ifndef LEBC_INCLUDE_LEBC_H
+#define LEBC_INCLUDE_LEBC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef LEBC_STATIC
+#define LEBCDEF static
+#else
+#define LEBCDEF extern
+#endif
+
+enum {
+    LEBC_FEATURE_POINT,
+    LEBC_FEATURE_SEGMENT,
+    LEBC_FEATURE_DISC,
+    LEBC_FEATURE_POLYGON_EDGE
+};
+
+// feature record; matches the std430 layout of lebc_Feature in criteria.glsl
+typedef struct {
+    float data[4];          // point: {x, y}, disc: {x, y, r}, segment/edge: {x0, y0, x1, y1}
+    uint32_t type;
+    uint32_t padding[3];
+} lebc_Feature;
+
+// grid cell; matches the uvec2 layout of criteria.glsl
+typedef struct {
+    uint32_t offset;        // first entry in the index array
+    uint32_t count;         // bits 0-30: index count, bit 31: center lies in a polygon
+} lebc_Cell;
+
+typedef struct lebc_Criteria lebc_Criteria;
+
+// ctor / dtor
+LEBCDEF lebc_Criteria *lebc_Create();
+LEBCDEF void lebc_Release(lebc_Criteria *criteria);
+
+// features (coordinates are expressed in the unit square)
+LEBCDEF void lebc_Clear(lebc_Criteria *criteria);
+LEBCDEF void lebc_AddPoint(lebc_Criteria *criteria, float x, float y);
+LEBCDEF void lebc_AddSegment(lebc_Criteria *criteria,
+                             float x0, float y0,
+                             float x1, float y1);
+LEBCDEF void lebc_AddPolyline(lebc_Criteria *criteria,
+                              const float vertices[][2],
+                              int64_t vertexCount);
+LEBCDEF void lebc_AddDisc(lebc_Criteria *criteria, float x, float y, float radius);
+LEBCDEF void lebc_AddPolygon(lebc_Criteria *criteria,
+                             const float vertices[][2],
+                             int64_t vertexCount);
+
+// acceleration grid (a resolution <= 0 derives one from the feature count)
+LEBCDEF void lebc_Build(lebc_Criteria *criteria, int32_t gridResolution);
+
+// queries
+LEBCDEF bool lebc_Intersects(const lebc_Criteria *criteria,
+                             const float faceVertices[][3]);
+
+// accessors (e.g., for uploading to the GPU)
+LEBCDEF int64_t lebc_FeatureCount(const lebc_Criteria *criteria);
+LEBCDEF const lebc_Feature *lebc_GetFeatures(const lebc_Criteria *criteria);
+LEBCDEF int32_t lebc_GridResolution(const lebc_Criteria *criteria);
+LEBCDEF const lebc_Cell *lebc_GetCells(const lebc_Criteria *criteria);
+LEBCDEF int64_t lebc_IndexCount(const lebc_Criteria *criteria);
+LEBCDEF const uint32_t *lebc_GetIndices(const lebc_Criteria *criteria);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+//
+//
+//// end header file ///////////////////////////////////////////////////////////
+#endif // LEBC_INCLUDE_LEBC_H
+
+#ifdef LEBC_IMPLEMENTATION
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LEBC__CELL_INSIDE_BIT 0x80000000u
+#define LEBC__CELL_COUNT_MASK 0x7FFFFFFFu
+#define LEBC__MAX_GRID_RESOLUTION 512
+
+struct lebc_Criteria {
+    lebc_Feature *features;
+    int64_t featureCount, featureCapacity;
+    lebc_Cell *cells;
+    int32_t gridResolution;
+    uint32_t *indices;
+    int64_t indexCount;
+};
+
+
+/*******************************************************************************
+ * Create -- Allocates an empty set of refinement criteria
+ *
+ */
+LEBCDEF lebc_Criteria *lebc_Create()
+{
+    lebc_Criteria *criteria = (lebc_Criteria *)malloc(sizeof(*criteria));
+
+    criteria->features = NULL;
+    criteria->featureCount = 0;
+    criteria->featureCapacity = 0;
+    criteria->cells = NULL;
+    criteria->gridResolution = 0;
+    criteria->indices = NULL;
+    criteria->indexCount = 0;
+
+    return criteria;
+}
+
+
+/*******************************************************************************
+ * Release -- Releases the memory associated to a set of criteria
+ *
+ */
+LEBCDEF void lebc_Release(lebc_Criteria *criteria)
+{
+    free(criteria->features);
+    free(criteria->cells);
+    free(criteria->indices);
+    free(criteria);
+}
+
+
+/*******************************************************************************
+ * Clear -- Removes all features
+ *
+ * The acceleration grid is discarded as well; lebc_Build must be called
+ * again before querying.
+ *
+ */
+LEBCDEF void lebc_Clear(lebc_Criteria *criteria)
+{
+    free(criteria->cells);
+    free(criteria->indices);
+    criteria->featureCount = 0;
+    criteria->cells = NULL;
+    criteria->gridResolution = 0;
+    criteria->indices = NULL;
+    criteria->indexCount = 0;
+}
+
+
+/*******************************************************************************
+ * PushFeature -- Appends a feature to the feature array
+ *
+ */
+static void
+lebc__PushFeature(lebc_Criteria *criteria, uint32_t type, const float data[4])
+{
+    lebc_Feature *feature;
+
+    if (criteria->featureCount == criteria->featureCapacity) {
+        int64_t capacity = criteria->featureCapacity > 0
+                         ? 2 * criteria->featureCapacity
+                         : 64;
+
+        criteria->features = (lebc_Feature *)
+            realloc(criteria->features, capacity * sizeof(lebc_Feature));
+        criteria->featureCapacity = capacity;
+    }
+
+    feature = &criteria->features[criteria->featureCount++];
+    memcpy(feature->data, data, sizeof(feature->data));
+    feature->type = type;
+    feature->padding[0] = feature->padding[1] = feature->padding[2] = 0u;
+}
+
+
+/*******************************************************************************
+ * Feature Factories
+ *
+ * Polylines are stored as individual segments, and polygons as individual
+ * edges, so that each grid cell only references the pieces that overlap it.
+ * Polygons are filled with the even-odd rule, i.e., the region covered by an
+ * even number of polygons is considered outside.
+ *
+ */
+LEBCDEF void lebc_AddPoint(lebc_Criteria *criteria, float x, float y)
+{
+    const float data[4] = {x, y, 0.0f, 0.0f};
+
+    lebc__PushFeature(criteria, LEBC_FEATURE_POINT, data);
+}
+
+LEBCDEF void
+lebc_AddSegment(lebc_Criteria *criteria, float x0, float y0, float x1, float y1)
+{
+    const float data[4] = {x0, y0, x1, y1};
+
+    lebc__PushFeature(criteria, LEBC_FEATURE_SEGMENT, data);
+}
+
+LEBCDEF void
+lebc_AddPolyline(
+    lebc_Criteria *criteria,
+    const float vertices[][2],
+    int64_t vertexCount
+) {
+    for (int64_t i = 0; i + 1 < vertexCount; ++i) {
+        lebc_AddSegment(criteria,
+                        vertices[i    ][0], vertices[i    ][1],
+                        vertices[i + 1][0], vertices[i + 1][1]);
+    }
+}
+
+LEBCDEF void lebc_AddDisc(lebc_Criteria *criteria, float x, float y, float radius)
+{
+    const float data[4] = {x, y, radius, 0.0f};
+
+    lebc__PushFeature(criteria, LEBC_FEATURE_DISC, data);
+}
+
+LEBCDEF void
+lebc_AddPolygon(
+    lebc_Criteria *criteria,
+    const float vertices[][2],
+    int64_t vertexCount
+) {
+    for (int64_t i = 0; i < vertexCount && vertexCount >= 3; ++i) {
+        int64_t j = (i + 1) % vertexCount;
+        const float data[4] = {
+            vertices[i][0], vertices[i][1], vertices[j][0], vertices[j][1]
+        };
+
+        lebc__PushFeature(criteria, LEBC_FEATURE_POLYGON_EDGE, data);
+    }
+}
+
+
+/*******************************************************************************
+ * Geometric Predicates
+ *
+ */
+static inline float
+lebc__Orient(const float *a, const float *b, const float *c)
+{
+    return (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+}
+
+static bool lebc__PointInTriangle(const float *p, const float v[3][2])
+{
+    float w1 = lebc__Orient(v[0], v[1], p);
+    float w2 = lebc__Orient(v[1], v[2], p);
+    float w3 = lebc__Orient(v[2], v[0], p);
+
+    return (w1 >= 0.0f && w2 >= 0.0f && w3 >= 0.0f)
+        || (w1 <= 0.0f && w2 <= 0.0f && w3 <= 0.0f);
+}
+
+static bool
+lebc__SegmentsIntersect(const float *a, const float *b, const float *c, const float *d)
+{
+    float o1 = lebc__Orient(a, b, c);
+    float o2 = lebc__Orient(a, b, d);
+    float o3 = lebc__Orient(c, d, a);
+    float o4 = lebc__Orient(c, d, b);
+
+    return (o1 * o2 <= 0.0f) && (o3 * o4 <= 0.0f);
+}
+
+// strict crossing test, used for even-odd parity computations
+static bool
+lebc__SegmentsCross(const float *a, const float *b, const float *c, const float *d)
+{
+    float o1 = lebc__Orient(a, b, c);
+    float o2 = lebc__Orient(a, b, d);
+    float o3 = lebc__Orient(c, d, a);
+    float o4 = lebc__Orient(c, d, b);
+
+    return ((o1 > 0.0f) != (o2 > 0.0f)) && ((o3 > 0.0f) != (o4 > 0.0f));
+}
+
+static float
+lebc__PointSegmentSqrDistance(const float *p, const float *a, const float *b)
+{
+    float ab[2] = {b[0] - a[0], b[1] - a[1]};
+    float ap[2] = {p[0] - a[0], p[1] - a[1]};
+    float dd = ab[0] * ab[0] + ab[1] * ab[1];
+    float t = dd > 0.0f ? (ap[0] * ab[0] + ap[1] * ab[1]) / dd : 0.0f;
+    float d[2];
+
+    t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+    d[0] = ap[0] - t * ab[0];
+    d[1] = ap[1] - t * ab[1];
+
+    return d[0] * d[0] + d[1] * d[1];
+}
+
+static bool
+lebc__SegmentIntersectsTriangle(const float *a, const float *b, const float v[3][2])
+{
+    if (lebc__PointInTriangle(a, v) || lebc__PointInTriangle(b, v))
+        return true;
+
+    for (int i = 0; i < 3; ++i)
+        if (lebc__SegmentsIntersect(a, b, v[i], v[(i + 1) % 3]))
+            return true;
+
+    return false;
+}
+
+static bool
+lebc__FeatureIntersectsTriangle(const lebc_Feature *feature, const float v[3][2])
+{
+    const float *data = feature->data;
+
+    switch (feature->type) {
+    case LEBC_FEATURE_POINT:
+        return lebc__PointInTriangle(data, v);
+    case LEBC_FEATURE_SEGMENT:
+    case LEBC_FEATURE_POLYGON_EDGE:
+        return lebc__SegmentIntersectsTriangle(&data[0], &data[2], v);
+    case LEBC_FEATURE_DISC: {
+        float sqrRadius = data[2] * data[2];
+
+        if (lebc__PointInTriangle(data, v))
+            return true;
+
+        for (int i = 0; i < 3; ++i)
+            if (lebc__PointSegmentSqrDistance(data, v[i], v[(i + 1) % 3]) <= sqrRadius)
+                return true;
+
+        return false;
+    }
+    default:
+        return false;
+    }
+}
+
+
+/*******************************************************************************
+ * FeatureBounds -- Computes the bounding box of a feature
+ *
+ */
+static void
+lebc__FeatureBounds(const lebc_Feature *feature, float *bmin, float *bmax)
+{
+    const float *data = feature->data;
+
+    switch (feature->type) {
+    case LEBC_FEATURE_SEGMENT:
+    case LEBC_FEATURE_POLYGON_EDGE:
+        bmin[0] = fminf(data[0], data[2]); bmax[0] = fmaxf(data[0], data[2]);
+        bmin[1] = fminf(data[1], data[3]); bmax[1] = fmaxf(data[1], data[3]);
+        break;
+    case LEBC_FEATURE_DISC:
+        bmin[0] = data[0] - data[2]; bmax[0] = data[0] + data[2];
+        bmin[1] = data[1] - data[2]; bmax[1] = data[1] + data[2];
+        break;
+    default:
+        bmin[0] = bmax[0] = data[0];
+        bmin[1] = bmax[1] = data[1];
+        break;
+    }
+}
+
+
+/*******************************************************************************
+ * FeatureOverlapsBox -- Refines the bounding box test for segments and discs
+ *
+ */
+static bool
+lebc__FeatureOverlapsBox(const lebc_Feature *feature, const float *bmin, const float *bmax)
+{
+    const float *data = feature->data;
+
+    switch (feature->type) {
+    case LEBC_FEATURE_SEGMENT:
+    case LEBC_FEATURE_POLYGON_EDGE: {
+        // the box overlaps the supporting line if its corners straddle it
+        const float corners[4][2] = {
+            {bmin[0], bmin[1]}, {bmax[0], bmin[1]},
+            {bmin[0], bmax[1]}, {bmax[0], bmax[1]}
+        };
+        int positive = 0, negative = 0;
+
+        for (int i = 0; i < 4; ++i) {
+            float o = lebc__Orient(&data[0], &data[2], corners[i]);
+
+            positive+= (o >= 0.0f);
+            negative+= (o <= 0.0f);
+        }
+
+        return positive > 0 && negative > 0;
+    }
+    case LEBC_FEATURE_DISC: {
+        float dx = fmaxf(fmaxf(bmin[0] - data[0], 0.0f), data[0] - bmax[0]);
+        float dy = fmaxf(fmaxf(bmin[1] - data[1], 0.0f), data[1] - bmax[1]);
+
+        return dx * dx + dy * dy <= data[2] * data[2];
+    }
+    default:
+        return true;
+    }
+}
+
+
+/*******************************************************************************
+ * CellRange -- Computes the range of grid cells covered by a bounding box
+ *
+ * Returns false if the box lies outside of the unit square.
+ *
+ */
+static bool
+lebc__CellRange(
+    int32_t gridResolution,
+    const float *bmin,
+    const float *bmax,
+    int32_t *cmin,
+    int32_t *cmax
+) {
+    if (bmax[0] < 0.0f || bmax[1] < 0.0f || bmin[0] > 1.0f || bmin[1] > 1.0f)
+        return false;
+
+    for (int i = 0; i < 2; ++i) {
+        int32_t lo = (int32_t)floorf(bmin[i] * gridResolution);
+        int32_t hi = (int32_t)floorf(bmax[i] * gridResolution);
+
+        cmin[i] = lo < 0 ? 0 : (lo >= gridResolution ? gridResolution - 1 : lo);
+        cmax[i] = hi < 0 ? 0 : (hi >= gridResolution ? gridResolution - 1 : hi);
+    }
+
+    return true;
+}
+
+static void lebc__CellBounds(int32_t gridResolution, int32_t i, int32_t j,
+                             float *bmin, float *bmax)
+{
+    float cellSize = 1.0f / gridResolution;
+
+    bmin[0] = i * cellSize; bmax[0] = bmin[0] + cellSize;
+    bmin[1] = j * cellSize; bmax[1] = bmin[1] + cellSize;
+}
+
+
+/*******************************************************************************
+ * Build -- Bins the features into a uniform grid over the unit square
+ *
+ * Each cell stores the indices of the features that overlap it, as well as
+ * whether its center lies inside the polygons. The latter is computed with
+ * one horizontal scanline per row of cells.
+ *
+ */
+static int lebc__CompareFloats(const void *a, const void *b)
+{
+    float x = *(const float *)a, y = *(const float *)b;
+
+    return (x > y) - (x < y);
+}
+
+LEBCDEF void lebc_Build(lebc_Criteria *criteria, int32_t gridResolution)
+{
+    const lebc_Feature *features = criteria->features;
+    int64_t featureCount = criteria->featureCount;
+    int64_t cellCount, indexCount = 0;
+    uint32_t *cursors;
+    float *crossings;
+
+    if (gridResolution <= 0) {
+        gridResolution = (int32_t)ceilf(sqrtf((float)featureCount));
+        gridResolution = gridResolution < 1 ? 1 : gridResolution;
+    }
+    if (gridResolution > LEBC__MAX_GRID_RESOLUTION)
+        gridResolution = LEBC__MAX_GRID_RESOLUTION;
+
+    cellCount = (int64_t)gridResolution * gridResolution;
+    free(criteria->cells);
+    free(criteria->indices);
+    criteria->gridResolution = gridResolution;
+    criteria->cells = (lebc_Cell *)calloc(cellCount, sizeof(lebc_Cell));
+    cursors = (uint32_t *)calloc(cellCount, sizeof(uint32_t));
+
+    // count the features of each cell, then fill the index array
+    for (int pass = 0; pass < 2; ++pass) {
+        for (int64_t featureID = 0; featureID < featureCount; ++featureID) {
+            const lebc_Feature *feature = &features[featureID];
+            float bmin[2], bmax[2];
+            int32_t cmin[2], cmax[2];
+
+            lebc__FeatureBounds(feature, bmin, bmax);
+            if (!lebc__CellRange(gridResolution, bmin, bmax, cmin, cmax))
+                continue;
+
+            for (int32_t j = cmin[1]; j <= cmax[1]; ++j)
+            for (int32_t i = cmin[0]; i <= cmax[0]; ++i) {
+                int64_t cellID = (int64_t)j * gridResolution + i;
+
+                lebc__CellBounds(gridResolution, i, j, bmin, bmax);
+                if (!lebc__FeatureOverlapsBox(feature, bmin, bmax))
+                    continue;
+
+                if (pass == 0) {
+                    ++criteria->cells[cellID].count;
+                } else {
+                    uint32_t offset = criteria->cells[cellID].offset;
+
+                    criteria->indices[offset + cursors[cellID]++] = (uint32_t)featureID;
+                }
+            }
+        }
+
+        if (pass == 0) {
+            for (int64_t cellID = 0; cellID < cellCount; ++cellID) {
+                criteria->cells[cellID].offset = (uint32_t)indexCount;
+                indexCount+= criteria->cells[cellID].count;
+            }
+            criteria->indices = (uint32_t *)malloc((indexCount > 0 ? indexCount : 1)
+                                                   * sizeof(uint32_t));
+            criteria->indexCount = indexCount;
+        }
+    }
+
+    // even-odd classification of the cell centers
+    crossings = (float *)malloc((featureCount > 0 ? featureCount : 1) * sizeof(float));
+    for (int32_t j = 0; j < gridResolution; ++j) {
+        float y = (j + 0.5f) / gridResolution;
+        int64_t crossingCount = 0, crossingID = 0;
+
+        for (int64_t featureID = 0; featureID < featureCount; ++featureID) {
+            const float *data = features[featureID].data;
+
+            if (features[featureID].type != LEBC_FEATURE_POLYGON_EDGE)
+                continue;
+
+            if ((data[1] > y) != (data[3] > y)) {
+                float t = (y - data[1]) / (data[3] - data[1]);
+
+                crossings[crossingCount++] = data[0] + t * (data[2] - data[0]);
+            }
+        }
+        qsort(crossings, crossingCount, sizeof(float), &lebc__CompareFloats);
+
+        for (int32_t i = 0; i < gridResolution; ++i) {
+            float x = (i + 0.5f) / gridResolution;
+            lebc_Cell *cell = &criteria->cells[(int64_t)j * gridResolution + i];
+
+            while (crossingID < crossingCount && crossings[crossingID] < x)
+                ++crossingID;
+
+            if (crossingID & 1)
+                cell->count|= LEBC__CELL_INSIDE_BIT;
+        }
+    }
+
+    free(crossings);
+    free(cursors);
+}
+
+
+/*******************************************************************************
+ * Intersects -- Checks whether a face overlaps any of the features
+ *
+ * A face that does not intersect any polygon edge lies either completely
+ * inside or completely outside the polygons; this is resolved by flipping
+ * the classification of the center of the cell containing the centroid of
+ * the face for each polygon edge that separates the two points. These edges
+ * necessarily overlap the cell, so the per-node cost only depends on the
+ * number of features referenced by the cells that the face covers.
+ *
+ */
+LEBCDEF bool
+lebc_Intersects(const lebc_Criteria *criteria, const float faceVertices[][3])
+{
+    const int32_t gridResolution = criteria->gridResolution;
+    const float v[3][2] = {
+        {faceVertices[0][0], faceVertices[1][0]},
+        {faceVertices[0][1], faceVertices[1][1]},
+        {faceVertices[0][2], faceVertices[1][2]}
+    };
+    float bmin[2], bmax[2], centroid[2], center[2];
+    int32_t cmin[2], cmax[2];
+    const lebc_Cell *centroidCell;
+    bool isInside;
+
+    if (gridResolution == 0)
+        return false;
+
+    bmin[0] = fminf(fminf(v[0][0], v[1][0]), v[2][0]);
+    bmin[1] = fminf(fminf(v[0][1], v[1][1]), v[2][1]);
+    bmax[0] = fmaxf(fmaxf(v[0][0], v[1][0]), v[2][0]);
+    bmax[1] = fmaxf(fmaxf(v[0][1], v[1][1]), v[2][1]);
+    if (!lebc__CellRange(gridResolution, bmin, bmax, cmin, cmax))
+        return false;
+
+    for (int32_t j = cmin[1]; j <= cmax[1]; ++j)
+    for (int32_t i = cmin[0]; i <= cmax[0]; ++i) {
+        const lebc_Cell *cell = &criteria->cells[(int64_t)j * gridResolution + i];
+        uint32_t count = cell->count & LEBC__CELL_COUNT_MASK;
+
+        for (uint32_t k = 0; k < count; ++k) {
+            const lebc_Feature *feature =
+                &criteria->features[criteria->indices[cell->offset + k]];
+
+            if (lebc__FeatureIntersectsTriangle(feature, v))
+                return true;
+        }
+    }
+
+    // polygon interiors
+    centroid[0] = (v[0][0] + v[1][0] + v[2][0]) / 3.0f;
+    centroid[1] = (v[0][1] + v[1][1] + v[2][1]) / 3.0f;
+    bmin[0] = bmax[0] = centroid[0];
+    bmin[1] = bmax[1] = centroid[1];
+    lebc__CellRange(gridResolution, bmin, bmax, cmin, cmax);
+    centroidCell = &criteria->cells[(int64_t)cmin[1] * gridResolution + cmin[0]];
+    center[0] = (cmin[0] + 0.5f) / gridResolution;
+    center[1] = (cmin[1] + 0.5f) / gridResolution;
+    isInside = (centroidCell->count & LEBC__CELL_INSIDE_BIT) != 0u;
+
+    for (uint32_t k = 0; k < (centroidCell->count & LEBC__CELL_COUNT_MASK); ++k) {
+        const lebc_Feature *feature =
+            &criteria->features[criteria->indices[centroidCell->offset + k]];
+
+        if (feature->type == LEBC_FEATURE_POLYGON_EDGE
+            && lebc__SegmentsCross(centroid, center, &feature->data[0], &feature->data[2])) {
+            isInside = !isInside;
+        }
+    }
+
+    return isInside;
+}
+
+
+/*******************************************************************************
+ * Accessors
+ *
+ */
+LEBCDEF int64_t lebc_FeatureCount(const lebc_Criteria *criteria)
+{
+    return criteria->featureCount;
+}
+
+LEBCDEF const lebc_Feature *lebc_GetFeatures(const lebc_Criteria *criteria)
+{
+    return criteria->features;
+}
+
+LEBCDEF int32_t lebc_GridResolution(const lebc_Criteria *criteria)
+{
+    return criteria->gridResolution;
+}
+
+LEBCDEF const lebc_Cell *lebc_GetCells(const lebc_Criteria *criteria)
+{
+    return criteria->cells;
+}
+
+LEBCDEF int64_t lebc_IndexCount(const lebc_Criteria *criteria)
+{
+    return criteria->indexCount;
+}
+
+LEBCDEF const uint32_t *lebc_GetIndices(const lebc_Criteria *criteria)
+{
+    return criteria->indices;
+}
+
+#undef LEBC__CELL_INSIDE_BIT
+#undef LEBC__CELL_COUNT_MASK
+#undef LEBC__MAX_GRID_RESOLUTION
+
+#endif // LEBC_IMPLEMENTATION
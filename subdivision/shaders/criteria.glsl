@@ -0,0 +1,167 @@
+// GLSL counterpart of lebc_Intersects (see RefinementCriteria.h)
+#ifndef LEBC_FEATURE_BUFFER_BINDING
+#   error Unspecified Feature Buffer Binding
+#endif
+#ifndef LEBC_CELL_BUFFER_BINDING
+#   error Unspecified Cell Buffer Binding
+#endif
+#ifndef LEBC_INDEX_BUFFER_BINDING
+#   error Unspecified Index Buffer Binding
+#endif
+
+#define LEBC_FEATURE_POINT          0u
+#define LEBC_FEATURE_SEGMENT        1u
+#define LEBC_FEATURE_DISC           2u
+#define LEBC_FEATURE_POLYGON_EDGE   3u
+#define LEBC_CELL_INSIDE_BIT        0x80000000u
+#define LEBC_CELL_COUNT_MASK        0x7FFFFFFFu
+
+struct lebc_Feature {
+    vec4 data;
+    uint type;
+};
+
+layout(std430, binding = LEBC_FEATURE_BUFFER_BINDING)
+readonly buffer lebc_FeatureBuffer {
+    lebc_Feature u_LebcFeatures[];
+};
+
+layout(std430, binding = LEBC_CELL_BUFFER_BINDING)
+readonly buffer lebc_CellBuffer {
+    uvec2 u_LebcCells[];
+};
+
+layout(std430, binding = LEBC_INDEX_BUFFER_BINDING)
+readonly buffer lebc_IndexBuffer {
+    uint u_LebcIndices[];
+};
+
+uniform int u_LebcGridResolution;
+
+float lebc_Orient(vec2 a, vec2 b, vec2 c)
+{
+    return (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x);
+}
+
+bool lebc_PointInTriangle(vec2 p, vec2 v[3])
+{
+    vec3 w = vec3(lebc_Orient(v[0], v[1], p),
+                  lebc_Orient(v[1], v[2], p),
+                  lebc_Orient(v[2], v[0], p));
+
+    return all(greaterThanEqual(w, vec3(0.0f)))
+        || all(lessThanEqual(w, vec3(0.0f)));
+}
+
+bool lebc_SegmentsIntersect(vec2 a, vec2 b, vec2 c, vec2 d)
+{
+    float o1 = lebc_Orient(a, b, c);
+    float o2 = lebc_Orient(a, b, d);
+    float o3 = lebc_Orient(c, d, a);
+    float o4 = lebc_Orient(c, d, b);
+
+    return (o1 * o2 <= 0.0f) && (o3 * o4 <= 0.0f);
+}
+
+bool lebc_SegmentsCross(vec2 a, vec2 b, vec2 c, vec2 d)
+{
+    float o1 = lebc_Orient(a, b, c);
+    float o2 = lebc_Orient(a, b, d);
+    float o3 = lebc_Orient(c, d, a);
+    float o4 = lebc_Orient(c, d, b);
+
+    return ((o1 > 0.0f) != (o2 > 0.0f)) && ((o3 > 0.0f) != (o4 > 0.0f));
+}
+
+float lebc_PointSegmentSqrDistance(vec2 p, vec2 a, vec2 b)
+{
+    vec2 ab = b - a, ap = p - a;
+    float dd = dot(ab, ab);
+    float t = dd > 0.0f ? clamp(dot(ap, ab) / dd, 0.0f, 1.0f) : 0.0f;
+    vec2 d = ap - t * ab;
+
+    return dot(d, d);
+}
+
+bool lebc_SegmentIntersectsTriangle(vec2 a, vec2 b, vec2 v[3])
+{
+    if (lebc_PointInTriangle(a, v) || lebc_PointInTriangle(b, v))
+        return true;
+
+    for (int i = 0; i < 3; ++i)
+        if (lebc_SegmentsIntersect(a, b, v[i], v[(i + 1) % 3]))
+            return true;
+
+    return false;
+}
+
+bool lebc_FeatureIntersectsTriangle(lebc_Feature feature, vec2 v[3])
+{
+    vec4 data = feature.data;
+
+    if (feature.type == LEBC_FEATURE_POINT) {
+        return lebc_PointInTriangle(data.xy, v);
+    } else if (feature.type == LEBC_FEATURE_DISC) {
+        float sqrRadius = data.z * data.z;
+
+        if (lebc_PointInTriangle(data.xy, v))
+            return true;
+
+        for (int i = 0; i < 3; ++i)
+            if (lebc_PointSegmentSqrDistance(data.xy, v[i], v[(i + 1) % 3]) <= sqrRadius)
+                return true;
+
+        return false;
+    }
+
+    return lebc_SegmentIntersectsTriangle(data.xy, data.zw, v);
+}
+
+bool lebc_Intersects(mat2x3 faceVertices)
+{
+    const int res = u_LebcGridResolution;
+    vec2 v[3] = vec2[3](
+        vec2(faceVertices[0][0], faceVertices[1][0]),
+        vec2(faceVertices[0][1], faceVertices[1][1]),
+        vec2(faceVertices[0][2], faceVertices[1][2])
+    );
+    vec2 bmin = min(min(v[0], v[1]), v[2]);
+    vec2 bmax = max(max(v[0], v[1]), v[2]);
+
+    if (res == 0 || any(lessThan(bmax, vec2(0.0f))) || any(greaterThan(bmin, vec2(1.0f))))
+        return false;
+
+    ivec2 cmin = clamp(ivec2(floor(bmin * float(res))), ivec2(0), ivec2(res - 1));
+    ivec2 cmax = clamp(ivec2(floor(bmax * float(res))), ivec2(0), ivec2(res - 1));
+
+    for (int j = cmin.y; j <= cmax.y; ++j)
+    for (int i = cmin.x; i <= cmax.x; ++i) {
+        uvec2 cell = u_LebcCells[j * res + i];
+        uint count = cell.y & LEBC_CELL_COUNT_MASK;
+
+        for (uint k = 0u; k < count; ++k) {
+            lebc_Feature feature = u_LebcFeatures[u_LebcIndices[cell.x + k]];
+
+            if (lebc_FeatureIntersectsTriangle(feature, v))
+                return true;
+        }
+    }
+
+    // polygon interiors
+    vec2 centroid = (v[0] + v[1] + v[2]) / 3.0f;
+    ivec2 c = clamp(ivec2(floor(centroid * float(res))), ivec2(0), ivec2(res - 1));
+    vec2 center = (vec2(c) + 0.5f) / float(res);
+    uvec2 cell = u_LebcCells[c.y * res + c.x];
+    bool isInside = (cell.y & LEBC_CELL_INSIDE_BIT) != 0u;
+
+    for (uint k = 0u; k < (cell.y & LEBC_CELL_COUNT_MASK); ++k) {
+        lebc_Feature feature = u_LebcFeatures[u_LebcIndices[cell.x + k]];
+
+        if (feature.type == LEBC_FEATURE_POLYGON_EDGE
+            && lebc_SegmentsCross(centroid, center, feature.data.xy, feature.data.zw)) {
+            isInside = !isInside;
+        }
+    }
+
+    return isInside;
+}
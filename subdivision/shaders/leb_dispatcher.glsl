@@ -11,5 +11,11 @@ void main()
     const int cbtID = u_CbtID;
     uint nodeCount = cbt_NodeCount(cbtID);
 
+#ifdef LEB_WELD_TRIANGLE_CAPACITY
+    // the welded draw takes over while the leaves fit in its buffers
+    u_DrawArraysIndirectBuffer[0] = nodeCount > uint(LEB_WELD_TRIANGLE_CAPACITY) ? 3u : 0u;
+#else
+    u_DrawArraysIndirectBuffer[0] = 3u;
+#endif
     u_DrawArraysIndirectBuffer[1] = nodeCount;
 }
@@ -1,4 +1,4 @@
-// requires cbt.glsl and leb.glsl
+// requires cbt.glsl and leb.glsl (and criteria.glsl if FLAG_CRITERIA is set)
 #ifndef CBT_LOCAL_SIZE_X
 #   define CBT_LOCAL_SIZE_X 256
 #endif
@@ -28,6 +28,15 @@ bool IsInside(mat2x3 faceVertices)
     return all(wb);
 }
 
+bool IsRefined(mat2x3 faceVertices)
+{
+#if FLAG_CRITERIA
+    return lebc_Intersects(faceVertices);
+#else
+    return IsInside(faceVertices);
+#endif
+}
+
 mat2x3 DecodeFaceVertices(cbt_Node node)
 {
     mat2x3 faceVertices = mat2x3(vec3(0, 0, 1), vec3(1, 0, 0));
@@ -52,7 +61,7 @@ void main()
 #if FLAG_SPLIT
         mat2x3 faceVertices = DecodeFaceVertices(node);
 
-        if (IsInside(faceVertices)) {
+        if (IsRefined(faceVertices)) {
 #if defined(MODE_TRIANGLE)
             leb_SplitNode(cbtID, node);
 #elif defined(MODE_SQUARE)
@@ -70,7 +79,7 @@ void main()
         mat2x3 baseFaceVertices = DecodeFaceVertices(diamondParent.base);
         mat2x3 topFaceVertices = DecodeFaceVertices(diamondParent.top);
 
-        if (!IsInside(baseFaceVertices) && !IsInside(topFaceVertices)) {
+        if (!IsRefined(baseFaceVertices) && !IsRefined(topFaceVertices)) {
 #if defined(MODE_TRIANGLE)
             leb_MergeNode(cbtID, node, diamondParent);
 #elif defined(MODE_SQUARE)
@@ -1,4 +1,17 @@
 #ifdef VERTEX_SHADER
+#if FLAG_WELDED
+layout(std430, binding = LEB_WELD_VERTEX_BUFFER_BINDING)
+readonly buffer LebWeldVertexBuffer {
+    vec2 u_LebWeldVertices[];
+};
+
+void main()
+{
+    vec2 pos = u_LebWeldVertices[gl_VertexID];
+
+    gl_Position = vec4((2.0 * pos - 1.0), 0.0, 1.0);
+}
+#else
 void main()
 {
     cbt_Node node = cbt_DecodeNode(0, gl_InstanceID);
@@ -13,6 +26,7 @@ void main()
     gl_Position = vec4((2.0 * pos - 1.0), 0.0, 1.0);
 }
 #endif
+#endif
 
 #ifdef GEOMETRY_SHADER
 layout (triangles) in;
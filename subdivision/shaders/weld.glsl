@@ -0,0 +1,195 @@
+// requires cbt.glsl and leb.glsl
+//
+// Builds a welded vertex and index buffer from the leaves, so that the
+// triangles that share a vertex also share its index. A vertex other than
+// a corner of the unit square is the midpoint of the longest edge of the
+// node whose split created it; it is keyed by the smallest heap index of
+// that node and of its edge neighbor, which both create it. The first
+// thread that inserts a key in the vertex table owns the vertex: it
+// allocates its index and writes its position (FLAG_VERTICES). A second
+// pass reads the index of the vertices of each leaf back from the table
+// (FLAG_INDICES).
+#ifndef LEB_WELD_TRIANGLE_CAPACITY
+#   error User must specify the number of leaves that may be welded
+#endif
+#ifndef LEB_WELD_VERTEX_CAPACITY
+#   error User must specify the size of the vertex buffer
+#endif
+#ifndef LEB_WELD_TABLE_SIZE
+#   error User must specify the size (a power of two) of the vertex table
+#endif
+
+uniform int u_CbtID = 0;
+
+layout(local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
+
+// vertex keys in [0, LEB_WELD_TABLE_SIZE), vertex indices after
+layout(std430, binding = LEB_WELD_TABLE_BUFFER_BINDING)
+buffer LebWeldTableBuffer {
+    uint u_LebWeldTable[];
+};
+
+layout(std430, binding = LEB_WELD_VERTEX_BUFFER_BINDING)
+buffer LebWeldVertexBuffer {
+    vec2 u_LebWeldVertices[];
+};
+
+layout(std430, binding = LEB_WELD_INDEX_BUFFER_BINDING)
+buffer LebWeldIndexBuffer {
+    uint u_LebWeldIndices[];
+};
+
+// DrawElementsIndirectCommand followed by the vertex count
+layout(std430, binding = LEB_WELD_DRAW_BUFFER_BINDING)
+buffer LebWeldDrawBuffer {
+    uint u_LebWeldDraw[];
+};
+
+#define LEB_WELD_EMPTY_KEY  0u
+#define LEB_WELD_CORNER_KEY 0x80000000u
+
+mat2x3 DecodeFaceVertices(cbt_Node node)
+{
+    mat2x3 faceVertices = mat2x3(vec3(0, 0, 1), vec3(1, 0, 0));
+
+#if defined(MODE_TRIANGLE)
+    faceVertices = leb_DecodeNodeAttributeArray       (node, faceVertices);
+#elif defined(MODE_SQUARE)
+    faceVertices = leb_DecodeNodeAttributeArray_Square(node, faceVertices);
+#endif
+
+    return faceVertices;
+}
+
+/**
+ * Returns the heap index of the nodes whose split created the vertices of
+ * a node, or 0 for the vertices of the root triangles. The vertex that a
+ * split creates is the one the splitting matrix averages; the others are
+ * copied from the parent.
+ */
+uvec3 DecodeVertexCreators(cbt_Node node)
+{
+    uvec3 creators = uvec3(0u);
+#if defined(MODE_SQUARE)
+    int minDepth = 1;
+#else
+    int minDepth = 0;
+#endif
+
+    for (int bitID = node.depth - minDepth - 1; bitID >= 0; --bitID) {
+        mat3 splitMatrix = leb__SplittingMatrix(leb__GetBitValue(node.id, bitID));
+        uint parentID = node.id >> (bitID + 1);
+        uvec3 childCreators = uvec3(parentID);
+
+        for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 3; ++j) {
+            if (splitMatrix[j][i] == 1.0f)
+                childCreators[i] = creators[j];
+        }
+
+        creators = childCreators;
+    }
+
+    return creators;
+}
+
+uint VertexKey(uint creatorID, vec2 vertex)
+{
+    if (creatorID == 0u) {
+        uvec2 corner = uvec2(round(vertex));
+
+        return LEB_WELD_CORNER_KEY | corner.x | (corner.y << 1);
+    }
+
+    cbt_Node creator = cbt_CreateNode(creatorID, findMSB(creatorID));
+#if defined(MODE_SQUARE)
+    uint edgeID = leb_DecodeSameDepthNeighborIDs_Square(creator).edge;
+#else
+    uint edgeID = leb_DecodeSameDepthNeighborIDs(creator).edge;
+#endif
+
+    return edgeID == 0u ? creatorID : min(creatorID, edgeID);
+}
+
+uint VertexTableSlot(uint key)
+{
+    key^= key >> 16;
+    key*= 0x7feb352du;
+    key^= key >> 15;
+    key*= 0x846ca68bu;
+    key^= key >> 16;
+
+    return key & uint(LEB_WELD_TABLE_SIZE - 1);
+}
+
+#if FLAG_VERTICES
+void InsertVertex(uint key, vec2 vertex)
+{
+    uint slot = VertexTableSlot(key);
+
+    for (int i = 0; i < LEB_WELD_TABLE_SIZE; ++i) {
+        uint slotKey = atomicCompSwap(u_LebWeldTable[slot], LEB_WELD_EMPTY_KEY, key);
+
+        if (slotKey == LEB_WELD_EMPTY_KEY) {
+            uint vertexID = atomicAdd(u_LebWeldDraw[5], 1u);
+
+            if (vertexID < uint(LEB_WELD_VERTEX_CAPACITY))
+                u_LebWeldVertices[vertexID] = vertex;
+            u_LebWeldTable[LEB_WELD_TABLE_SIZE + slot] = vertexID;
+
+            return;
+        } else if (slotKey == key) {
+            return;
+        }
+
+        slot = (slot + 1u) & uint(LEB_WELD_TABLE_SIZE - 1);
+    }
+}
+#elif FLAG_INDICES
+uint FindVertex(uint key)
+{
+    uint slot = VertexTableSlot(key);
+
+    for (int i = 0; i < LEB_WELD_TABLE_SIZE; ++i) {
+        if (u_LebWeldTable[slot] == key)
+            return u_LebWeldTable[LEB_WELD_TABLE_SIZE + slot];
+
+        slot = (slot + 1u) & uint(LEB_WELD_TABLE_SIZE - 1);
+    }
+
+    return 0u;
+}
+#endif
+
+void main()
+{
+    const int cbtID = u_CbtID;
+    uint nodeCount = cbt_NodeCount(cbtID);
+    uint threadCount = gl_NumWorkGroups.x * gl_WorkGroupSize.x;
+
+#if FLAG_INDICES
+    if (gl_GlobalInvocationID.x == 0u)
+        u_LebWeldDraw[0] = nodeCount > uint(LEB_WELD_TRIANGLE_CAPACITY) ? 0u : 3u * nodeCount;
+#endif
+
+    // the leaves are drawn unwelded once they no longer fit
+    if (nodeCount > uint(LEB_WELD_TRIANGLE_CAPACITY))
+        return;
+
+    for (uint leafID = gl_GlobalInvocationID.x; leafID < nodeCount; leafID+= threadCount) {
+        cbt_Node node = cbt_DecodeNode(cbtID, leafID);
+        mat2x3 faceVertices = DecodeFaceVertices(node);
+        uvec3 creators = DecodeVertexCreators(node);
+
+        for (int i = 0; i < 3; ++i) {
+            vec2 vertex = vec2(faceVertices[0][i], faceVertices[1][i]);
+            uint key = VertexKey(creators[i], vertex);
+
+#if FLAG_VERTICES
+            InsertVertex(key, vertex);
+#elif FLAG_INDICES
+            u_LebWeldIndices[3u * leafID + uint(i)] = FindVertex(key);
+#endif
+        }
+    }
+}
@@ -1,6 +1,8 @@
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <utility>
+#include <algorithm>
 
 #include "glad/glad.h"
 #include "GLFW/glfw3.h"
@@ -12,9 +14,21 @@
 #define CBT_IMPLEMENTATION
 #include "cbt.h"
 
+#define CBTR_IMPLEMENTATION
+#include "CbtReduction.h"
+
 #define LEB_IMPLEMENTATION
 #include "leb.h"
 
+#define LEBS_IMPLEMENTATION
+#define LEBC_IMPLEMENTATION
+#define CBTL_IMPLEMENTATION
+#include "LebSubdivision.h"
+#define CBTS_IMPLEMENTATION
+#include "CbtSnapshot.h"
+#define GLRB_IMPLEMENTATION
+#include "GlReadback.h"
+
 #define DJ_OPENGL_IMPLEMENTATION
 #include "dj_opengl.h"
 
@@ -39,36 +53,82 @@ struct Window {
 };
 
 #define CBT_MAX_DEPTH 20
-enum {MODE_TRIANGLE, MODE_SQUARE};
 enum {BACKEND_CPU, BACKEND_GPU};
+enum {CRITERION_TARGET, CRITERION_FEATURES};
 struct LongestEdgeBisection {
     cbt_Tree *cbt;
+    lebc_Criteria *criteria;
     struct {
         int mode;
         int backend;
+        int criterion;
         struct {
             float x, y;
         } target;
+        bool batched;
+        bool sparse;
+        bool incremental;
+        bool leafCache;
+        bool welded;
     } params;
     int32_t triangleCount;
+    int32_t vertexCount;
 } g_leb = {
     cbt_CreateAtDepth(CBT_MAX_DEPTH, CBT_INIT_MAX_DEPTH),
+    NULL,
     {
         MODE_TRIANGLE,
         BACKEND_GPU,
-        {0.49951f, 0.41204f}
+        CRITERION_TARGET,
+        {0.49951f, 0.41204f},
+        false,
+        false,
+        false,
+        false,
+        false
     },
+    0,
     0
 };
 #undef CBT_MAX_DEPTH
 
+// worklists of the sparse CPU update
+#define SPARSE_FULL_SWEEP_PERIOD 64
+lebs_SparseState g_sparse;
+
+// blocks of the CBT modified since the last incremental CPU reduction
+cbtr_DirtyMap g_dirty;
+
+// the leaf cache is rewritten before its next use once the tree was loaded
+// or uploaded; the GPU updates rewrite it themselves if they changed the
+// tree (see DirtyLeafCacheKernel)
+bool g_leafCacheIsStale = true;
+
+// the welded vertex and index buffers are rebuilt once the tree changed;
+// the GPU backend learns it from the epoch of the dirty block list, which
+// counts the updates that modified the tree (see CbtDirtyDispatcher.glsl)
+bool g_weldIsStale = true;
+uint32_t g_weldEpoch = 0;
+
+// CBT snapshot used to warm start the subdivision (see --snapshot)
+struct Snapshot {
+    const char *path;
+    bool warmStart;
+} g_snapshot = {NULL, false};
+
 enum {
     PROGRAM_TRIANGLES,
+    PROGRAM_TRIANGLES_WELDED,
     PROGRAM_TARGET,
     PROGRAM_CBT_SUM_REDUCTION_PREPASS,
     PROGRAM_CBT_SUM_REDUCTION,
+    PROGRAM_CBT_DIRTY_DISPATCH,
+    PROGRAM_CBT_DIRTY_REDUCTION,
+    PROGRAM_CBT_LEAF_CACHE,
     PROGRAM_CBT_DISPATCH,
     PROGRAM_LEB_DISPATCH,
+    PROGRAM_LEB_WELD_VERTICES,
+    PROGRAM_LEB_WELD_INDICES,
     PROGRAM_LEB_SPLIT,
     PROGRAM_LEB_MERGE,
 
@@ -78,7 +138,16 @@ enum {
     BUFFER_CBT,
     BUFFER_CBT_DISPATCHER,
     BUFFER_LEB_DISPATCHER,
-    BUFFER_TRIANGLE_COUNT,
+    BUFFER_CBT_DIRTY_BLOCK_FLAGS,
+    BUFFER_CBT_DIRTY_BLOCK_LIST,
+    BUFFER_CBT_LEAF_CACHE,
+    BUFFER_LEB_WELD_TABLE,
+    BUFFER_LEB_WELD_VERTICES,
+    BUFFER_LEB_WELD_INDICES,
+    BUFFER_LEB_WELD_DRAW,
+    BUFFER_CRITERIA_FEATURES,
+    BUFFER_CRITERIA_CELLS,
+    BUFFER_CRITERIA_INDICES,
 
     BUFFER_COUNT
 };
@@ -88,15 +157,19 @@ enum {
     VERTEXARRAY_COUNT
 };
 enum {
-    QUERY_NODE_COUNT,
+    READBACK_TRIANGLE_COUNT,
+    READBACK_VERTEX_COUNT,
+    READBACK_CBT_EPOCH,
 
-    QUERY_COUNT
+    READBACK_COUNT
 };
 enum {
     CLOCK_DISPATCHER,
     CLOCK_SUBDIVISION_SPLIT,
     CLOCK_SUBDIVISION_MERGE,
     CLOCK_SUM_REDUCTION,
+    CLOCK_LEAF_CACHE,
+    CLOCK_WELD,
 
     CLOCK_COUNT
 };
@@ -104,19 +177,123 @@ struct OpenGL {
     GLuint programs[PROGRAM_COUNT];
     GLuint vertexarrays[VERTEXARRAY_COUNT];
     GLuint buffers[BUFFER_COUNT];
-    GLuint queries[QUERY_COUNT];
+    glrb_Ring readbacks[READBACK_COUNT];
     djg_clock *clocks[CLOCK_COUNT];
 } g_gl = {
     {0},
     {0},
     {0},
-    {0},
+    {},
     {NULL}
 };
 
+// frames of triangle counts in flight before new readbacks are skipped
+#define READBACK_SLOT_COUNT 4
+
+// CPU backend: the CBT buffer holds two persistently mapped copies of the
+// heap that are drawn from in turn, and only the blocks of the heap that
+// changed since a copy was last written are copied into it
+#define CBT_UPLOAD_SLOT_COUNT 2
+#define CBT_UPLOAD_SLOT_ALIGNMENT 4096
+struct CbtUpload {
+    uint8_t *mappedHeaps;                   // persistent mapping of BUFFER_CBT
+    int64_t slotByteSize;                   // offset between two copies
+    GLsync fences[CBT_UPLOAD_SLOT_COUNT];   // signaled once the GPU is done reading
+    int64_t *blockIDs;                      // blocks modified by the previous update
+    int64_t blockCount;                     // or -1 if unknown
+    int32_t slotID;                         // copy the GPU reads
+    int64_t byteCount;                      // bytes uploaded during the last frame
+} g_upload = {
+    NULL,
+    0,
+    {NULL, NULL},
+    NULL,
+    0,
+    0,
+    0
+};
+
 #define PATH_TO_SHADER_DIRECTORY PATH_TO_SRC_DIRECTORY "subdivision/shaders/"
 #define PATH_TO_CBT_DIRECTORY PATH_TO_SRC_DIRECTORY "submodules/libcbt/"
 #define PATH_TO_LEB_DIRECTORY PATH_TO_SRC_DIRECTORY "submodules/libleb/"
+#define PATH_TO_COMMON_SHADER_DIRECTORY PATH_TO_SRC_DIRECTORY "common/shaders/"
+
+// levels of the sum reduction computed per dispatch (see CbtSumReduction.glsl)
+#define CBT_SUM_REDUCTION_LEVEL_COUNT 8
+
+// depth of the roots of the blocks of the incremental reduction; the GPU
+// programs flag the blocks they modify even when the reduction is complete,
+// which is how the weld knows the tree changed
+int CbtDirtyBlockDepth()
+{
+    return std::max((int)cbt_MaxDepth(g_leb.cbt) - CBTR_BLOCK_LEAF_DEPTH, 0);
+}
+
+void PushCbtDirtyBlockShader(djg_program *djgp)
+{
+    djgp_push_string(djgp, "#define CBTR_BLOCK_LEAF_DEPTH %i\n", CBTR_BLOCK_LEAF_DEPTH);
+    djgp_push_string(djgp, "#define CBT_DIRTY_BLOCK_FLAG_BUFFER_BINDING %i\n", BUFFER_CBT_DIRTY_BLOCK_FLAGS);
+    djgp_push_string(djgp, "#define CBT_DIRTY_BLOCK_LIST_BUFFER_BINDING %i\n", BUFFER_CBT_DIRTY_BLOCK_LIST);
+    djgp_push_file(djgp, PATH_TO_COMMON_SHADER_DIRECTORY "CbtDirtyBlocks.glsl");
+}
+
+// leaves cached per CBT by the leaf cache (see CbtLeafCache.glsl), and
+// workgroups of the pass that writes them
+#define CBT_LEAF_CACHE_MAX_CAPACITY (1 << 22)
+#define CBT_LEAF_CACHE_MAX_GROUP_COUNT 1024
+
+int CbtLeafCacheCapacity()
+{
+    return (int)std::min(int64_t(1) << cbt_MaxDepth(g_leb.cbt),
+                         (int64_t)CBT_LEAF_CACHE_MAX_CAPACITY);
+}
+
+int CbtLeafCacheGroupCount()
+{
+    return std::min(std::max(CbtLeafCacheCapacity() >> 8, 1),
+                    CBT_LEAF_CACHE_MAX_GROUP_COUNT);
+}
+
+void PushCbtLeafCacheShader(djg_program *djgp)
+{
+    djgp_push_string(djgp, "#define CBT_LEAF_CACHE_BUFFER_BINDING %i\n", BUFFER_CBT_LEAF_CACHE);
+    djgp_push_string(djgp, "#define CBT_LEAF_CACHE_CAPACITY %i\n", CbtLeafCacheCapacity());
+    djgp_push_file(djgp, PATH_TO_COMMON_SHADER_DIRECTORY "CbtLeafCache.glsl");
+}
+
+// leaves that the welded vertex and index buffers can hold (see weld.glsl),
+// and workgroups of the passes that build them
+#define LEB_WELD_MAX_TRIANGLE_COUNT (1 << 21)
+#define LEB_WELD_MAX_GROUP_COUNT 1024
+
+int LebWeldTriangleCapacity()
+{
+    return (int)std::min(int64_t(1) << cbt_MaxDepth(g_leb.cbt),
+                         (int64_t)LEB_WELD_MAX_TRIANGLE_COUNT);
+}
+
+// by Euler's formula, a triangulated disc has fewer vertices than
+// triangles plus 3; the vertex table is kept at most half full
+int LebWeldVertexCapacity()
+{
+    return LebWeldTriangleCapacity() + 3;
+}
+
+int LebWeldTableSize()
+{
+    return 2 * LebWeldTriangleCapacity();
+}
+
+void PushLebWeldDefines(djg_program *djgp)
+{
+    djgp_push_string(djgp, "#define LEB_WELD_TRIANGLE_CAPACITY %i\n", LebWeldTriangleCapacity());
+    djgp_push_string(djgp, "#define LEB_WELD_VERTEX_CAPACITY %i\n", LebWeldVertexCapacity());
+    djgp_push_string(djgp, "#define LEB_WELD_TABLE_SIZE %i\n", LebWeldTableSize());
+    djgp_push_string(djgp, "#define LEB_WELD_TABLE_BUFFER_BINDING %i\n", BUFFER_LEB_WELD_TABLE);
+    djgp_push_string(djgp, "#define LEB_WELD_VERTEX_BUFFER_BINDING %i\n", BUFFER_LEB_WELD_VERTICES);
+    djgp_push_string(djgp, "#define LEB_WELD_INDEX_BUFFER_BINDING %i\n", BUFFER_LEB_WELD_INDICES);
+    djgp_push_string(djgp, "#define LEB_WELD_DRAW_BUFFER_BINDING %i\n", BUFFER_LEB_WELD_DRAW);
+}
 
 bool LoadTargetProgram()
 {
@@ -164,8 +341,78 @@ bool LoadCbtSumReductionProgram()
     GLuint *glp = &g_gl.programs[PROGRAM_CBT_SUM_REDUCTION];
 
     djgp_push_string(djgp, "#define CBT_HEAP_BUFFER_BINDING %i\n", BUFFER_CBT);
+    djgp_push_string(djgp, "#define CBT_SUM_REDUCTION_LEVEL_COUNT %i\n", CBT_SUM_REDUCTION_LEVEL_COUNT);
+    djgp_push_file(djgp, PATH_TO_CBT_DIRECTORY "glsl/cbt.glsl");
+    djgp_push_file(djgp, PATH_TO_COMMON_SHADER_DIRECTORY "CbtSumReduction.glsl");
+    djgp_push_string(djgp, "#ifdef COMPUTE_SHADER\n#endif");
+    if (!djgp_to_gl(djgp, 450, false, true, glp)) {
+        djgp_release(djgp);
+
+        return false;
+    }
+
+    djgp_release(djgp);
+
+    return glGetError() == GL_NO_ERROR;
+}
+
+bool LoadCbtDirtyDispatcherProgram()
+{
+    LOG("Loading {CBT-Dirty-Dispatcher Program}");
+    djg_program *djgp = djgp_create();
+    GLuint *glp = &g_gl.programs[PROGRAM_CBT_DIRTY_DISPATCH];
+
+    djgp_push_string(djgp, "#define CBT_HEAP_BUFFER_BINDING %i\n", BUFFER_CBT);
+    djgp_push_file(djgp, PATH_TO_CBT_DIRECTORY "glsl/cbt.glsl");
+    if (g_leb.params.leafCache)
+        djgp_push_string(djgp, "#define CBT_LEAF_CACHE_GROUP_COUNT_X %iu\n", CbtLeafCacheGroupCount());
+    PushCbtDirtyBlockShader(djgp);
+    djgp_push_file(djgp, PATH_TO_COMMON_SHADER_DIRECTORY "CbtDirtyDispatcher.glsl");
+    djgp_push_string(djgp, "#ifdef COMPUTE_SHADER\n#endif");
+    if (!djgp_to_gl(djgp, 450, false, true, glp)) {
+        djgp_release(djgp);
+
+        return false;
+    }
+
+    djgp_release(djgp);
+
+    return glGetError() == GL_NO_ERROR;
+}
+
+bool LoadCbtDirtyReductionProgram()
+{
+    LOG("Loading {CBT-Dirty-Reduction Program}");
+    djg_program *djgp = djgp_create();
+    GLuint *glp = &g_gl.programs[PROGRAM_CBT_DIRTY_REDUCTION];
+
+    djgp_push_string(djgp, "#define CBT_HEAP_BUFFER_BINDING %i\n", BUFFER_CBT);
+    djgp_push_file(djgp, PATH_TO_CBT_DIRECTORY "glsl/cbt.glsl");
+    PushCbtDirtyBlockShader(djgp);
+    djgp_push_file(djgp, PATH_TO_COMMON_SHADER_DIRECTORY "CbtDirtyReduction.glsl");
+    djgp_push_string(djgp, "#ifdef COMPUTE_SHADER\n#endif");
+    if (!djgp_to_gl(djgp, 450, false, true, glp)) {
+        djgp_release(djgp);
+
+        return false;
+    }
+
+    djgp_release(djgp);
+
+    return glGetError() == GL_NO_ERROR;
+}
+
+bool LoadCbtLeafCacheProgram()
+{
+    LOG("Loading {CBT-Leaf-Cache Program}");
+    djg_program *djgp = djgp_create();
+    GLuint *glp = &g_gl.programs[PROGRAM_CBT_LEAF_CACHE];
+
+    djgp_push_string(djgp, "#define CBT_HEAP_BUFFER_BINDING %i\n", BUFFER_CBT);
+    djgp_push_string(djgp, "#define CBT_LEAF_CACHE_WRITER\n");
     djgp_push_file(djgp, PATH_TO_CBT_DIRECTORY "glsl/cbt.glsl");
-    djgp_push_file(djgp, PATH_TO_CBT_DIRECTORY "glsl/cbt_SumReduction.glsl");
+    PushCbtLeafCacheShader(djgp);
+    djgp_push_file(djgp, PATH_TO_COMMON_SHADER_DIRECTORY "CbtLeafCacheWriter.glsl");
     djgp_push_string(djgp, "#ifdef COMPUTE_SHADER\n#endif");
     if (!djgp_to_gl(djgp, 450, false, true, glp)) {
         djgp_release(djgp);
@@ -208,6 +455,8 @@ bool LoadLebDispatcherProgram()
 
     djgp_push_string(djgp, "#define CBT_HEAP_BUFFER_BINDING %i\n", BUFFER_CBT);
     djgp_push_string(djgp, "#define LEB_DISPATCHER_BUFFER_BINDING %i\n", BUFFER_LEB_DISPATCHER);
+    if (g_leb.params.welded)
+        PushLebWeldDefines(djgp);
     djgp_push_file(djgp, PATH_TO_CBT_DIRECTORY "glsl/cbt.glsl");
     djgp_push_file(djgp, PATH_TO_SHADER_DIRECTORY "leb_dispatcher.glsl");
     djgp_push_string(djgp, "#ifdef COMPUTE_SHADER\n#endif");
@@ -236,7 +485,17 @@ bool LoadSubdivisionProgram(int programID, const char *flags)
     djgp_push_string(djgp, flags);
     djgp_push_string(djgp, "#define CBT_HEAP_BUFFER_BINDING %i\n", BUFFER_CBT);
     djgp_push_file(djgp, PATH_TO_CBT_DIRECTORY "glsl/cbt.glsl");
+    if (g_leb.params.leafCache)
+        PushCbtLeafCacheShader(djgp);
+    PushCbtDirtyBlockShader(djgp);
     djgp_push_file(djgp, PATH_TO_LEB_DIRECTORY "glsl/leb.glsl");
+    if (g_leb.params.criterion == CRITERION_FEATURES) {
+        djgp_push_string(djgp, "#define FLAG_CRITERIA 1\n");
+        djgp_push_string(djgp, "#define LEBC_FEATURE_BUFFER_BINDING %i\n", BUFFER_CRITERIA_FEATURES);
+        djgp_push_string(djgp, "#define LEBC_CELL_BUFFER_BINDING %i\n", BUFFER_CRITERIA_CELLS);
+        djgp_push_string(djgp, "#define LEBC_INDEX_BUFFER_BINDING %i\n", BUFFER_CRITERIA_INDICES);
+        djgp_push_file(djgp, PATH_TO_SHADER_DIRECTORY "criteria.glsl");
+    }
     djgp_push_file(djgp, PATH_TO_SHADER_DIRECTORY "subdivision.glsl");
     djgp_push_string(djgp, "#ifdef COMPUTE_SHADER\n#endif");
     if (!djgp_to_gl(djgp, 450, false, true, glp)) {
@@ -265,19 +524,65 @@ bool LoadSubdivisionPrograms()
     return LoadSubdivisionMergeProgram() && LoadSubdivisionSplitProgram();
 }
 
-bool LoadTrianglesProgram()
+bool LoadLebWeldProgram(int programID, const char *flags)
+{
+    LOG("Loading {LEB-Weld Program}")
+    djg_program *djgp = djgp_create();
+    GLuint *glp = &g_gl.programs[programID];
+
+    if (g_leb.params.mode == MODE_SQUARE)
+        djgp_push_string(djgp, "#define MODE_SQUARE\n");
+    else
+        djgp_push_string(djgp, "#define MODE_TRIANGLE\n");
+
+    djgp_push_string(djgp, flags);
+    djgp_push_string(djgp, "#define CBT_HEAP_BUFFER_BINDING %i\n", BUFFER_CBT);
+    PushLebWeldDefines(djgp);
+    djgp_push_file(djgp, PATH_TO_CBT_DIRECTORY "glsl/cbt.glsl");
+    if (g_leb.params.leafCache)
+        PushCbtLeafCacheShader(djgp);
+    djgp_push_file(djgp, PATH_TO_LEB_DIRECTORY "glsl/leb.glsl");
+    djgp_push_file(djgp, PATH_TO_SHADER_DIRECTORY "weld.glsl");
+    djgp_push_string(djgp, "#ifdef COMPUTE_SHADER\n#endif");
+    if (!djgp_to_gl(djgp, 450, false, true, glp)) {
+        djgp_release(djgp);
+
+        return false;
+    }
+
+    djgp_release(djgp);
+
+    return glGetError() == GL_NO_ERROR;
+}
+
+bool LoadLebWeldPrograms()
+{
+    if (!g_leb.params.welded)
+        return true;
+
+    return LoadLebWeldProgram(PROGRAM_LEB_WELD_VERTICES, "#define FLAG_VERTICES 1\n")
+        && LoadLebWeldProgram(PROGRAM_LEB_WELD_INDICES, "#define FLAG_INDICES 1\n");
+}
+
+bool LoadTrianglesProgram(int programID, bool welded)
 {
     LOG("Loading {Triangles Program}")
     djg_program *djgp = djgp_create();
-    GLuint *glp = &g_gl.programs[PROGRAM_TRIANGLES];
+    GLuint *glp = &g_gl.programs[programID];
 
     if (g_leb.params.mode == MODE_SQUARE)
         djgp_push_string(djgp, "#define MODE_SQUARE\n");
     else
         djgp_push_string(djgp, "#define MODE_TRIANGLE\n");
 
+    if (welded) {
+        djgp_push_string(djgp, "#define FLAG_WELDED 1\n");
+        PushLebWeldDefines(djgp);
+    }
     djgp_push_string(djgp, "#define CBT_HEAP_BUFFER_BINDING %i\n", BUFFER_CBT);
     djgp_push_file(djgp, PATH_TO_CBT_DIRECTORY "glsl/cbt.glsl");
+    if (g_leb.params.leafCache)
+        PushCbtLeafCacheShader(djgp);
     djgp_push_file(djgp, PATH_TO_LEB_DIRECTORY "glsl/leb.glsl");
     djgp_push_file(djgp, PATH_TO_SHADER_DIRECTORY "triangles.glsl");
     if (!djgp_to_gl(djgp, 450, false, true, glp)) {
@@ -291,17 +596,31 @@ bool LoadTrianglesProgram()
     return glGetError() == GL_NO_ERROR;
 }
 
+bool LoadTrianglesPrograms()
+{
+    bool success = LoadTrianglesProgram(PROGRAM_TRIANGLES, false);
+
+    if (success && g_leb.params.welded)
+        success = LoadTrianglesProgram(PROGRAM_TRIANGLES_WELDED, true);
+
+    return success;
+}
+
 
 bool LoadPrograms()
 {
     bool success = true;
 
-    if (success) success = LoadTrianglesProgram();
+    if (success) success = LoadTrianglesPrograms();
     if (success) success = LoadTargetProgram();
     if (success) success = LoadCbtSumReductionPrepassProgram();
     if (success) success = LoadCbtSumReductionProgram();
+    if (success) success = LoadCbtDirtyDispatcherProgram();
+    if (success) success = LoadCbtDirtyReductionProgram();
+    if (success) success = LoadCbtLeafCacheProgram();
     if (success) success = LoadCbtDispatcherProgram();
     if (success) success = LoadLebDispatcherProgram();
+    if (success) success = LoadLebWeldPrograms();
     if (success) success = LoadSubdivisionPrograms();
 
     return success;
@@ -331,17 +650,130 @@ bool LoadVertexArrays()
     return success;
 }
 
-bool LoadTriangleCountBuffer()
+void ReleaseCbtUpload()
 {
-    GLuint *buffer = &g_gl.buffers[BUFFER_TRIANGLE_COUNT];
+    for (int i = 0; i < CBT_UPLOAD_SLOT_COUNT; ++i) {
+        if (g_upload.fences[i]) {
+            glDeleteSync(g_upload.fences[i]);
+            g_upload.fences[i] = NULL;
+        }
+    }
+
+    free(g_upload.blockIDs);
+    g_upload.blockIDs = NULL;
+    g_upload.blockCount = 0;
+    g_upload.mappedHeaps = NULL;
+    g_upload.slotID = 0;
+    g_upload.byteCount = 0;
+}
+
+/**
+ * Allocates the block flags and the dirty block list of the GPU programs,
+ * which drive the incremental GPU reduction and the weld, and the dirty map
+ * of the CPU updates, which also drives the uploads of the CPU backend. All
+ * blocks start clean, since the heap is uploaded reduced.
+ */
+bool LoadCbtDirtyBlockBuffers()
+{
+    const int64_t blockCount = 1LL << CbtDirtyBlockDepth();
+    const int64_t byteSizes[2] = {
+        blockCount * (int64_t)sizeof(uint32_t),
+        (8 + blockCount) * (int64_t)sizeof(uint32_t)
+    };
+
+    g_weldEpoch = 0;
+    cbtr_DirtyMapRelease(&g_dirty);
+    cbtr_DirtyMapInit(&g_dirty, g_leb.cbt);
+    g_dirty.fullReduction = !g_leb.params.incremental;
+    free(g_upload.blockIDs);
+    g_upload.blockIDs = (int64_t *)malloc(blockCount * sizeof(int64_t));
+    g_upload.blockCount = 0;
+
+    for (int i = 0; i < 2; ++i) {
+        int bufferID = BUFFER_CBT_DIRTY_BLOCK_FLAGS + i;
+        GLuint *buffer = &g_gl.buffers[bufferID];
+
+        if (glIsBuffer(*buffer))
+            glDeleteBuffers(1, buffer);
+
+        glGenBuffers(1, buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, *buffer);
+        glBufferStorage(GL_SHADER_STORAGE_BUFFER, byteSizes[i], NULL, 0);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER,
+                          GL_R32UI,
+                          GL_RED_INTEGER,
+                          GL_UNSIGNED_INT,
+                          NULL);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, bufferID, *buffer);
+    }
+
+    return glGetError() == GL_NO_ERROR;
+}
+
+/**
+ * Allocates the leaf cache of the GPU programs. It starts out stale, and
+ * gets written before its first use.
+ */
+bool LoadCbtLeafCacheBuffer()
+{
+    GLuint *buffer = &g_gl.buffers[BUFFER_CBT_LEAF_CACHE];
+
+    g_leafCacheIsStale = true;
+    if (glIsBuffer(*buffer))
+        glDeleteBuffers(1, buffer);
 
     glGenBuffers(1, buffer);
-    glBindBuffer(GL_ARRAY_BUFFER, *buffer);
-    glBufferStorage(GL_ARRAY_BUFFER,
-                    sizeof(int32_t),
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, *buffer);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER,
+                    g_leb.params.leafCache ? CbtLeafCacheCapacity() * sizeof(uint32_t)
+                                           : sizeof(uint32_t),
                     NULL,
-                    GL_MAP_READ_BIT);
-    glBindBuffer(GL_ARRAY_BUFFER, 0);
+                    0);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_CBT_LEAF_CACHE, *buffer);
+
+    return glGetError() == GL_NO_ERROR;
+}
+
+/**
+ * Allocates the vertex table, the vertex and index buffers, and the draw
+ * command of the welded draw. They start out stale, and get built before
+ * their first use.
+ */
+bool LoadLebWeldBuffers()
+{
+    // empty buffers are not allowed by GL, so we always allocate something
+    int64_t byteSizes[3] = {sizeof(uint32_t), sizeof(uint32_t), sizeof(uint32_t)};
+    uint32_t drawElementsCmd[8] = {0, 1, 0, 0, 0, 0, 0, 0};
+
+    if (g_leb.params.welded) {
+        byteSizes[0] = 2 * (int64_t)LebWeldTableSize() * sizeof(uint32_t);
+        byteSizes[1] = 2 * (int64_t)LebWeldVertexCapacity() * sizeof(float);
+        byteSizes[2] = 3 * (int64_t)LebWeldTriangleCapacity() * sizeof(uint32_t);
+    }
+
+    g_weldIsStale = true;
+    for (int i = 0; i < 4; ++i) {
+        int bufferID = BUFFER_LEB_WELD_TABLE + i;
+        GLuint *buffer = &g_gl.buffers[bufferID];
+
+        if (glIsBuffer(*buffer))
+            glDeleteBuffers(1, buffer);
+
+        glGenBuffers(1, buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, *buffer);
+        if (bufferID == BUFFER_LEB_WELD_DRAW) {
+            glBufferStorage(GL_SHADER_STORAGE_BUFFER,
+                            sizeof(drawElementsCmd),
+                            drawElementsCmd,
+                            0);
+        } else {
+            glBufferStorage(GL_SHADER_STORAGE_BUFFER, byteSizes[i], NULL, 0);
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, bufferID, *buffer);
+    }
 
     return glGetError() == GL_NO_ERROR;
 }
@@ -349,20 +781,49 @@ bool LoadTriangleCountBuffer()
 bool LoadCbtBuffer()
 {
     GLuint *buffer = &g_gl.buffers[BUFFER_CBT];
+    int64_t heapByteSize = cbt_HeapByteSize(g_leb.cbt);
+
+    // the tree was reset or replaced
+    lebs_SparseStateInvalidate(&g_sparse);
 
+    // deleting the buffer also releases its mapping
+    ReleaseCbtUpload();
     if (glIsBuffer(*buffer))
         glDeleteBuffers(1, buffer);
 
     glGenBuffers(1, buffer);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, *buffer);
-    glBufferStorage(GL_SHADER_STORAGE_BUFFER,
-                    cbt_HeapByteSize(g_leb.cbt),
-                    cbt_GetHeap(g_leb.cbt),
-                    0);
+    if (g_leb.params.backend == BACKEND_CPU) {
+        GLbitfield flags = GL_MAP_WRITE_BIT
+                         | GL_MAP_PERSISTENT_BIT
+                         | GL_MAP_COHERENT_BIT;
+        int64_t slotByteSize = (heapByteSize + CBT_UPLOAD_SLOT_ALIGNMENT - 1)
+                             & ~(int64_t)(CBT_UPLOAD_SLOT_ALIGNMENT - 1);
+        int64_t byteSize = CBT_UPLOAD_SLOT_COUNT * slotByteSize;
+
+        glBufferStorage(GL_SHADER_STORAGE_BUFFER, byteSize, NULL, flags);
+        g_upload.mappedHeaps = (uint8_t *)
+            glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, byteSize, flags);
+        g_upload.slotByteSize = slotByteSize;
+        for (int i = 0; i < CBT_UPLOAD_SLOT_COUNT; ++i)
+            memcpy(&g_upload.mappedHeaps[i * slotByteSize],
+                   cbt_GetHeap(g_leb.cbt),
+                   heapByteSize);
+        g_upload.byteCount = heapByteSize;
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, BUFFER_CBT, *buffer, 0, heapByteSize);
+    } else {
+        glBufferStorage(GL_SHADER_STORAGE_BUFFER,
+                        heapByteSize,
+                        cbt_GetHeap(g_leb.cbt),
+                        0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_CBT, *buffer);
+    }
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_CBT, *buffer);
 
-    return glGetError() == GL_NO_ERROR;
+    return glGetError() == GL_NO_ERROR
+        && LoadCbtDirtyBlockBuffers()
+        && LoadCbtLeafCacheBuffer()
+        && LoadLebWeldBuffers();
 }
 
 bool LoadCbtDispatcherBuffer()
@@ -399,6 +860,94 @@ bool LoadLebDispatcherBuffer()
     return glGetError() == GL_NO_ERROR;
 }
 
+/**
+ * Builds the features used by the CRITERION_FEATURES refinement mode: a
+ * scattered set of sensor points, a polyline, two discs, and a star-shaped
+ * polygon.
+ */
+void BuildDemoCriteria(lebc_Criteria *criteria)
+{
+    const float pi = 3.14159265358979f;
+    float polyline[65][2];
+    float star[10][2];
+    uint32_t seed = 1u;
+
+    lebc_Clear(criteria);
+
+    for (int i = 0; i < 512; ++i) {
+        float u, v;
+
+        seed = seed * 1664525u + 1013904223u; u = (seed >> 8) / 16777216.0f;
+        seed = seed * 1664525u + 1013904223u; v = (seed >> 8) / 16777216.0f;
+        lebc_AddPoint(criteria, u, v);
+    }
+
+    for (int i = 0; i < 65; ++i) {
+        float u = i / 64.0f;
+
+        polyline[i][0] = 0.05f + 0.9f * u;
+        polyline[i][1] = 0.5f + 0.15f * sinf(4.0f * pi * u);
+    }
+    lebc_AddPolyline(criteria, polyline, 65);
+
+    lebc_AddDisc(criteria, 0.25f, 0.75f, 0.05f);
+    lebc_AddDisc(criteria, 0.70f, 0.20f, 0.08f);
+
+    for (int i = 0; i < 10; ++i) {
+        float r = (i & 1) ? 0.05f : 0.12f;
+        float phi = 2.0f * pi * i / 10.0f;
+
+        star[i][0] = 0.3f + r * cosf(phi);
+        star[i][1] = 0.3f + r * sinf(phi);
+    }
+    lebc_AddPolygon(criteria, star, 10);
+
+    lebc_Build(criteria, 0);
+}
+
+bool LoadCriteriaBuffer(int bufferID, const void *data, int64_t byteSize)
+{
+    GLuint *buffer = &g_gl.buffers[bufferID];
+    // empty buffers are not allowed by GL, so we always allocate something
+    uint8_t dummy[16] = {0};
+
+    if (glIsBuffer(*buffer))
+        glDeleteBuffers(1, buffer);
+
+    glGenBuffers(1, buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, *buffer);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER,
+                    byteSize > 0 ? byteSize : sizeof(dummy),
+                    byteSize > 0 ? data : dummy,
+                    0);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, bufferID, *buffer);
+
+    return glGetError() == GL_NO_ERROR;
+}
+
+bool LoadCriteriaBuffers()
+{
+    const lebc_Criteria *criteria = g_leb.criteria;
+    int32_t gridResolution = lebc_GridResolution(criteria);
+    bool success = true;
+
+    if (success) success = LoadCriteriaBuffer(BUFFER_CRITERIA_FEATURES,
+                                              lebc_GetFeatures(criteria),
+                                              lebc_FeatureCount(criteria)
+                                              * sizeof(lebc_Feature));
+    if (success) success = LoadCriteriaBuffer(BUFFER_CRITERIA_CELLS,
+                                              lebc_GetCells(criteria),
+                                              (int64_t)gridResolution * gridResolution
+                                              * sizeof(lebc_Cell));
+    if (success) success = LoadCriteriaBuffer(BUFFER_CRITERIA_INDICES,
+                                              lebc_GetIndices(criteria),
+                                              lebc_IndexCount(criteria)
+                                              * sizeof(uint32_t));
+
+    return success;
+}
+
 bool LoadBuffers()
 {
     bool success = true;
@@ -406,26 +955,49 @@ bool LoadBuffers()
     if (success) success = LoadCbtBuffer();
     if (success) success = LoadCbtDispatcherBuffer();
     if (success) success = LoadLebDispatcherBuffer();
-    if (success) success = LoadTriangleCountBuffer();
+    if (success) success = LoadCriteriaBuffers();
 
     return success;
 }
 
-bool LoadNodeCountQuery()
+// the triangle count is the instance count of the draw command, which is
+// copied to a ring of fenced readback slots (see RetrieveNodeCount)
+bool LoadTriangleCountReadback()
 {
-    GLuint *query = &g_gl.queries[QUERY_NODE_COUNT];
+    glrb_Ring *ring = &g_gl.readbacks[READBACK_TRIANGLE_COUNT];
 
-    glGenQueries(1, query);
-    glQueryCounter(*query, GL_TIMESTAMP);
+    glrb_Release(ring);
 
-    return glGetError() == GL_NO_ERROR;
+    return glrb_Create(ring, sizeof(int32_t), READBACK_SLOT_COUNT);
+}
+
+// the vertex count of the welded draw follows its draw command
+bool LoadVertexCountReadback()
+{
+    glrb_Ring *ring = &g_gl.readbacks[READBACK_VERTEX_COUNT];
+
+    glrb_Release(ring);
+
+    return glrb_Create(ring, sizeof(int32_t), READBACK_SLOT_COUNT);
 }
 
-bool LoadQueries()
+// the epoch of the dirty block list follows the reduction (see RetrieveCbtEpoch)
+bool LoadCbtEpochReadback()
+{
+    glrb_Ring *ring = &g_gl.readbacks[READBACK_CBT_EPOCH];
+
+    glrb_Release(ring);
+
+    return glrb_Create(ring, sizeof(uint32_t), READBACK_SLOT_COUNT);
+}
+
+bool LoadReadbacks()
 {
     bool success = true;
 
-    if (success) success = LoadNodeCountQuery();
+    if (success) success = LoadTriangleCountReadback();
+    if (success) success = LoadVertexCountReadback();
+    if (success) success = LoadCbtEpochReadback();
 
     return success;
 }
@@ -477,6 +1049,65 @@ DebugOutputLogger(
     }
 }
 
+/**
+ * Restores the subdivision saved at the last exit so that the demo does not
+ * have to converge again from the root triangles. The heap is copied from
+ * the mapped file into the CPU tree. The snapshot also restores the mode it
+ * was saved in, which overrides the default mode; snapshots of another max
+ * depth are ignored.
+ */
+void LoadSnapshot()
+{
+    cbts_Snapshot snapshot;
+    int mode;
+
+    if (!g_snapshot.warmStart || !cbts_Map(g_snapshot.path, &snapshot, true))
+        return;
+
+    switch (snapshot.header->mode) {
+    case CBTS_MODE_LEB_TRIANGLE: mode = MODE_TRIANGLE; break;
+    case CBTS_MODE_LEB_SQUARE: mode = MODE_SQUARE; break;
+    default: mode = -1; break;
+    }
+
+    if (mode >= 0
+        && snapshot.header->rootCount == (mode == MODE_SQUARE ? 2 : 1)
+        && snapshot.header->maxDepth == cbt_MaxDepth(g_leb.cbt)) {
+        LOG("Loading {Snapshot: %s}", g_snapshot.path);
+        cbt_Release(g_leb.cbt);
+        g_leb.cbt = cbts_CreateTree(&snapshot);
+        g_leb.params.mode = mode;
+    }
+
+    cbts_Unmap(&snapshot);
+}
+
+/**
+ * Saves the current subdivision; with the GPU backend the heap is read back
+ * from the CBT buffer first.
+ */
+bool SaveSnapshot()
+{
+    int64_t heapByteSize = cbt_HeapByteSize(g_leb.cbt);
+    int mode = g_leb.params.mode == MODE_SQUARE ? CBTS_MODE_LEB_SQUARE
+                                                : CBTS_MODE_LEB_TRIANGLE;
+    int64_t rootCount = g_leb.params.mode == MODE_SQUARE ? 2 : 1;
+    bool success;
+
+    LOG("Saving {Snapshot: %s}", g_snapshot.path);
+    if (g_leb.params.backend == BACKEND_GPU) {
+        char *heap = (char *)malloc(heapByteSize);
+
+        glGetNamedBufferSubData(g_gl.buffers[BUFFER_CBT], 0, heapByteSize, heap);
+        success = cbts_Write(g_snapshot.path, heap, heapByteSize, mode, rootCount);
+        free(heap);
+    } else {
+        success = cbts_WriteTree(g_snapshot.path, g_leb.cbt, mode, rootCount);
+    }
+
+    return success && glGetError() == GL_NO_ERROR;
+}
+
 bool Load()
 {
     bool success = true;
@@ -487,19 +1118,33 @@ bool Load()
     for (int i = 0; i < CLOCK_COUNT; ++i)
         g_gl.clocks[i] = djgc_create();
 
+    lebs_SparseStateInit(&g_sparse, SPARSE_FULL_SWEEP_PERIOD);
+
+    if (!g_leb.criteria) {
+        g_leb.criteria = lebc_Create();
+        BuildDemoCriteria(g_leb.criteria);
+    }
+
+    LoadSnapshot();
+
     if (success) success = LoadPrograms();
     if (success) success = LoadVertexArrays();
     if (success) success = LoadBuffers();
-    if (success) success = LoadQueries();
+    if (success) success = LoadReadbacks();
 
     return success;
 }
 
 void Release()
 {
+    ReleaseCbtUpload();
+    cbtr_DirtyMapRelease(&g_dirty);
     glDeleteBuffers(BUFFER_COUNT, g_gl.buffers);
     glDeleteVertexArrays(VERTEXARRAY_COUNT, g_gl.vertexarrays);
 
+    for (int i = 0; i < READBACK_COUNT; ++i)
+        glrb_Release(&g_gl.readbacks[i]);
+
     for (int i = 0; i < CLOCK_COUNT; ++i)
         djgc_release(g_gl.clocks[i]);
     for (int i = 0; i < PROGRAM_COUNT; ++i)
@@ -510,13 +1155,29 @@ void ReductionKernel()
 {
     int it = cbt_MaxDepth(g_leb.cbt);
 
-    glUseProgram(g_gl.programs[PROGRAM_CBT_SUM_REDUCTION_PREPASS]);
-    if (true) {
+    // lists the blocks the subdivision modified and bumps the epoch if any
+    glUseProgram(g_gl.programs[PROGRAM_CBT_DIRTY_DISPATCH]);
+    glDispatchCompute(1, 1, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT
+                    | GL_SHADER_STORAGE_BARRIER_BIT
+                    | GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    if (g_leb.params.incremental) {
+        // one workgroup per dirty block, then the levels above the blocks
+        glUseProgram(g_gl.programs[PROGRAM_CBT_DIRTY_REDUCTION]);
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER,
+                     g_gl.buffers[BUFFER_CBT_DIRTY_BLOCK_LIST]);
+        glDispatchComputeIndirect(0);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        it = CbtDirtyBlockDepth();
+    } else {
         int cnt = ((1 << it) >> 5);
         int numGroup = (cnt >= 256) ? (cnt >> 8) : 1;
         int loc = glGetUniformLocation(g_gl.programs[PROGRAM_CBT_SUM_REDUCTION_PREPASS],
                                        "u_PassID");
 
+        glUseProgram(g_gl.programs[PROGRAM_CBT_SUM_REDUCTION_PREPASS]);
         glUniform1i(loc, it);
         glDispatchCompute(numGroup, 1, 1);
         glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
@@ -524,18 +1185,111 @@ void ReductionKernel()
         it-= 5;
     }
 
+    // each pass reads the nodes at depth it and writes the levels above
     glUseProgram(g_gl.programs[PROGRAM_CBT_SUM_REDUCTION]);
-    while (--it >= 0) {
+    while (it > 0) {
         int loc = glGetUniformLocation(g_gl.programs[PROGRAM_CBT_SUM_REDUCTION], "u_PassID");
-        int cnt = 1 << it;
-        int numGroup = (cnt >= 256) ? (cnt >> 8) : 1;
+        int numGroup = std::max((1 << it) >> CBT_SUM_REDUCTION_LEVEL_COUNT, 1);
+        int numGroupX = std::min(numGroup, 1 << 15);
 
         glUniform1i(loc, it);
-        glDispatchCompute(numGroup, 1, 1);
+        glDispatchCompute(numGroupX, 1, numGroup / numGroupX);
         glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        it-= CBT_SUM_REDUCTION_LEVEL_COUNT;
     }
 }
 
+/**
+ * Caches the leaves of the tree if it was loaded or uploaded since they
+ * were last cached, so that each following pass reads the leaves from the
+ * cache instead of decoding them from the heap (see CbtLeafCache.glsl).
+ */
+void LeafCacheKernel()
+{
+    if (!g_leb.params.leafCache || !g_leafCacheIsStale)
+        return;
+
+    djgc_start(g_gl.clocks[CLOCK_LEAF_CACHE]);
+    glUseProgram(g_gl.programs[PROGRAM_CBT_LEAF_CACHE]);
+    glDispatchCompute(CbtLeafCacheGroupCount(), 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glUseProgram(0);
+    djgc_stop(g_gl.clocks[CLOCK_LEAF_CACHE]);
+
+    g_leafCacheIsStale = false;
+}
+
+/**
+ * Caches the leaves of the tree after a GPU update. The dirty dispatcher
+ * sizes the dispatch, which launches no workgroups if the update modified
+ * no block, so the cache is rewritten exactly when the tree changed.
+ */
+void DirtyLeafCacheKernel()
+{
+    if (!g_leb.params.leafCache)
+        return;
+
+    djgc_start(g_gl.clocks[CLOCK_LEAF_CACHE]);
+    glUseProgram(g_gl.programs[PROGRAM_CBT_LEAF_CACHE]);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER,
+                 g_gl.buffers[BUFFER_CBT_DIRTY_BLOCK_LIST]);
+    glDispatchComputeIndirect(5 * sizeof(uint32_t));
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+    glUseProgram(0);
+    djgc_stop(g_gl.clocks[CLOCK_LEAF_CACHE]);
+}
+
+/**
+ * Rebuilds the welded vertex and index buffers if the tree changed since
+ * they were last built (see weld.glsl). The vertex table and the vertex
+ * count are cleared first, so that the first leaf that inserts a vertex
+ * owns it.
+ */
+void WeldKernel()
+{
+    if (!g_leb.params.welded || !g_weldIsStale)
+        return;
+
+    int numGroup = std::min(std::max(LebWeldTriangleCapacity() >> 8, 1),
+                            LEB_WELD_MAX_GROUP_COUNT);
+
+    djgc_start(g_gl.clocks[CLOCK_WELD]);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_gl.buffers[BUFFER_LEB_WELD_TABLE]);
+    glClearBufferSubData(GL_SHADER_STORAGE_BUFFER,
+                         GL_R32UI,
+                         0,
+                         LebWeldTableSize() * sizeof(uint32_t),
+                         GL_RED_INTEGER,
+                         GL_UNSIGNED_INT,
+                         NULL);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_gl.buffers[BUFFER_LEB_WELD_DRAW]);
+    glClearBufferSubData(GL_SHADER_STORAGE_BUFFER,
+                         GL_R32UI,
+                         5 * sizeof(uint32_t),
+                         sizeof(uint32_t),
+                         GL_RED_INTEGER,
+                         GL_UNSIGNED_INT,
+                         NULL);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glUseProgram(g_gl.programs[PROGRAM_LEB_WELD_VERTICES]);
+    glDispatchCompute(numGroup, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    glUseProgram(g_gl.programs[PROGRAM_LEB_WELD_INDICES]);
+    glDispatchCompute(numGroup, 1, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT
+                    | GL_ELEMENT_ARRAY_BARRIER_BIT
+                    | GL_COMMAND_BARRIER_BIT
+                    | GL_BUFFER_UPDATE_BARRIER_BIT);
+    glUseProgram(0);
+    djgc_stop(g_gl.clocks[CLOCK_WELD]);
+
+    g_weldIsStale = false;
+}
+
 void DispatcherKernel()
 {
     glUseProgram(g_gl.programs[PROGRAM_CBT_DISPATCH]);
@@ -551,6 +1305,10 @@ void SubdivisionKernel(int pingPong)
     glUseProgram(*program);
     int loc = glGetUniformLocation(*program, "u_TargetPosition");
     glUniform2f(loc, g_leb.params.target.x, g_leb.params.target.y);
+    if (g_leb.params.criterion == CRITERION_FEATURES) {
+        loc = glGetUniformLocation(*program, "u_LebcGridResolution");
+        glUniform1i(loc, lebc_GridResolution(g_leb.criteria));
+    }
     glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER,
                  g_gl.buffers[BUFFER_CBT_DISPATCHER]);
     glDispatchComputeIndirect(0);
@@ -587,91 +1345,101 @@ void ReleaseGui()
     ImGui::DestroyContext();
 }
 
-float Wedge(const float *a, const float *b)
-{
-    return a[0] * b[1] - a[1] * b[0];
-}
-
-bool IsInside(const float faceVertices[][3])
+/**
+ * Copies the blocks of the CBT heap that changed into the copy of the CBT
+ * buffer the GPU read two frames ago, and makes the GPU read from it.
+ *
+ * That copy misses the changes of the previous update and of the last one,
+ * i.e., the blocks that the dirty map listed then and lists now. Its fence
+ * was set once the GPU was done with it (see Draw), so the wait is normally
+ * over before it starts, and the bus traffic scales with the amount of
+ * refinement that happened during the last two frames.
+ */
+void UploadCbtBufferDirtyBlocks()
 {
-    float target[2] = {g_leb.params.target.x, g_leb.params.target.y};
-    float v1[2] = {faceVertices[0][0], faceVertices[1][0]};
-    float v2[2] = {faceVertices[0][1], faceVertices[1][1]};
-    float v3[2] = {faceVertices[0][2], faceVertices[1][2]};
-    float x1[2] = {v2[0] - v1[0], v2[1] - v1[1]};
-    float x2[2] = {v3[0] - v2[0], v3[1] - v2[1]};
-    float x3[2] = {v1[0] - v3[0], v1[1] - v3[1]};
-    float y1[2] = {target[0] - v1[0], target[1] - v1[1]};
-    float y2[2] = {target[0] - v2[0], target[1] - v2[1]};
-    float y3[2] = {target[0] - v3[0], target[1] - v3[1]};
-    float w1 = Wedge(x1, y1);
-    float w2 = Wedge(x2, y2);
-    float w3 = Wedge(x3, y3);
-
-    return (w1 >= 0.0f) && (w2 >= 0.0f) && (w3 >= 0.0f);
-}
-
-void
-UpdateSubdivisionCpuCallback_Split(
-    cbt_Tree *cbt,
-    const cbt_Node node,
-    const void *userData
-) {
-    (void)userData;
-    float faceVertices[][3] = {
-        {0.0f, 0.0f, 1.0f},
-        {1.0f, 0.0f, 0.0f}
-    };
-
-    if (g_leb.params.mode == MODE_TRIANGLE) {
-        leb_DecodeNodeAttributeArray(node, 2, faceVertices);
+    const int32_t slotID = (g_upload.slotID + 1) % CBT_UPLOAD_SLOT_COUNT;
+    const int64_t heapByteSize = cbt_HeapByteSize(g_leb.cbt);
+    const int64_t blockCount = g_dirty.dirtyBlockCount;
+    uint8_t *heap = &g_upload.mappedHeaps[slotID * g_upload.slotByteSize];
+    GLsync *fence = &g_upload.fences[slotID];
+    int64_t byteCount = 0;
+
+    if (*fence) {
+        while (glClientWaitSync(*fence,
+                                GL_SYNC_FLUSH_COMMANDS_BIT,
+                                1000000000ull) == GL_TIMEOUT_EXPIRED);
+        glDeleteSync(*fence);
+        *fence = NULL;
+    }
 
-        if (IsInside(faceVertices)) {
-            leb_SplitNode(cbt, node);
-        }
+    if (blockCount < 0 || g_upload.blockCount < 0) {
+        memcpy(heap, cbt_GetHeap(g_leb.cbt), heapByteSize);
+        byteCount = heapByteSize;
     } else {
-        leb_DecodeNodeAttributeArray_Square(node, 2, faceVertices);
+        byteCount+= cbtr_CopyBlocks(&g_dirty,
+                                    g_leb.cbt,
+                                    g_upload.blockIDs,
+                                    g_upload.blockCount,
+                                    heap);
+        byteCount+= cbtr_CopyBlocks(&g_dirty,
+                                    g_leb.cbt,
+                                    g_dirty.blockIDs,
+                                    blockCount,
+                                    heap);
+    }
 
-        if (IsInside(faceVertices)) {
-            leb_SplitNode_Square(cbt, node);
-        }
+    if (blockCount > 0)
+        memcpy(g_upload.blockIDs, g_dirty.blockIDs, blockCount * sizeof(int64_t));
+    g_upload.blockCount = blockCount;
+    g_upload.byteCount = byteCount;
+    g_upload.slotID = slotID;
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER,
+                      BUFFER_CBT,
+                      g_gl.buffers[BUFFER_CBT],
+                      slotID * g_upload.slotByteSize,
+                      heapByteSize);
+
+    if (blockCount != 0) {
+        g_leafCacheIsStale = true;
+        g_weldIsStale = true;
     }
 }
 
-void
-UpdateSubdivisionCpuCallback_Merge(
-    cbt_Tree *cbt,
-    const cbt_Node node,
-    const void *userData
-) {
-    (void)userData;
-    float baseFaceVertices[][3] = {
-        {0.0f, 0.0f, 1.0f},
-        {1.0f, 0.0f, 0.0f}
-    };
-    float topFaceVertices[][3] = {
-        {0.0f, 0.0f, 1.0f},
-        {1.0f, 0.0f, 0.0f}
+lebs_Params SubdivisionParams()
+{
+    lebs_Params params = {
+        g_leb.params.mode,
+        {g_leb.params.target.x, g_leb.params.target.y},
+        g_leb.params.criterion == CRITERION_FEATURES ? g_leb.criteria : NULL
     };
 
-    if (g_leb.params.mode == MODE_TRIANGLE) {
-        leb_DiamondParent diamondParent = leb_DecodeDiamondParent(node);
-
-        leb_DecodeNodeAttributeArray(diamondParent.base, 2, baseFaceVertices);
-        leb_DecodeNodeAttributeArray(diamondParent.top, 2, topFaceVertices);
+    return params;
+}
 
-        if (!IsInside(baseFaceVertices) && !IsInside(topFaceVertices)) {
-            leb_MergeNode(cbt, node, diamondParent);
-        }
-    } else {
-        leb_DiamondParent diamondParent = leb_DecodeDiamondParent_Square(node);
+/**
+ * Marks the weld stale once a readback shows that the epoch of the dirty
+ * block list moved, i.e., that an update modified the tree. The readback
+ * is a few frames late, so the welded draw trails the tree by as many
+ * frames, but an epoch, unlike a count of the blocks of a single update,
+ * also accounts for the frames whose readback was skipped.
+ */
+void RetrieveCbtEpoch()
+{
+    glrb_Ring *ring = &g_gl.readbacks[READBACK_CBT_EPOCH];
+    const uint32_t *epoch = (const uint32_t *)glrb_Read(ring);
 
-        leb_DecodeNodeAttributeArray_Square(diamondParent.base, 2, baseFaceVertices);
-        leb_DecodeNodeAttributeArray_Square(diamondParent.top, 2, topFaceVertices);
+    if (epoch && *epoch != g_weldEpoch) {
+        g_weldEpoch = *epoch;
+        g_weldIsStale = true;
+    }
 
-        if (!IsInside(baseFaceVertices) && !IsInside(topFaceVertices)) {
-            leb_MergeNode_Square(cbt, node, diamondParent);
-        }
+    if (glrb_CanWrite(ring)) {
+        glrb_Copy(ring,
+                  g_gl.buffers[BUFFER_CBT_DIRTY_BLOCK_LIST],
+                  4 * sizeof(uint32_t),
+                  0,
+                  sizeof(uint32_t));
+        glrb_Submit(ring);
     }
 }
 
@@ -680,22 +1448,27 @@ void UpdateSubdivision()
     static int pingPong = 0;
 
     if (g_leb.params.backend == BACKEND_CPU) {
+        cbtr_DirtyMap *dirtyMap = &g_dirty;
+        lebs_Params params = SubdivisionParams();
 
         djgc_start(g_gl.clocks[CLOCK_SUBDIVISION_SPLIT + pingPong]);
-        if (pingPong == 0) {
-            cbt_Update(g_leb.cbt, &UpdateSubdivisionCpuCallback_Split, NULL);
-        } else {
-            cbt_Update(g_leb.cbt, &UpdateSubdivisionCpuCallback_Merge, NULL);
-        }
+        if (g_leb.params.sparse)
+            lebs_UpdateSparse(g_leb.cbt, dirtyMap, &params, pingPong, &g_sparse);
+        else if (g_leb.params.batched)
+            lebs_UpdateBatched(g_leb.cbt, dirtyMap, &params, pingPong);
+        else
+            lebs_Update(g_leb.cbt, dirtyMap, &params, pingPong);
         djgc_stop(g_gl.clocks[CLOCK_SUBDIVISION_SPLIT + pingPong]);
 
-        LoadCbtBuffer();
+        UploadCbtBufferDirtyBlocks();
 
     } else {
         djgc_start(g_gl.clocks[CLOCK_DISPATCHER]);
         DispatcherKernel();
         djgc_stop(g_gl.clocks[CLOCK_DISPATCHER]);
 
+        LeafCacheKernel();
+
         djgc_start(g_gl.clocks[CLOCK_SUBDIVISION_SPLIT + pingPong]);
         SubdivisionKernel(pingPong);
         djgc_stop(g_gl.clocks[CLOCK_SUBDIVISION_SPLIT + pingPong]);
@@ -703,6 +1476,10 @@ void UpdateSubdivision()
         djgc_start(g_gl.clocks[CLOCK_SUM_REDUCTION]);
         ReductionKernel();
         djgc_stop(g_gl.clocks[CLOCK_SUM_REDUCTION]);
+
+        DirtyLeafCacheKernel();
+
+        RetrieveCbtEpoch();
     }
 
     pingPong = 1 - pingPong;
@@ -725,28 +1502,45 @@ void DrawTarget()
 
 void RetrieveNodeCount()
 {
-    static GLint isReady = GL_FALSE;
-    const GLuint *query = &g_gl.queries[QUERY_NODE_COUNT];
-
-    glGetQueryObjectiv(*query, GL_QUERY_RESULT_AVAILABLE, &isReady);
-
-    if (isReady) {
-        GLuint *buffer = &g_gl.buffers[BUFFER_TRIANGLE_COUNT];
+    glrb_Ring *ring = &g_gl.readbacks[READBACK_TRIANGLE_COUNT];
+    const int32_t *triangleCount = (const int32_t *)glrb_Read(ring);
+
+    if (triangleCount)
+        g_leb.triangleCount = *triangleCount;
+
+    if (glrb_CanWrite(ring)) {
+        glrb_Copy(ring,
+                  g_gl.buffers[BUFFER_LEB_DISPATCHER],
+                  sizeof(int32_t),
+                  0,
+                  sizeof(int32_t));
+        glrb_Submit(ring);
+    }
+}
 
-        g_leb.triangleCount = *(int *)
-            glMapNamedBuffer(*buffer, GL_READ_ONLY | GL_MAP_UNSYNCHRONIZED_BIT);
-        glUnmapNamedBuffer(g_gl.buffers[BUFFER_TRIANGLE_COUNT]);
-        glCopyNamedBufferSubData(g_gl.buffers[BUFFER_LEB_DISPATCHER],
-                                 g_gl.buffers[BUFFER_TRIANGLE_COUNT],
-                                 sizeof(int32_t),
-                                 0,
-                                 sizeof(int32_t));
-        glQueryCounter(*query, GL_TIMESTAMP);
+void RetrieveVertexCount()
+{
+    glrb_Ring *ring = &g_gl.readbacks[READBACK_VERTEX_COUNT];
+    const int32_t *vertexCount = (const int32_t *)glrb_Read(ring);
+
+    if (vertexCount)
+        g_leb.vertexCount = *vertexCount;
+
+    if (glrb_CanWrite(ring)) {
+        glrb_Copy(ring,
+                  g_gl.buffers[BUFFER_LEB_WELD_DRAW],
+                  5 * sizeof(int32_t),
+                  0,
+                  sizeof(int32_t));
+        glrb_Submit(ring);
     }
 }
 
 void DrawLeb()
 {
+    LeafCacheKernel();
+    WeldKernel();
+
     // prepare indirect draw command
     glUseProgram(g_gl.programs[PROGRAM_LEB_DISPATCH]);
     glDispatchCompute(1, 1, 1);
@@ -762,10 +1556,28 @@ void DrawLeb()
     glBindVertexArray(g_gl.vertexarrays[VERTEXARRAY_EMPTY]);
         glDrawArraysIndirect(GL_TRIANGLES, 0);
     glBindVertexArray(0);
+
+    // the welded draw is empty once the leaves no longer fit in its buffers,
+    // and the draw above is empty until then
+    if (g_leb.params.welded) {
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, g_gl.buffers[BUFFER_LEB_WELD_DRAW]);
+        glUseProgram(g_gl.programs[PROGRAM_TRIANGLES_WELDED]);
+        glUniform2f(glGetUniformLocation(g_gl.programs[PROGRAM_TRIANGLES_WELDED],
+                                         "u_ScreenResolution"),
+                    g_window.width, g_window.height);
+        glBindVertexArray(g_gl.vertexarrays[VERTEXARRAY_EMPTY]);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_gl.buffers[BUFFER_LEB_WELD_INDICES]);
+            glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
     glUseProgram(0);
     glDisable(GL_CULL_FACE);
 
     RetrieveNodeCount();
+    if (g_leb.params.welded)
+        RetrieveVertexCount();
 }
 
 void Draw()
@@ -774,7 +1586,17 @@ void Draw()
     glClear(GL_COLOR_BUFFER_BIT);
     glViewport(0, 0, g_window.width, g_window.height);
     DrawLeb();
-    DrawTarget();
+    if (g_leb.params.criterion == CRITERION_TARGET)
+        DrawTarget();
+
+    // guards the next upload to the copy of the CBT buffer drawn from
+    if (g_leb.params.backend == BACKEND_CPU) {
+        GLsync *fence = &g_upload.fences[g_upload.slotID];
+
+        if (*fence)
+            glDeleteSync(*fence);
+        *fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
 }
 
 void DrawGui()
@@ -787,6 +1609,7 @@ void DrawGui()
     {
         const char* eModes[] = {"Triangle", "Square"};
         const char* eBackends[] = {"CPU", "GPU"};
+        const char* eCriteria[] = {"Target", "Features"};
         int32_t cbtByteSize = cbt_HeapByteSize(g_leb.cbt);
         int32_t maxDepth = cbt_MaxDepth(g_leb.cbt);
         double cpuDt, gpuDt;
@@ -800,8 +1623,42 @@ void DrawGui()
             cbt_ResetToDepth(g_leb.cbt, CBT_INIT_MAX_DEPTH);
             LoadCbtBuffer();
         }
-        ImGui::SliderFloat("TargetX", &g_leb.params.target.x, -0.1, 1.1);
-        ImGui::SliderFloat("TargetY", &g_leb.params.target.y, -0.1, 1.1);
+        if (ImGui::Combo("Criterion", &g_leb.params.criterion, &eCriteria[0], 2)) {
+            cbt_ResetToDepth(g_leb.cbt, CBT_INIT_MAX_DEPTH);
+            LoadCbtBuffer();
+            LoadPrograms();
+        }
+        if (g_leb.params.backend == BACKEND_CPU) {
+            ImGui::Checkbox("Batched", &g_leb.params.batched);
+            ImGui::SameLine();
+            ImGui::Checkbox("Sparse", &g_leb.params.sparse);
+            ImGui::SameLine();
+        }
+        if (ImGui::Checkbox("Incremental", &g_leb.params.incremental)) {
+            cbt_ResetToDepth(g_leb.cbt, CBT_INIT_MAX_DEPTH);
+            LoadCbtBuffer();
+            LoadPrograms();
+        }
+        ImGui::SameLine();
+        if (ImGui::Checkbox("Leaf Cache", &g_leb.params.leafCache)) {
+            cbt_ResetToDepth(g_leb.cbt, CBT_INIT_MAX_DEPTH);
+            LoadCbtBuffer();
+            LoadPrograms();
+        }
+        ImGui::SameLine();
+        if (ImGui::Checkbox("Welded", &g_leb.params.welded)) {
+            LoadLebWeldBuffers();
+            LoadPrograms();
+        }
+        if (g_leb.params.criterion == CRITERION_TARGET) {
+            ImGui::SliderFloat("TargetX", &g_leb.params.target.x, -0.1, 1.1);
+            ImGui::SliderFloat("TargetY", &g_leb.params.target.y, -0.1, 1.1);
+        } else {
+            ImGui::Text("Features: %li (%ix%i grid)",
+                        (long)lebc_FeatureCount(g_leb.criteria),
+                        lebc_GridResolution(g_leb.criteria),
+                        lebc_GridResolution(g_leb.criteria));
+        }
         if (ImGui::SliderInt("MaxDepth", &maxDepth, 6, 30)) {
             cbt_Release(g_leb.cbt);
             g_leb.cbt = cbt_CreateAtDepth(maxDepth, CBT_INIT_MAX_DEPTH);
@@ -812,11 +1669,39 @@ void DrawGui()
             cbt_ResetToDepth(g_leb.cbt, CBT_INIT_MAX_DEPTH);
             LoadCbtBuffer();
         }
+        if (g_leb.params.backend == BACKEND_CPU) {
+            static int32_t passCount = 0;
+            lebs_Params params = SubdivisionParams();
+
+            ImGui::SameLine();
+            if (ImGui::Button("Converge")) {
+                lebs_Converge(g_leb.cbt, &g_dirty, &params, 8 * maxDepth, &passCount);
+                lebs_SparseStateInvalidate(&g_sparse);
+
+                // the dirty map only lists the blocks of the last pass
+                g_dirty.dirtyBlockCount = -1;
+                UploadCbtBufferDirtyBlocks();
+            }
+            ImGui::SameLine();
+            ImGui::Text("(%i passes)", passCount);
+        }
         ImGui::Separator();
         ImGui::Text("Nodes: %i", g_leb.triangleCount);
+        if (g_leb.params.welded)
+            ImGui::Text("Vertices: %i (%.2f per triangle)",
+                        g_leb.vertexCount,
+                        g_leb.vertexCount / std::max(1.0, (double)g_leb.triangleCount));
         ImGui::Text("Mem Usage: %u %s",
                     cbtByteSize >= (1 << 20) ? (cbtByteSize >> 20) : (cbtByteSize >= (1 << 10) ? cbtByteSize >> 10 : cbtByteSize),
                     cbtByteSize >= (1 << 20) ? "MiB" : (cbtByteSize > (1 << 10) ? "KiB" : "B"));
+        if (g_leb.params.backend == BACKEND_CPU)
+            ImGui::Text("Upload: %.1f KiB", g_upload.byteCount / 1024.0);
+        if (g_leb.params.backend == BACKEND_CPU && g_leb.params.sparse)
+            ImGui::Text("Visited: %li", (long)g_sparse.visitedNodeCount);
+        if (g_leb.params.backend == BACKEND_CPU && g_dirty.dirtyBlockCount >= 0)
+            ImGui::Text("Dirty Blocks: %li / %li",
+                        (long)g_dirty.dirtyBlockCount,
+                        (long)(1L << g_dirty.blockDepth));
         ImGui::Text("Timings (ms)");
         if (g_leb.params.backend == BACKEND_CPU) {
             djgc_ticks(g_gl.clocks[CLOCK_SUBDIVISION_SPLIT], &cpuDt, &gpuDt);
@@ -833,6 +1718,14 @@ void DrawGui()
             djgc_ticks(g_gl.clocks[CLOCK_SUM_REDUCTION], &cpuDt, &gpuDt);
             ImGui::Text("SumReduction:        %.3f (CPU) %.3f (GPU)", cpuDt * 1e3, gpuDt * 1e3);
         }
+        if (g_leb.params.leafCache) {
+            djgc_ticks(g_gl.clocks[CLOCK_LEAF_CACHE], &cpuDt, &gpuDt);
+            ImGui::Text("LeafCache:           %.3f (CPU) %.3f (GPU)", cpuDt * 1e3, gpuDt * 1e3);
+        }
+        if (g_leb.params.welded) {
+            djgc_ticks(g_gl.clocks[CLOCK_WELD], &cpuDt, &gpuDt);
+            ImGui::Text("Weld:                %.3f (CPU) %.3f (GPU)", cpuDt * 1e3, gpuDt * 1e3);
+        }
     }
     ImGui::End();
     ImGui::Render();
@@ -849,8 +1742,34 @@ void resizeCallback(GLFWwindow* window, int width, int height)
 }
 
 
+void Usage(const char *app)
+{
+    LOG("usage: %s [--snapshot subdivision.cbts]", app);
+}
+
+// warm starting is opt-in, since it writes a file on exit
+bool ParseCommandLine(int argc, char **argv)
+{
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--snapshot") && i + 1 < argc) {
+            g_snapshot.path = argv[++i];
+            g_snapshot.warmStart = true;
+        } else {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 int main(int argc, char **argv)
 {
+    if (!ParseCommandLine(argc, argv)) {
+        Usage(argv[0]);
+
+        return EXIT_FAILURE;
+    }
+
     LOG("Loading {OpenGL Window}");
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, g_window.glversion.major);
@@ -901,8 +1820,13 @@ int main(int argc, char **argv)
         glfwSwapBuffers(g_window.handle);
     }
 
+    if (g_snapshot.warmStart && !SaveSnapshot()) {
+        LOG("=> Snapshot Failure <=");
+    }
     Release();
+    lebs_SparseStateRelease(&g_sparse);
     cbt_Release(g_leb.cbt);
+    lebc_Release(g_leb.criteria);
     ReleaseGui();
     glfwTerminate();
 
@@ -0,0 +1,448 @@
+#ifndef DMT_INCLUDE_DMT_H
+#define DMT_INCLUDE_DMT_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef DMT_STATIC
+#define DMTDEF static
+#else
+#define DMTDEF extern
+#endif
+
+#define DMT_VERSION 1
+
+// enough levels for a 2^20 x 2^20 texture with 64 x 64 tiles
+#define DMT_MAX_LEVEL_COUNT 16
+
+// texels shared with each neighbouring tile, so that bilinear lookups
+// never straddle two pages
+#define DMT_TILE_BORDER 1
+
+// byte alignment of the tiles within the file
+#define DMT_ALIGNMENT 4096
+
+// page table entry of a tile that is not resident
+#define DMT_PAGE_NULL 0xFFFFFFFFu
+
+// stamp of a page that must never be evicted
+#define DMT_STAMP_PINNED 0xFFFFFFFFu
+
+// on-disk header; the tiles start at byte DMT_ALIGNMENT
+typedef struct {
+    char magic[4];          // "DMTS"
+    uint32_t version;       // DMT_VERSION
+    int32_t width;          // width of the finest level
+    int32_t height;         // height of the finest level
+    int32_t tileSize;       // texels per tile side, borders excluded
+    int32_t levelCount;     // levels stored, the last one fits in one tile
+    int64_t tileCount;      // tiles of all levels
+    uint64_t tileStride;    // bytes between two consecutive tiles
+    uint8_t reserved[24];   // pads the header to 64 bytes
+} dmt_Header;
+
+// tiling of a mip level
+typedef struct {
+    int32_t width, height;          // in texels
+    int32_t tileCountX, tileCountY;
+    int64_t firstTileID;            // ID of the first tile of the level
+} dmt_Level;
+
+// tile store opened for reading
+typedef struct {
+    FILE *stream;
+    int32_t width, height;
+    int32_t tileSize;               // texels per tile side, borders excluded
+    int32_t pageSize;               // texels per tile side, borders included
+    int32_t levelCount;
+    int64_t tileCount;
+    int64_t tileByteSize;           // bytes of RG16 texels per tile
+    int64_t tileStride;
+    dmt_Level levels[DMT_MAX_LEVEL_COUNT];
+} dmt_Store;
+
+// residency of the tiles in a fixed-size pool of pages
+typedef struct {
+    int32_t pageCount;
+    int64_t tileCount;
+    int64_t *pageTiles;             // tile held by each page, or -1
+    uint32_t *pageStamps;           // frame of the last request of each page
+    uint32_t *tilePages;            // page of each tile, or DMT_PAGE_NULL
+} dmt_Cache;
+
+// writes a store from a mip chain of RG16 (z, z^2) textures, where level
+// i has max(1, width >> i) x max(1, height >> i) texels; returns false if
+// the chain is too short or the file can't be written
+DMTDEF bool dmt_Build(const char *path,
+                      const uint16_t *const *levels,
+                      int32_t width,
+                      int32_t height,
+                      int32_t levelCount,
+                      int32_t tileSize);
+
+// store I/O
+DMTDEF bool dmt_Open(const char *path, dmt_Store *store);
+DMTDEF void dmt_Close(dmt_Store *store);
+DMTDEF bool dmt_ReadTile(dmt_Store *store, int64_t tileID, uint16_t *texels);
+DMTDEF int64_t dmt_TileID(const dmt_Store *store, int32_t level, int32_t x, int32_t y);
+DMTDEF int32_t dmt_TileLevel(const dmt_Store *store, int64_t tileID);
+
+// residency cache
+DMTDEF bool dmt_CreateCache(const dmt_Store *store, int32_t pageCount, dmt_Cache *cache);
+DMTDEF void dmt_ReleaseCache(dmt_Cache *cache);
+DMTDEF bool dmt_TouchTile(dmt_Cache *cache, int64_t tileID, uint32_t frame);
+DMTDEF int32_t dmt_MapTile(dmt_Cache *cache,
+                           int64_t tileID,
+                           uint32_t frame,
+                           int64_t *evictedTileID);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+//
+//
+//// end header file ///////////////////////////////////////////////////////////
+#endif // DMT_INCLUDE_DMT_H
+
+#ifdef DMT_IMPLEMENTATION
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#   define dmt__fseek _fseeki64
+#else
+#   define dmt__fseek fseeko
+#endif
+
+
+/*******************************************************************************
+ * Tiling -- Computes the tiles of each level
+ *
+ * Level i has max(1, width >> i) x max(1, height >> i) texels, as in a GL
+ * mip chain, and the last level is the first one that fits in a single
+ * tile. The tiles are stored level by level, in row-major order.
+ *
+ */
+static int32_t
+dmt__LoadLevels(
+    int32_t width,
+    int32_t height,
+    int32_t tileSize,
+    dmt_Level *levels,
+    int64_t *tileCount
+) {
+    int32_t levelCount = 0;
+
+    *tileCount = 0;
+    while (levelCount < DMT_MAX_LEVEL_COUNT) {
+        dmt_Level *level = &levels[levelCount];
+
+        level->width  = width  >> levelCount; if (level->width  < 1) level->width  = 1;
+        level->height = height >> levelCount; if (level->height < 1) level->height = 1;
+        level->tileCountX = (level->width  + tileSize - 1) / tileSize;
+        level->tileCountY = (level->height + tileSize - 1) / tileSize;
+        level->firstTileID = *tileCount;
+        *tileCount+= (int64_t)level->tileCountX * level->tileCountY;
+        ++levelCount;
+
+        if (level->tileCountX == 1 && level->tileCountY == 1)
+            return levelCount;
+    }
+
+    return 0;
+}
+
+static int64_t dmt__TileStride(int32_t tileSize)
+{
+    int64_t pageSize = tileSize + 2 * DMT_TILE_BORDER;
+    int64_t byteSize = pageSize * pageSize * 2 * sizeof(uint16_t);
+
+    return (byteSize + DMT_ALIGNMENT - 1) / DMT_ALIGNMENT * DMT_ALIGNMENT;
+}
+
+
+/*******************************************************************************
+ * Build -- Writes a mip chain to disk, one tile at a time
+ *
+ * Each tile stores its tileSize^2 texels along with a border of
+ * DMT_TILE_BORDER texels copied from its neighbours (or clamped at the
+ * edges of the level), so a page can be filtered on its own.
+ *
+ */
+DMTDEF bool
+dmt_Build(
+    const char *path,
+    const uint16_t *const *levels,
+    int32_t width,
+    int32_t height,
+    int32_t levelCount,
+    int32_t tileSize
+) {
+    dmt_Level tiling[DMT_MAX_LEVEL_COUNT];
+    dmt_Header header;
+    int32_t pageSize = tileSize + 2 * DMT_TILE_BORDER;
+    int64_t tileStride = dmt__TileStride(tileSize);
+    uint16_t *texels;
+    FILE *stream;
+    bool success = true;
+
+    if (tileSize < 1)
+        return false;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "DMTS", 4);
+    header.version = DMT_VERSION;
+    header.width = width;
+    header.height = height;
+    header.tileSize = tileSize;
+    header.levelCount = dmt__LoadLevels(width, height, tileSize,
+                                        tiling, &header.tileCount);
+    header.tileStride = (uint64_t)tileStride;
+
+    if (header.levelCount == 0 || header.levelCount > levelCount)
+        return false;
+
+    // the padding bytes of the buffer are written along with each tile
+    texels = (uint16_t *)calloc(tileStride, 1);
+    if (!texels)
+        return false;
+
+    stream = fopen(path, "wb");
+    if (!stream) {
+        free(texels);
+
+        return false;
+    }
+
+    memcpy(texels, &header, sizeof(header));
+    success = fwrite(texels, DMT_ALIGNMENT, 1, stream) == 1;
+    memset(texels, 0, sizeof(header));
+
+    for (int32_t levelID = 0; levelID < header.levelCount && success; ++levelID) {
+        const dmt_Level *level = &tiling[levelID];
+        const uint16_t *src = levels[levelID];
+
+        for (int32_t tileY = 0; tileY < level->tileCountY && success; ++tileY)
+        for (int32_t tileX = 0; tileX < level->tileCountX && success; ++tileX) {
+            for (int32_t j = 0; j < pageSize; ++j)
+            for (int32_t i = 0; i < pageSize; ++i) {
+                int32_t x = tileX * tileSize + i - DMT_TILE_BORDER;
+                int32_t y = tileY * tileSize + j - DMT_TILE_BORDER;
+
+                x = x < 0 ? 0 : (x >= level->width  ? level->width  - 1 : x);
+                y = y < 0 ? 0 : (y >= level->height ? level->height - 1 : y);
+                texels[2 * (i + pageSize * j)    ] = src[2 * (x + level->width * y)    ];
+                texels[2 * (i + pageSize * j) + 1] = src[2 * (x + level->width * y) + 1];
+            }
+
+            success = fwrite(texels, tileStride, 1, stream) == 1;
+        }
+    }
+
+    free(texels);
+    fclose(stream);
+
+    return success;
+}
+
+
+/*******************************************************************************
+ * Open -- Reads the header of a store and keeps the file open
+ *
+ */
+DMTDEF bool dmt_Open(const char *path, dmt_Store *store)
+{
+    dmt_Header header;
+    int64_t tileCount;
+
+    store->stream = fopen(path, "rb");
+    if (!store->stream)
+        return false;
+
+    if (fread(&header, sizeof(header), 1, store->stream) != 1
+        || memcmp(header.magic, "DMTS", 4) != 0
+        || header.version != DMT_VERSION
+        || header.tileSize < 1
+        || dmt__LoadLevels(header.width, header.height, header.tileSize,
+                           store->levels, &tileCount) != header.levelCount
+        || tileCount != header.tileCount
+        || (int64_t)header.tileStride != dmt__TileStride(header.tileSize)) {
+        fclose(store->stream);
+        store->stream = NULL;
+
+        return false;
+    }
+
+    store->width = header.width;
+    store->height = header.height;
+    store->tileSize = header.tileSize;
+    store->pageSize = header.tileSize + 2 * DMT_TILE_BORDER;
+    store->levelCount = header.levelCount;
+    store->tileCount = header.tileCount;
+    store->tileByteSize = (int64_t)store->pageSize * store->pageSize
+                        * 2 * sizeof(uint16_t);
+    store->tileStride = (int64_t)header.tileStride;
+
+    return true;
+}
+
+DMTDEF void dmt_Close(dmt_Store *store)
+{
+    if (store->stream)
+        fclose(store->stream);
+    store->stream = NULL;
+}
+
+
+/*******************************************************************************
+ * ReadTile -- Reads the pageSize^2 RG16 texels of a tile
+ *
+ * The store holds a single file position, so tiles must be read from one
+ * thread at a time.
+ *
+ */
+DMTDEF bool dmt_ReadTile(dmt_Store *store, int64_t tileID, uint16_t *texels)
+{
+    int64_t offset = DMT_ALIGNMENT + tileID * store->tileStride;
+
+    if (tileID < 0 || tileID >= store->tileCount)
+        return false;
+
+    return dmt__fseek(store->stream, offset, SEEK_SET) == 0
+        && fread(texels, store->tileByteSize, 1, store->stream) == 1;
+}
+
+
+/*******************************************************************************
+ * TileID -- Converts tile coordinates into a tile ID and back
+ *
+ */
+DMTDEF int64_t
+dmt_TileID(const dmt_Store *store, int32_t level, int32_t x, int32_t y)
+{
+    const dmt_Level *tiling = &store->levels[level];
+
+    return tiling->firstTileID + x + (int64_t)tiling->tileCountX * y;
+}
+
+DMTDEF int32_t dmt_TileLevel(const dmt_Store *store, int64_t tileID)
+{
+    int32_t level = store->levelCount - 1;
+
+    while (level > 0 && store->levels[level].firstTileID > tileID)
+        --level;
+
+    return level;
+}
+
+
+/*******************************************************************************
+ * CreateCache -- Allocates an empty residency cache
+ *
+ */
+DMTDEF bool
+dmt_CreateCache(const dmt_Store *store, int32_t pageCount, dmt_Cache *cache)
+{
+    cache->pageCount = pageCount;
+    cache->tileCount = store->tileCount;
+    cache->pageTiles = (int64_t *)malloc(sizeof(int64_t) * pageCount);
+    cache->pageStamps = (uint32_t *)calloc(pageCount, sizeof(uint32_t));
+    cache->tilePages = (uint32_t *)malloc(sizeof(uint32_t) * store->tileCount);
+
+    if (!cache->pageTiles || !cache->pageStamps || !cache->tilePages) {
+        dmt_ReleaseCache(cache);
+
+        return false;
+    }
+
+    for (int32_t pageID = 0; pageID < pageCount; ++pageID)
+        cache->pageTiles[pageID] = -1;
+    for (int64_t tileID = 0; tileID < store->tileCount; ++tileID)
+        cache->tilePages[tileID] = DMT_PAGE_NULL;
+
+    return true;
+}
+
+DMTDEF void dmt_ReleaseCache(dmt_Cache *cache)
+{
+    free(cache->pageTiles);
+    free(cache->pageStamps);
+    free(cache->tilePages);
+    cache->pageTiles = NULL;
+    cache->pageStamps = NULL;
+    cache->tilePages = NULL;
+}
+
+
+/*******************************************************************************
+ * TouchTile -- Marks a tile as used during a frame
+ *
+ * Returns true if the tile is resident.
+ *
+ */
+DMTDEF bool dmt_TouchTile(dmt_Cache *cache, int64_t tileID, uint32_t frame)
+{
+    uint32_t pageID = cache->tilePages[tileID];
+
+    if (pageID == DMT_PAGE_NULL)
+        return false;
+
+    if (cache->pageStamps[pageID] != DMT_STAMP_PINNED)
+        cache->pageStamps[pageID] = frame;
+
+    return true;
+}
+
+
+/*******************************************************************************
+ * MapTile -- Assigns a page to a tile
+ *
+ * Free pages are used first; otherwise, the least recently used page gets
+ * evicted, and its tile is returned in evictedTileID (-1 if none). Pages
+ * used during the current frame are never evicted, so -1 is returned if
+ * they all are. The pool holds a few hundred pages at most, so a linear
+ * search is cheaper than maintaining an ordered list.
+ *
+ */
+DMTDEF int32_t
+dmt_MapTile(
+    dmt_Cache *cache,
+    int64_t tileID,
+    uint32_t frame,
+    int64_t *evictedTileID
+) {
+    int32_t lruPageID = -1;
+
+    *evictedTileID = -1;
+    for (int32_t pageID = 0; pageID < cache->pageCount; ++pageID) {
+        if (cache->pageTiles[pageID] < 0) {
+            lruPageID = pageID;
+            break;
+        }
+
+        if (cache->pageStamps[pageID] < frame
+            && (lruPageID < 0
+                || cache->pageStamps[pageID] < cache->pageStamps[lruPageID])) {
+            lruPageID = pageID;
+        }
+    }
+
+    if (lruPageID < 0)
+        return -1;
+
+    if (cache->pageTiles[lruPageID] >= 0) {
+        *evictedTileID = cache->pageTiles[lruPageID];
+        cache->tilePages[*evictedTileID] = DMT_PAGE_NULL;
+    }
+    cache->pageTiles[lruPageID] = tileID;
+    cache->pageStamps[lruPageID] = frame;
+    cache->tilePages[tileID] = (uint32_t)lruPageID;
+
+    return lruPageID;
+}
+
+#endif // DMT_IMPLEMENTATION
@@ -0,0 +1,1210 @@
+#ifndef LEBT_INCLUDE_LEBT_H
+#define LEBT_INCLUDE_LEBT_H
+
+#include "CbtLeaves.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef LEBT_STATIC
+#define LEBTDEF static
+#else
+#define LEBTDEF extern
+#endif
+
+// same values as the PROJECTION_* enums of terrain.cpp
+enum {
+    LEBT_PROJECTION_ORTHOGRAPHIC,
+    LEBT_PROJECTION_RECTILINEAR,
+    LEBT_PROJECTION_FISHEYE
+};
+
+// number of intermediate points tested by the horizon occlusion test
+#ifndef LEBT_HORIZON_SAMPLE_COUNT
+#define LEBT_HORIZON_SAMPLE_COUNT 4
+#endif
+
+// outcome of the culling tests of a triangle
+enum {
+    LEBT_CULL_NONE,                 // the triangle is visible
+    LEBT_CULL_FRUSTUM,              // the triangle lies outside the frustum
+    LEBT_CULL_HORIZON,              // the triangle lies behind nearer terrain
+
+    LEBT_CULL_COUNT
+};
+
+// min/max pyramid of the heights of a dmap, whose levels have the same
+// resolution as the mip levels of the dmap; the last texel of a row or a
+// column also covers the texels that odd resolutions leave out
+typedef struct {
+    int32_t width, height;          // resolution of the first level
+    int32_t levelCount;
+    uint16_t **levels;              // (min height, max height) texel pairs
+} lebt_DmapBounds;
+
+// CPU copy of the RG16 displacement texture and its mip chain
+typedef struct {
+    int32_t width, height;          // resolution of the first level
+    int32_t levelCount;
+    uint16_t **levels;              // (height, squared height) texel pairs
+    lebt_DmapBounds *bounds;
+} lebt_Dmap;
+
+// depth of the deepest nodes of an lebt_NodeErrors table
+#ifndef LEBT_NODE_ERROR_MAX_DEPTH
+#define LEBT_NODE_ERROR_MAX_DEPTH 22
+#endif
+
+// geometric errors of the LEB nodes of the unit square, stored as an
+// implicit heap indexed by node ID (entry 2^d + k belongs to the k-th node
+// at depth d); errors are in units of 1 / 65535 of the normalized height
+typedef struct {
+    int32_t depth;                  // depth of the deepest nodes
+    uint16_t *errors;               // 2^(depth + 1) entries
+} lebt_NodeErrors;
+
+// CPU counterpart of the terrain shader variables
+typedef struct {
+    float modelView[4][4];          // row-major model-view matrix
+    float frustumPlanes[6][4];      // see lebt_LoadFrustumPlanes
+    float lodFactor;                // u_LodFactor (see computeLodFactor)
+    float dmapFactor;               // u_DmapFactor
+    float minLodVariance;           // u_MinLodVariance
+    float errorFactor;              // u_ErrorFactor (see computeErrorFactor)
+    float cameraPosition[3];        // u_LocalCameraPosition
+    int32_t projection;             // one of LEBT_PROJECTION_*
+    bool displace;                  // FLAG_DISPLACE (requires a dmap)
+    bool cull;                      // FLAG_CULL
+    bool horizon;                   // FLAG_HORIZON_CULL
+    const lebt_Dmap *dmap;
+    const lebt_NodeErrors *nodeErrors; // FLAG_NODE_ERRORS if not NULL
+} lebt_Params;
+
+// creates the mip chain of a 16-bit heightmap like LoadDmapTexture16 does
+LEBTDEF lebt_Dmap *lebt_CreateDmap(const uint16_t *texels, int32_t width, int32_t height);
+LEBTDEF void lebt_ReleaseDmap(lebt_Dmap *dmap);
+
+// creates the min/max pyramid of a 16-bit heightmap whose heights are
+// texelStride values apart, e.g., 2 for the RG16 texels of a dmap
+LEBTDEF lebt_DmapBounds *lebt_CreateDmapBounds(const uint16_t *texels,
+                                               int32_t texelStride,
+                                               int32_t width,
+                                               int32_t height);
+LEBTDEF void lebt_ReleaseDmapBounds(lebt_DmapBounds *bounds);
+
+// computes the distance between a 16-bit heightmap and the planar triangle
+// of each node, down to the depth at which nodes cover about one texel; the
+// error of a node bounds the errors of its descendants
+LEBTDEF lebt_NodeErrors *lebt_CreateNodeErrors(const uint16_t *texels,
+                                               int32_t texelStride,
+                                               int32_t width,
+                                               int32_t height);
+// errors of the patches that the GPU tessellates each node into, i.e., of
+// the descendants 2 * patchSubdLevel levels deeper than the node
+LEBTDEF lebt_NodeErrors *lebt_CreatePatchErrors(const lebt_NodeErrors *nodeErrors,
+                                                int32_t patchSubdLevel);
+LEBTDEF void lebt_ReleaseNodeErrors(lebt_NodeErrors *nodeErrors);
+
+// normalized error of a node; nodes deeper than the table get the error of
+// their ancestor, halved at each level
+LEBTDEF float lebt_NodeError(const lebt_NodeErrors *nodeErrors, const cbt_Node node);
+
+// extracts the frustum planes of a row-major model-view-projection matrix
+LEBTDEF void lebt_LoadFrustumPlanes(const float modelViewProjection[4][4],
+                                    float frustumPlanes[6][4]);
+
+// counterparts of the GLSL routines of TerrainRenderCommon.glsl
+LEBTDEF void lebt_DecodeTriangleVertices(const lebt_Params *params,
+                                         const cbt_Node node,
+                                         float triangleVertices[3][4]);
+LEBTDEF void lebt_LevelOfDetail(const lebt_Params *params,
+                                const cbt_Node node,
+                                const float triangleVertices[3][4],
+                                float lod[2]);
+
+// runs the culling tests of lebt_LevelOfDetail; returns one of LEBT_CULL_*
+LEBTDEF int32_t lebt_CullingTest(const lebt_Params *params,
+                                 const float triangleVertices[3][4]);
+
+// counts the leaves of a CBT that pass or fail each culling test, i.e.,
+// counts[LEBT_CULL_*]
+LEBTDEF void lebt_CountCulledLeaves(const cbt_Tree *cbt,
+                                    const lebt_Params *params,
+                                    int64_t counts[LEBT_CULL_COUNT]);
+
+// cbt_Update callbacks (userData must point to an lebt_Params)
+LEBTDEF void lebt_SplitCallback(cbt_Tree *cbt,
+                                const cbt_Node node,
+                                const void *userData);
+LEBTDEF void lebt_MergeCallback(cbt_Tree *cbt,
+                                const cbt_Node node,
+                                const void *userData);
+
+// single split (pingPong == 0) or merge (pingPong == 1) pass, which
+// mirrors the dispatch of TerrainUpdateCS.glsl
+LEBTDEF void lebt_Update(cbt_Tree *cbt, const lebt_Params *params, int pingPong);
+
+// alternates split and merge passes until a pair of passes leaves the tree
+// unchanged, or until passBudget passes were run; returns true if the tree
+// reached a fixed point
+LEBTDEF bool lebt_Converge(cbt_Tree *cbt,
+                           const lebt_Params *params,
+                           int32_t passBudget,
+                           int32_t *passCount);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+//
+//
+//// end header file ///////////////////////////////////////////////////////////
+#endif // LEBT_INCLUDE_LEBT_H
+
+#ifdef LEBT_IMPLEMENTATION
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/*******************************************************************************
+ * CreateDmap -- Builds the CPU copy of the displacement texture
+ *
+ * The texels are stored as in the GL_RG16 texture of the demo: the first
+ * channel holds the height, and the second one its square. Each mip level
+ * is the box-filtered, rounded down-sample of the previous one, which is
+ * what glGenerateMipmap produces on common implementations.
+ *
+ */
+static uint16_t *lebt__DmapTexel(const lebt_Dmap *dmap, int32_t level, int32_t i, int32_t j)
+{
+    int32_t w = dmap->width  >> level; if (w < 1) w = 1;
+
+    return &dmap->levels[level][2 * (i + w * j)];
+}
+
+LEBTDEF lebt_Dmap *
+lebt_CreateDmap(const uint16_t *texels, int32_t width, int32_t height)
+{
+    lebt_Dmap *dmap = (lebt_Dmap *)malloc(sizeof(*dmap));
+    int32_t maxSize = width > height ? width : height;
+
+    dmap->width = width;
+    dmap->height = height;
+    dmap->levelCount = 1;
+    while ((maxSize >> dmap->levelCount) > 0)
+        ++dmap->levelCount;
+    dmap->levels = (uint16_t **)malloc(sizeof(uint16_t *) * dmap->levelCount);
+
+    for (int32_t level = 0; level < dmap->levelCount; ++level) {
+        int32_t w = width  >> level; if (w < 1) w = 1;
+        int32_t h = height >> level; if (h < 1) h = 1;
+
+        dmap->levels[level] = (uint16_t *)malloc(sizeof(uint16_t) * 2 * w * h);
+
+        for (int32_t j = 0; j < h; ++j)
+        for (int32_t i = 0; i < w; ++i) {
+            uint16_t *texel = lebt__DmapTexel(dmap, level, i, j);
+
+            if (level == 0) {
+                uint16_t z = texels[i + width * j];
+                float zf = (float)z / (float)((1 << 16) - 1);
+
+                texel[0] = z;
+                texel[1] = (uint16_t)(zf * zf * ((1 << 16) - 1));
+            } else {
+                int32_t pw = width  >> (level - 1); if (pw < 1) pw = 1;
+                int32_t ph = height >> (level - 1); if (ph < 1) ph = 1;
+                int32_t i1 = 2 * i + 1 < pw ? 2 * i + 1 : pw - 1;
+                int32_t j1 = 2 * j + 1 < ph ? 2 * j + 1 : ph - 1;
+
+                for (int32_t c = 0; c < 2; ++c) {
+                    uint32_t sum = lebt__DmapTexel(dmap, level - 1, 2 * i, 2 * j)[c]
+                                 + lebt__DmapTexel(dmap, level - 1, i1   , 2 * j)[c]
+                                 + lebt__DmapTexel(dmap, level - 1, 2 * i, j1   )[c]
+                                 + lebt__DmapTexel(dmap, level - 1, i1   , j1   )[c];
+
+                    texel[c] = (uint16_t)((sum + 2u) / 4u);
+                }
+            }
+        }
+    }
+    dmap->bounds = lebt_CreateDmapBounds(texels, 1, width, height);
+
+    return dmap;
+}
+
+LEBTDEF void lebt_ReleaseDmap(lebt_Dmap *dmap)
+{
+    for (int32_t level = 0; level < dmap->levelCount; ++level)
+        free(dmap->levels[level]);
+
+    lebt_ReleaseDmapBounds(dmap->bounds);
+    free(dmap->levels);
+    free(dmap);
+}
+
+
+/*******************************************************************************
+ * CreateDmapBounds -- Builds the min/max pyramid of a heightmap
+ *
+ * Each texel of a level holds the range of the 2x2 texels of the previous
+ * level it covers. When the previous level has an odd resolution, the last
+ * texel of each row (resp. column) also covers the texel that a 2x2
+ * footprint misses, so that a texel at level L covers the texels
+ * [i 2^L, (i + 1) 2^L) of the first level, except for the last one, which
+ * covers the remaining texels.
+ *
+ */
+static uint16_t *
+lebt__DmapBoundsTexel(const lebt_DmapBounds *bounds, int32_t level, int32_t i, int32_t j)
+{
+    int32_t w = bounds->width  >> level; if (w < 1) w = 1;
+
+    return &bounds->levels[level][2 * (i + w * j)];
+}
+
+LEBTDEF lebt_DmapBounds *
+lebt_CreateDmapBounds(
+    const uint16_t *texels,
+    int32_t texelStride,
+    int32_t width,
+    int32_t height
+) {
+    lebt_DmapBounds *bounds = (lebt_DmapBounds *)malloc(sizeof(*bounds));
+    int32_t maxSize = width > height ? width : height;
+
+    bounds->width = width;
+    bounds->height = height;
+    bounds->levelCount = 1;
+    while ((maxSize >> bounds->levelCount) > 0)
+        ++bounds->levelCount;
+    bounds->levels = (uint16_t **)malloc(sizeof(uint16_t *) * bounds->levelCount);
+
+    for (int32_t level = 0; level < bounds->levelCount; ++level) {
+        int32_t w = width  >> level; if (w < 1) w = 1;
+        int32_t h = height >> level; if (h < 1) h = 1;
+        int32_t pw = level > 0 ? width  >> (level - 1) : width;  if (pw < 1) pw = 1;
+        int32_t ph = level > 0 ? height >> (level - 1) : height; if (ph < 1) ph = 1;
+
+        bounds->levels[level] = (uint16_t *)malloc(sizeof(uint16_t) * 2 * w * h);
+
+#pragma omp parallel for
+        for (int32_t j = 0; j < h; ++j)
+        for (int32_t i = 0; i < w; ++i) {
+            uint16_t *texel = lebt__DmapBoundsTexel(bounds, level, i, j);
+
+            if (level == 0) {
+                uint16_t z = texels[texelStride * (i + (int64_t)width * j)];
+
+                texel[0] = texel[1] = z;
+            } else {
+                int32_t i1 = (i == w - 1) ? pw - 1 : 2 * i + 1;
+                int32_t j1 = (j == h - 1) ? ph - 1 : 2 * j + 1;
+
+                texel[0] = 0xFFFF;
+                texel[1] = 0;
+                for (int32_t y = 2 * j; y <= j1; ++y)
+                for (int32_t x = 2 * i; x <= i1; ++x) {
+                    const uint16_t *child = lebt__DmapBoundsTexel(bounds, level - 1, x, y);
+
+                    texel[0] = child[0] < texel[0] ? child[0] : texel[0];
+                    texel[1] = child[1] > texel[1] ? child[1] : texel[1];
+                }
+            }
+        }
+    }
+
+    return bounds;
+}
+
+LEBTDEF void lebt_ReleaseDmapBounds(lebt_DmapBounds *bounds)
+{
+    for (int32_t level = 0; level < bounds->levelCount; ++level)
+        free(bounds->levels[level]);
+
+    free(bounds->levels);
+    free(bounds);
+}
+
+
+/*******************************************************************************
+ * CreateNodeErrors -- Builds the geometric error table of a heightmap
+ *
+ * The triangle of a node is displaced by the heights that
+ * DecodeTriangleVertices fetches at its vertices, and its error is the
+ * largest vertical distance between that triangle and the texels whose
+ * centers it covers. Each error is then raised to the errors of the
+ * children of the node, so that the error of a node bounds those of its
+ * whole subtree. The table stops at the depth where nodes cover about one
+ * texel (see lebt_NodeError for deeper nodes).
+ *
+ */
+typedef struct {
+    const uint16_t *texels;
+    int32_t texelStride, width, height;
+    int32_t depth;
+    float splitMatrices[2][3][3];   // vertices of the children of a node
+    uint16_t *errors;
+} lebt__NodeErrorContext;
+
+static float
+lebt__NodeErrorTexel(const lebt__NodeErrorContext *ctx, int32_t i, int32_t j)
+{
+    i = i < 0 ? 0 : (i >= ctx->width  ? ctx->width  - 1 : i);
+    j = j < 0 ? 0 : (j >= ctx->height ? ctx->height - 1 : j);
+
+    return ctx->texels[ctx->texelStride * (i + (int64_t)ctx->width * j)]
+         / (float)((1 << 16) - 1);
+}
+
+// same lookup as lebt__SampleLevel at the first level
+static float
+lebt__NodeErrorSample(const lebt__NodeErrorContext *ctx, float u, float v)
+{
+    float x = u * ctx->width - 0.5f, y = v * ctx->height - 0.5f;
+    float xf = floorf(x), yf = floorf(y);
+    float ax = x - xf, ay = y - yf;
+    int32_t i = (int32_t)xf, j = (int32_t)yf;
+    float t00 = lebt__NodeErrorTexel(ctx, i    , j    );
+    float t10 = lebt__NodeErrorTexel(ctx, i + 1, j    );
+    float t01 = lebt__NodeErrorTexel(ctx, i    , j + 1);
+    float t11 = lebt__NodeErrorTexel(ctx, i + 1, j + 1);
+    float t0 = t00 + ax * (t10 - t00);
+    float t1 = t01 + ax * (t11 - t01);
+
+    return t0 + ay * (t1 - t0);
+}
+
+static uint16_t
+lebt__TriangleError(const lebt__NodeErrorContext *ctx, const float uv[3][2])
+{
+    float p[3][2], z[3], pmin[2], pmax[2];
+    float area, error = 0.0f;
+    int32_t i0, i1, j0, j1;
+
+    // vertices in texel space, where texel centers have integer coordinates
+    for (int k = 0; k < 3; ++k) {
+        p[k][0] = uv[k][0] * ctx->width  - 0.5f;
+        p[k][1] = uv[k][1] * ctx->height - 0.5f;
+        z[k] = lebt__NodeErrorSample(ctx, uv[k][0], uv[k][1]);
+    }
+    for (int k = 0; k < 2; ++k) {
+        pmin[k] = fminf(fminf(p[0][k], p[1][k]), p[2][k]);
+        pmax[k] = fmaxf(fmaxf(p[0][k], p[1][k]), p[2][k]);
+    }
+    area = (p[1][0] - p[0][0]) * (p[2][1] - p[0][1])
+         - (p[1][1] - p[0][1]) * (p[2][0] - p[0][0]);
+    i0 = (int32_t)ceilf(pmin[0]);  i0 = i0 < 0 ? 0 : i0;
+    j0 = (int32_t)ceilf(pmin[1]);  j0 = j0 < 0 ? 0 : j0;
+    i1 = (int32_t)floorf(pmax[0]); i1 = i1 >= ctx->width  ? ctx->width  - 1 : i1;
+    j1 = (int32_t)floorf(pmax[1]); j1 = j1 >= ctx->height ? ctx->height - 1 : j1;
+
+    for (int32_t j = j0; j <= j1; ++j)
+    for (int32_t i = i0; i <= i1; ++i) {
+        float x = (float)i, y = (float)j;
+        float b0 = ((p[1][0] - x) * (p[2][1] - y) - (p[1][1] - y) * (p[2][0] - x)) / area;
+        float b1 = ((p[2][0] - x) * (p[0][1] - y) - (p[2][1] - y) * (p[0][0] - x)) / area;
+        float b2 = 1.0f - b0 - b1;
+
+        if (b0 >= -1e-5f && b1 >= -1e-5f && b2 >= -1e-5f) {
+            float zPlane = b0 * z[0] + b1 * z[1] + b2 * z[2];
+
+            error = fmaxf(error, fabsf(lebt__NodeErrorTexel(ctx, i, j) - zPlane));
+        }
+    }
+
+    return (uint16_t)fminf(ceilf(error * (float)((1 << 16) - 1)), (float)((1 << 16) - 1));
+}
+
+static void lebt__NodeErrorVertices(const cbt_Node node, float uv[3][2])
+{
+    float attributeArray[][3] = {
+        {0.0f, 0.0f, 1.0f},
+        {1.0f, 0.0f, 0.0f}
+    };
+
+    leb_DecodeNodeAttributeArray_Square(node, 2, attributeArray);
+
+    for (int k = 0; k < 3; ++k) {
+        uv[k][0] = attributeArray[0][k];
+        uv[k][1] = attributeArray[1][k];
+    }
+}
+
+static uint16_t
+lebt__NodeErrorsRecursive(
+    const lebt__NodeErrorContext *ctx,
+    uint64_t nodeID,
+    int32_t nodeDepth,
+    const float uv[3][2]
+) {
+    uint16_t error = lebt__TriangleError(ctx, uv);
+
+    if (nodeDepth < ctx->depth) {
+        for (int bit = 0; bit < 2; ++bit) {
+            const float (*m)[3] = ctx->splitMatrices[bit];
+            float childUv[3][2];
+            uint16_t childError;
+
+            for (int j = 0; j < 3; ++j)
+            for (int k = 0; k < 2; ++k)
+                childUv[j][k] = m[j][0] * uv[0][k] + m[j][1] * uv[1][k] + m[j][2] * uv[2][k];
+
+            childError = lebt__NodeErrorsRecursive(ctx, 2u * nodeID + bit, nodeDepth + 1, childUv);
+            error = childError > error ? childError : error;
+        }
+    }
+
+    ctx->errors[nodeID] = error;
+
+    return error;
+}
+
+LEBTDEF lebt_NodeErrors *
+lebt_CreateNodeErrors(
+    const uint16_t *texels,
+    int32_t texelStride,
+    int32_t width,
+    int32_t height
+) {
+    lebt_NodeErrors *nodeErrors = (lebt_NodeErrors *)malloc(sizeof(*nodeErrors));
+    lebt__NodeErrorContext ctx;
+    int32_t subtreeDepth;
+
+    ctx.texels = texels;
+    ctx.texelStride = texelStride;
+    ctx.width = width;
+    ctx.height = height;
+
+    // nodes at depth d cover 2^-d of the square
+    ctx.depth = 1;
+    while (ctx.depth < LEBT_NODE_ERROR_MAX_DEPTH
+           && ((int64_t)1 << ctx.depth) < (int64_t)width * height)
+        ++ctx.depth;
+    ctx.errors = (uint16_t *)malloc(sizeof(uint16_t) << (ctx.depth + 1));
+    ctx.errors[0] = 0;
+
+    // the children of a node are the images of its vertices by these
+    for (int bit = 0; bit < 2; ++bit) {
+        float attributeArray[][3] = {
+            {1.0f, 0.0f, 0.0f},
+            {0.0f, 1.0f, 0.0f},
+            {0.0f, 0.0f, 1.0f}
+        };
+
+        leb_DecodeNodeAttributeArray(cbt_CreateNode(2u + bit, 1), 3, attributeArray);
+
+        for (int j = 0; j < 3; ++j)
+        for (int k = 0; k < 3; ++k)
+            ctx.splitMatrices[bit][j][k] = attributeArray[k][j];
+    }
+
+    // subtrees are processed in parallel, and their roots decoded directly
+    subtreeDepth = ctx.depth < 10 ? ctx.depth : 10;
+#pragma omp parallel for schedule(dynamic)
+    for (int64_t nodeID = (int64_t)1 << subtreeDepth; nodeID < (int64_t)2 << subtreeDepth; ++nodeID) {
+        float uv[3][2];
+
+        lebt__NodeErrorVertices(cbt_CreateNode((uint64_t)nodeID, subtreeDepth), uv);
+        lebt__NodeErrorsRecursive(&ctx, (uint64_t)nodeID, subtreeDepth, uv);
+    }
+
+    for (int32_t depth = subtreeDepth - 1; depth >= 1; --depth) {
+#pragma omp parallel for schedule(dynamic)
+        for (int64_t nodeID = (int64_t)1 << depth; nodeID < (int64_t)2 << depth; ++nodeID) {
+            uint16_t *errors = ctx.errors;
+            float uv[3][2];
+            uint16_t error;
+
+            lebt__NodeErrorVertices(cbt_CreateNode((uint64_t)nodeID, depth), uv);
+            error = lebt__TriangleError(&ctx, uv);
+            error = errors[2 * nodeID    ] > error ? errors[2 * nodeID    ] : error;
+            error = errors[2 * nodeID + 1] > error ? errors[2 * nodeID + 1] : error;
+            errors[nodeID] = error;
+        }
+    }
+
+    // the root node stands for the whole square
+    ctx.errors[1] = ctx.errors[2] > ctx.errors[3] ? ctx.errors[2] : ctx.errors[3];
+
+    nodeErrors->depth = ctx.depth;
+    nodeErrors->errors = ctx.errors;
+
+    return nodeErrors;
+}
+
+
+/*******************************************************************************
+ * CreatePatchErrors -- Builds the error table of the tessellated nodes
+ *
+ * Each step replaces the error of a node by the largest error of its
+ * children, and extrapolates the errors of the deepest nodes, so that
+ * after 2 * patchSubdLevel steps a node holds the largest error of the
+ * triangles the GPU renders for it.
+ *
+ */
+LEBTDEF lebt_NodeErrors *
+lebt_CreatePatchErrors(const lebt_NodeErrors *nodeErrors, int32_t patchSubdLevel)
+{
+    lebt_NodeErrors *patchErrors = (lebt_NodeErrors *)malloc(sizeof(*patchErrors));
+    const int32_t depth = nodeErrors->depth;
+    const size_t byteSize = sizeof(uint16_t) << (depth + 1);
+    uint16_t *errors = (uint16_t *)malloc(byteSize);
+
+    memcpy(errors, nodeErrors->errors, byteSize);
+
+    for (int32_t step = 0; step < 2 * patchSubdLevel; ++step) {
+        for (int32_t nodeDepth = 1; nodeDepth <= depth; ++nodeDepth) {
+#pragma omp parallel for
+            for (int64_t nodeID = (int64_t)1 << nodeDepth; nodeID < (int64_t)2 << nodeDepth; ++nodeID) {
+                if (nodeDepth < depth) {
+                    uint16_t e0 = errors[2 * nodeID], e1 = errors[2 * nodeID + 1];
+
+                    errors[nodeID] = e0 > e1 ? e0 : e1;
+                } else {
+                    errors[nodeID] = (uint16_t)((errors[nodeID] + 1u) >> 1);
+                }
+            }
+        }
+
+        errors[1] = errors[2] > errors[3] ? errors[2] : errors[3];
+    }
+
+    patchErrors->depth = depth;
+    patchErrors->errors = errors;
+
+    return patchErrors;
+}
+
+LEBTDEF void lebt_ReleaseNodeErrors(lebt_NodeErrors *nodeErrors)
+{
+    free(nodeErrors->errors);
+    free(nodeErrors);
+}
+
+
+/*******************************************************************************
+ * NodeError -- Looks up the normalized error of a node
+ *
+ * Nodes deeper than the table cover less than a texel, and are assumed to
+ * halve the error of their ancestor at each level. The lookup matches
+ * NodeError in TerrainRenderCommon.glsl.
+ *
+ */
+LEBTDEF float
+lebt_NodeError(const lebt_NodeErrors *nodeErrors, const cbt_Node node)
+{
+    int32_t excessDepth = (int32_t)node.depth - nodeErrors->depth;
+    uint64_t nodeID;
+
+    excessDepth = excessDepth < 0 ? 0 : excessDepth;
+    nodeID = node.id >> excessDepth;
+
+    return ldexpf(nodeErrors->errors[nodeID] / (float)((1 << 16) - 1), -excessDepth);
+}
+
+
+/*******************************************************************************
+ * DmapBounds -- Computes conservative height bounds over a region
+ *
+ * The region is expanded to the texels that bilinear lookups at the first
+ * level may read, and the bounds are fetched at the coarsest level whose
+ * texels cover that range with at most 2x2 texels. The arithmetic matches
+ * DmapBounds in TerrainRenderCommon.glsl.
+ *
+ */
+static int32_t lebt__FindMSB(uint32_t x)
+{
+    int32_t msb = -1;
+
+    while (x > 0u) {
+        x>>= 1;
+        ++msb;
+    }
+
+    return msb;
+}
+
+static void
+lebt__DmapBounds(
+    const lebt_DmapBounds *bounds,
+    const float uvMin[2],
+    const float uvMax[2],
+    float zBounds[2]
+) {
+    const int32_t size[2] = {bounds->width, bounds->height};
+    int32_t t0[2], t1[2], levelSize[2], b0[2], b1[2], level;
+
+    for (int32_t k = 0; k < 2; ++k) {
+        t0[k] = (int32_t)floorf(uvMin[k] * (float)size[k] - 0.5f);
+        t1[k] = (int32_t)floorf(uvMax[k] * (float)size[k] - 0.5f) + 1;
+        t0[k] = t0[k] < 0 ? 0 : (t0[k] >= size[k] ? size[k] - 1 : t0[k]);
+        t1[k] = t1[k] < 0 ? 0 : (t1[k] >= size[k] ? size[k] - 1 : t1[k]);
+    }
+
+    level = lebt__FindMSB((uint32_t)(t1[0] - t0[0] > t1[1] - t0[1]
+                                   ? t1[0] - t0[0] : t1[1] - t0[1])) + 1;
+    level = level < bounds->levelCount - 1 ? level : bounds->levelCount - 1;
+
+    for (int32_t k = 0; k < 2; ++k) {
+        levelSize[k] = size[k] >> level; if (levelSize[k] < 1) levelSize[k] = 1;
+        b0[k] = (t0[k] >> level) < levelSize[k] - 1 ? t0[k] >> level : levelSize[k] - 1;
+        b1[k] = (t1[k] >> level) < levelSize[k] - 1 ? t1[k] >> level : levelSize[k] - 1;
+    }
+
+    {
+        const uint16_t *z00 = lebt__DmapBoundsTexel(bounds, level, b0[0], b0[1]);
+        const uint16_t *z10 = lebt__DmapBoundsTexel(bounds, level, b1[0], b0[1]);
+        const uint16_t *z01 = lebt__DmapBoundsTexel(bounds, level, b0[0], b1[1]);
+        const uint16_t *z11 = lebt__DmapBoundsTexel(bounds, level, b1[0], b1[1]);
+        uint16_t zMin = z00[0], zMax = z00[1];
+
+        zMin = z10[0] < zMin ? z10[0] : zMin; zMax = z10[1] > zMax ? z10[1] : zMax;
+        zMin = z01[0] < zMin ? z01[0] : zMin; zMax = z01[1] > zMax ? z01[1] : zMax;
+        zMin = z11[0] < zMin ? z11[0] : zMin; zMax = z11[1] > zMax ? z11[1] : zMax;
+
+        zBounds[0] = (float)zMin / (float)((1 << 16) - 1);
+        zBounds[1] = (float)zMax / (float)((1 << 16) - 1);
+    }
+}
+
+
+/*******************************************************************************
+ * Dmap Sampling -- Emulates the GL_LINEAR_MIPMAP_LINEAR sampler
+ *
+ * Texture coordinates are clamped to the edge as in the demo.
+ *
+ */
+static void
+lebt__SampleLevel(const lebt_Dmap *dmap, int32_t level, float u, float v, float rg[2])
+{
+    int32_t w = dmap->width  >> level; if (w < 1) w = 1;
+    int32_t h = dmap->height >> level; if (h < 1) h = 1;
+    float x = u * w - 0.5f, y = v * h - 0.5f;
+    float xf = floorf(x), yf = floorf(y);
+    float ax = x - xf, ay = y - yf;
+    int32_t i0 = (int32_t)xf, j0 = (int32_t)yf;
+    int32_t i1 = i0 + 1, j1 = j0 + 1;
+
+    i0 = i0 < 0 ? 0 : (i0 >= w ? w - 1 : i0);
+    i1 = i1 < 0 ? 0 : (i1 >= w ? w - 1 : i1);
+    j0 = j0 < 0 ? 0 : (j0 >= h ? h - 1 : j0);
+    j1 = j1 < 0 ? 0 : (j1 >= h ? h - 1 : j1);
+
+    for (int32_t c = 0; c < 2; ++c) {
+        float t00 = lebt__DmapTexel(dmap, level, i0, j0)[c];
+        float t10 = lebt__DmapTexel(dmap, level, i1, j0)[c];
+        float t01 = lebt__DmapTexel(dmap, level, i0, j1)[c];
+        float t11 = lebt__DmapTexel(dmap, level, i1, j1)[c];
+        float t0 = t00 + ax * (t10 - t00);
+        float t1 = t01 + ax * (t11 - t01);
+
+        rg[c] = (t0 + ay * (t1 - t0)) / (float)((1 << 16) - 1);
+    }
+}
+
+// textureGrad counterpart
+static void
+lebt__SampleGrad(
+    const lebt_Dmap *dmap,
+    const float uv[2],
+    const float dx[2],
+    const float dy[2],
+    float rg[2]
+) {
+    float sx = dx[0] * dmap->width, sy = dx[1] * dmap->height;
+    float tx = dy[0] * dmap->width, ty = dy[1] * dmap->height;
+    float rhoSqr = fmaxf(sx * sx + sy * sy, tx * tx + ty * ty);
+    float lod = 0.5f * log2f(rhoSqr);
+    float maxLod = (float)(dmap->levelCount - 1);
+
+    if (!(lod > 0.0f)) {
+        lebt__SampleLevel(dmap, 0, uv[0], uv[1], rg);
+    } else {
+        float lodFloor;
+        float rg0[2], rg1[2];
+        int32_t level;
+
+        if (lod > maxLod)
+            lod = maxLod;
+        lodFloor = floorf(lod);
+        level = (int32_t)lodFloor;
+
+        lebt__SampleLevel(dmap, level, uv[0], uv[1], rg0);
+        if (level + 1 < dmap->levelCount) {
+            lebt__SampleLevel(dmap, level + 1, uv[0], uv[1], rg1);
+        } else {
+            rg1[0] = rg0[0]; rg1[1] = rg0[1];
+        }
+
+        rg[0] = rg0[0] + (lod - lodFloor) * (rg1[0] - rg0[0]);
+        rg[1] = rg0[1] + (lod - lodFloor) * (rg1[1] - rg0[1]);
+    }
+}
+
+
+/*******************************************************************************
+ * LoadFrustumPlanes -- Extracts the planes of the view frustum
+ *
+ * Same as in LoadTerrainVariables, except that the planes are normalized;
+ * the culling test only depends on their sign.
+ *
+ */
+LEBTDEF void
+lebt_LoadFrustumPlanes(
+    const float modelViewProjection[4][4],
+    float frustumPlanes[6][4]
+) {
+    for (int i = 0; i < 3; ++i)
+    for (int j = 0; j < 2; ++j) {
+        float *plane = frustumPlanes[i * 2 + j];
+        float nrm;
+
+        for (int k = 0; k < 4; ++k) {
+            float x = modelViewProjection[i][k];
+
+            plane[k] = modelViewProjection[3][k] + (j == 0 ? x : -x);
+        }
+
+        nrm = sqrtf(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+        if (nrm > 0.0f)
+            for (int k = 0; k < 4; ++k)
+                plane[k]/= nrm;
+    }
+}
+
+
+/*******************************************************************************
+ * DecodeTriangleVertices -- Decodes the triangle vertices in local space
+ *
+ * Compute shaders have no implicit derivatives, so the GPU fetches the
+ * heights from the first mip level.
+ *
+ */
+LEBTDEF void
+lebt_DecodeTriangleVertices(
+    const lebt_Params *params,
+    const cbt_Node node,
+    float triangleVertices[3][4]
+) {
+    float attributeArray[][3] = {
+        {0.0f, 0.0f, 1.0f},
+        {1.0f, 0.0f, 0.0f}
+    };
+
+    leb_DecodeNodeAttributeArray_Square(node, 2, attributeArray);
+
+    for (int i = 0; i < 3; ++i) {
+        triangleVertices[i][0] = attributeArray[0][i];
+        triangleVertices[i][1] = attributeArray[1][i];
+        triangleVertices[i][2] = 0.0f;
+        triangleVertices[i][3] = 1.0f;
+
+        if (params->displace && params->dmap) {
+            float rg[2];
+
+            lebt__SampleLevel(params->dmap, 0, attributeArray[0][i], attributeArray[1][i], rg);
+            triangleVertices[i][2] = params->dmapFactor * rg[0];
+        }
+    }
+}
+
+
+/*******************************************************************************
+ * TriangleLevelOfDetail -- Computes the LoD associated to a triangle
+ *
+ * See TerrainRenderCommon.glsl for the derivation; the fisheye projection
+ * uses the perspective formula as on the GPU.
+ *
+ */
+static void
+lebt__TransformPoint(const float m[4][4], const float p[4], float out[3])
+{
+    for (int i = 0; i < 3; ++i)
+        out[i] = m[i][0] * p[0] + m[i][1] * p[1] + m[i][2] * p[2] + m[i][3] * p[3];
+}
+
+static float lebt__Dot(const float a[3], const float b[3])
+{
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static float
+lebt__TriangleLevelOfDetail(const lebt_Params *params, const float triangleVertices[3][4])
+{
+    float v0[3], v2[3];
+
+    lebt__TransformPoint(params->modelView, triangleVertices[0], v0);
+    lebt__TransformPoint(params->modelView, triangleVertices[2], v2);
+
+    if (params->projection == LEBT_PROJECTION_RECTILINEAR
+        || params->projection == LEBT_PROJECTION_FISHEYE) {
+        float sqrMagSum = lebt__Dot(v0, v0) + lebt__Dot(v2, v2);
+        float twoDotAC = 2.0f * lebt__Dot(v0, v2);
+        float distanceToEdgeSqr = sqrMagSum + twoDotAC;
+        float edgeLengthSqr     = sqrMagSum - twoDotAC;
+
+        return params->lodFactor + log2f(edgeLengthSqr / distanceToEdgeSqr);
+    } else if (params->projection == LEBT_PROJECTION_ORTHOGRAPHIC) {
+        float edgeVector[3] = {v2[0] - v0[0], v2[1] - v0[1], v2[2] - v0[2]};
+
+        return params->lodFactor + log2f(lebt__Dot(edgeVector, edgeVector));
+    }
+
+    return 0.0f;
+}
+
+
+/*******************************************************************************
+ * DisplacementVarianceTest -- Checks if the height variance criteria is met
+ *
+ */
+static bool
+lebt__DisplacementVarianceTest(
+    const lebt_Params *params,
+    const float triangleVertices[3][4]
+) {
+    const float *p0 = triangleVertices[0];
+    const float *p1 = triangleVertices[1];
+    const float *p2 = triangleVertices[2];
+    float p[2] = {(p0[0] + p1[0] + p2[0]) / 3.0f, (p0[1] + p1[1] + p2[1]) / 3.0f};
+    float dx[2] = {p0[0] - p1[0], p0[1] - p1[1]};
+    float dy[2] = {p2[0] - p1[0], p2[1] - p1[1]};
+    float dmap[2], dmapVariance;
+
+    lebt__SampleGrad(params->dmap, p, dx, dy, dmap);
+    dmapVariance = dmap[1] - dmap[0] * dmap[0];
+    dmapVariance = dmapVariance < 0.0f ? 0.0f : (dmapVariance > 1.0f ? 1.0f : dmapVariance);
+
+    return (dmapVariance >= params->minLodVariance);
+}
+
+
+/*******************************************************************************
+ * TriangleBounds -- Computes the bounding box of the displaced triangle
+ *
+ * With a dmap, the heights come from the min/max pyramid so the box holds
+ * the tessellated triangle, and not just its three vertices.
+ *
+ */
+static void
+lebt__TriangleBounds(
+    const lebt_Params *params,
+    const float triangleVertices[3][4],
+    float bmin[3],
+    float bmax[3]
+) {
+    for (int k = 0; k < 3; ++k) {
+        bmin[k] = fminf(fminf(triangleVertices[0][k], triangleVertices[1][k]), triangleVertices[2][k]);
+        bmax[k] = fmaxf(fmaxf(triangleVertices[0][k], triangleVertices[1][k]), triangleVertices[2][k]);
+    }
+
+    if (params->displace && params->dmap) {
+        float zBounds[2];
+
+        lebt__DmapBounds(params->dmap->bounds, bmin, bmax, zBounds);
+        bmin[2] = params->dmapFactor * zBounds[0];
+        bmax[2] = params->dmapFactor * zBounds[1];
+    }
+}
+
+
+/*******************************************************************************
+ * FrustumCullingTest -- Checks if the triangle lies inside the view frustum
+ *
+ */
+static bool
+lebt__FrustumCullingTest(const lebt_Params *params, const float bmin[3], const float bmax[3])
+{
+    float a = 1.0f;
+
+    for (int i = 0; i < 6 && a >= 0.0f; ++i) {
+        const float *plane = params->frustumPlanes[i];
+
+        a = plane[3];
+        for (int k = 0; k < 3; ++k)
+            a+= plane[k] * (plane[k] > 0.0f ? bmax[k] : bmin[k]);
+    }
+
+    return (a >= 0.0f);
+}
+
+
+/*******************************************************************************
+ * HorizonOcclusionTest -- Checks if the triangle is not hidden by the terrain
+ *
+ * At parameter t, the rays going from the camera to the box of the
+ * triangle lie within the box scaled by t around the camera, and below
+ * the height of the ray that reaches the top of the box. If the terrain
+ * is higher than that everywhere within the scaled box, which the min/max
+ * pyramid tells conservatively, every ray goes through the terrain before
+ * it reaches the triangle. Scaled boxes that overlap the triangle or leave
+ * the terrain are skipped, so only nearer terrain occludes. The test
+ * assumes the camera lies above the terrain.
+ *
+ */
+static bool
+lebt__HorizonOcclusionTest(const lebt_Params *params, const float bmin[3], const float bmax[3])
+{
+    const float *eye = params->cameraPosition;
+
+    for (int32_t i = 1; i <= LEBT_HORIZON_SAMPLE_COUNT; ++i) {
+        float t = (float)i / (float)(LEBT_HORIZON_SAMPLE_COUNT + 1);
+        float rmin[2], rmax[2], zBounds[2];
+        float rayMax = eye[2] + t * (bmax[2] - eye[2]);
+        bool isInside = true, isDisjoint = false;
+
+        for (int k = 0; k < 2; ++k) {
+            rmin[k] = eye[k] + t * (bmin[k] - eye[k]);
+            rmax[k] = eye[k] + t * (bmax[k] - eye[k]);
+            isInside&= rmin[k] >= 0.0f && rmax[k] <= 1.0f;
+            isDisjoint|= rmax[k] < bmin[k] || rmin[k] > bmax[k];
+        }
+
+        if (isInside && isDisjoint) {
+            lebt__DmapBounds(params->dmap->bounds, rmin, rmax, zBounds);
+
+            if (params->dmapFactor * zBounds[0] > rayMax)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+
+/*******************************************************************************
+ * CullingTest -- Runs the frustum and horizon occlusion tests
+ *
+ */
+LEBTDEF int32_t
+lebt_CullingTest(const lebt_Params *params, const float triangleVertices[3][4])
+{
+    float bmin[3], bmax[3];
+
+    lebt__TriangleBounds(params, triangleVertices, bmin, bmax);
+
+    if (!lebt__FrustumCullingTest(params, bmin, bmax))
+        return LEBT_CULL_FRUSTUM;
+
+    if (params->horizon && params->displace && params->dmap
+        && params->projection != LEBT_PROJECTION_ORTHOGRAPHIC
+        && !lebt__HorizonOcclusionTest(params, bmin, bmax))
+        return LEBT_CULL_HORIZON;
+
+    return LEBT_CULL_NONE;
+}
+
+
+/*******************************************************************************
+ * TriangleLevelOfDetail_Error -- Computes the LoD of a node from its error
+ *
+ * See TerrainRenderCommon.glsl; the box is that of lebt__TriangleBounds.
+ *
+ */
+static float
+lebt__TriangleLevelOfDetail_Error(
+    const lebt_Params *params,
+    const float bmin[3],
+    const float bmax[3],
+    float nodeError
+) {
+    const float (*m)[4] = params->modelView;
+    float zAxis[3] = {m[0][2], m[1][2], m[2][2]};
+    float errorLength = params->dmapFactor * nodeError * sqrtf(lebt__Dot(zAxis, zAxis));
+    float pixelError = errorLength * params->errorFactor;
+
+    if (params->projection != LEBT_PROJECTION_ORTHOGRAPHIC) {
+        float distanceSqr = 0.0f;
+
+        for (int i = 0; i < 3; ++i) {
+            float center = m[i][3], extent = 0.0f, d;
+
+            for (int k = 0; k < 3; ++k) {
+                center+= m[i][k] * 0.5f * (bmin[k] + bmax[k]);
+                extent+= fabsf(m[i][k]) * 0.5f * (bmax[k] - bmin[k]);
+            }
+
+            d = fmaxf(fabsf(center) - extent, 0.0f);
+            distanceSqr+= d * d;
+        }
+
+        pixelError/= fmaxf(sqrtf(distanceSqr), 1e-6f);
+    }
+
+    return 1.0f + log2f(fmaxf(pixelError, 1e-9f));
+}
+
+
+/*******************************************************************************
+ * LevelOfDetail -- Computes the level of detail associated to a triangle
+ *
+ * The first component is the actual LoD value. The second value is 0 if the
+ * triangle is culled, and one otherwise.
+ *
+ */
+LEBTDEF void
+lebt_LevelOfDetail(
+    const lebt_Params *params,
+    const cbt_Node node,
+    const float triangleVertices[3][4],
+    float lod[2]
+) {
+    // culling tests
+    if (lebt_CullingTest(params, triangleVertices) != LEBT_CULL_NONE) {
+        lod[0] = 0.0f;
+        lod[1] = params->cull ? 0.0f : 1.0f;
+
+        return;
+    }
+
+    // geometric error
+    if (params->displace && params->dmap && params->nodeErrors) {
+        float bmin[3], bmax[3];
+
+        lebt__TriangleBounds(params, triangleVertices, bmin, bmax);
+        lod[0] = lebt__TriangleLevelOfDetail_Error(params, bmin, bmax,
+                                                   lebt_NodeError(params->nodeErrors, node));
+        lod[1] = 1.0f;
+
+        return;
+    }
+
+    // variance test
+    if (params->displace && params->dmap
+        && !lebt__DisplacementVarianceTest(params, triangleVertices)) {
+        lod[0] = 0.0f;
+        lod[1] = 1.0f;
+
+        return;
+    }
+
+    // compute triangle LOD
+    lod[0] = lebt__TriangleLevelOfDetail(params, triangleVertices);
+    lod[1] = 1.0f;
+}
+
+
+/*******************************************************************************
+ * SplitCallback -- Splits the nodes whose LoD is above one
+ *
+ */
+LEBTDEF void
+lebt_SplitCallback(cbt_Tree *cbt, const cbt_Node node, const void *userData)
+{
+    const lebt_Params *params = (const lebt_Params *)userData;
+    float triangleVertices[3][4];
+    float lod[2];
+
+    lebt_DecodeTriangleVertices(params, node, triangleVertices);
+    lebt_LevelOfDetail(params, node, triangleVertices, lod);
+
+    if (lod[0] > 1.0f) {
+        leb_SplitNode_Square(cbt, node);
+    }
+}
+
+
+/*******************************************************************************
+ * MergeCallback -- Merges the diamonds whose LoD is below one
+ *
+ */
+LEBTDEF void
+lebt_MergeCallback(cbt_Tree *cbt, const cbt_Node node, const void *userData)
+{
+    const lebt_Params *params = (const lebt_Params *)userData;
+    leb_DiamondParent diamond = leb_DecodeDiamondParent_Square(node);
+    float baseVertices[3][4], topVertices[3][4];
+    float baseLod[2], topLod[2];
+
+    lebt_DecodeTriangleVertices(params, diamond.base, baseVertices);
+    lebt_DecodeTriangleVertices(params, diamond.top, topVertices);
+    lebt_LevelOfDetail(params, diamond.base, baseVertices, baseLod);
+    lebt_LevelOfDetail(params, diamond.top, topVertices, topLod);
+
+    if (baseLod[0] < 1.0f && topLod[0] < 1.0f) {
+        leb_MergeNode_Square(cbt, node, diamond);
+    }
+}
+
+
+/*******************************************************************************
+ * Update -- Runs a split or a merge pass over the leaf nodes of the CBT
+ *
+ */
+LEBTDEF void lebt_Update(cbt_Tree *cbt, const lebt_Params *params, int pingPong)
+{
+    if (pingPong == 0) {
+        cbtl_Update(cbt, NULL, &lebt_SplitCallback, params);
+    } else {
+        cbtl_Update(cbt, NULL, &lebt_MergeCallback, params);
+    }
+}
+
+
+/*******************************************************************************
+ * CountCulledLeaves -- Classifies the leaves of a CBT by culling test
+ *
+ */
+LEBTDEF void
+lebt_CountCulledLeaves(
+    const cbt_Tree *cbt,
+    const lebt_Params *params,
+    int64_t counts[LEBT_CULL_COUNT]
+) {
+    cbtl_Iterator it;
+
+    for (int32_t i = 0; i < LEBT_CULL_COUNT; ++i)
+        counts[i] = 0;
+
+    cbtl_IteratorInit(&it, cbt, 0, cbt_NodeCount(cbt));
+    while (cbtl_IteratorNext(&it)) {
+        float triangleVertices[3][4];
+
+        lebt_DecodeTriangleVertices(params, it.node, triangleVertices);
+        ++counts[lebt_CullingTest(params, triangleVertices)];
+    }
+}
+
+
+/*******************************************************************************
+ * Converge -- Updates the subdivision until it reaches a fixed point
+ *
+ * The passes alternate exactly as they do from one frame to the next on
+ * the GPU, so both reach the same subdivision for a static camera.
+ *
+ */
+LEBTDEF bool
+lebt_Converge(
+    cbt_Tree *cbt,
+    const lebt_Params *params,
+    int32_t passBudget,
+    int32_t *passCount
+) {
+    const int64_t heapByteSize = cbt_HeapByteSize(cbt);
+    char *heap = (char *)malloc(heapByteSize);
+    int32_t passID = 0;
+    bool isConverged = false;
+
+    while (!isConverged && passID + 2 <= passBudget) {
+        memcpy(heap, cbt_GetHeap(cbt), heapByteSize);
+
+        lebt_Update(cbt, params, 0);
+        lebt_Update(cbt, params, 1);
+        passID+= 2;
+
+        isConverged = (memcmp(heap, cbt_GetHeap(cbt), heapByteSize) == 0);
+    }
+
+    free(heap);
+
+    if (passCount)
+        *passCount = passID;
+
+    return isConverged;
+}
+
+#endif // LEBT_IMPLEMENTATION
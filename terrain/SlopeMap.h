@@ -0,0 +1,332 @@
+#ifndef SMAP_INCLUDE_SMAP_H
+#define SMAP_INCLUDE_SMAP_H
+
+#if defined(__AVX2__) || defined(__F16C__)
+#   include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#   include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#   include <arm_neon.h>
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef SMAP_STATIC
+#define SMAPDEF static
+#else
+#define SMAPDEF extern
+#endif
+
+// rows processed by each task of the slope kernel
+#ifndef SMAP_BAND_SIZE
+#define SMAP_BAND_SIZE 64
+#endif
+
+// writes the slope map of a heightmap as RG16F texels, i.e., two half
+// floats per texel; the slopes are the central differences of the heights
+// in [0, 1], scaled by the resolution of the heightmap
+SMAPDEF void smap_Compute16(const uint16_t *texels,
+                            int32_t width,
+                            int32_t height,
+                            uint16_t *slopes);
+SMAPDEF void smap_Compute8(const uint8_t *texels,
+                           int32_t width,
+                           int32_t height,
+                           uint16_t *slopes);
+
+// IEEE 754 half-precision conversions (rounding to nearest even)
+SMAPDEF uint16_t smap_FloatToHalf(float x);
+SMAPDEF float smap_HalfToFloat(uint16_t x);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+//
+//
+//// end header file ///////////////////////////////////////////////////////////
+#endif // SMAP_INCLUDE_SMAP_H
+
+#ifdef SMAP_IMPLEMENTATION
+
+#include <stdlib.h>
+#include <string.h>
+
+
+/*******************************************************************************
+ * FloatToHalf -- Converts a float to a half float
+ *
+ * Normal results get their exponent rebiased and their mantissa rounded with
+ * integer arithmetic; subnormal results are aligned and rounded by a float
+ * addition of 0.5. Values beyond the half-float range become infinite.
+ *
+ */
+SMAPDEF uint16_t smap_FloatToHalf(float f)
+{
+    uint32_t x, sign, h;
+
+    memcpy(&x, &f, sizeof(x));
+    sign = x & 0x80000000u;
+    x^= sign;
+
+    if (x >= 0x47800000u) {
+        h = x > 0x7F800000u ? 0x7E00u : 0x7C00u;
+    } else if (x < 0x38800000u) {
+        float g;
+
+        memcpy(&g, &x, sizeof(g));
+        g+= 0.5f;
+        memcpy(&h, &g, sizeof(h));
+        h-= 0x3F000000u;
+    } else {
+        h = (x + 0xC8000FFFu + ((x >> 13) & 1u)) >> 13;
+    }
+
+    return (uint16_t)(h | (sign >> 16));
+}
+
+SMAPDEF float smap_HalfToFloat(uint16_t h)
+{
+    uint32_t sign = (uint32_t)(h & 0x8000u) << 16;
+    uint32_t exponent = (h >> 10) & 0x1Fu;
+    uint32_t mantissa = h & 0x3FFu;
+    uint32_t x;
+    float f;
+
+    if (exponent == 0u) {
+        f = (float)mantissa * (1.0f / 16777216.0f);
+
+        return sign ? -f : f;
+    } else if (exponent == 31u) {
+        x = sign | 0x7F800000u | (mantissa << 13);
+    } else {
+        x = sign | ((exponent + 112u) << 23) | (mantissa << 13);
+    }
+    memcpy(&f, &x, sizeof(f));
+
+    return f;
+}
+
+#if !defined(__F16C__) && (defined(__SSE2__) || defined(_M_X64))
+// 4-wide counterpart of smap_FloatToHalf for finite inputs; the halves are
+// returned sign-extended to 32 bits so that _mm_packs_epi32 preserves them
+static __m128i smap__FloatToHalf_SSE2(__m128 f)
+{
+    const __m128i signMask = _mm_set1_epi32((int)0x80000000u);
+    const __m128i infinity = _mm_set1_epi32(0x7C00);
+    const __m128i overflow = _mm_set1_epi32(0x47800000);
+    const __m128i minNormal = _mm_set1_epi32(0x38800000);
+    const __m128i subnormalMagic = _mm_set1_epi32(0x3F000000);
+    const __m128i normalBias = _mm_set1_epi32((int)0xC8000FFFu);
+    const __m128i one = _mm_set1_epi32(1);
+    __m128i x = _mm_castps_si128(f);
+    __m128i sign = _mm_and_si128(x, signMask);
+    __m128i absx = _mm_xor_si128(x, sign);
+    __m128i subnormal = _mm_sub_epi32(
+        _mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(absx),
+                                    _mm_castsi128_ps(subnormalMagic))),
+        subnormalMagic);
+    __m128i mantissaOdd = _mm_and_si128(_mm_srli_epi32(absx, 13), one);
+    __m128i normal = _mm_srli_epi32(
+        _mm_add_epi32(_mm_add_epi32(absx, normalBias), mantissaOdd), 13);
+    __m128i isSubnormal = _mm_cmpgt_epi32(minNormal, absx);
+    __m128i isFinite = _mm_cmpgt_epi32(overflow, absx);
+    __m128i h = _mm_or_si128(_mm_and_si128(isSubnormal, subnormal),
+                             _mm_andnot_si128(isSubnormal, normal));
+
+    h = _mm_or_si128(_mm_and_si128(isFinite, h), _mm_andnot_si128(isFinite, infinity));
+
+    return _mm_or_si128(h, _mm_srai_epi32(sign, 16));
+}
+#endif
+
+
+/*******************************************************************************
+ * ComputeRow -- Computes the slopes of a row of texels
+ *
+ * The bottom, center and top rows hold the raw heights as floats, which are
+ * integers and thus exact, so each slope is a single rounded product. The
+ * first and last texels are clamped; the others are processed 8 (AVX2) or
+ * 4 (SSE2, NEON) at a time, and the slopes are interleaved before being
+ * converted to half floats.
+ *
+ */
+static void
+smap__ComputeTexel(
+    const float *b,
+    const float *c,
+    const float *t,
+    int32_t width,
+    int32_t i,
+    float kx,
+    float ky,
+    uint16_t *slopes
+) {
+    int32_t i1 = i > 0 ? i - 1 : 0;
+    int32_t i2 = i < width - 1 ? i + 1 : width - 1;
+
+    slopes[2 * i    ] = smap_FloatToHalf((c[i2] - c[i1]) * kx);
+    slopes[2 * i + 1] = smap_FloatToHalf((t[i] - b[i]) * ky);
+}
+
+static void
+smap__ComputeRow(
+    const float *b,
+    const float *c,
+    const float *t,
+    int32_t width,
+    float kx,
+    float ky,
+    uint16_t *slopes
+) {
+    int32_t i = 1;
+
+    smap__ComputeTexel(b, c, t, width, 0, kx, ky, slopes);
+
+#if defined(__AVX2__) && defined(__F16C__)
+    const __m256 kx8 = _mm256_set1_ps(kx);
+    const __m256 ky8 = _mm256_set1_ps(ky);
+
+    for (; i + 8 <= width - 1; i+= 8) {
+        __m256 sx = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(&c[i + 1]),
+                                                _mm256_loadu_ps(&c[i - 1])), kx8);
+        __m256 sy = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(&t[i]),
+                                                _mm256_loadu_ps(&b[i])), ky8);
+        __m256 lo = _mm256_unpacklo_ps(sx, sy); // texels 0, 1 | 4, 5
+        __m256 hi = _mm256_unpackhi_ps(sx, sy); // texels 2, 3 | 6, 7
+
+        _mm_storeu_si128((__m128i *)&slopes[2 * i],
+                         _mm256_cvtps_ph(_mm256_permute2f128_ps(lo, hi, 0x20), 0));
+        _mm_storeu_si128((__m128i *)&slopes[2 * i + 8],
+                         _mm256_cvtps_ph(_mm256_permute2f128_ps(lo, hi, 0x31), 0));
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    const __m128 kx4 = _mm_set1_ps(kx);
+    const __m128 ky4 = _mm_set1_ps(ky);
+
+    for (; i + 4 <= width - 1; i+= 4) {
+        __m128 sx = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&c[i + 1]),
+                                          _mm_loadu_ps(&c[i - 1])), kx4);
+        __m128 sy = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(&t[i]),
+                                          _mm_loadu_ps(&b[i])), ky4);
+        __m128 lo = _mm_unpacklo_ps(sx, sy);    // texels 0, 1
+        __m128 hi = _mm_unpackhi_ps(sx, sy);    // texels 2, 3
+
+#   if defined(__F16C__)
+        _mm_storeu_si128((__m128i *)&slopes[2 * i],
+                         _mm_unpacklo_epi64(_mm_cvtps_ph(lo, 0), _mm_cvtps_ph(hi, 0)));
+#   else
+        _mm_storeu_si128((__m128i *)&slopes[2 * i],
+                         _mm_packs_epi32(smap__FloatToHalf_SSE2(lo),
+                                         smap__FloatToHalf_SSE2(hi)));
+#   endif
+    }
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    for (; i + 4 <= width - 1; i+= 4) {
+        float32x4_t sx = vmulq_n_f32(vsubq_f32(vld1q_f32(&c[i + 1]),
+                                               vld1q_f32(&c[i - 1])), kx);
+        float32x4_t sy = vmulq_n_f32(vsubq_f32(vld1q_f32(&t[i]),
+                                               vld1q_f32(&b[i])), ky);
+        float32x4x2_t xy = vzipq_f32(sx, sy);
+
+        vst1_u16(&slopes[2 * i    ], vreinterpret_u16_f16(vcvt_f16_f32(xy.val[0])));
+        vst1_u16(&slopes[2 * i + 4], vreinterpret_u16_f16(vcvt_f16_f32(xy.val[1])));
+    }
+#endif
+
+    // remainder
+    for (; i < width; ++i)
+        smap__ComputeTexel(b, c, t, width, i, kx, ky, slopes);
+}
+
+
+/*******************************************************************************
+ * Compute -- Computes the slope map in parallel
+ *
+ * The rows are split into bands of SMAP_BAND_SIZE rows that are distributed
+ * with OpenMP. Each band converts its rows to floats once, and keeps the
+ * last three of them in a ring, so the memory overhead is 3 rows per
+ * thread on top of the output.
+ *
+ */
+static void
+smap__LoadRow(
+    const void *texels,
+    int32_t bytesPerTexel,
+    int32_t width,
+    int32_t j,
+    float *row
+) {
+    if (bytesPerTexel == 2) {
+        const uint16_t *src = (const uint16_t *)texels + (int64_t)width * j;
+
+        for (int32_t i = 0; i < width; ++i)
+            row[i] = (float)src[i];
+    } else {
+        const uint8_t *src = (const uint8_t *)texels + (int64_t)width * j;
+
+        for (int32_t i = 0; i < width; ++i)
+            row[i] = (float)src[i];
+    }
+}
+
+static void
+smap__Compute(
+    const void *texels,
+    int32_t bytesPerTexel,
+    int32_t width,
+    int32_t height,
+    uint16_t *slopes
+) {
+    const float maxValue = bytesPerTexel == 2 ? 65535.0f : 255.0f;
+    const float kx = 0.5f * (float)width / maxValue;
+    const float ky = 0.5f * (float)height / maxValue;
+    const int32_t bandCount = (height + SMAP_BAND_SIZE - 1) / SMAP_BAND_SIZE;
+
+#pragma omp parallel for schedule(static)
+    for (int32_t bandID = 0; bandID < bandCount; ++bandID) {
+        float *rows = (float *)malloc(3 * sizeof(float) * width);
+        float *b = rows, *c = rows + width, *t = rows + 2 * width;
+        int32_t j0 = bandID * SMAP_BAND_SIZE;
+        int32_t j1 = j0 + SMAP_BAND_SIZE < height ? j0 + SMAP_BAND_SIZE : height;
+
+        smap__LoadRow(texels, bytesPerTexel, width, j0 > 0 ? j0 - 1 : 0, b);
+        smap__LoadRow(texels, bytesPerTexel, width, j0, c);
+
+        for (int32_t j = j0; j < j1; ++j) {
+            float *tmp;
+
+            smap__LoadRow(texels, bytesPerTexel, width,
+                          j + 1 < height ? j + 1 : height - 1, t);
+            smap__ComputeRow(b, c, t, width, kx, ky,
+                             &slopes[2 * (int64_t)width * j]);
+            tmp = b; b = c; c = t; t = tmp;
+        }
+
+        free(rows);
+    }
+}
+
+SMAPDEF void
+smap_Compute16(
+    const uint16_t *texels,
+    int32_t width,
+    int32_t height,
+    uint16_t *slopes
+) {
+    smap__Compute(texels, 2, width, height, slopes);
+}
+
+SMAPDEF void
+smap_Compute8(
+    const uint8_t *texels,
+    int32_t width,
+    int32_t height,
+    uint16_t *slopes
+) {
+    smap__Compute(texels, 1, width, height, slopes);
+}
+
+#endif // SMAP_IMPLEMENTATION
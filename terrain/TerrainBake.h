@@ -0,0 +1,532 @@
+#ifndef TBK_INCLUDE_TBK_H
+#define TBK_INCLUDE_TBK_H
+
+#include "SlopeMap.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef TBK_STATIC
+#define TBKDEF static
+#else
+#define TBKDEF extern
+#endif
+
+#define TBK_VERSION 1
+
+// enough levels for any 2D texture
+#define TBK_MAX_LEVEL_COUNT 32
+
+// byte alignment of the levels within the file, so that each level can be
+// mapped and handed to the driver as is
+#define TBK_ALIGNMENT 4096
+
+// texture sections of a baked terrain
+enum {
+    TBK_SECTION_DMAP,   // RG16 texels holding the height and its square
+    TBK_SECTION_SMAP,   // RG16F texels holding the slopes
+
+    TBK_SECTION_COUNT
+};
+
+// location of a mip level within the file
+typedef struct {
+    uint64_t offset;        // multiple of TBK_ALIGNMENT
+    uint64_t byteSize;
+    int32_t width, height;
+} tbk_Level;
+
+// on-disk header; the first level starts at byte TBK_ALIGNMENT
+typedef struct {
+    char magic[4];          // "TBKE"
+    uint32_t version;       // TBK_VERSION
+    int32_t width;          // width of the finest level
+    int32_t height;         // height of the finest level
+    int32_t levelCount;     // levels of each section, down to 1x1 texels
+    int32_t bytesPerTexel;  // of each section (4)
+    uint64_t sourceByteSize;// size of the heightmap file the asset was baked from
+    tbk_Level levels[TBK_SECTION_COUNT][TBK_MAX_LEVEL_COUNT];
+} tbk_Header;
+
+// memory-mapped asset
+typedef struct {
+    const tbk_Header *header;
+    void *data;
+    int64_t byteSize;
+    void *handles[2];       // platform-specific file handles
+    bool isHeap;            // data was allocated by tbk_BakeInMemory
+} tbk_Asset;
+
+// bakes the mip chains of a 16-bit heightmap into a file; sourceByteSize
+// identifies the heightmap file, see tbk_MatchesSource
+TBKDEF bool tbk_Bake(const char *path,
+                     const uint16_t *texels,
+                     int32_t width,
+                     int32_t height,
+                     uint64_t sourceByteSize);
+
+// bakes the same mip chains into an asset that lives in memory, laid out
+// as in a file; tbk_Unmap releases it
+TBKDEF bool tbk_BakeInMemory(tbk_Asset *asset,
+                             const uint16_t *texels,
+                             int32_t width,
+                             int32_t height,
+                             uint64_t sourceByteSize);
+
+// maps an asset in memory; its levels can then be sent to the GPU as is
+TBKDEF bool tbk_Map(const char *path, tbk_Asset *asset);
+TBKDEF void tbk_Unmap(tbk_Asset *asset);
+
+// returns true if the asset was baked from a file of the same size
+TBKDEF bool tbk_MatchesSource(const tbk_Asset *asset, const char *sourcePath);
+
+// texels of a mip level of a section
+TBKDEF const void *tbk_LevelTexels(const tbk_Asset *asset, int32_t section, int32_t level);
+
+// number of levels of the full mip chain of a texture
+TBKDEF int32_t tbk_LevelCount(int32_t width, int32_t height);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
+
+//
+//
+//// end header file ///////////////////////////////////////////////////////////
+#endif // TBK_INCLUDE_TBK_H
+
+#ifdef TBK_IMPLEMENTATION
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#   ifndef WIN32_LEAN_AND_MEAN
+#       define WIN32_LEAN_AND_MEAN
+#   endif
+#   ifndef NOMINMAX
+#       define NOMINMAX
+#   endif
+#   include <windows.h>
+#   define tbk__fseek _fseeki64
+#   define tbk__ftell _ftelli64
+#else
+#   include <fcntl.h>
+#   include <sys/mman.h>
+#   include <sys/stat.h>
+#   include <unistd.h>
+#   define tbk__fseek fseeko
+#   define tbk__ftell ftello
+#endif
+
+
+/*******************************************************************************
+ * LevelCount -- Computes the number of levels of a full mip chain
+ *
+ * This matches the level count OpenGL expects for a complete texture.
+ *
+ */
+TBKDEF int32_t tbk_LevelCount(int32_t width, int32_t height)
+{
+    int32_t size = width > height ? width : height;
+    int32_t levelCount = 1;
+
+    while ((size>>= 1) > 0)
+        ++levelCount;
+
+    return levelCount;
+}
+
+
+/*******************************************************************************
+ * Downsample -- Computes a mip level from the previous one
+ *
+ * Both sections are reduced with a 2x2 box filter, as glGenerateMipmap does;
+ * the texels of odd-sized levels are clamped to the edge. The moments of the
+ * dmap remain moments, so the variance can still be retrieved from the
+ * coarser levels.
+ *
+ */
+static float tbk__TexelToFloat(const uint16_t *texel, int32_t section)
+{
+    if (section == TBK_SECTION_DMAP)
+        return (float)texel[0] / 65535.0f;
+    else
+        return smap_HalfToFloat(texel[0]);
+}
+
+static uint16_t tbk__FloatToTexel(float x, int32_t section)
+{
+    if (section == TBK_SECTION_DMAP)
+        return (uint16_t)(x * 65535.0f + 0.5f);
+    else
+        return smap_FloatToHalf(x);
+}
+
+static void
+tbk__Downsample(
+    const uint16_t *src,
+    int32_t srcWidth,
+    int32_t srcHeight,
+    int32_t section,
+    uint16_t *dst
+) {
+    int32_t dstWidth = srcWidth > 1 ? srcWidth / 2 : 1;
+    int32_t dstHeight = srcHeight > 1 ? srcHeight / 2 : 1;
+
+#pragma omp parallel for
+    for (int32_t j = 0; j < dstHeight; ++j)
+    for (int32_t i = 0; i < dstWidth; ++i) {
+        int32_t i1 = 2 * i, i2 = 2 * i + 1 < srcWidth ? 2 * i + 1 : srcWidth - 1;
+        int32_t j1 = 2 * j, j2 = 2 * j + 1 < srcHeight ? 2 * j + 1 : srcHeight - 1;
+        const uint16_t *t[4] = {
+            &src[2 * (i1 + (int64_t)srcWidth * j1)],
+            &src[2 * (i2 + (int64_t)srcWidth * j1)],
+            &src[2 * (i1 + (int64_t)srcWidth * j2)],
+            &src[2 * (i2 + (int64_t)srcWidth * j2)]
+        };
+
+        for (int32_t c = 0; c < 2; ++c) {
+            float x = 0.25f * (tbk__TexelToFloat(t[0] + c, section)
+                             + tbk__TexelToFloat(t[1] + c, section)
+                             + tbk__TexelToFloat(t[2] + c, section)
+                             + tbk__TexelToFloat(t[3] + c, section));
+
+            dst[c + 2 * (i + (int64_t)dstWidth * j)] = tbk__FloatToTexel(x, section);
+        }
+    }
+}
+
+
+/*******************************************************************************
+ * Bake -- Writes the mip chains of the dmap and of the slope map
+ *
+ * The levels are written one after the other, so that only two levels of
+ * a section live in memory at any time. The finest dmap level packs the
+ * height and its square exactly as the terrain program does when it decodes
+ * the heightmap, and the finest slope level comes from smap_Compute16.
+ * The levels go either to a file or to a memory block with the same layout.
+ *
+ */
+typedef struct {
+    FILE *file;
+    uint8_t *data;
+} tbk__Output;
+
+static bool tbk__WriteLevel(tbk__Output *out, const tbk_Level *level, const void *texels)
+{
+    if (out->data) {
+        memcpy(out->data + level->offset, texels, (size_t)level->byteSize);
+
+        return true;
+    }
+
+    if (tbk__fseek(out->file, (int64_t)level->offset, SEEK_SET) != 0)
+        return false;
+
+    return fwrite(texels, (size_t)level->byteSize, 1, out->file) == 1;
+}
+
+// returns the byte size of the asset
+static uint64_t
+tbk__LoadHeader(
+    tbk_Header *header,
+    int32_t width,
+    int32_t height,
+    uint64_t sourceByteSize
+) {
+    uint64_t offset = TBK_ALIGNMENT;
+
+    memset(header, 0, sizeof(*header));
+    memcpy(header->magic, "TBKE", 4);
+    header->version = TBK_VERSION;
+    header->width = width;
+    header->height = height;
+    header->levelCount = tbk_LevelCount(width, height);
+    header->bytesPerTexel = 2 * sizeof(uint16_t);
+    header->sourceByteSize = sourceByteSize;
+    for (int32_t section = 0; section < TBK_SECTION_COUNT; ++section)
+    for (int32_t levelID = 0; levelID < header->levelCount; ++levelID) {
+        tbk_Level *level = &header->levels[section][levelID];
+
+        level->width = (width >> levelID) > 0 ? width >> levelID : 1;
+        level->height = (height >> levelID) > 0 ? height >> levelID : 1;
+        level->byteSize = (uint64_t)level->width * level->height * header->bytesPerTexel;
+        level->offset = offset;
+        offset+= (level->byteSize + TBK_ALIGNMENT - 1) / TBK_ALIGNMENT * TBK_ALIGNMENT;
+    }
+
+    return offset;
+}
+
+static bool
+tbk__WriteLevels(
+    tbk__Output *out,
+    const tbk_Header *header,
+    const uint16_t *texels
+) {
+    int32_t width = header->width, height = header->height;
+    uint16_t *levels[2];
+    bool success = true;
+
+    levels[0] = (uint16_t *)malloc(header->levels[0][0].byteSize);
+    levels[1] = (uint16_t *)malloc(header->levels[0][1 % header->levelCount].byteSize);
+    if (!levels[0] || !levels[1]) {
+        free(levels[0]);
+        free(levels[1]);
+
+        return false;
+    }
+
+    for (int32_t section = 0; section < TBK_SECTION_COUNT && success; ++section) {
+        if (section == TBK_SECTION_DMAP) {
+#pragma omp parallel for
+            for (int64_t i = 0; i < (int64_t)width * height; ++i) {
+                float z = (float)texels[i] / 65535.0f;
+
+                levels[0][2 * i    ] = texels[i];
+                levels[0][2 * i + 1] = (uint16_t)(z * z * 65535.0f);
+            }
+        } else {
+            smap_Compute16(texels, width, height, levels[0]);
+        }
+        success&= tbk__WriteLevel(out, &header->levels[section][0], levels[0]);
+
+        for (int32_t levelID = 1; levelID < header->levelCount && success; ++levelID) {
+            const tbk_Level *src = &header->levels[section][levelID - 1];
+            uint16_t *tmp;
+
+            tbk__Downsample(levels[0], src->width, src->height, section, levels[1]);
+            success&= tbk__WriteLevel(out, &header->levels[section][levelID], levels[1]);
+            tmp = levels[0]; levels[0] = levels[1]; levels[1] = tmp;
+        }
+    }
+
+    free(levels[0]);
+    free(levels[1]);
+
+    return success;
+}
+
+TBKDEF bool
+tbk_Bake(
+    const char *path,
+    const uint16_t *texels,
+    int32_t width,
+    int32_t height,
+    uint64_t sourceByteSize
+) {
+    tbk_Header header;
+    tbk__Output out = {NULL, NULL};
+    bool success = true;
+
+    if (width < 1 || height < 1)
+        return false;
+
+    tbk__LoadHeader(&header, width, height, sourceByteSize);
+    out.file = fopen(path, "wb");
+    if (!out.file)
+        return false;
+
+    success&= fwrite(&header, sizeof(header), 1, out.file) == 1;
+    if (success)
+        success = tbk__WriteLevels(&out, &header, texels);
+    success&= (fclose(out.file) == 0);
+
+    return success;
+}
+
+TBKDEF bool
+tbk_BakeInMemory(
+    tbk_Asset *asset,
+    const uint16_t *texels,
+    int32_t width,
+    int32_t height,
+    uint64_t sourceByteSize
+) {
+    tbk_Header header;
+    tbk__Output out = {NULL, NULL};
+    uint64_t byteSize;
+
+    memset(asset, 0, sizeof(*asset));
+    if (width < 1 || height < 1)
+        return false;
+
+    byteSize = tbk__LoadHeader(&header, width, height, sourceByteSize);
+    out.data = (uint8_t *)malloc((size_t)byteSize);
+    if (!out.data)
+        return false;
+
+    memcpy(out.data, &header, sizeof(header));
+    if (!tbk__WriteLevels(&out, &header, texels)) {
+        free(out.data);
+
+        return false;
+    }
+    asset->header = (const tbk_Header *)out.data;
+    asset->data = out.data;
+    asset->byteSize = (int64_t)byteSize;
+    asset->isHeap = true;
+
+    return true;
+}
+
+
+/*******************************************************************************
+ * Map -- Maps an asset file in memory and validates its header
+ *
+ */
+TBKDEF bool tbk_Map(const char *path, tbk_Asset *asset)
+{
+    const tbk_Header *header;
+    bool isValid;
+
+    memset(asset, 0, sizeof(*asset));
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    HANDLE mapping;
+    LARGE_INTEGER size;
+
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    if (!GetFileSizeEx(file, &size) || size.QuadPart < (LONGLONG)sizeof(tbk_Header)) {
+        CloseHandle(file);
+
+        return false;
+    }
+
+    mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL) {
+        CloseHandle(file);
+
+        return false;
+    }
+
+    asset->data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (asset->data == NULL) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+
+        return false;
+    }
+
+    asset->byteSize = (int64_t)size.QuadPart;
+    asset->handles[0] = (void *)file;
+    asset->handles[1] = (void *)mapping;
+#else
+    struct stat st;
+    int fd = open(path, O_RDONLY);
+    void *data;
+
+    if (fd < 0)
+        return false;
+
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(tbk_Header)) {
+        close(fd);
+
+        return false;
+    }
+
+    data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    asset->data = data;
+    asset->byteSize = (int64_t)st.st_size;
+#endif
+
+    header = (const tbk_Header *)asset->data;
+    isValid = memcmp(header->magic, "TBKE", 4) == 0
+           && header->version == TBK_VERSION
+           && header->width > 0 && header->height > 0
+           && header->levelCount == tbk_LevelCount(header->width, header->height)
+           && header->bytesPerTexel == 2 * (int32_t)sizeof(uint16_t);
+    for (int32_t section = 0; section < TBK_SECTION_COUNT && isValid; ++section)
+    for (int32_t levelID = 0; levelID < header->levelCount && isValid; ++levelID) {
+        const tbk_Level *level = &header->levels[section][levelID];
+
+        isValid = level->offset % TBK_ALIGNMENT == 0
+               && level->byteSize == (uint64_t)level->width * level->height
+                                   * header->bytesPerTexel
+               && level->offset + level->byteSize <= (uint64_t)asset->byteSize;
+    }
+
+    if (!isValid) {
+        tbk_Unmap(asset);
+
+        return false;
+    }
+    asset->header = header;
+
+    return true;
+}
+
+
+/*******************************************************************************
+ * Unmap -- Releases a mapped asset
+ *
+ */
+TBKDEF void tbk_Unmap(tbk_Asset *asset)
+{
+    if (asset->data == NULL)
+        return;
+
+    if (asset->isHeap) {
+        free(asset->data);
+        memset(asset, 0, sizeof(*asset));
+
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(asset->data);
+    CloseHandle((HANDLE)asset->handles[1]);
+    CloseHandle((HANDLE)asset->handles[0]);
+#else
+    munmap(asset->data, (size_t)asset->byteSize);
+#endif
+
+    memset(asset, 0, sizeof(*asset));
+}
+
+
+/*******************************************************************************
+ * MatchesSource -- Checks that an asset is not older than its heightmap
+ *
+ * Only the size of the heightmap file is compared, which is enough to catch
+ * an asset baked from another heightmap without reading the heightmap.
+ *
+ */
+TBKDEF bool tbk_MatchesSource(const tbk_Asset *asset, const char *sourcePath)
+{
+    FILE *pf = fopen(sourcePath, "rb");
+    int64_t byteSize = -1;
+
+    if (!pf)
+        return false;
+
+    if (tbk__fseek(pf, 0, SEEK_END) == 0)
+        byteSize = (int64_t)tbk__ftell(pf);
+    fclose(pf);
+
+    return byteSize >= 0 && (uint64_t)byteSize == asset->header->sourceByteSize;
+}
+
+
+/*******************************************************************************
+ * LevelTexels -- Returns the texels of a mip level
+ *
+ */
+TBKDEF const void *
+tbk_LevelTexels(const tbk_Asset *asset, int32_t section, int32_t level)
+{
+    return (const uint8_t *)asset->data + asset->header->levels[section][level].offset;
+}
+
+#endif // TBK_IMPLEMENTATION
@@ -0,0 +1,60 @@
+/* HizPyramid.glsl - public domain
+
+    Builds one level of the max-depth pyramid of the scene depth buffer.
+    Level 0 resolves the depth buffer (the farthest sample of each pixel in
+    MSAA mode); each next level holds the farthest depth of the 2x2 texels
+    it covers in the previous one. When the previous level has an odd
+    resolution, the last texel of a row (resp. column) also covers the
+    texel that a 2x2 footprint misses.
+*/
+
+#ifdef COMPUTE_SHADER
+layout(local_size_x = 16, local_size_y = 16, local_size_z = 1) in;
+
+#if MSAA_FACTOR
+uniform sampler2DMS u_DepthSampler;
+#else
+uniform sampler2D u_DepthSampler;
+#endif
+uniform sampler2D u_HizSampler;
+uniform int u_HizLevel;
+layout(r32f) writeonly uniform image2D u_HizImage;
+
+float SceneDepth(ivec2 P)
+{
+#if MSAA_FACTOR
+    float z = 0.0;
+
+    for (int i = 0; i < MSAA_FACTOR; ++i)
+        z = max(z, texelFetch(u_DepthSampler, P, i).r);
+
+    return z;
+#else
+    return texelFetch(u_DepthSampler, P, 0).r;
+#endif
+}
+
+void main()
+{
+    ivec2 P = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 size = imageSize(u_HizImage);
+
+    if (any(greaterThanEqual(P, size)))
+        return;
+
+    if (u_HizLevel == 0) {
+        imageStore(u_HizImage, P, vec4(SceneDepth(P)));
+    } else {
+        ivec2 srcSize = textureSize(u_HizSampler, u_HizLevel - 1);
+        ivec2 P0 = 2 * P;
+        ivec2 P1 = mix(2 * P + 1, srcSize - 1, equal(P, size - 1));
+        float z = 0.0;
+
+        for (int y = P0.y; y <= P1.y; ++y)
+        for (int x = P0.x; x <= P1.x; ++x)
+            z = max(z, texelFetch(u_HizSampler, ivec2(x, y), u_HizLevel - 1).r);
+
+        imageStore(u_HizImage, P, vec4(z));
+    }
+}
+#endif
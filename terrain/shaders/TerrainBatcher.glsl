@@ -3,8 +3,6 @@
 
 //#pragma optionNV(unroll none)
 
-uniform int u_CbtID = 0;
-
 layout(std430, binding = BUFFER_BINDING_DRAW_ARRAYS_INDIRECT_COMMAND)
 buffer DrawArraysIndirectCommandBuffer {
     uint u_DrawArraysIndirectCommand[];
@@ -30,21 +28,24 @@ buffer DispatchIndirectCommandBuffer {
 
 layout(local_size_x = 1, local_size_y = 1, local_size_z = 1) in;
 
+// each workgroup sets the commands of one CBT; the draw commands of the
+// CBTs are consecutive, and the update of all CBTs is a single dispatch
+// whose rows of workgroups map to the CBTs (the CPU resets its x size)
 void main()
 {
-    const int cbtID = u_CbtID;
+    const int cbtID = int(gl_WorkGroupID.x);
     uint nodeCount = cbt_NodeCount(cbtID);
 
-    u_DrawArraysIndirectCommand[0] = nodeCount;
+    u_DrawArraysIndirectCommand[4 * cbtID] = nodeCount;
 
 #if FLAG_MS
     u_DrawMeshTasksIndirectCommand[0] = max(1, (nodeCount >> 5) + 1);
 #endif
 
 #if FLAG_CS
-    u_DispatchIndirectCommand[0] = nodeCount / 256u + 1u;
-    u_DrawElementsIndirectCommand[0] = MESHLET_INDEX_COUNT;
-    u_DrawElementsIndirectCommand[1] = nodeCount;
+    atomicMax(u_DispatchIndirectCommand[0], nodeCount / 256u + 1u);
+    u_DrawElementsIndirectCommand[5 * cbtID + 0] = MESHLET_INDEX_COUNT;
+    u_DrawElementsIndirectCommand[5 * cbtID + 1] = nodeCount;
 #endif
 }
 
@@ -18,10 +18,14 @@ layout(location = 1) out vec3 o_WorldPos;
 
 void main()
 {
+#if TERRAIN_TILE_COUNT > 1
+    const int cbtID = gl_DrawIDARB; // one draw per CBT (see lebRenderCs)
+#else
     const int cbtID = 0;
+#endif
     uint nodeID = gl_InstanceID;
     cbt_Node node = cbt_DecodeNode(cbtID, nodeID);
-    vec4 triangleVertices[3] = DecodeTriangleVertices(node);
+    vec4 triangleVertices[3] = DecodeTriangleVertices(cbtID, node);
     vec2 triangleTexCoords[3] = vec2[3](
         triangleVertices[0].xy,
         triangleVertices[1].xy,
@@ -11,7 +11,9 @@ uniform PerFrameVariables {
     mat4 u_CameraMatrix;
     mat4 u_ViewProjectionMatrix;
     mat4 u_ModelViewProjectionMatrix;
+    mat4 u_HizModelViewProjectionMatrix;
     vec4 u_FrustumPlanes[6];
+    vec4 u_LocalCameraPosition;
 };
 
 uniform float u_TargetEdgeLength;
@@ -26,19 +28,187 @@ uniform float u_MinLodVariance;
 #endif
 
 
+#if FLAG_DISPLACE && FLAG_DMAP_STREAMING
+/*******************************************************************************
+ * Streamed Dmap -- Samples the dmap from a pool of resident tiles
+ *
+ * The dmap is split into tiles of DMAP_TILE_SIZE^2 texels at each mip
+ * level, and only a subset of them is resident in the page pool. A lookup
+ * falls back to the next coarser level until it finds a resident tile; the
+ * coarsest level is made of a single tile that is always resident. See
+ * DmapTiles.h and the tile streaming pass in terrain.cpp.
+ *
+ */
+uniform sampler2DArray u_DmapPageSampler;
+uniform uint u_DmapFrame;
+
+layout(std430, binding = BUFFER_BINDING_DMAP_PAGE_TABLE)
+readonly buffer DmapPageTableBuffer {
+    uvec4 u_DmapLevels[DMAP_MAX_LEVEL_COUNT];   // width, height, tileCountX, firstTileID
+    uint u_DmapPageTable[];                     // page of each tile, or DMAP_PAGE_NULL
+};
+
+layout(std430, binding = BUFFER_BINDING_DMAP_TILE_REQUESTS)
+buffer DmapTileRequestBuffer {
+    uint u_DmapTileRequestCount;
+    uint u_DmapTileRequests[DMAP_TILE_REQUEST_CAPACITY];
+};
+
+layout(std430, binding = BUFFER_BINDING_DMAP_TILE_STAMPS)
+buffer DmapTileStampBuffer {
+    uint u_DmapTileStamps[];                    // frame of the last request of each tile
+};
+
+// texel-space coordinates of a point at a given level
+vec2 DmapTexelCoord(vec2 uv, int level)
+{
+    return clamp(uv, 0.0, 1.0) * vec2(u_DmapLevels[level].xy);
+}
+
+// tile that holds a texel-space point at a given level
+uvec2 DmapTileCoord(vec2 texelCoord, int level)
+{
+    uvec2 tileCount = (u_DmapLevels[level].xy + DMAP_TILE_SIZE - 1u) / DMAP_TILE_SIZE;
+
+    return min(uvec2(texelCoord) / DMAP_TILE_SIZE, tileCount - 1u);
+}
+
+uint DmapTileID(uvec2 tileCoord, int level)
+{
+    return u_DmapLevels[level].w + tileCoord.x + u_DmapLevels[level].z * tileCoord.y;
+}
+
+vec2 DmapSample(vec2 uv, int level)
+{
+    for (int i = level; i < DMAP_LEVEL_COUNT; ++i) {
+        vec2 texelCoord = DmapTexelCoord(uv, i);
+        uvec2 tileCoord = DmapTileCoord(texelCoord, i);
+        uint pageID = u_DmapPageTable[DmapTileID(tileCoord, i)];
+
+        if (pageID != DMAP_PAGE_NULL) {
+            vec2 pageCoord = texelCoord - vec2(tileCoord * DMAP_TILE_SIZE)
+                           + float(DMAP_TILE_BORDER);
+
+            return textureLod(u_DmapPageSampler,
+                              vec3(pageCoord / float(DMAP_PAGE_SIZE), float(pageID)),
+                              0.0).rg;
+        }
+    }
+
+    return vec2(0.0);
+}
+
+// level whose texels match the vertex spacing of a tessellated triangle
+int DmapLevel(in const vec4[3] patchVertices)
+{
+    vec2 edge = (patchVertices[2].xy - patchVertices[0].xy) * vec2(u_DmapLevels[0].xy);
+    float texelsPerVertex = length(edge) / float(TERRAIN_PATCH_TESS_FACTOR);
+
+    return clamp(int(log2(max(texelsPerVertex, 1.0))), 0, DMAP_LEVEL_COUNT - 1);
+}
+
+void DmapRequestTile(vec2 uv, int level)
+{
+    uint tileID = DmapTileID(DmapTileCoord(DmapTexelCoord(uv, level), level), level);
+
+    if (atomicExchange(u_DmapTileStamps[tileID], u_DmapFrame) != u_DmapFrame) {
+        uint requestID = atomicAdd(u_DmapTileRequestCount, 1u);
+
+        if (requestID < DMAP_TILE_REQUEST_CAPACITY)
+            u_DmapTileRequests[requestID] = tileID;
+    }
+}
+
+// requests the tiles a triangle needs, which are at most as large as it
+void DmapRequestTiles(in const vec4[3] patchVertices)
+{
+    int level = DmapLevel(patchVertices);
+
+    DmapRequestTile(patchVertices[0].xy, level);
+    DmapRequestTile(patchVertices[1].xy, level);
+    DmapRequestTile(patchVertices[2].xy, level);
+}
+#endif
+
+
+#if FLAG_DISPLACE && FLAG_DMAP_BOUNDS
+/*******************************************************************************
+ * Dmap Bounds -- Conservative height bounds from a min/max pyramid
+ *
+ * Each texel of the pyramid holds the height range of the dmap texels it
+ * covers (see lebt_CreateDmapBounds in LebTerrain.h). A region is expanded
+ * to the texels that bilinear lookups at the first level may read, and the
+ * bounds are fetched at the coarsest level whose texels cover that range
+ * with at most 2x2 texels.
+ *
+ */
+uniform sampler2D u_DmapBoundsSampler;
+
+vec2 DmapBounds(vec2 uvMin, vec2 uvMax)
+{
+    ivec2 size = textureSize(u_DmapBoundsSampler, 0);
+    ivec2 t0 = clamp(ivec2(floor(uvMin * vec2(size) - 0.5)), ivec2(0), size - 1);
+    ivec2 t1 = clamp(ivec2(floor(uvMax * vec2(size) - 0.5)) + 1, ivec2(0), size - 1);
+    ivec2 dt = t1 - t0;
+    int level = min(findMSB(uint(max(dt.x, dt.y))) + 1,
+                    textureQueryLevels(u_DmapBoundsSampler) - 1);
+    ivec2 levelSize = textureSize(u_DmapBoundsSampler, level);
+    ivec2 b0 = min(t0 >> level, levelSize - 1);
+    ivec2 b1 = min(t1 >> level, levelSize - 1);
+    vec2 z00 = texelFetch(u_DmapBoundsSampler, b0, level).rg;
+    vec2 z10 = texelFetch(u_DmapBoundsSampler, ivec2(b1.x, b0.y), level).rg;
+    vec2 z01 = texelFetch(u_DmapBoundsSampler, ivec2(b0.x, b1.y), level).rg;
+    vec2 z11 = texelFetch(u_DmapBoundsSampler, b1, level).rg;
+
+    return vec2(min(min(z00.x, z10.x), min(z01.x, z11.x)),
+                max(max(z00.y, z10.y), max(z01.y, z11.y)));
+}
+#endif
+
+
+/*******************************************************************************
+ * Terrain Tiles -- Maps each CBT to a tile of the terrain
+ *
+ * The terrain is split into TERRAIN_TILE_COUNT x TERRAIN_TILE_COUNT tiles,
+ * each subdivided by its own CBT: the CBT cbtID covers the tile in column
+ * cbtID % TERRAIN_TILE_COUNT and row cbtID / TERRAIN_TILE_COUNT.
+ *
+ */
+#ifndef TERRAIN_TILE_COUNT
+#   define TERRAIN_TILE_COUNT 1
+#endif
+
+vec2 TileToTerrainSpace(in const int cbtID, vec2 p)
+{
+#if TERRAIN_TILE_COUNT > 1
+    ivec2 tile = ivec2(cbtID % TERRAIN_TILE_COUNT, cbtID / TERRAIN_TILE_COUNT);
+
+    return (p + vec2(tile)) / float(TERRAIN_TILE_COUNT);
+#else
+    return p;
+#endif
+}
+
+
 /*******************************************************************************
  * DecodeTriangleVertices -- Decodes the triangle vertices in local space
  *
  */
-vec4[3] DecodeTriangleVertices(in const cbt_Node node)
+vec4[3] DecodeTriangleVertices(in const int cbtID, in const cbt_Node node)
 {
     vec3 xPos = vec3(0, 0, 1), yPos = vec3(1, 0, 0);
     mat2x3 pos = leb_DecodeNodeAttributeArray_Square(node, mat2x3(xPos, yPos));
-    vec4 p1 = vec4(pos[0][0], pos[1][0], 0.0, 1.0);
-    vec4 p2 = vec4(pos[0][1], pos[1][1], 0.0, 1.0);
-    vec4 p3 = vec4(pos[0][2], pos[1][2], 0.0, 1.0);
-
-#if FLAG_DISPLACE
+    vec4 p1 = vec4(TileToTerrainSpace(cbtID, vec2(pos[0][0], pos[1][0])), 0.0, 1.0);
+    vec4 p2 = vec4(TileToTerrainSpace(cbtID, vec2(pos[0][1], pos[1][1])), 0.0, 1.0);
+    vec4 p3 = vec4(TileToTerrainSpace(cbtID, vec2(pos[0][2], pos[1][2])), 0.0, 1.0);
+
+#if FLAG_DISPLACE && FLAG_DMAP_STREAMING
+    // the finest resident level only depends on the position, so
+    // neighbouring triangles agree on the height of their shared vertices
+    p1.z = u_DmapFactor * DmapSample(p1.xy, 0).r;
+    p2.z = u_DmapFactor * DmapSample(p2.xy, 0).r;
+    p3.z = u_DmapFactor * DmapSample(p3.xy, 0).r;
+#elif FLAG_DISPLACE
     p1.z = u_DmapFactor * texture(u_DmapSampler, p1.xy).r;
     p2.z = u_DmapFactor * texture(u_DmapSampler, p2.xy).r;
     p3.z = u_DmapFactor * texture(u_DmapSampler, p3.xy).r;
@@ -180,7 +350,13 @@ bool DisplacementVarianceTest(in const vec4[3] patchVertices)
     vec2 P = (P0 + P1 + P2) / 3.0;
     vec2 dx = (P0 - P1);
     vec2 dy = (P2 - P1);
+#if FLAG_DMAP_STREAMING
+    float footprint = max(length(dx), length(dy)) * float(u_DmapLevels[0].x);
+    int level = clamp(int(log2(max(footprint, 1.0))), 0, DMAP_LEVEL_COUNT - 1);
+    vec2 dmap = DmapSample(P, level);
+#else
     vec2 dmap = textureGrad(u_DmapSampler, P, dx, dy).rg;
+#endif
     float dmapVariance = clamp(dmap.y - dmap.x * dmap.x, 0.0, 1.0);
 
     return (dmapVariance >= u_MinLodVariance);
@@ -190,6 +366,26 @@ bool DisplacementVarianceTest(in const vec4[3] patchVertices)
 }
 #endif
 
+/*******************************************************************************
+ * TriangleBounds -- Computes the bounding box of the displaced triangle
+ *
+ * With the min/max pyramid, the box holds the tessellated triangle rather
+ * than its three vertices only.
+ *
+ */
+void TriangleBounds(in const vec4[3] patchVertices, out vec3 bmin, out vec3 bmax)
+{
+    bmin = min(min(patchVertices[0].xyz, patchVertices[1].xyz), patchVertices[2].xyz);
+    bmax = max(max(patchVertices[0].xyz, patchVertices[1].xyz), patchVertices[2].xyz);
+
+#if FLAG_DISPLACE && FLAG_DMAP_BOUNDS
+    vec2 zBounds = u_DmapFactor * DmapBounds(bmin.xy, bmax.xy);
+
+    bmin.z = zBounds.x;
+    bmax.z = zBounds.y;
+#endif
+}
+
 /*******************************************************************************
  * FrustumCullingTest -- Checks if the triangle lies inside the view frutsum
  *
@@ -198,12 +394,142 @@ bool DisplacementVarianceTest(in const vec4[3] patchVertices)
  */
 bool FrustumCullingTest(in const vec4[3] patchVertices)
 {
-    vec3 bmin = min(min(patchVertices[0].xyz, patchVertices[1].xyz), patchVertices[2].xyz);
-    vec3 bmax = max(max(patchVertices[0].xyz, patchVertices[1].xyz), patchVertices[2].xyz);
+    vec3 bmin, bmax;
+
+    TriangleBounds(patchVertices, bmin, bmax);
 
     return FrustumCullingTest(u_FrustumPlanes, bmin, bmax);
 }
 
+#if FLAG_HORIZON_CULL
+/*******************************************************************************
+ * HorizonOcclusionTest -- Checks if the triangle is not hidden by the terrain
+ *
+ * At parameter t, the rays going from the camera to the box of the
+ * triangle lie within the box scaled by t around the camera, and below the
+ * ray that reaches the top of the box. If the min/max pyramid says that the
+ * terrain is higher everywhere within the scaled box, every ray goes through
+ * the terrain before it reaches the triangle. Scaled boxes that overlap the
+ * triangle or leave the terrain are skipped. This assumes the camera is
+ * above the terrain; see lebt__HorizonOcclusionTest for the CPU version.
+ *
+ */
+bool HorizonOcclusionTest(vec3 bmin, vec3 bmax)
+{
+    vec3 eye = u_LocalCameraPosition.xyz;
+
+    for (int i = 1; i <= HORIZON_SAMPLE_COUNT; ++i) {
+        float t = float(i) / float(HORIZON_SAMPLE_COUNT + 1);
+        vec2 rmin = eye.xy + t * (bmin.xy - eye.xy);
+        vec2 rmax = eye.xy + t * (bmax.xy - eye.xy);
+        float rayMax = eye.z + t * (bmax.z - eye.z);
+        bool isInside = all(greaterThanEqual(rmin, vec2(0.0)))
+                     && all(lessThanEqual(rmax, vec2(1.0)));
+        bool isDisjoint = any(lessThan(rmax, bmin.xy))
+                       || any(greaterThan(rmin, bmax.xy));
+
+        if (isInside && isDisjoint
+            && u_DmapFactor * DmapBounds(rmin, rmax).x > rayMax)
+            return false;
+    }
+
+    return true;
+}
+#endif
+
+#if FLAG_HIZ_CULL
+/*******************************************************************************
+ * HizOcclusionTest -- Checks if the triangle is not hidden by the last frame
+ *
+ * The box of the triangle is projected with the transformation of the frame
+ * the Hi-Z pyramid was built from (see HizPyramid.glsl), and its nearest
+ * depth is compared against the farthest depth of the pixels it covers.
+ * The pixels are fetched at the coarsest pyramid level whose texels cover
+ * them with at most 2x2 texels. Boxes that cross the near plane are always
+ * visible.
+ *
+ */
+uniform sampler2D u_HizSampler;
+
+layout(std430, binding = BUFFER_BINDING_HIZ_CULL_COUNT)
+buffer HizCullCountBuffer {
+    uint u_HizCullCount;
+};
+
+float HizDepth(vec2 uvMin, vec2 uvMax)
+{
+    ivec2 size = textureSize(u_HizSampler, 0);
+    ivec2 t0 = clamp(ivec2(floor(uvMin * vec2(size))), ivec2(0), size - 1);
+    ivec2 t1 = clamp(ivec2(floor(uvMax * vec2(size))), ivec2(0), size - 1);
+    ivec2 dt = t1 - t0;
+    int level = min(findMSB(uint(max(dt.x, dt.y))) + 1,
+                    textureQueryLevels(u_HizSampler) - 1);
+    ivec2 levelSize = textureSize(u_HizSampler, level);
+    ivec2 b0 = min(t0 >> level, levelSize - 1);
+    ivec2 b1 = min(t1 >> level, levelSize - 1);
+
+    return max(max(texelFetch(u_HizSampler, b0, level).r,
+                   texelFetch(u_HizSampler, ivec2(b1.x, b0.y), level).r),
+               max(texelFetch(u_HizSampler, ivec2(b0.x, b1.y), level).r,
+                   texelFetch(u_HizSampler, b1, level).r));
+}
+
+bool HizOcclusionTest(vec3 bmin, vec3 bmax)
+{
+    vec3 ndcMin = vec3(+1.0), ndcMax = vec3(-1.0);
+
+    for (int i = 0; i < 8; ++i) {
+        vec3 corner = mix(bmin, bmax, bvec3(i & 1, i & 2, i & 4));
+        vec4 clip = u_HizModelViewProjectionMatrix * vec4(corner, 1.0);
+
+        if (clip.w <= 0.0 || clip.z < -clip.w)
+            return true;
+
+        ndcMin = min(ndcMin, clip.xyz / clip.w);
+        ndcMax = max(ndcMax, clip.xyz / clip.w);
+    }
+
+    vec2 uvMin = clamp(ndcMin.xy * 0.5 + 0.5, 0.0, 1.0);
+    vec2 uvMax = clamp(ndcMax.xy * 0.5 + 0.5, 0.0, 1.0);
+
+    return ndcMin.z * 0.5 + 0.5 <= HizDepth(uvMin, uvMax);
+}
+#endif
+
+/*******************************************************************************
+ * VisibilityTest -- Runs the culling tests of a triangle
+ *
+ * Returns false if the triangle is culled; the bounding box of the triangle
+ * is returned for the LoD computations.
+ *
+ */
+bool VisibilityTest(in const vec4[3] patchVertices, out vec3 bmin, out vec3 bmax)
+{
+    TriangleBounds(patchVertices, bmin, bmax);
+
+    // culling test
+    if (!FrustumCullingTest(u_FrustumPlanes, bmin, bmax))
+        return false;
+
+#if FLAG_HORIZON_CULL
+    // occlusion test
+    if (!HorizonOcclusionTest(bmin, bmax))
+        return false;
+#endif
+
+#if FLAG_HIZ_CULL
+    // occlusion test against the last frame
+    if (!HizOcclusionTest(bmin, bmax)) {
+#   if FLAG_SPLIT
+        atomicAdd(u_HizCullCount, 1u);
+#   endif
+        return false;
+    }
+#endif
+
+    return true;
+}
+
 /*******************************************************************************
  * LevelOfDetail -- Computes the level of detail of associated to a triangle
  *
@@ -213,14 +539,21 @@ bool FrustumCullingTest(in const vec4[3] patchVertices)
  */
 vec2 LevelOfDetail(in const vec4[3] patchVertices)
 {
-    // culling test
-    if (!FrustumCullingTest(patchVertices))
+    vec3 bmin, bmax;
+
+    // culling tests
+    if (!VisibilityTest(patchVertices, bmin, bmax))
 #if FLAG_CULL
         return vec2(0.0f, 0.0f);
 #else
         return vec2(0.0f, 1.0f);
 #endif
 
+#if FLAG_DISPLACE && FLAG_DMAP_STREAMING
+    // visible triangles request the tiles they need
+    DmapRequestTiles(patchVertices);
+#endif
+
 #   if FLAG_DISPLACE
     // variance test
     if (!DisplacementVarianceTest(patchVertices))
@@ -231,6 +564,83 @@ vec2 LevelOfDetail(in const vec4[3] patchVertices)
     return vec2(TriangleLevelOfDetail(patchVertices), 1.0f);
 }
 
+#if FLAG_DISPLACE && FLAG_NODE_ERRORS
+/*******************************************************************************
+ * Node Errors -- Geometric error of each LEB node
+ *
+ * The error of a node is the largest vertical distance between the dmap and
+ * the triangles rendered for the node, which bounds the errors of its
+ * descendants. The errors are precomputed down to the depth where nodes
+ * cover about one texel (see lebt_CreatePatchErrors in LebTerrain.h), and
+ * packed by pairs of 16-bit values in a heap indexed by node ID; deeper
+ * nodes halve the error of their ancestor at each level.
+ *
+ */
+layout(std430, binding = BUFFER_BINDING_NODE_ERRORS)
+readonly buffer NodeErrorBuffer {
+    uint u_NodeErrors[];
+};
+
+uniform float u_ErrorFactor;
+
+float NodeError(in const cbt_Node node)
+{
+    int excessDepth = max(int(node.depth) - NODE_ERROR_DEPTH, 0);
+    uint nodeID = uint(node.id) >> excessDepth;
+    uint error = (u_NodeErrors[nodeID >> 1] >> ((nodeID & 1u) << 4)) & 0xFFFFu;
+
+    return ldexp(float(error) / 65535.0, -excessDepth);
+}
+
+/*
+    The error of a node projects to at most
+        PixelError = Error / Distance * ImagePlanePixelResolution / ImagePlaneViewSize
+    pixels, where Distance is the distance from the camera to the bounding box
+    of the triangle (Distance drops out in orthographic mode). So we
+    precompute:
+    u_ErrorFactor = ImagePlanePixelResolution / (ImagePlaneViewSize * TargetPixelError)
+    and the LoD is above one when the pixel error exceeds its target.
+*/
+float TriangleLevelOfDetail_Error(vec3 bmin, vec3 bmax, float nodeError)
+{
+    float errorLength = u_DmapFactor * nodeError * length(u_ModelViewMatrix[2].xyz);
+    float pixelError = errorLength * u_ErrorFactor;
+
+#if !defined(PROJECTION_ORTHOGRAPHIC)
+    vec3 center = (u_ModelViewMatrix * vec4(0.5 * (bmin + bmax), 1.0)).xyz;
+    vec3 extent = 0.5 * (bmax - bmin);
+    vec3 viewExtent = abs(u_ModelViewMatrix[0].xyz) * extent.x
+                    + abs(u_ModelViewMatrix[1].xyz) * extent.y
+                    + abs(u_ModelViewMatrix[2].xyz) * extent.z;
+    float distance = length(max(abs(center) - viewExtent, vec3(0.0)));
+
+    pixelError/= max(distance, 1e-6);
+#endif
+
+    return 1.0 + log2(max(pixelError, 1e-9));
+}
+
+vec2 LevelOfDetail(in const cbt_Node node, in const vec4[3] patchVertices)
+{
+    vec3 bmin, bmax;
+
+    // culling tests
+    if (!VisibilityTest(patchVertices, bmin, bmax))
+#if FLAG_CULL
+        return vec2(0.0f, 0.0f);
+#else
+        return vec2(0.0f, 1.0f);
+#endif
+
+    // compute node LOD
+    return vec2(TriangleLevelOfDetail_Error(bmin, bmax, NodeError(node)), 1.0f);
+}
+#else
+vec2 LevelOfDetail(in const cbt_Node node, in const vec4[3] patchVertices)
+{
+    return LevelOfDetail(patchVertices);
+}
+#endif
 
 /*******************************************************************************
  * BarycentricInterpolation -- Computes a barycentric interpolation
@@ -263,7 +673,9 @@ VertexAttribute TessellateTriangle(
     vec2 texCoord = BarycentricInterpolation(texCoords, tessCoord);
     vec4 position = vec4(texCoord, 0, 1);
 
-#if FLAG_DISPLACE
+#if FLAG_DISPLACE && FLAG_DMAP_STREAMING
+    position.z = u_DmapFactor * DmapSample(texCoord, 0).r;
+#elif FLAG_DISPLACE
     position.z = u_DmapFactor * textureLod(u_DmapSampler, texCoord, 0.0).r;
 #endif
 
@@ -290,7 +702,21 @@ vec4 ShadeFragment(vec2 texCoord, vec3 worldPos)
     float blendFactor = exp2(-nearestDistance / wireScale);
 #endif
 
-#if FLAG_DISPLACE
+#if FLAG_DISPLACE && FLAG_DMAP_STREAMING
+    // the slope map isn't streamed, so the slope is computed from the dmap
+    float texelSize = 1.0f / float(u_DmapLevels[0].x);
+    float footprint = length(fwidth(texCoord)) / texelSize;
+    int level = clamp(int(log2(max(footprint, 1.0))), 0, DMAP_LEVEL_COUNT - 1);
+    float filterSize = texelSize * exp2(float(level));
+    float sx0 = DmapSample(texCoord - vec2(filterSize, 0.0), level).r;
+    float sx1 = DmapSample(texCoord + vec2(filterSize, 0.0), level).r;
+    float sy0 = DmapSample(texCoord - vec2(0.0, filterSize), level).r;
+    float sy1 = DmapSample(texCoord + vec2(0.0, filterSize), level).r;
+    float sx = sx1 - sx0;
+    float sy = sy1 - sy0;
+
+    vec3 n = normalize(vec3(u_DmapFactor * 0.03 / filterSize * 0.5f * vec2(-sx, -sy), 1));
+#elif FLAG_DISPLACE
 #if 1
     // slope
     vec2 smap = texture(u_SmapSampler, texCoord).rg * u_DmapFactor * 0.03;
@@ -65,17 +65,19 @@ GenerateVertex(
     EmitVertex();
 }
 
+uniform int u_CbtID = 0;
+
 void main()
 {
-    const int cbtID = 0;
+    const int cbtID = u_CbtID;
 
     // get threadID (each triangle is associated to a thread)
     // and extract triangle vertices
     cbt_Node node = cbt_DecodeNode(cbtID, gl_PrimitiveIDIn);
-    vec4 triangleVertices[3] = DecodeTriangleVertices(node);
+    vec4 triangleVertices[3] = DecodeTriangleVertices(cbtID, node);
 
     // compute target LoD
-    vec2 targetLod = LevelOfDetail(triangleVertices);
+    vec2 targetLod = LevelOfDetail(node, triangleVertices);
 
     // splitting pass
 #if FLAG_SPLIT
@@ -88,8 +90,8 @@ void main()
 #if FLAG_MERGE
     if (true) {
         leb_DiamondParent diamond = leb_DecodeDiamondParent_Square(node);
-        bool shouldMergeBase = LevelOfDetail(DecodeTriangleVertices(diamond.base)).x < 1.0;
-        bool shouldMergeTop = LevelOfDetail(DecodeTriangleVertices(diamond.top)).x < 1.0;
+        bool shouldMergeBase = LevelOfDetail(diamond.base, DecodeTriangleVertices(cbtID, diamond.base)).x < 1.0;
+        bool shouldMergeTop = LevelOfDetail(diamond.top, DecodeTriangleVertices(cbtID, diamond.top)).x < 1.0;
 
         if (shouldMergeBase && shouldMergeTop)
             leb_MergeNode_Square(cbtID, node, diamond);
@@ -29,13 +29,15 @@ out Patch {
     vec4 vertices[3];
 } o_Patch[];
 
+uniform int u_CbtID = 0;
+
 void main()
 {
     // get threadID and decode triangle vertices
-    const int cbtID = 0;
+    const int cbtID = u_CbtID;
     uint threadID = uint(gl_PrimitiveID);
     cbt_Node node = cbt_DecodeNode(cbtID, threadID);
-    vec4 v[3] = DecodeTriangleVertices(node);
+    vec4 v[3] = DecodeTriangleVertices(cbtID, node);
 
     // perform frustum culling
     bool isVisible = FrustumCullingTest(v);
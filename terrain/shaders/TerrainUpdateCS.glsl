@@ -9,19 +9,23 @@ by Jonathan Dupuy
 #ifdef COMPUTE_SHADER
 layout(local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
 
+// range of nodes to update (see the budgeted update in terrain.cpp)
+uniform uint u_NodeOffset = 0u;
+uniform uint u_NodeBudget = 0xFFFFFFFFu;
+
 void main(void)
 {
-    // get threadID
-    const int cbtID = 0;
-    uint threadID = gl_GlobalInvocationID.x;
+    // get threadID (each row of workgroups updates a CBT)
+    const int cbtID = int(gl_WorkGroupID.y);
+    uint threadID = u_NodeOffset + gl_GlobalInvocationID.x;
 
-    if (threadID < cbt_NodeCount(cbtID)) {
+    if (gl_GlobalInvocationID.x < u_NodeBudget && threadID < cbt_NodeCount(cbtID)) {
         // and extract triangle vertices
         cbt_Node node = cbt_DecodeNode(cbtID, threadID);
-        vec4 triangleVertices[3] = DecodeTriangleVertices(node);
+        vec4 triangleVertices[3] = DecodeTriangleVertices(cbtID, node);
 
         // compute target LoD
-        vec2 targetLod = LevelOfDetail(triangleVertices);
+        vec2 targetLod = LevelOfDetail(node, triangleVertices);
 
         // splitting update
 #if FLAG_SPLIT
@@ -34,8 +38,8 @@ void main(void)
 #if FLAG_MERGE
         if (true) {
             leb_DiamondParent diamond = leb_DecodeDiamondParent_Square(node);
-            bool shouldMergeBase = LevelOfDetail(DecodeTriangleVertices(diamond.base)).x < 1.0;
-            bool shouldMergeTop = LevelOfDetail(DecodeTriangleVertices(diamond.top)).x < 1.0;
+            bool shouldMergeBase = LevelOfDetail(diamond.base, DecodeTriangleVertices(cbtID, diamond.base)).x < 1.0;
+            bool shouldMergeTop = LevelOfDetail(diamond.top, DecodeTriangleVertices(cbtID, diamond.top)).x < 1.0;
 
             if (shouldMergeBase && shouldMergeTop) {
                 leb_MergeNode_Square(cbtID, node, diamond);
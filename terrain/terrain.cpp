@@ -14,7 +14,14 @@
 #include <vector>
 #include <map>
 #include <algorithm>
+#include <functional>
 #include <cmath>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -31,9 +38,25 @@
 #define CBT_IMPLEMENTATION
 #include "cbt.h"
 
+#define CBTR_IMPLEMENTATION
+#include "CbtReduction.h"
+
 #define LEB_IMPLEMENTATION
 #include "leb.h"
 
+#define CBTS_IMPLEMENTATION
+#include "CbtSnapshot.h"
+#define CBTL_IMPLEMENTATION
+#define LEBT_IMPLEMENTATION
+#include "LebTerrain.h"
+#define DMT_IMPLEMENTATION
+#include "DmapTiles.h"
+#define SMAP_IMPLEMENTATION
+#define TBK_IMPLEMENTATION
+#include "TerrainBake.h"
+#define GLRB_IMPLEMENTATION
+#include "GlReadback.h"
+
 #define LOG(fmt, ...)  fprintf(stdout, fmt, ##__VA_ARGS__); fflush(stdout);
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -50,6 +73,23 @@
 
 #define PATH_TO_ASSET_DIRECTORY PATH_TO_SRC_DIRECTORY "./assets/"
 
+// max tiles requested by a LoD pass, and loaded ahead of the uploads
+#define DMAP_TILE_REQUEST_CAPACITY 16384
+#define DMAP_LOADED_TILE_CAPACITY  64
+
+// max bytes of dmap and slope map texels uploaded per frame while loading
+#define DMAP_LEVEL_UPLOAD_BUDGET (16 << 20)
+
+// levels of the CBT sum reduction computed per dispatch (see CbtSumReduction.glsl)
+#define CBT_SUM_REDUCTION_LEVEL_COUNT 8
+
+// frames of GPU statistics in flight before new readbacks are skipped
+#define READBACK_SLOT_COUNT 4
+
+// default frames recorded (resp. run beforehand) per pipeline in benchmark mode
+#define BENCHMARK_DEFAULT_FRAME_COUNT  1024
+#define BENCHMARK_DEFAULT_WARMUP_COUNT 64
+
 ////////////////////////////////////////////////////////////////////////////////
 // Global Variables
 //
@@ -123,10 +163,13 @@ void updateCameraMatrix()
 // Terrain Manager
 enum { METHOD_CS, METHOD_TS, METHOD_GS, METHOD_MS };
 enum { SHADING_DIFFUSE, SHADING_NORMALS, SHADING_COLOR};
+enum { BUDGET_NODES, BUDGET_MICROSECONDS };
+enum { LOD_METRIC_EDGE_LENGTH, LOD_METRIC_ERROR };
 struct TerrainManager {
-    struct { bool displace, cull, freeze, wire, topView; } flags;
+    struct { bool displace, cull, horizon, hiz, freeze, wire, topView, leafCache, incremental; } flags;
     struct {
         std::string pathToFile;
+        std::string pathToBakedFile; // see terrain_bake, used if up to date
         float width, height, zMin, zMax;
         float scale;
     } dmap;
@@ -135,12 +178,65 @@ struct TerrainManager {
     int gpuSubd;
     float primitivePixelLengthTarget;
     float minLodStdev;
+    int lodMetric;              // LOD_METRIC_ERROR requires a dmap that is not streamed
+    float pixelErrorTarget;     // max screen-space error of a node (in pixels)
     int maxDepth;
     uint32_t nodeCount;
     float size;
+    struct {
+        bool enabled;           // skips the update once the view is static
+        int fullSweepPeriod;    // frames between two full sweeps
+        int pendingFrameCount;  // update frames left before going idle
+        int frameCount;         // frames since the last full sweep
+        float viewKey[24];      // view and LoD parameters of the last update
+    } staticSkip;
+    struct {
+        bool enabled;           // caps the nodes visited by each update
+        int mode;               // BUDGET_NODES or BUDGET_MICROSECONDS
+        int nodeCount;          // max nodes per update (BUDGET_NODES)
+        float microseconds;     // max GPU time per update (BUDGET_MICROSECONDS)
+        uint32_t nodeOffset;    // first node of the next slice
+        uint32_t sliceSize;     // nodes dispatched by the last slice
+        uint32_t sweepCount;    // sweeps completed since the last reset
+        float nsPerNode;        // smoothed GPU cost of a node
+    } budget;
+    struct {
+        lebt_Dmap *dmap;        // CPU copy of the dmap (loaded on demand)
+        int passCount;          // passes run by the last CPU update
+        int64_t nodeCount;      // nodes produced by the last CPU update
+        bool isConverged;
+        bool matchesGpu;        // true if the CPU and GPU heaps are equal
+        int64_t cullCounts[LEBT_CULL_COUNT]; // leaves per culling test outcome
+    } reference;
+    struct {
+        bool enabled;           // streams the dmap from a tile store
+        std::string pathToFile; // tile store, baked from the dmap if missing
+        int tileSize;           // texels per tile side (when baking the store)
+        int pageCount;          // pages of the GPU page pool
+        int uploadBudget;       // max tiles uploaded per frame
+        uint32_t frame;         // stamp of the requests of the next LoD pass
+        uint32_t requestCount;  // tiles requested by the last LoD pass
+        uint32_t pendingCount;  // tiles waiting to be loaded
+        uint32_t residentCount; // tiles held by the page pool
+    } streaming;
+    struct {
+        dja::mat4 modelViewProjection;  // of the frame the pyramid comes from
+        uint32_t cullCount;             // leaves rejected by the last split
+    } hiz;
+    struct {
+        lebt_NodeErrors *nodes;     // errors of the dmap (see LoadNodeErrors)
+        lebt_NodeErrors *patches;   // errors of the tessellated nodes
+    } errors;
+    struct {
+        int count;              // tiles per side, each subdivided by its own CBT
+        int64_t heapStride;     // bytes between two heaps of the CBT buffer
+        uint32_t maxNodeCount;  // nodes of the most subdivided CBT
+    } tiles;
+    bool leafCacheIsStale;      // true once the CBTs were loaded (see lebLeafCachePass)
 } g_terrain = {
-    {true, true, false, false, true},
+    {true, true, true, false, false, false, true, false, false},
     {std::string(PATH_TO_ASSET_DIRECTORY "./kauai.png"),
+     std::string("terrain.tbk"),
      52660.0f, 52660.0f, -14.0f, 1587.0f,
      1.0f},
     METHOD_CS,
@@ -148,9 +244,19 @@ struct TerrainManager {
     3,
     7.0f,
     0.1f,
+    LOD_METRIC_ERROR,
+    1.0f,
     25,
     0,
-    52660.0f
+    52660.0f,
+    {false, 64, 0, 0, {0.0f}},
+    {false, BUDGET_NODES, 1 << 18, 2000.0f, 0, 0, 0, 0.0f},
+    {NULL, 0, 0, false, false, {0}},
+    {false, "terrain.dmts", 128, 512, 16, 1, 0, 0, 0},
+    {dja::mat4(1.0f), 0},
+    {NULL, NULL},
+    {1, 0, 0},
+    true
 };
 
 
@@ -169,6 +275,10 @@ struct AppManager {
     struct {
         int on, frame, capture;
     } recorder;
+    struct {
+        const char *path;
+        bool warmStart;
+    } snapshot;
     int frame, frameLimit;
 } g_app = {
     /*dir*/     {
@@ -181,6 +291,7 @@ struct AppManager {
                    2.2f, 0.4f
                 },
     /*record*/  {false, 0, 0},
+    /*snapshot*/{NULL, false},
     /*frame*/   0, -1
 };
 
@@ -192,6 +303,7 @@ enum {
     CLOCK_BATCH,
     CLOCK_UPDATE,
     CLOCK_RENDER,
+    CLOCK_LEAF_CACHE,
     CLOCK_REDUCTION,
     CLOCK_REDUCTION00,
     CLOCK_REDUCTION01,
@@ -244,9 +356,20 @@ enum {
     BUFFER_SPHERE_VERTICES,
     BUFFER_SPHERE_INDEXES,
     BUFFER_CBT_NODE_COUNT,
+    BUFFER_DMAP_PAGE_TABLE,     // tile streaming only
+    BUFFER_DMAP_TILE_REQUESTS,  // tile streaming only
+    BUFFER_DMAP_TILE_STAMPS,    // tile streaming only
+    BUFFER_HIZ_CULL_COUNT,
+    BUFFER_NODE_ERRORS,         // geometric error LoD only
+    BUFFER_LEAF_CACHE,          // all pipelines but the mesh shader one
+    BUFFER_CBT_DIRTY_BLOCK_FLAGS,   // all pipelines but the mesh shader one
+    BUFFER_CBT_DIRTY_BLOCK_LIST,    // all pipelines but the mesh shader one
 
     BUFFER_COUNT
 };
+// the heaps of BUFFER_LEB are bound to consecutive binding points that
+// follow those of the other buffers, one per CBT (see lebBindBuffers)
+enum { BUFFER_BINDING_LEB_HEAPS = BUFFER_COUNT };
 enum {
     TEXTURE_CBUF,
     TEXTURE_ZBUF,
@@ -257,6 +380,9 @@ enum {
     TEXTURE_ATMOSPHERE_TRANSMITTANCE,
     TEXTURE_ROCK_DMAP,
     TEXTURE_ROCK_SMAP,
+    TEXTURE_DMAP_PAGES,         // tile streaming only
+    TEXTURE_DMAP_BOUNDS,        // min/max pyramid of the dmap
+    TEXTURE_HIZ,                // max-depth pyramid of the last frame
 
     TEXTURE_COUNT
 };
@@ -271,13 +397,19 @@ enum {
     PROGRAM_BATCH,
     PROGRAM_SKY,
     PROGRAM_CBT_NODE_COUNT,
+    PROGRAM_HIZ,
+    PROGRAM_LEAF_CACHE,
+    PROGRAM_CBT_DIRTY_DISPATCH,
+    PROGRAM_CBT_DIRTY_REDUCTION,
 
     PROGRAM_COUNT
 };
 enum {
-    QUERY_NODE_COUNT,
+    READBACK_NODE_COUNT,
+    READBACK_HIZ_CULL_COUNT,
+    READBACK_DMAP_TILE_REQUESTS,
 
-    QUERY_COUNT
+    READBACK_COUNT
 };
 enum {
     UNIFORM_VIEWER_FRAMEBUFFER_SAMPLER,
@@ -295,6 +427,11 @@ enum {
     UNIFORM_TERRAIN_INSCATTER_SAMPLER,
     UNIFORM_TERRAIN_IRRADIANCE_SAMPLER,
     UNIFORM_TERRAIN_TRANSMITTANCE_SAMPLER,
+    UNIFORM_TERRAIN_DMAP_PAGE_SAMPLER,
+    UNIFORM_TERRAIN_DMAP_FRAME,
+    UNIFORM_TERRAIN_DMAP_BOUNDS_SAMPLER,
+    UNIFORM_TERRAIN_HIZ_SAMPLER,
+    UNIFORM_TERRAIN_ERROR_FACTOR,
 
     UNIFORM_SPLIT_DMAP_SAMPLER,
     UNIFORM_SPLIT_SMAP_SAMPLER,
@@ -308,6 +445,11 @@ enum {
     UNIFORM_SPLIT_INSCATTER_SAMPLER,
     UNIFORM_SPLIT_IRRADIANCE_SAMPLER,
     UNIFORM_SPLIT_TRANSMITTANCE_SAMPLER,
+    UNIFORM_SPLIT_DMAP_PAGE_SAMPLER,
+    UNIFORM_SPLIT_DMAP_FRAME,
+    UNIFORM_SPLIT_DMAP_BOUNDS_SAMPLER,
+    UNIFORM_SPLIT_HIZ_SAMPLER,
+    UNIFORM_SPLIT_ERROR_FACTOR,
 
     UNIFORM_MERGE_DMAP_SAMPLER,
     UNIFORM_MERGE_SMAP_SAMPLER,
@@ -321,6 +463,11 @@ enum {
     UNIFORM_MERGE_INSCATTER_SAMPLER,
     UNIFORM_MERGE_IRRADIANCE_SAMPLER,
     UNIFORM_MERGE_TRANSMITTANCE_SAMPLER,
+    UNIFORM_MERGE_DMAP_PAGE_SAMPLER,
+    UNIFORM_MERGE_DMAP_FRAME,
+    UNIFORM_MERGE_DMAP_BOUNDS_SAMPLER,
+    UNIFORM_MERGE_HIZ_SAMPLER,
+    UNIFORM_MERGE_ERROR_FACTOR,
 
     UNIFORM_RENDER_DMAP_SAMPLER,
     UNIFORM_RENDER_SMAP_SAMPLER,
@@ -334,6 +481,11 @@ enum {
     UNIFORM_RENDER_INSCATTER_SAMPLER,
     UNIFORM_RENDER_IRRADIANCE_SAMPLER,
     UNIFORM_RENDER_TRANSMITTANCE_SAMPLER,
+    UNIFORM_RENDER_DMAP_PAGE_SAMPLER,
+    UNIFORM_RENDER_DMAP_FRAME,
+    UNIFORM_RENDER_DMAP_BOUNDS_SAMPLER,
+    UNIFORM_RENDER_HIZ_SAMPLER,
+    UNIFORM_RENDER_ERROR_FACTOR,
 
     UNIFORM_TOPVIEW_DMAP_SAMPLER,
     UNIFORM_TOPVIEW_DMAP_FACTOR,
@@ -345,6 +497,10 @@ enum {
     UNIFORM_SKY_IRRADIANCE_SAMPLER,
     UNIFORM_SKY_TRANSMITTANCE_SAMPLER,
 
+    UNIFORM_HIZ_DEPTH_SAMPLER,
+    UNIFORM_HIZ_SAMPLER,
+    UNIFORM_HIZ_LEVEL,
+
     UNIFORM_COUNT
 };
 struct OpenGLManager {
@@ -353,7 +509,7 @@ struct OpenGLManager {
     GLuint textures[TEXTURE_COUNT];
     GLuint vertexArrays[VERTEXARRAY_COUNT];
     GLuint buffers[BUFFER_COUNT];
-    GLuint queries[QUERY_COUNT];
+    glrb_Ring readbacks[READBACK_COUNT];
     GLint uniforms[UNIFORM_COUNT];
     djg_buffer *streams[STREAM_COUNT];
     djg_clock *clocks[CLOCK_COUNT];
@@ -363,11 +519,161 @@ struct OpenGLManager {
     {0},
     {0},
     {0},
-    {0},
+    {},
     {NULL},
     {NULL}
 };
 
+// -----------------------------------------------------------------------------
+// Benchmark Manager (see the benchmark mode)
+struct CameraKey {
+    dja::vec3 pos;
+    float upAngle, sideAngle;
+};
+struct BenchmarkFrame {
+    int method, frame;
+    uint32_t nodeCount;
+    double frameTime;               // CPU time between two frames (in seconds)
+    double gpuTimes[CLOCK_COUNT];   // GPU time of each clock (in seconds)
+};
+struct BenchmarkManager {
+    bool enabled;
+    std::string pathToOutput;       // prefix of the CSV files
+    std::vector<CameraKey> keys;    // camera path, see LoadCameraPath
+    std::vector<int> methods;       // pipelines left to run, current first
+    int warmupCount;                // frames run before recording a pipeline
+    int frame;                      // frame of the current pipeline
+    std::chrono::steady_clock::time_point frameStart;
+    std::vector<BenchmarkFrame> frames;
+} g_benchmark = {
+    false,
+    "benchmark",
+    std::vector<CameraKey>(),
+    std::vector<int>(),
+    BENCHMARK_DEFAULT_WARMUP_COUNT,
+    0,
+    std::chrono::steady_clock::time_point(),
+    std::vector<BenchmarkFrame>()
+};
+const char *g_methodNames[] = {"cs", "ts", "gs", "ms"};
+
+// -----------------------------------------------------------------------------
+// Tile Loader Manager (see the streamed displacement texture)
+enum { TILE_IDLE, TILE_QUEUED, TILE_RESIDENT, TILE_FAILED };
+struct TileLoaderManager {
+    dmt_Store store;
+    dmt_Cache cache;
+    std::vector<uint8_t> tileStates;    // TILE_* state of each tile
+    std::thread thread;
+    std::mutex mutex;                   // guards the members below
+    std::condition_variable condition;
+    std::deque<int64_t> queue;          // tiles to load, coarsest first
+    std::deque<std::pair<int64_t, std::vector<uint16_t> > > loaded;
+    bool quit;
+} g_tileLoader;
+
+// -----------------------------------------------------------------------------
+// Dmap Loader Manager (see the asynchronous displacement texture)
+enum { DMAP_LOADER_IDLE, DMAP_LOADER_BUSY, DMAP_LOADER_READY, DMAP_LOADER_UPLOADING };
+struct DmapLoaderManager {
+    std::thread thread;
+    std::atomic<int> state;     // DMAP_LOADER_* state of the last load
+    tbk_Asset asset;            // mip chains of the dmap and slope map
+    lebt_DmapBounds *bounds;    // height bounds of the dmap
+    lebt_NodeErrors *errors;    // errors of the dmap (see LoadNodeErrors)
+    int levelID;                // level being uploaded
+    int rowID;                  // first row of the level left to upload
+    GLuint pbo;                 // staging buffer of the uploads
+} g_dmapLoader;
+
+bool dmapIsStreamed()
+{
+    return g_terrain.streaming.enabled && g_tileLoader.store.stream != NULL;
+}
+
+// the mesh shader pipeline still uses the legacy LEB API, which only
+// knows of a single tree
+int lebTileCount()
+{
+    return g_terrain.method == METHOD_MS ? 1 : g_terrain.tiles.count;
+}
+
+int lebTreeCount()
+{
+    return lebTileCount() * lebTileCount();
+}
+
+// the streamed dmap has no error table, so it keeps the variance test;
+// the error table is indexed by the nodes of a single tree
+bool lodUsesNodeErrors()
+{
+    return g_terrain.lodMetric == LOD_METRIC_ERROR
+        && g_terrain.flags.displace
+        && g_terrain.errors.patches != NULL
+        && !dmapIsStreamed()
+        && lebTreeCount() == 1;
+}
+
+// the leaves of the CBTs are cached once per frame for the passes that
+// enumerate them (see CbtLeafCache.glsl); the mesh shader pipeline does
+// not enumerate them through cbt.glsl
+#define LEAF_CACHE_MAX_CAPACITY (1 << 22)
+#define LEAF_CACHE_MAX_GROUP_COUNT 1024
+
+bool lebUsesLeafCache()
+{
+    return g_terrain.flags.leafCache && g_terrain.method != METHOD_MS;
+}
+
+// leaves cached per CBT, the CBTs sharing the capacity of the cache
+int lebLeafCacheCapacity()
+{
+    return (int)std::min(int64_t(1) << g_terrain.maxDepth,
+                         (int64_t)(LEAF_CACHE_MAX_CAPACITY / lebTreeCount()));
+}
+
+// workgroups per CBT of the pass that writes the cache
+int lebLeafCacheGroupCount()
+{
+    return std::min(std::max(lebLeafCacheCapacity() >> 8, 1),
+                    LEAF_CACHE_MAX_GROUP_COUNT);
+}
+
+void PushLeafCacheShader(djg_program *djp)
+{
+    djgp_push_string(djp, "#define CBT_LEAF_CACHE_BUFFER_BINDING %i\n", BUFFER_LEAF_CACHE);
+    djgp_push_string(djp, "#define CBT_LEAF_CACHE_CAPACITY %i\n", lebLeafCacheCapacity());
+    djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./common/shaders/CbtLeafCache.glsl");
+}
+
+// the split and merge passes flag the blocks of the CBTs they modify (see
+// CbtDirtyBlocks.glsl), so that the reduction may skip the others; the
+// mesh shader pipeline splits and merges through the legacy LEB API,
+// which knows of a single tree and cannot be redirected
+bool lebUsesDirtyBlocks()
+{
+    return g_terrain.method != METHOD_MS;
+}
+
+bool lebUsesIncrementalReduction()
+{
+    return g_terrain.flags.incremental && lebUsesDirtyBlocks();
+}
+
+// depth of the roots of the blocks, the same for all the CBTs
+int lebDirtyBlockDepth()
+{
+    return std::max(g_terrain.maxDepth - CBTR_BLOCK_LEAF_DEPTH, 0);
+}
+
+void PushDirtyBlockShader(djg_program *djp)
+{
+    djgp_push_string(djp, "#define CBTR_BLOCK_LEAF_DEPTH %i\n", CBTR_BLOCK_LEAF_DEPTH);
+    djgp_push_string(djp, "#define CBT_DIRTY_BLOCK_FLAG_BUFFER_BINDING %i\n", BUFFER_CBT_DIRTY_BLOCK_FLAGS);
+    djgp_push_string(djp, "#define CBT_DIRTY_BLOCK_LIST_BUFFER_BINDING %i\n", BUFFER_CBT_DIRTY_BLOCK_LIST);
+    djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./common/shaders/CbtDirtyBlocks.glsl");
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 // Utility functions
 //
@@ -493,6 +799,15 @@ float computeLodFactor()
     return 1.0f;
 }
 
+// pixels per view-space unit at unit distance, over the target pixel error
+// (see TriangleLevelOfDetail_Error in TerrainRenderCommon.glsl)
+float computeErrorFactor()
+{
+    float planeSize = 2.0f * tan(radians(g_camera.fovy / 2.0f));
+
+    return g_framebuffer.h / (planeSize * g_terrain.pixelErrorTarget);
+}
+
 void ConfigureTerrainProgram(GLuint glp, GLuint offset)
 {
     float lodFactor = computeLodFactor();
@@ -533,6 +848,21 @@ void ConfigureTerrainProgram(GLuint glp, GLuint offset)
     glProgramUniform1i(glp,
         g_gl.uniforms[UNIFORM_TERRAIN_TRANSMITTANCE_SAMPLER + offset],
         TEXTURE_ATMOSPHERE_TRANSMITTANCE);
+    glProgramUniform1i(glp,
+        g_gl.uniforms[UNIFORM_TERRAIN_DMAP_PAGE_SAMPLER + offset],
+        TEXTURE_DMAP_PAGES);
+    glProgramUniform1ui(glp,
+        g_gl.uniforms[UNIFORM_TERRAIN_DMAP_FRAME + offset],
+        g_terrain.streaming.frame);
+    glProgramUniform1i(glp,
+        g_gl.uniforms[UNIFORM_TERRAIN_DMAP_BOUNDS_SAMPLER + offset],
+        TEXTURE_DMAP_BOUNDS);
+    glProgramUniform1i(glp,
+        g_gl.uniforms[UNIFORM_TERRAIN_HIZ_SAMPLER + offset],
+        TEXTURE_HIZ);
+    glProgramUniform1f(glp,
+        g_gl.uniforms[UNIFORM_TERRAIN_ERROR_FACTOR + offset],
+        computeErrorFactor());
 }
 
 void ConfigureTerrainPrograms()
@@ -650,6 +980,8 @@ bool LoadTerrainProgram(GLuint *glp, const char *flag, GLuint uniformOffset)
         djgp_push_string(djp, "#extension GL_NV_shader_thread_shuffle : require\n");
         djgp_push_string(djp, "#extension GL_NV_gpu_shader5 : require\n");
     }
+    if (g_terrain.method == METHOD_CS && lebTreeCount() > 1)
+        djgp_push_string(djp, "#ifdef VERTEX_SHADER\n#extension GL_ARB_shader_draw_parameters : require\n#endif\n");
     switch (g_camera.projection) {
     case PROJECTION_RECTILINEAR:
         djgp_push_string(djp, "#define PROJECTION_RECTILINEAR\n");
@@ -668,6 +1000,7 @@ bool LoadTerrainProgram(GLuint *glp, const char *flag, GLuint uniformOffset)
     djgp_push_string(djp, "#define BUFFER_BINDING_MESHLET_INDEXES %i\n", BUFFER_MESHLET_INDEXES);
     djgp_push_string(djp, "#define TERRAIN_PATCH_SUBD_LEVEL %i\n", g_terrain.gpuSubd);
     djgp_push_string(djp, "#define TERRAIN_PATCH_TESS_FACTOR %i\n", 1 << g_terrain.gpuSubd);
+    djgp_push_string(djp, "#define TERRAIN_TILE_COUNT %i\n", lebTileCount());
     if (g_terrain.shading == SHADING_DIFFUSE)
         djgp_push_string(djp, "#define SHADING_DIFFUSE 1\n");
     else if (g_terrain.shading == SHADING_NORMALS)
@@ -680,10 +1013,43 @@ bool LoadTerrainProgram(GLuint *glp, const char *flag, GLuint uniformOffset)
         djgp_push_string(djp, "#define FLAG_CULL 1\n");
     if (g_terrain.flags.wire)
         djgp_push_string(djp, "#define FLAG_WIRE 1\n");
+    if (g_terrain.flags.hiz && g_camera.projection != PROJECTION_FISHEYE) {
+        djgp_push_string(djp, "#define FLAG_HIZ_CULL 1\n");
+        djgp_push_string(djp, "#define BUFFER_BINDING_HIZ_CULL_COUNT %i\n", BUFFER_HIZ_CULL_COUNT);
+    }
+    if (dmapIsStreamed()) {
+        djgp_push_string(djp, "#define FLAG_DMAP_STREAMING 1\n");
+        djgp_push_string(djp, "#define DMAP_TILE_SIZE %iu\n", g_tileLoader.store.tileSize);
+        djgp_push_string(djp, "#define DMAP_TILE_BORDER %iu\n", DMT_TILE_BORDER);
+        djgp_push_string(djp, "#define DMAP_PAGE_SIZE %i\n", g_tileLoader.store.pageSize);
+        djgp_push_string(djp, "#define DMAP_PAGE_NULL %uu\n", DMT_PAGE_NULL);
+        djgp_push_string(djp, "#define DMAP_LEVEL_COUNT %i\n", g_tileLoader.store.levelCount);
+        djgp_push_string(djp, "#define DMAP_MAX_LEVEL_COUNT %i\n", DMT_MAX_LEVEL_COUNT);
+        djgp_push_string(djp, "#define DMAP_TILE_REQUEST_CAPACITY %i\n", DMAP_TILE_REQUEST_CAPACITY);
+        djgp_push_string(djp, "#define BUFFER_BINDING_DMAP_PAGE_TABLE %i\n", BUFFER_DMAP_PAGE_TABLE);
+        djgp_push_string(djp, "#define BUFFER_BINDING_DMAP_TILE_REQUESTS %i\n", BUFFER_DMAP_TILE_REQUESTS);
+        djgp_push_string(djp, "#define BUFFER_BINDING_DMAP_TILE_STAMPS %i\n", BUFFER_DMAP_TILE_STAMPS);
+    } else if (g_terrain.flags.displace) {
+        djgp_push_string(djp, "#define FLAG_DMAP_BOUNDS 1\n");
+        if (g_terrain.flags.horizon && g_camera.projection != PROJECTION_ORTHOGRAPHIC) {
+            djgp_push_string(djp, "#define FLAG_HORIZON_CULL 1\n");
+            djgp_push_string(djp, "#define HORIZON_SAMPLE_COUNT %i\n", LEBT_HORIZON_SAMPLE_COUNT);
+        }
+    }
+    if (lodUsesNodeErrors()) {
+        djgp_push_string(djp, "#define FLAG_NODE_ERRORS 1\n");
+        djgp_push_string(djp, "#define NODE_ERROR_DEPTH %i\n", g_terrain.errors.patches->depth);
+        djgp_push_string(djp, "#define BUFFER_BINDING_NODE_ERRORS %i\n", BUFFER_NODE_ERRORS);
+    }
     djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./terrain/shaders/FrustumCulling.glsl");
-    djgp_push_string(djp, "#define CBT_HEAP_BUFFER_BINDING %i\n", BUFFER_LEB);
+    djgp_push_string(djp, "#define CBT_HEAP_BUFFER_BINDING %i\n", BUFFER_BINDING_LEB_HEAPS);
+    djgp_push_string(djp, "#define CBT_HEAP_BUFFER_COUNT %i\n", lebTreeCount());
     djgp_push_string(djp, "#define CBT_READ_ONLY\n");
     djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./submodules/libcbt/glsl/cbt.glsl");
+    if (lebUsesLeafCache())
+        PushLeafCacheShader(djp);
+    if (lebUsesDirtyBlocks() && strcmp("/* thisIsAHackForComputePass */\n", flag) != 0)
+        PushDirtyBlockShader(djp);
     djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./submodules/libleb/glsl/leb.glsl");
     djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./terrain/shaders/BrunetonAtmosphere.glsl");
     djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./terrain/shaders/TerrainRenderCommon.glsl");
@@ -752,6 +1118,16 @@ bool LoadTerrainProgram(GLuint *glp, const char *flag, GLuint uniformOffset)
         glGetUniformLocation(*glp, "inscatterSampler");
     g_gl.uniforms[UNIFORM_TERRAIN_TRANSMITTANCE_SAMPLER + uniformOffset] =
         glGetUniformLocation(*glp, "transmittanceSampler");
+    g_gl.uniforms[UNIFORM_TERRAIN_DMAP_PAGE_SAMPLER + uniformOffset] =
+        glGetUniformLocation(*glp, "u_DmapPageSampler");
+    g_gl.uniforms[UNIFORM_TERRAIN_DMAP_FRAME + uniformOffset] =
+        glGetUniformLocation(*glp, "u_DmapFrame");
+    g_gl.uniforms[UNIFORM_TERRAIN_DMAP_BOUNDS_SAMPLER + uniformOffset] =
+        glGetUniformLocation(*glp, "u_DmapBoundsSampler");
+    g_gl.uniforms[UNIFORM_TERRAIN_HIZ_SAMPLER + uniformOffset] =
+        glGetUniformLocation(*glp, "u_HizSampler");
+    g_gl.uniforms[UNIFORM_TERRAIN_ERROR_FACTOR + uniformOffset] =
+        glGetUniformLocation(*glp, "u_ErrorFactor");
 
     ConfigureTerrainProgram(*glp, uniformOffset);
 
@@ -780,8 +1156,11 @@ bool LoadTerrainPrograms()
  * Load the Reduction Program
  *
  * This program is responsible for precomputing a reduction for the
- * subdivision tree. This allows to locate the i-th bit in a bitfield of
- * size N in log(N) operations.
+ * subdivision trees. This allows to locate the i-th bit in a bitfield of
+ * size N in log(N) operations. Each dispatch reduces
+ * CBT_SUM_REDUCTION_LEVEL_COUNT levels of all the trees in shared memory
+ * (see CbtSumReduction.glsl); the prepass of libcbt only reduces the first
+ * tree, so it is used when there is a single one.
  */
 bool LoadLebReductionProgram()
 {
@@ -789,9 +1168,11 @@ bool LoadLebReductionProgram()
     GLuint *glp = &g_gl.programs[PROGRAM_LEB_REDUCTION];
 
     LOG("Loading {Reduction-Program}\n");
-    djgp_push_string(djp, "#define CBT_HEAP_BUFFER_BINDING %i\n", BUFFER_LEB);
+    djgp_push_string(djp, "#define CBT_HEAP_BUFFER_BINDING %i\n", BUFFER_BINDING_LEB_HEAPS);
+    djgp_push_string(djp, "#define CBT_HEAP_BUFFER_COUNT %i\n", lebTreeCount());
+    djgp_push_string(djp, "#define CBT_SUM_REDUCTION_LEVEL_COUNT %i\n", CBT_SUM_REDUCTION_LEVEL_COUNT);
     djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./submodules/libcbt/glsl/cbt.glsl");
-    djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./submodules/libcbt/glsl/cbt_SumReduction.glsl");
+    djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./common/shaders/CbtSumReduction.glsl");
     djgp_push_string(djp, "#ifdef COMPUTE_SHADER\n#endif");
 
     if (!djgp_to_gl(djp, 450, false, true, glp)) {
@@ -810,7 +1191,8 @@ bool LoadLebReductionPrepassProgram()
     GLuint *glp = &g_gl.programs[PROGRAM_LEB_REDUCTION_PREPASS];
 
     LOG("Loading {Reduction-Prepass-Program}\n");
-    djgp_push_string(djp, "#define CBT_HEAP_BUFFER_BINDING %i\n", BUFFER_LEB);
+    djgp_push_string(djp, "#define CBT_HEAP_BUFFER_BINDING %i\n", BUFFER_BINDING_LEB_HEAPS);
+    djgp_push_string(djp, "#define CBT_HEAP_BUFFER_COUNT %i\n", lebTreeCount());
     djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./submodules/libcbt/glsl/cbt.glsl");
     djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./submodules/libcbt/glsl/cbt_SumReductionPrepass.glsl");
     djgp_push_string(djp, "#ifdef COMPUTE_SHADER\n#endif");
@@ -824,6 +1206,96 @@ bool LoadLebReductionPrepassProgram()
     return (glGetError() == GL_NO_ERROR);
 }
 
+// -----------------------------------------------------------------------------
+/**
+ * Load the Dirty Block Programs
+ *
+ * The dispatcher turns the blocks flagged by the split and merge passes
+ * into an indirect dispatch and clears their flags. The dirty reduction
+ * reduces these blocks only, one workgroup per block whichever CBT it
+ * belongs to, so that the reduction program may start at the depth of the
+ * roots of the blocks (see lebReductionPass).
+ */
+bool LoadDirtyDispatcherProgram()
+{
+    djg_program *djp = djgp_create();
+    GLuint *glp = &g_gl.programs[PROGRAM_CBT_DIRTY_DISPATCH];
+
+    LOG("Loading {Dirty-Dispatcher-Program}\n");
+    djgp_push_string(djp, "#define CBT_HEAP_BUFFER_BINDING %i\n", BUFFER_BINDING_LEB_HEAPS);
+    djgp_push_string(djp, "#define CBT_HEAP_BUFFER_COUNT %i\n", lebTreeCount());
+    if (lebUsesLeafCache()) {
+        djgp_push_string(djp, "#define CBT_LEAF_CACHE_GROUP_COUNT_X %iu\n", lebLeafCacheGroupCount());
+        djgp_push_string(djp, "#define CBT_LEAF_CACHE_GROUP_COUNT_Y %iu\n", lebTreeCount());
+    }
+    djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./submodules/libcbt/glsl/cbt.glsl");
+    PushDirtyBlockShader(djp);
+    djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./common/shaders/CbtDirtyDispatcher.glsl");
+    djgp_push_string(djp, "#ifdef COMPUTE_SHADER\n#endif");
+    if (!djgp_to_gl(djp, 450, false, true, glp)) {
+        djgp_release(djp);
+
+        return false;
+    }
+    djgp_release(djp);
+
+    return (glGetError() == GL_NO_ERROR);
+}
+
+bool LoadDirtyReductionProgram()
+{
+    djg_program *djp = djgp_create();
+    GLuint *glp = &g_gl.programs[PROGRAM_CBT_DIRTY_REDUCTION];
+
+    LOG("Loading {Dirty-Reduction-Program}\n");
+    djgp_push_string(djp, "#define CBT_HEAP_BUFFER_BINDING %i\n", BUFFER_BINDING_LEB_HEAPS);
+    djgp_push_string(djp, "#define CBT_HEAP_BUFFER_COUNT %i\n", lebTreeCount());
+    djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./submodules/libcbt/glsl/cbt.glsl");
+    PushDirtyBlockShader(djp);
+    djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./common/shaders/CbtDirtyReduction.glsl");
+    djgp_push_string(djp, "#ifdef COMPUTE_SHADER\n#endif");
+    if (!djgp_to_gl(djp, 450, false, true, glp)) {
+        djgp_release(djp);
+
+        return false;
+    }
+    djgp_release(djp);
+
+    return (glGetError() == GL_NO_ERROR);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Load the Leaf Cache Program
+ *
+ * This program writes the leaves of all the CBTs to the leaf cache once
+ * they are reduced, so that the update and render passes read them from
+ * the cache rather than decoding them from the heaps.
+ */
+bool LoadLeafCacheProgram()
+{
+    djg_program *djp = djgp_create();
+    GLuint *glp = &g_gl.programs[PROGRAM_LEAF_CACHE];
+
+    LOG("Loading {Leaf-Cache-Program}\n");
+    djgp_push_string(djp, "#define CBT_HEAP_BUFFER_BINDING %i\n", BUFFER_BINDING_LEB_HEAPS);
+    djgp_push_string(djp, "#define CBT_HEAP_BUFFER_COUNT %i\n", lebTreeCount());
+    djgp_push_string(djp, "#define CBT_READ_ONLY\n");
+    djgp_push_string(djp, "#define CBT_LEAF_CACHE_WRITER\n");
+    djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./submodules/libcbt/glsl/cbt.glsl");
+    PushLeafCacheShader(djp);
+    djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./common/shaders/CbtLeafCacheWriter.glsl");
+    djgp_push_string(djp, "#ifdef COMPUTE_SHADER\n#endif");
+    if (!djgp_to_gl(djp, 450, false, true, glp)) {
+        djgp_release(djp);
+
+        return false;
+    }
+    djgp_release(djp);
+
+    return (glGetError() == GL_NO_ERROR);
+}
+
 // -----------------------------------------------------------------------------
 /**
  * Load the Batch Program
@@ -853,13 +1325,14 @@ bool LoadBatchProgram()
         djgp_push_string(djp, "#define BUFFER_BINDING_DISPATCH_INDIRECT_COMMAND %i\n", BUFFER_TERRAIN_DISPATCH_CS);
         djgp_push_string(djp, "#define MESHLET_INDEX_COUNT %i\n", 3 << (2 * g_terrain.gpuSubd));
     }
-    djgp_push_string(djp, "#define LEB_BUFFER_COUNT 1\n");
-    djgp_push_string(djp, "#define BUFFER_BINDING_LEB %i\n", BUFFER_LEB);
+    djgp_push_string(djp, "#define LEB_BUFFER_COUNT %i\n", lebTreeCount());
+    djgp_push_string(djp, "#define BUFFER_BINDING_LEB %i\n", BUFFER_BINDING_LEB_HEAPS);
     djgp_push_string(djp, "#define BUFFER_BINDING_DRAW_ARRAYS_INDIRECT_COMMAND %i\n", BUFFER_TERRAIN_DRAW);
 #if 0
     djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./terrain/shaders/LongestEdgeBisection.glsl");
 #else
-    djgp_push_string(djp, "#define CBT_HEAP_BUFFER_BINDING %i\n", BUFFER_LEB);
+    djgp_push_string(djp, "#define CBT_HEAP_BUFFER_BINDING %i\n", BUFFER_BINDING_LEB_HEAPS);
+    djgp_push_string(djp, "#define CBT_HEAP_BUFFER_COUNT %i\n", lebTreeCount());
     djgp_push_string(djp, "#define CBT_READ_ONLY\n");
     djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./submodules/libcbt/glsl/cbt.glsl");
 #endif
@@ -890,13 +1363,17 @@ bool LoadTopViewProgram()
         djgp_push_string(djp, "#define FLAG_DISPLACE 1\n");
     djgp_push_string(djp, "#define TERRAIN_PATCH_SUBD_LEVEL %i\n", g_terrain.gpuSubd);
     djgp_push_string(djp, "#define TERRAIN_PATCH_TESS_FACTOR %i\n", 1 << g_terrain.gpuSubd);
+    djgp_push_string(djp, "#define TERRAIN_TILE_COUNT %i\n", lebTileCount());
     djgp_push_string(djp, "#define BUFFER_BINDING_TERRAIN_VARIABLES %i\n", STREAM_TERRAIN_VARIABLES);
-    djgp_push_string(djp, "#define LEB_BUFFER_COUNT 1\n");
-    djgp_push_string(djp, "#define BUFFER_BINDING_LEB %i\n", BUFFER_LEB);
+    djgp_push_string(djp, "#define LEB_BUFFER_COUNT %i\n", lebTreeCount());
+    djgp_push_string(djp, "#define BUFFER_BINDING_LEB %i\n", BUFFER_BINDING_LEB_HEAPS);
     djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./terrain/shaders/FrustumCulling.glsl");
-    djgp_push_string(djp, "#define CBT_HEAP_BUFFER_BINDING %i\n", BUFFER_LEB);
+    djgp_push_string(djp, "#define CBT_HEAP_BUFFER_BINDING %i\n", BUFFER_BINDING_LEB_HEAPS);
+    djgp_push_string(djp, "#define CBT_HEAP_BUFFER_COUNT %i\n", lebTreeCount());
     djgp_push_string(djp, "#define CBT_READ_ONLY\n");
     djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./submodules/libcbt/glsl/cbt.glsl");
+    if (lebUsesLeafCache())
+        PushLeafCacheShader(djp);
     djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./submodules/libleb/glsl/leb.glsl");
     djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./terrain/shaders/TerrainRenderCommon.glsl");
     djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./terrain/shaders/TerrainTopView.glsl");
@@ -982,7 +1459,8 @@ bool LoadCbtNodeCountProgram()
 
     LOG("Loading {Cbt-Node-Count-Program}\n");
     djgp_push_string(djp, "#define CBT_NODE_COUNT_BUFFER_BINDING %i\n", BUFFER_CBT_NODE_COUNT);
-    djgp_push_string(djp, "#define CBT_HEAP_BUFFER_BINDING %i\n", BUFFER_LEB);
+    djgp_push_string(djp, "#define CBT_HEAP_BUFFER_BINDING %i\n", BUFFER_BINDING_LEB_HEAPS);
+    djgp_push_string(djp, "#define CBT_HEAP_BUFFER_COUNT %i\n", lebTreeCount());
     djgp_push_string(djp, "#define CBT_READ_ONLY\n");
     djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./submodules/libcbt/glsl/cbt.glsl");
     djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./terrain/shaders/NodeCount.glsl");
@@ -997,6 +1475,41 @@ bool LoadCbtNodeCountProgram()
     return (glGetError() == GL_NO_ERROR);
 }
 
+// -----------------------------------------------------------------------------
+/**
+ * Load the Hi-Z Program
+ *
+ * This program builds the max-depth pyramid of the scene, one level per
+ * dispatch (see HizPyramid.glsl).
+ */
+bool LoadHizProgram()
+{
+    djg_program *djp = djgp_create();
+    GLuint *glp = &g_gl.programs[PROGRAM_HIZ];
+
+    LOG("Loading {Hi-Z-Program}\n");
+    if (g_framebuffer.aa >= AA_MSAA2 && g_framebuffer.aa <= AA_MSAA16)
+        djgp_push_string(djp, "#define MSAA_FACTOR %i\n", 1 << g_framebuffer.aa);
+    djgp_push_file(djp, PATH_TO_SRC_DIRECTORY "./terrain/shaders/HizPyramid.glsl");
+    if (!djgp_to_gl(djp, 450, false, true, glp)) {
+        djgp_release(djp);
+
+        return false;
+    }
+    djgp_release(djp);
+
+    g_gl.uniforms[UNIFORM_HIZ_DEPTH_SAMPLER] =
+        glGetUniformLocation(*glp, "u_DepthSampler");
+    g_gl.uniforms[UNIFORM_HIZ_SAMPLER] =
+        glGetUniformLocation(*glp, "u_HizSampler");
+    g_gl.uniforms[UNIFORM_HIZ_LEVEL] =
+        glGetUniformLocation(*glp, "u_HizLevel");
+    glProgramUniform1i(*glp, g_gl.uniforms[UNIFORM_HIZ_DEPTH_SAMPLER], TEXTURE_ZBUF);
+    glProgramUniform1i(*glp, g_gl.uniforms[UNIFORM_HIZ_SAMPLER], TEXTURE_HIZ);
+
+    return (glGetError() == GL_NO_ERROR);
+}
+
 
 // -----------------------------------------------------------------------------
 /**
@@ -1011,10 +1524,14 @@ bool LoadPrograms()
     if (v) v &= LoadTerrainPrograms();
     if (v) v &= LoadLebReductionProgram();
     if (v) v &= LoadLebReductionPrepassProgram();
+    if (v) v &= LoadDirtyDispatcherProgram();
+    if (v) v &= LoadDirtyReductionProgram();
+    if (v) v &= LoadLeafCacheProgram();
     if (v) v &= LoadBatchProgram();
     if (v) v &= LoadTopViewProgram();
     if (v) v &= LoadSkyProgram();
     if (v) v &= LoadCbtNodeCountProgram();
+    if (v) v &= LoadHizProgram();
 
     return v;
 }
@@ -1024,6 +1541,37 @@ bool LoadPrograms()
 //
 ////////////////////////////////////////////////////////////////////////////////
 
+// -----------------------------------------------------------------------------
+/**
+ * Load the Hi-Z Texture
+ *
+ * This loads the max-depth pyramid of the scene framebuffer, which the LoD
+ * passes use for occlusion culling. It is cleared to the far plane, so
+ * nothing is culled until it holds a frame.
+ */
+bool LoadHizTexture()
+{
+    const float zFar = 1.0f;
+    int mipcnt = djgt__mipcnt(g_framebuffer.w, g_framebuffer.h, 1);
+
+    LOG("Loading {Hi-Z-Texture}\n");
+    if (glIsTexture(g_gl.textures[TEXTURE_HIZ]))
+        glDeleteTextures(1, &g_gl.textures[TEXTURE_HIZ]);
+    glGenTextures(1, &g_gl.textures[TEXTURE_HIZ]);
+    glActiveTexture(GL_TEXTURE0 + TEXTURE_HIZ);
+    glBindTexture(GL_TEXTURE_2D, g_gl.textures[TEXTURE_HIZ]);
+    glTexStorage2D(GL_TEXTURE_2D, mipcnt, GL_R32F, g_framebuffer.w, g_framebuffer.h);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    for (int level = 0; level < mipcnt; ++level)
+        glClearTexImage(g_gl.textures[TEXTURE_HIZ], level, GL_RED, GL_FLOAT, &zFar);
+    glActiveTexture(GL_TEXTURE0);
+
+    return (glGetError() == GL_NO_ERROR);
+}
+
 // -----------------------------------------------------------------------------
 /**
  * Load the Scene Framebuffer Textures
@@ -1106,235 +1654,472 @@ bool LoadSceneFramebufferTexture()
     }
     glActiveTexture(GL_TEXTURE0);
 
-    return (glGetError() == GL_NO_ERROR);
+    return LoadHizTexture();
 }
 
 // -----------------------------------------------------------------------------
 /**
- * Load the Normal Texture Map
+ * Load the Displacement Bounds Texture
  *
- * This Loads an RG32F texture used as a slope map
+ * This loads the min/max pyramid of the dmap (see lebt_CreateDmapBounds),
+ * whose RG16 texels hold the lowest and highest heights of the dmap texels
+ * they cover. The LoD passes fetch it to bound the height of a triangle
+ * for the frustum and horizon culling tests. The bounds of the full
+ * resolution dmap also bound its coarser levels, so they are loaded at
+ * once while the dmap is uploaded progressively.
  */
-void LoadNmapTexture16(int smapID, const djg_texture *dmap)
-{
-    int w = dmap->next->x;
-    int h = dmap->next->y;
-    const uint16_t *texels = (const uint16_t *)dmap->next->texels;
-    int mipcnt = djgt__mipcnt(w, h, 1);
-
-    std::vector<float> smap(w * h * 2);
-
-    for (int j = 0; j < h; ++j)
-        for (int i = 0; i < w; ++i) {
-            int i1 = std::max(0, i - 1);
-            int i2 = std::min(w - 1, i + 1);
-            int j1 = std::max(0, j - 1);
-            int j2 = std::min(h - 1, j + 1);
-            uint16_t px_l = texels[i1 + w * j]; // in [0,2^16-1]
-            uint16_t px_r = texels[i2 + w * j]; // in [0,2^16-1]
-            uint16_t px_b = texels[i + w * j1]; // in [0,2^16-1]
-            uint16_t px_t = texels[i + w * j2]; // in [0,2^16-1]
-            float z_l = (float)px_l / 65535.0f; // in [0, 1]
-            float z_r = (float)px_r / 65535.0f; // in [0, 1]
-            float z_b = (float)px_b / 65535.0f; // in [0, 1]
-            float z_t = (float)px_t / 65535.0f; // in [0, 1]
-            float slope_x = (float)w * 0.5f * (z_r - z_l);
-            float slope_y = (float)h * 0.5f * (z_t - z_b);
-
-            smap[    2 * (i + w * j)] = slope_x;
-            smap[1 + 2 * (i + w * j)] = slope_y;
-        }
-
-    if (glIsTexture(g_gl.textures[smapID]))
-        glDeleteTextures(1, &g_gl.textures[smapID]);
-
-    glGenTextures(1, &g_gl.textures[smapID]);
-    glActiveTexture(GL_TEXTURE0 + smapID);
-    glBindTexture(GL_TEXTURE_2D, g_gl.textures[smapID]);
-    glTexStorage2D(GL_TEXTURE_2D, mipcnt, GL_RG32F, w, h);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RG, GL_FLOAT, &smap[0]);
-
-    glGenerateMipmap(GL_TEXTURE_2D);
+void LoadDmapBoundsTexture(int boundsID, const lebt_DmapBounds *bounds, int w, int h)
+{
+    if (glIsTexture(g_gl.textures[boundsID]))
+        glDeleteTextures(1, &g_gl.textures[boundsID]);
+
+    glGenTextures(1, &g_gl.textures[boundsID]);
+    glActiveTexture(GL_TEXTURE0 + boundsID);
+    glBindTexture(GL_TEXTURE_2D, g_gl.textures[boundsID]);
+    glTexStorage2D(GL_TEXTURE_2D, bounds->levelCount, GL_RG16, w, h);
+    for (int level = 0; level < bounds->levelCount; ++level) {
+        glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0,
+                        std::max(w >> level, 1), std::max(h >> level, 1),
+                        GL_RG, GL_UNSIGNED_SHORT, bounds->levels[level]);
+    }
+    glTexParameteri(GL_TEXTURE_2D,
+                    GL_TEXTURE_MIN_FILTER,
+                    GL_NEAREST_MIPMAP_NEAREST);
     glTexParameteri(GL_TEXTURE_2D,
-        GL_TEXTURE_MIN_FILTER,
-        GL_LINEAR_MIPMAP_LINEAR);
+                    GL_TEXTURE_MAG_FILTER,
+                    GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D,
-        GL_TEXTURE_WRAP_S,
-        GL_CLAMP_TO_EDGE);
+                    GL_TEXTURE_WRAP_S,
+                    GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D,
-        GL_TEXTURE_WRAP_T,
-        GL_CLAMP_TO_EDGE);
+                    GL_TEXTURE_WRAP_T,
+                    GL_CLAMP_TO_EDGE);
     glActiveTexture(GL_TEXTURE0);
 }
 
-void LoadNmapTexture8(int smapID, const djg_texture *dmap)
-{
-    int w = dmap->next->x;
-    int h = dmap->next->y;
-    const uint8_t *texels = (const uint8_t *)dmap->next->texels;
-    int mipcnt = djgt__mipcnt(w, h, 1);
-
-    std::vector<float> smap(w * h * 2);
-
-    for (int j = 0; j < h; ++j)
-        for (int i = 0; i < w; ++i) {
-            int i1 = std::max(0, i - 1);
-            int i2 = std::min(w - 1, i + 1);
-            int j1 = std::max(0, j - 1);
-            int j2 = std::min(h - 1, j + 1);
-            uint8_t px_l = texels[i1 + w * j]; // in [0,2^16-1]
-            uint8_t px_r = texels[i2 + w * j]; // in [0,2^16-1]
-            uint8_t px_b = texels[i + w * j1]; // in [0,2^16-1]
-            uint8_t px_t = texels[i + w * j2]; // in [0,2^16-1]
-            float z_l = (float)px_l / 255.0f; // in [0, 1]
-            float z_r = (float)px_r / 255.0f; // in [0, 1]
-            float z_b = (float)px_b / 255.0f; // in [0, 1]
-            float z_t = (float)px_t / 255.0f; // in [0, 1]
-            float slope_x = (float)w * 0.5f * (z_r - z_l);
-            float slope_y = (float)h * 0.5f * (z_t - z_b);
-
-            smap[    2 * (i + w * j)] = slope_x;
-            smap[1 + 2 * (i + w * j)] = slope_y;
-        }
-
-    if (glIsTexture(g_gl.textures[smapID]))
-        glDeleteTextures(1, &g_gl.textures[smapID]);
+// -----------------------------------------------------------------------------
+/**
+ * Load the Node Error Table
+ *
+ * The dmap loader computes the geometric error of each LEB node of the
+ * dmap (see lebt_CreateNodeErrors), down to the depth where nodes cover
+ * about one texel. LoadNodeErrorBuffer derives the errors of the
+ * tessellated nodes from it, which the LoD passes look up instead of the
+ * dmap variance.
+ */
+void ReleaseNodeErrors()
+{
+    if (g_terrain.errors.nodes)
+        lebt_ReleaseNodeErrors(g_terrain.errors.nodes);
+    if (g_terrain.errors.patches)
+        lebt_ReleaseNodeErrors(g_terrain.errors.patches);
 
-    glGenTextures(1, &g_gl.textures[smapID]);
-    glActiveTexture(GL_TEXTURE0 + smapID);
-    glBindTexture(GL_TEXTURE_2D, g_gl.textures[smapID]);
-    glTexStorage2D(GL_TEXTURE_2D, mipcnt, GL_RG32F, w, h);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RG, GL_FLOAT, &smap[0]);
+    g_terrain.errors.nodes = g_terrain.errors.patches = NULL;
+}
 
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glTexParameteri(GL_TEXTURE_2D,
-        GL_TEXTURE_MIN_FILTER,
-        GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D,
-        GL_TEXTURE_WRAP_S,
-        GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D,
-        GL_TEXTURE_WRAP_T,
-        GL_REPEAT);
-    glActiveTexture(GL_TEXTURE0);
+void LoadNodeErrors(lebt_NodeErrors *errors)
+{
+    LOG("Loading {Node-Errors}\n");
+    ReleaseNodeErrors();
+    g_terrain.errors.nodes = errors;
 }
 
 // -----------------------------------------------------------------------------
 /**
  * Load the Displacement Texture
  *
- * This Loads an R16 texture used as a displacement map
+ * The dmap is loaded by a background thread, so the program renders a
+ * flat terrain right away. The thread maps the container baked by
+ * terrain_bake (see TerrainBake.h) if it is up to date, or else decodes
+ * the 16-bit heightmap and bakes the same mip chains in memory. It then
+ * derives the height bounds and the node errors from the finest level.
+ * Once it is done, StreamDmapLevels uploads the RG16 dmap and RG16F slope
+ * map levels from coarse to fine through a pixel buffer, within a budget
+ * of bytes per frame, and lowers the base level of the textures as the
+ * finer levels land.
  */
-bool LoadDmapTexture16(int dmapID, int smapID, const char *pathToFile)
+void DmapLoaderThread(std::string pathToFile, std::string pathToBakedFile)
 {
-    djg_texture *djgt = djgt_create(1);
+    tbk_Asset *asset = &g_dmapLoader.asset;
 
-    LOG("Loading {Dmap-Texture}\n");
-    djgt_push_image_u16(djgt, pathToFile, 1);
-
-    int w = djgt->next->x;
-    int h = djgt->next->y;
-    const uint16_t *texels = (const uint16_t *)djgt->next->texels;
-    int mipcnt = djgt__mipcnt(w, h, 1);
-    std::vector<uint16_t> dmap(w * h * 2);
+    if (tbk_Map(pathToBakedFile.c_str(), asset)
+        && !tbk_MatchesSource(asset, pathToFile.c_str())) {
+        LOG("(!) %s is out of date (!)\n", pathToBakedFile.c_str());
+        tbk_Unmap(asset);
+    }
 
-    for (int j = 0; j < h; ++j)
-    for (int i = 0; i < w; ++i) {
-        uint16_t z = texels[i + w * j]; // in [0,2^16-1]
-        float zf = float(z) / float((1 << 16) - 1);
-        uint16_t z2 = zf * zf * ((1 << 16) - 1);
+    if (!asset->data) {
+        djg_texture *djgt = djgt_create(1);
 
-        dmap[    2 * (i + w * j)] = z;
-        dmap[1 + 2 * (i + w * j)] = z2;
+        djgt_push_image_u16(djgt, pathToFile.c_str(), 1);
+        tbk_BakeInMemory(asset,
+                         (const uint16_t *)djgt->next->texels,
+                         djgt->next->x,
+                         djgt->next->y,
+                         0);
+        djgt_release(djgt);
     }
 
-    // Load nmap from dmap
-    LoadNmapTexture16(smapID, djgt);
+    if (asset->data) {
+        const uint16_t *texels =
+            (const uint16_t *)tbk_LevelTexels(asset, TBK_SECTION_DMAP, 0);
+        int w = asset->header->width;
+        int h = asset->header->height;
 
-    glActiveTexture(GL_TEXTURE0 + dmapID);
-    if (glIsTexture(g_gl.textures[dmapID]))
-        glDeleteTextures(1, &g_gl.textures[dmapID]);
+        g_dmapLoader.bounds = lebt_CreateDmapBounds(texels, 2, w, h);
+        g_dmapLoader.errors = lebt_CreateNodeErrors(texels, 2, w, h);
+    }
 
-    glGenTextures(1, &g_gl.textures[dmapID]);
-    glActiveTexture(GL_TEXTURE0 + dmapID);
-    glBindTexture(GL_TEXTURE_2D, g_gl.textures[dmapID]);
-    glTexStorage2D(GL_TEXTURE_2D, mipcnt, GL_RG16, w, h);
-    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RG, GL_UNSIGNED_SHORT, &dmap[0]);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glTexParameteri(GL_TEXTURE_2D,
-                    GL_TEXTURE_MIN_FILTER,
-                    GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D,
-                    GL_TEXTURE_MAG_FILTER,
-                    GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D,
-                    GL_TEXTURE_WRAP_S,
-                    GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D,
-                    GL_TEXTURE_WRAP_T,
-                    GL_CLAMP_TO_EDGE);
-    glActiveTexture(GL_TEXTURE0);
-    djgt_release(djgt);
+    g_dmapLoader.state = DMAP_LOADER_READY;
+}
 
-    return (glGetError() == GL_NO_ERROR);
+void ReleaseDmapLoader()
+{
+    if (g_dmapLoader.thread.joinable())
+        g_dmapLoader.thread.join();
+
+    tbk_Unmap(&g_dmapLoader.asset);
+    if (g_dmapLoader.bounds)
+        lebt_ReleaseDmapBounds(g_dmapLoader.bounds);
+    if (g_dmapLoader.errors)
+        lebt_ReleaseNodeErrors(g_dmapLoader.errors);
+    if (glIsBuffer(g_dmapLoader.pbo))
+        glDeleteBuffers(1, &g_dmapLoader.pbo);
+
+    g_dmapLoader.bounds = NULL;
+    g_dmapLoader.errors = NULL;
+    g_dmapLoader.pbo = 0;
+    g_dmapLoader.state = DMAP_LOADER_IDLE;
 }
 
-bool LoadDmapTexture()
+bool LoadDmapTextureAsync(int dmapID, int smapID, int boundsID)
 {
-    LOG("%s", g_terrain.dmap.pathToFile.c_str());
-    if (!g_terrain.dmap.pathToFile.empty()) {
-        return LoadDmapTexture16(TEXTURE_DMAP,
-                                 TEXTURE_SMAP,
-                                 g_terrain.dmap.pathToFile.c_str());
+    const int textureIDs[] = {dmapID, smapID, boundsID};
+
+    LOG("Loading {Dmap-Texture-Async}\n");
+    ReleaseDmapLoader();
+
+    // the samplers read zeros until the first levels are uploaded
+    for (int i = 0; i < BUFFER_SIZE(textureIDs); ++i) {
+        if (glIsTexture(g_gl.textures[textureIDs[i]]))
+            glDeleteTextures(1, &g_gl.textures[textureIDs[i]]);
+        g_gl.textures[textureIDs[i]] = 0;
     }
 
+    g_dmapLoader.state = DMAP_LOADER_BUSY;
+    g_dmapLoader.thread = std::thread(DmapLoaderThread,
+                                      g_terrain.dmap.pathToFile,
+                                      g_terrain.dmap.pathToBakedFile);
+
     return (glGetError() == GL_NO_ERROR);
 }
 
 // -----------------------------------------------------------------------------
-bool LoadBrunetonAtmosphereTextures()
+/**
+ * Load the Streamed Displacement Texture
+ *
+ * The dmap is read on demand from a tile store (see DmapTiles.h), which is
+ * baked from the dmap if it doesn't exist yet. The GPU holds a fixed-size
+ * pool of pages, i.e., an array texture with one tile per layer, and a page
+ * table that maps each tile to its page. The LoD pass requests the tiles
+ * it needs, and a background thread reads them from disk. The coarsest
+ * tile is pinned in the pool, so every lookup resolves to some level.
+ */
+void TileLoaderThread()
 {
-    float *data = new float[16*64*3];
-    FILE *f = fopen(PATH_TO_ASSET_DIRECTORY "irradiance.raw", "rb");
-    fread(data, 1, 16*64*3*sizeof(float), f);
-    fclose(f);
-    glActiveTexture(GL_TEXTURE0 + TEXTURE_ATMOSPHERE_IRRADIANCE);
-    glBindTexture(GL_TEXTURE_2D, g_gl.textures[TEXTURE_ATMOSPHERE_IRRADIANCE]);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, 64, 16, 0, GL_RGB, GL_FLOAT, data);
-    delete[] data;
+    std::vector<uint16_t> texels(g_tileLoader.store.tileByteSize / sizeof(uint16_t));
 
-    int res = 64;
-    int nr = res / 2;
-    int nv = res * 2;
-    int nb = res / 2;
-    int na = 8;
-    f = fopen(PATH_TO_ASSET_DIRECTORY "inscatter.raw", "rb");
-    data = new float[nr*nv*nb*na*4];
-    fread(data, 1, nr*nv*nb*na*4*sizeof(float), f);
-    fclose(f);
-    glActiveTexture(GL_TEXTURE0 + TEXTURE_ATMOSPHERE_INSCATTER);
-    glBindTexture(GL_TEXTURE_3D, g_gl.textures[TEXTURE_ATMOSPHERE_INSCATTER]);
-        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-        glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, na*nb, nv, nr, 0, GL_RGBA, GL_FLOAT, data);
-    delete[] data;
+    for (;;) {
+        int64_t tileID;
 
-    data = new float[256*64*3];
-    f = fopen(PATH_TO_ASSET_DIRECTORY "transmittance.raw", "rb");
-    fread(data, 1, 256*64*3*sizeof(float), f);
-    fclose(f);
-    glActiveTexture(GL_TEXTURE0 + TEXTURE_ATMOSPHERE_TRANSMITTANCE);
-    glBindTexture(GL_TEXTURE_2D, g_gl.textures[TEXTURE_ATMOSPHERE_TRANSMITTANCE]);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        {
+            std::unique_lock<std::mutex> lock(g_tileLoader.mutex);
+
+            g_tileLoader.condition.wait(lock, [] {
+                return g_tileLoader.quit
+                    || (!g_tileLoader.queue.empty()
+                        && g_tileLoader.loaded.size() < DMAP_LOADED_TILE_CAPACITY);
+            });
+            if (g_tileLoader.quit)
+                return;
+
+            tileID = g_tileLoader.queue.front();
+            g_tileLoader.queue.pop_front();
+        }
+
+        // an empty tile notifies the main thread of the failure
+        bool success = dmt_ReadTile(&g_tileLoader.store, tileID, &texels[0]);
+
+        {
+            std::lock_guard<std::mutex> lock(g_tileLoader.mutex);
+
+            g_tileLoader.loaded.push_back(std::make_pair(
+                tileID,
+                success ? texels : std::vector<uint16_t>()
+            ));
+        }
+    }
+}
+
+void ReleaseDmapTiles()
+{
+    if (g_tileLoader.thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(g_tileLoader.mutex);
+
+            g_tileLoader.quit = true;
+        }
+        g_tileLoader.condition.notify_all();
+        g_tileLoader.thread.join();
+    }
+
+    g_tileLoader.quit = false;
+    g_tileLoader.queue.clear();
+    g_tileLoader.loaded.clear();
+    g_tileLoader.tileStates.clear();
+    dmt_ReleaseCache(&g_tileLoader.cache);
+    dmt_Close(&g_tileLoader.store);
+    glrb_Release(&g_gl.readbacks[READBACK_DMAP_TILE_REQUESTS]);
+}
+
+bool BakeDmapTiles(const char *pathToFile)
+{
+    djg_texture *djgt = djgt_create(1);
+    lebt_Dmap *dmap;
+    bool success;
+
+    LOG("Baking {Dmap-Tiles}\n");
+    djgt_push_image_u16(djgt, g_terrain.dmap.pathToFile.c_str(), 1);
+    dmap = lebt_CreateDmap((const uint16_t *)djgt->next->texels,
+                           djgt->next->x,
+                           djgt->next->y);
+    djgt_release(djgt);
+    success = dmt_Build(pathToFile,
+                        dmap->levels,
+                        dmap->width,
+                        dmap->height,
+                        dmap->levelCount,
+                        g_terrain.streaming.tileSize);
+    lebt_ReleaseDmap(dmap);
+
+    return success;
+}
+
+void LoadDmapTilesBuffer(int bufferID, size_t byteSize, const void *data)
+{
+    if (glIsBuffer(g_gl.buffers[bufferID]))
+        glDeleteBuffers(1, &g_gl.buffers[bufferID]);
+    glGenBuffers(1, &g_gl.buffers[bufferID]);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_gl.buffers[bufferID]);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, byteSize, data, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,
+                     bufferID,
+                     g_gl.buffers[bufferID]);
+}
+
+// the page table starts with the tiling of each level (see TerrainRenderCommon.glsl)
+void dmapWritePageTable(int64_t tileID, uint32_t pageID)
+{
+    glNamedBufferSubData(g_gl.buffers[BUFFER_DMAP_PAGE_TABLE],
+                         sizeof(uint32_t) * (4 * DMT_MAX_LEVEL_COUNT + tileID),
+                         sizeof(uint32_t),
+                         &pageID);
+}
+
+void dmapUploadTile(int64_t tileID, int32_t pageID, const uint16_t *texels)
+{
+    int pageSize = g_tileLoader.store.pageSize;
+
+    glTextureSubImage3D(g_gl.textures[TEXTURE_DMAP_PAGES],
+                        0, 0, 0, pageID, pageSize, pageSize, 1,
+                        GL_RG, GL_UNSIGNED_SHORT, texels);
+    dmapWritePageTable(tileID, (uint32_t)pageID);
+    g_tileLoader.tileStates[tileID] = TILE_RESIDENT;
+}
+
+bool LoadDmapTiles()
+{
+    const char *pathToFile = g_terrain.streaming.pathToFile.c_str();
+    dmt_Store *store = &g_tileLoader.store;
+    int pageSize, pageCount = std::max(g_terrain.streaming.pageCount, 2);
+
+    LOG("Loading {Dmap-Tiles}\n");
+    ReleaseDmapTiles();
+    if (!dmt_Open(pathToFile, store)) {
+        if (!BakeDmapTiles(pathToFile) || !dmt_Open(pathToFile, store)) {
+            LOG("=> Failure <=\n");
+
+            return false;
+        }
+    }
+    if (!dmt_CreateCache(store, pageCount, &g_tileLoader.cache)) {
+        dmt_Close(store);
+
+        return false;
+    }
+    g_tileLoader.tileStates.assign(store->tileCount, TILE_IDLE);
+    pageSize = store->pageSize;
+
+    // page pool
+    glActiveTexture(GL_TEXTURE0 + TEXTURE_DMAP_PAGES);
+    if (glIsTexture(g_gl.textures[TEXTURE_DMAP_PAGES]))
+        glDeleteTextures(1, &g_gl.textures[TEXTURE_DMAP_PAGES]);
+    glGenTextures(1, &g_gl.textures[TEXTURE_DMAP_PAGES]);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, g_gl.textures[TEXTURE_DMAP_PAGES]);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RG16, pageSize, pageSize, pageCount);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glActiveTexture(GL_TEXTURE0);
+
+    // page table, tile requests, and tile request stamps
+    {
+        std::vector<uint32_t> pageTable(4 * DMT_MAX_LEVEL_COUNT + store->tileCount,
+                                        DMT_PAGE_NULL);
+        std::vector<uint32_t> zeros(std::max<int64_t>(store->tileCount,
+                                                      1 + DMAP_TILE_REQUEST_CAPACITY),
+                                    0u);
+
+        for (int i = 0; i < store->levelCount; ++i) {
+            pageTable[4 * i    ] = store->levels[i].width;
+            pageTable[4 * i + 1] = store->levels[i].height;
+            pageTable[4 * i + 2] = store->levels[i].tileCountX;
+            pageTable[4 * i + 3] = (uint32_t)store->levels[i].firstTileID;
+        }
+
+        LoadDmapTilesBuffer(BUFFER_DMAP_PAGE_TABLE,
+                            sizeof(uint32_t) * pageTable.size(),
+                            &pageTable[0]);
+        LoadDmapTilesBuffer(BUFFER_DMAP_TILE_REQUESTS,
+                            sizeof(uint32_t) * (1 + DMAP_TILE_REQUEST_CAPACITY),
+                            &zeros[0]);
+        glrb_Create(&g_gl.readbacks[READBACK_DMAP_TILE_REQUESTS],
+                    sizeof(uint32_t) * (1 + DMAP_TILE_REQUEST_CAPACITY),
+                    READBACK_SLOT_COUNT);
+        LoadDmapTilesBuffer(BUFFER_DMAP_TILE_STAMPS,
+                            sizeof(uint32_t) * store->tileCount,
+                            &zeros[0]);
+    }
+
+    // pin the coarsest tile, which the top view samples as well
+    {
+        const dmt_Level *level = &store->levels[store->levelCount - 1];
+        int64_t rootTileID = store->tileCount - 1, evictedTileID;
+        std::vector<uint16_t> texels(store->tileByteSize / sizeof(uint16_t));
+        int32_t pageID = dmt_MapTile(&g_tileLoader.cache, rootTileID, 0, &evictedTileID);
+
+        if (!dmt_ReadTile(store, rootTileID, &texels[0])) {
+            LOG("=> Failure <=\n");
+            ReleaseDmapTiles();
+
+            return false;
+        }
+        g_tileLoader.cache.pageStamps[pageID] = DMT_STAMP_PINNED;
+        dmapUploadTile(rootTileID, pageID, &texels[0]);
+
+        glActiveTexture(GL_TEXTURE0 + TEXTURE_DMAP);
+        if (glIsTexture(g_gl.textures[TEXTURE_DMAP]))
+            glDeleteTextures(1, &g_gl.textures[TEXTURE_DMAP]);
+        glGenTextures(1, &g_gl.textures[TEXTURE_DMAP]);
+        glBindTexture(GL_TEXTURE_2D, g_gl.textures[TEXTURE_DMAP]);
+        glTexStorage2D(GL_TEXTURE_2D,
+                       djgt__mipcnt(level->width, level->height, 1),
+                       GL_RG16,
+                       level->width,
+                       level->height);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, pageSize);
+        glPixelStorei(GL_UNPACK_SKIP_PIXELS, DMT_TILE_BORDER);
+        glPixelStorei(GL_UNPACK_SKIP_ROWS, DMT_TILE_BORDER);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, level->width, level->height,
+                        GL_RG, GL_UNSIGNED_SHORT, &texels[0]);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+        glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    LOG("%lix%li texels, %i levels, %li tiles, %i pages\n",
+        (long)store->width, (long)store->height,
+        store->levelCount, (long)store->tileCount, pageCount);
+    g_tileLoader.thread = std::thread(TileLoaderThread);
+
+    return (glGetError() == GL_NO_ERROR);
+}
+
+bool LoadDmapTexture()
+{
+    LOG("%s", g_terrain.dmap.pathToFile.c_str());
+    ReleaseNodeErrors();
+    ReleaseDmapLoader();
+    if (!g_terrain.dmap.pathToFile.empty()) {
+        if (g_terrain.streaming.enabled) {
+            if (LoadDmapTiles())
+                return true;
+
+            LOG("(!) Tile streaming disabled (!)\n");
+            g_terrain.streaming.enabled = false;
+        }
+        ReleaseDmapTiles();
+
+        return LoadDmapTextureAsync(TEXTURE_DMAP,
+                                    TEXTURE_SMAP,
+                                    TEXTURE_DMAP_BOUNDS);
+    }
+
+    return (glGetError() == GL_NO_ERROR);
+}
+
+// -----------------------------------------------------------------------------
+bool LoadBrunetonAtmosphereTextures()
+{
+    float *data = new float[16*64*3];
+    FILE *f = fopen(PATH_TO_ASSET_DIRECTORY "irradiance.raw", "rb");
+    fread(data, 1, 16*64*3*sizeof(float), f);
+    fclose(f);
+    glActiveTexture(GL_TEXTURE0 + TEXTURE_ATMOSPHERE_IRRADIANCE);
+    glBindTexture(GL_TEXTURE_2D, g_gl.textures[TEXTURE_ATMOSPHERE_IRRADIANCE]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, 64, 16, 0, GL_RGB, GL_FLOAT, data);
+    delete[] data;
+
+    int res = 64;
+    int nr = res / 2;
+    int nv = res * 2;
+    int nb = res / 2;
+    int na = 8;
+    f = fopen(PATH_TO_ASSET_DIRECTORY "inscatter.raw", "rb");
+    data = new float[nr*nv*nb*na*4];
+    fread(data, 1, nr*nv*nb*na*4*sizeof(float), f);
+    fclose(f);
+    glActiveTexture(GL_TEXTURE0 + TEXTURE_ATMOSPHERE_INSCATTER);
+    glBindTexture(GL_TEXTURE_3D, g_gl.textures[TEXTURE_ATMOSPHERE_INSCATTER]);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, na*nb, nv, nr, 0, GL_RGBA, GL_FLOAT, data);
+    delete[] data;
+
+    data = new float[256*64*3];
+    f = fopen(PATH_TO_ASSET_DIRECTORY "transmittance.raw", "rb");
+    fread(data, 1, 256*64*3*sizeof(float), f);
+    fclose(f);
+    glActiveTexture(GL_TEXTURE0 + TEXTURE_ATMOSPHERE_TRANSMITTANCE);
+    glBindTexture(GL_TEXTURE_2D, g_gl.textures[TEXTURE_ATMOSPHERE_TRANSMITTANCE]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, 256, 64, 0, GL_RGB, GL_FLOAT, data);
     delete[] data;
@@ -1362,6 +2147,34 @@ bool LoadTextures()
 //
 ////////////////////////////////////////////////////////////////////////////////
 
+// -----------------------------------------------------------------------------
+/**
+ * Terrain Model Matrix
+ *
+ * Maps the unit square of the subdivision, displaced along z, to world
+ * space.
+ */
+dja::mat4 terrainModelMatrix()
+{
+    float width = g_terrain.dmap.width;
+    float height = g_terrain.dmap.height;
+    float zMin = g_terrain.dmap.zMin;
+    float zMax = g_terrain.dmap.zMax;
+    dja::vec3 scale = dja::vec3(width, zMax - zMin, height);
+
+    return dja::mat4::homogeneous::translation(dja::vec3(-width / 2.0f, zMin, +height / 2.0f))
+            * dja::mat4::homogeneous::scale(dja::vec3(scale))
+            * dja::mat4::homogeneous::rotation(dja::vec3(1, 0, 0), M_PI / 2.0f);
+}
+
+// camera position in the space of the subdivision (see terrainModelMatrix)
+dja::vec4 terrainCameraPosition()
+{
+    const dja::vec3 &pos = g_camera.pos;
+
+    return dja::inverse(terrainModelMatrix()) * dja::vec4(pos.x, pos.y, pos.z, 1.0f);
+}
+
 // -----------------------------------------------------------------------------
 /**
  * Load Terrain Variables UBO
@@ -1377,9 +2190,11 @@ bool LoadTerrainVariables()
                   view,                 // 16
                   camera,               // 16
                   viewProjection,       // 16
-                  modelViewProjection;  // 16
+                  modelViewProjection,  // 16
+                  hizModelViewProjection; // 16
         dja::vec4 frustum[6];           // 24
-        dja::vec4 align[2];             // 8
+        dja::vec4 localCameraPosition;  // 4
+        dja::vec4 align;                // 4
     } variables;
 
     if (first) {
@@ -1421,17 +2236,10 @@ bool LoadTerrainVariables()
 #endif
     }
 
-    float width = g_terrain.dmap.width;
-    float height = g_terrain.dmap.height;
-    float zMin = g_terrain.dmap.zMin;
-    float zMax = g_terrain.dmap.zMax;
-    dja::vec3 scale = dja::vec3(width, zMax - zMin, height);
     dja::mat4 viewInv = dja::mat4::homogeneous::translation(g_camera.pos)
         * dja::mat4::homogeneous::from_mat3(g_camera.axis);
     dja::mat4 view = dja::inverse(viewInv);
-    dja::mat4 model = dja::mat4::homogeneous::translation(dja::vec3(-width / 2.0f, zMin, +height / 2.0f))
-            * dja::mat4::homogeneous::scale(dja::vec3(scale))
-            * dja::mat4::homogeneous::rotation(dja::vec3(1, 0, 0), M_PI / 2.0f);
+    dja::mat4 model = terrainModelMatrix();
 
     // set transformations (column-major)
     variables.model = dja::transpose(model);
@@ -1441,6 +2249,7 @@ bool LoadTerrainVariables()
     variables.modelView = dja::transpose(view * model);
     variables.modelViewProjection = dja::transpose(projection * view * model);
     variables.viewProjection = dja::transpose(projection * view);
+    variables.hizModelViewProjection = dja::transpose(g_terrain.hiz.modelViewProjection);
     //variables.projection = dja::transpose(projection);
 
     // extract frustum planes
@@ -1454,6 +2263,7 @@ bool LoadTerrainVariables()
         dja::vec4 tmp = variables.frustum[i*2+j];
         variables.frustum[i*2+j]*= dja::norm(dja::vec3(tmp.x, tmp.y, tmp.z));
     }
+    variables.localCameraPosition = terrainCameraPosition();
 
     // upLoad to GPU
     djgb_to_gl(g_gl.streams[STREAM_TERRAIN_VARIABLES], (const void *)&variables, NULL);
@@ -1464,41 +2274,349 @@ bool LoadTerrainVariables()
     return (glGetError() == GL_NO_ERROR);
 }
 
+// -----------------------------------------------------------------------------
+/**
+ * Budgeted Update
+ *
+ * When the budget is enabled, each update pass only visits a slice of the
+ * node range, and the slices move through the range in a round-robin
+ * fashion: a split pass and a merge pass process the same slice, after
+ * which the next slice starts where the previous one ended. The slice size
+ * is either fixed, or derived from the GPU cost per node measured over the
+ * previous updates. Since the node handles shift as the tree gets
+ * modified, a sweep only approximately visits each node once. Only the
+ * compute shader pipeline supports this since the other pipelines render
+ * the terrain within the update pass. With several CBTs, the slice applies
+ * to each of them, and a sweep ends with the range of the largest one.
+ */
+bool lebIsBudgeted()
+{
+    return g_terrain.budget.enabled && g_terrain.method == METHOD_CS;
+}
+
+void lebResetBudget()
+{
+    g_terrain.budget.nodeOffset = 0;
+    g_terrain.budget.sliceSize = 0;
+    g_terrain.budget.sweepCount = 0;
+}
+
+uint32_t lebBudgetNodeCount()
+{
+    const uint32_t minNodeCount = 256u;
+    const uint32_t maxNodeCount = 65535u * 256u;
+    double nodeCount = g_terrain.budget.nodeCount;
+
+    if (g_terrain.budget.mode == BUDGET_MICROSECONDS) {
+        double cpuDt, gpuDt;
+
+        djgc_ticks(g_gl.clocks[CLOCK_UPDATE], &cpuDt, &gpuDt);
+        if (g_terrain.budget.sliceSize > 0 && gpuDt > 0.0) {
+            float nsPerNode = gpuDt * 1e9 / g_terrain.budget.sliceSize;
+
+            if (g_terrain.budget.nsPerNode > 0.0f) {
+                g_terrain.budget.nsPerNode+= 0.1f * (nsPerNode - g_terrain.budget.nsPerNode);
+            } else {
+                g_terrain.budget.nsPerNode = nsPerNode;
+            }
+        }
+
+        if (g_terrain.budget.nsPerNode > 0.0f)
+            nodeCount = g_terrain.budget.microseconds * 1e3 / g_terrain.budget.nsPerNode;
+    }
+
+    return (uint32_t)std::min(std::max(nodeCount, (double)minNodeCount),
+                              (double)maxNodeCount);
+}
+
+uint32_t lebBudgetBacklog()
+{
+    if (g_terrain.tiles.maxNodeCount > g_terrain.budget.nodeOffset)
+        return g_terrain.tiles.maxNodeCount - g_terrain.budget.nodeOffset;
+
+    return 0;
+}
+
+// moves to the next slice once both passes were applied to the current one
+void lebAdvanceBudget()
+{
+    g_terrain.budget.nodeOffset+= g_terrain.budget.sliceSize;
+
+    if (g_terrain.budget.nodeOffset >= g_terrain.tiles.maxNodeCount) {
+        g_terrain.budget.nodeOffset = 0;
+        ++g_terrain.budget.sweepCount;
+
+        // a sweep amounts to one split and one merge pass
+        g_terrain.staticSkip.pendingFrameCount =
+            std::max(0, g_terrain.staticSkip.pendingFrameCount - 2);
+    }
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Static Update Skipping
+ *
+ * Once the view stops moving, the LoD of each node stops changing, and the
+ * subdivision settles after at most one split and one merge pass per
+ * level of the tree. With "Skip Static Updates" on, the update,
+ * reduction and batching passes are skipped from then on, except for a
+ * periodic full sweep. Only the compute shader pipeline supports this
+ * since the other pipelines render the terrain within the update pass.
+ * With a budgeted update, the pending passes are counted in sweeps rather
+ * than in frames (see lebAdvanceBudget).
+ */
+void lebInvalidateStaticSkip()
+{
+    g_terrain.staticSkip.pendingFrameCount = 2 * (g_terrain.maxDepth + 1);
+}
+
+bool lebShouldUpdate()
+{
+    const float viewKey[24] = {
+        g_camera.pos.x, g_camera.pos.y, g_camera.pos.z,
+        g_camera.upAngle, g_camera.sideAngle,
+        g_camera.fovy, g_camera.zNear, g_camera.zFar,
+        (float)g_camera.projection,
+        (float)g_framebuffer.w, (float)g_framebuffer.h,
+        g_terrain.primitivePixelLengthTarget,
+        g_terrain.minLodStdev,
+        (float)g_terrain.lodMetric,
+        g_terrain.pixelErrorTarget,
+        g_terrain.dmap.scale,
+        (float)g_terrain.flags.displace,
+        (float)g_terrain.flags.freeze,
+        (float)g_terrain.maxDepth,
+        (float)g_terrain.gpuSubd,
+        (float)g_terrain.method
+    };
+
+    if (!g_terrain.staticSkip.enabled || g_terrain.method != METHOD_CS)
+        return true;
+
+    if (memcmp(viewKey, g_terrain.staticSkip.viewKey, sizeof(viewKey)) != 0) {
+        memcpy(g_terrain.staticSkip.viewKey, viewKey, sizeof(viewKey));
+        lebInvalidateStaticSkip();
+    } else if (++g_terrain.staticSkip.frameCount >= g_terrain.staticSkip.fullSweepPeriod) {
+        g_terrain.staticSkip.pendingFrameCount = std::max(2, g_terrain.staticSkip.pendingFrameCount);
+    }
+
+    if (g_terrain.staticSkip.pendingFrameCount > 0) {
+        if (!lebIsBudgeted())
+            --g_terrain.staticSkip.pendingFrameCount;
+        g_terrain.staticSkip.frameCount = 0;
+
+        return true;
+    }
+
+    return false;
+}
+
 // -----------------------------------------------------------------------------
 /**
  * Load LEB Buffer
  *
- * This procedure initializes the subdivision buffer.
+ * This procedure initializes the subdivision buffer. The first time the
+ * buffer gets loaded, the subdivision saved at the last exit is restored
+ * from its snapshot (if any) so that the terrain starts out converged.
+ */
+bool LoadLebBufferFromSnapshot()
+{
+    cbts_Snapshot snapshot;
+    bool v = false;
+
+    if (!cbts_Map(g_app.snapshot.path, &snapshot, true))
+        return false;
+
+    if (snapshot.header->mode == CBTS_MODE_LEB_SQUARE
+        && snapshot.header->rootCount == 2
+        && snapshot.header->maxDepth == g_terrain.maxDepth) {
+        LOG("Loading {Subd-Buffer-Snapshot}\n");
+        glBufferData(GL_SHADER_STORAGE_BUFFER,
+                     snapshot.header->heapByteSize,
+                     snapshot.heap,
+                     GL_STATIC_DRAW);
+        v = true;
+    }
+
+    cbts_Unmap(&snapshot);
+
+    return v;
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Bind the LEB Buffer
+ *
+ * The subdivision buffer packs the heaps of all the CBTs, one per terrain
+ * tile, at offsets aligned for SSBO bindings. Each heap is bound to its own
+ * binding point so that cbt.glsl sees them as an array of heap buffers,
+ * indexed by the ID of the CBT.
  */
+void lebBindBuffers()
+{
+    for (int i = 0; i < lebTreeCount(); ++i) {
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER,
+                          BUFFER_BINDING_LEB_HEAPS + i,
+                          g_gl.buffers[BUFFER_LEB],
+                          i * g_terrain.tiles.heapStride,
+                          cbt__HeapByteSize(g_terrain.maxDepth));
+    }
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,
+                     BUFFER_LEAF_CACHE,
+                     g_gl.buffers[BUFFER_LEAF_CACHE]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,
+                     BUFFER_CBT_DIRTY_BLOCK_FLAGS,
+                     g_gl.buffers[BUFFER_CBT_DIRTY_BLOCK_FLAGS]);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,
+                     BUFFER_CBT_DIRTY_BLOCK_LIST,
+                     g_gl.buffers[BUFFER_CBT_DIRTY_BLOCK_LIST]);
+}
+
+void lebUnbindBuffers()
+{
+    for (int i = 0; i < lebTreeCount(); ++i)
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_BINDING_LEB_HEAPS + i, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_LEAF_CACHE, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_CBT_DIRTY_BLOCK_FLAGS, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_CBT_DIRTY_BLOCK_LIST, 0);
+}
+
 bool LoadLebBuffer()
 {
+    bool warmStart = g_app.snapshot.warmStart
+                  && !glIsBuffer(g_gl.buffers[BUFFER_LEB])
+                  && lebTreeCount() == 1;
     cbt_Tree *cbt = cbt_CreateAtDepth(g_terrain.maxDepth, 1);
+    int64_t heapByteSize = cbt_HeapByteSize(cbt);
+    GLint alignment;
 
     LOG("Loading {Subd-Buffer}\n");
+    lebInvalidateStaticSkip();
+    lebResetBudget();
+    glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    g_terrain.tiles.heapStride =
+        (heapByteSize + alignment - 1) / alignment * alignment;
     if (glIsBuffer(g_gl.buffers[BUFFER_LEB]))
         glDeleteBuffers(1, &g_gl.buffers[BUFFER_LEB]);
     glGenBuffers(1, &g_gl.buffers[BUFFER_LEB]);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_gl.buffers[BUFFER_LEB]);
-    glBufferData(GL_SHADER_STORAGE_BUFFER,
-                 cbt_HeapByteSize(cbt),
-                 cbt_GetHeap(cbt),
-                 GL_STATIC_DRAW);
+    if (!warmStart || !LoadLebBufferFromSnapshot()) {
+        glBufferData(GL_SHADER_STORAGE_BUFFER,
+                     lebTreeCount() * g_terrain.tiles.heapStride,
+                     NULL,
+                     GL_STATIC_DRAW);
+        for (int i = 0; i < lebTreeCount(); ++i) {
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER,
+                            i * g_terrain.tiles.heapStride,
+                            heapByteSize,
+                            cbt_GetHeap(cbt));
+        }
+    }
+    cbt_Release(cbt);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,
-                     BUFFER_LEB,
-                     g_gl.buffers[BUFFER_LEB]);
+    lebBindBuffers();
+    g_terrain.leafCacheIsStale = true;
 
-    cbt_Release(cbt);
+    return (glGetError() == GL_NO_ERROR);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Load the Dirty Block Buffers
+ *
+ * The flags hold one word per block of each CBT, and the list the blocks
+ * of all the CBTs after its header (see CbtDirtyBlocks.glsl). All blocks
+ * start clean, since the heaps are uploaded reduced.
+ */
+bool LoadDirtyBlockBuffers()
+{
+    int64_t blockCount = (int64_t)lebTreeCount() << lebDirtyBlockDepth();
+    int64_t byteSizes[2] = {
+        blockCount * (int64_t)sizeof(uint32_t),
+        (8 + blockCount) * (int64_t)sizeof(uint32_t)
+    };
+
+    LOG("Loading {Dirty-Block-Buffers}\n");
+    for (int i = 0; i < 2; ++i) {
+        GLuint *buffer = &g_gl.buffers[BUFFER_CBT_DIRTY_BLOCK_FLAGS + i];
+
+        if (glIsBuffer(*buffer))
+            glDeleteBuffers(1, buffer);
+        glGenBuffers(1, buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, *buffer);
+        glBufferStorage(GL_SHADER_STORAGE_BUFFER, byteSizes[i], NULL, 0);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER,
+                          GL_R32UI,
+                          GL_RED_INTEGER,
+                          GL_UNSIGNED_INT,
+                          NULL);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+    lebBindBuffers();
 
     return (glGetError() == GL_NO_ERROR);
 }
 
+// -----------------------------------------------------------------------------
+/**
+ * Load the Leaf Cache Buffer
+ *
+ * The cache holds the leaves of each CBT at a stride of its capacity (see
+ * CbtLeafCache.glsl). It starts out stale, and gets written before its
+ * first use.
+ */
+bool LoadLeafCacheBuffer()
+{
+    int64_t byteSize = lebUsesLeafCache()
+                     ? (int64_t)lebLeafCacheCapacity() * lebTreeCount() * sizeof(uint32_t)
+                     : sizeof(uint32_t);
+
+    LOG("Loading {Leaf-Cache-Buffer}\n");
+    if (glIsBuffer(g_gl.buffers[BUFFER_LEAF_CACHE]))
+        glDeleteBuffers(1, &g_gl.buffers[BUFFER_LEAF_CACHE]);
+    glGenBuffers(1, &g_gl.buffers[BUFFER_LEAF_CACHE]);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_gl.buffers[BUFFER_LEAF_CACHE]);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER, byteSize, NULL, 0);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    g_terrain.leafCacheIsStale = true;
+    lebBindBuffers();
+
+    return (glGetError() == GL_NO_ERROR);
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Save LEB Buffer
+ *
+ * This procedure reads back the subdivision buffer and writes it to disk.
+ */
+bool SaveLebBuffer()
+{
+    int64_t byteSize = 1LL << (g_terrain.maxDepth - 1);
+    char *heap = (char *)malloc(byteSize);
+    bool v;
+
+    LOG("Saving {Subd-Buffer-Snapshot}\n");
+    glGetNamedBufferSubData(g_gl.buffers[BUFFER_LEB], 0, byteSize, heap);
+    v = (glGetError() == GL_NO_ERROR);
+    if (v) v &= cbts_Write(g_app.snapshot.path,
+                           heap,
+                           byteSize,
+                           CBTS_MODE_LEB_SQUARE,
+                           2);
+    free(heap);
+
+    return v;
+}
+
 
 // -----------------------------------------------------------------------------
 /**
  * Load CBT Node Count Buffer
  *
- * This procedure initializes a buffer that stores the number of nodes in the CBT.
+ * This procedure initializes a buffer that stores the number of nodes in
+ * each CBT, and the readback ring that carries it back to the CPU (see
+ * RetrieveNodeCount).
  */
 bool LoadCbtNodeCountBuffer()
 {
@@ -1508,13 +2626,93 @@ bool LoadCbtNodeCountBuffer()
     glGenBuffers(1, &g_gl.buffers[BUFFER_CBT_NODE_COUNT]);
     glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_gl.buffers[BUFFER_CBT_NODE_COUNT]);
     glBufferStorage(GL_SHADER_STORAGE_BUFFER,
-                    sizeof(int32_t),
+                    sizeof(int32_t) * lebTreeCount(),
                     NULL,
-                    GL_MAP_READ_BIT);
+                    0);
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER,
                      BUFFER_CBT_NODE_COUNT,
                      g_gl.buffers[BUFFER_CBT_NODE_COUNT]);
 
+    // slots in flight hold the counts of the previous trees
+    glrb_Release(&g_gl.readbacks[READBACK_NODE_COUNT]);
+    if (!glrb_Create(&g_gl.readbacks[READBACK_NODE_COUNT],
+                     sizeof(uint32_t) * lebTreeCount(),
+                     READBACK_SLOT_COUNT))
+        return false;
+
+    return (glGetError() == GL_NO_ERROR);
+}
+
+
+// -----------------------------------------------------------------------------
+/**
+ * Load the Hi-Z Cull Count Buffer
+ *
+ * The split pass counts the leaves that fail the Hi-Z occlusion test in
+ * this buffer (see HizOcclusionTest in TerrainRenderCommon.glsl).
+ */
+bool LoadHizCullCountBuffer()
+{
+    const uint32_t zero = 0;
+
+    LOG("Loading {Hi-Z-Cull-Count-Buffer}\n");
+    if (glIsBuffer(g_gl.buffers[BUFFER_HIZ_CULL_COUNT]))
+        glDeleteBuffers(1, &g_gl.buffers[BUFFER_HIZ_CULL_COUNT]);
+    glGenBuffers(1, &g_gl.buffers[BUFFER_HIZ_CULL_COUNT]);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_gl.buffers[BUFFER_HIZ_CULL_COUNT]);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER,
+                    sizeof(uint32_t),
+                    &zero,
+                    GL_DYNAMIC_STORAGE_BIT);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,
+                     BUFFER_HIZ_CULL_COUNT,
+                     g_gl.buffers[BUFFER_HIZ_CULL_COUNT]);
+
+    glrb_Release(&g_gl.readbacks[READBACK_HIZ_CULL_COUNT]);
+    if (!glrb_Create(&g_gl.readbacks[READBACK_HIZ_CULL_COUNT],
+                     sizeof(uint32_t),
+                     READBACK_SLOT_COUNT))
+        return false;
+
+    return (glGetError() == GL_NO_ERROR);
+}
+
+
+// -----------------------------------------------------------------------------
+/**
+ * Load the Node Error Buffer
+ *
+ * This uploads the errors of the nodes tessellated at the current patch
+ * subdivision level (see lebt_CreatePatchErrors), which depend on the
+ * PatchSubdLevel slider. The 16-bit errors are stored as they are, i.e.,
+ * two per 32-bit word.
+ */
+bool LoadNodeErrorBuffer()
+{
+    if (glIsBuffer(g_gl.buffers[BUFFER_NODE_ERRORS]))
+        glDeleteBuffers(1, &g_gl.buffers[BUFFER_NODE_ERRORS]);
+    g_gl.buffers[BUFFER_NODE_ERRORS] = 0;
+
+    if (g_terrain.errors.patches)
+        lebt_ReleaseNodeErrors(g_terrain.errors.patches);
+    g_terrain.errors.patches = NULL;
+
+    if (!g_terrain.errors.nodes)
+        return true;
+
+    LOG("Loading {Node-Error-Buffer}\n");
+    g_terrain.errors.patches = lebt_CreatePatchErrors(g_terrain.errors.nodes,
+                                                      g_terrain.gpuSubd);
+    glGenBuffers(1, &g_gl.buffers[BUFFER_NODE_ERRORS]);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, g_gl.buffers[BUFFER_NODE_ERRORS]);
+    glBufferStorage(GL_SHADER_STORAGE_BUFFER,
+                    sizeof(uint16_t) << (g_terrain.errors.patches->depth + 1),
+                    g_terrain.errors.patches->errors,
+                    0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER,
+                     BUFFER_NODE_ERRORS,
+                     g_gl.buffers[BUFFER_NODE_ERRORS]);
+
     return (glGetError() == GL_NO_ERROR);
 }
 
@@ -1527,10 +2725,16 @@ bool LoadCbtNodeCountBuffer()
  */
 bool LoadRenderCmdBuffer()
 {
-    uint32_t drawArraysCmd[8] = {2, 1, 0, 0, 0, 0, 0, 0};
+    // one draw command per CBT, and a single dispatch for all the CBTs
+    std::vector<uint32_t> drawArraysCmd(4 * lebTreeCount(), 0u);
+    std::vector<uint32_t> drawElementsCmd(5 * lebTreeCount(), 0u);
     uint32_t drawMeshTasksCmd[8] = {1, 0, 0, 0, 0, 0, 0, 0};
-    uint32_t drawElementsCmd[8] = {0, 0, 0, 0, 0, 0, 0, 0};
-    uint32_t dispatchCmd[8] = {2, 1, 1, 0, 0, 0, 0, 0};
+    uint32_t dispatchCmd[8] = {2, (uint32_t)lebTreeCount(), 1, 0, 0, 0, 0, 0};
+
+    for (int i = 0; i < lebTreeCount(); ++i) {
+        drawArraysCmd[4 * i + 0] = 2;
+        drawArraysCmd[4 * i + 1] = 1;
+    }
 
     if (glIsBuffer(g_gl.buffers[BUFFER_TERRAIN_DRAW]))
         glDeleteBuffers(1, &g_gl.buffers[BUFFER_TERRAIN_DRAW]);
@@ -1541,9 +2745,15 @@ bool LoadRenderCmdBuffer()
     if (glIsBuffer(g_gl.buffers[BUFFER_TERRAIN_DRAW_CS]))
         glDeleteBuffers(1, &g_gl.buffers[BUFFER_TERRAIN_DRAW_CS]);
 
+    if (glIsBuffer(g_gl.buffers[BUFFER_TERRAIN_DISPATCH_CS]))
+        glDeleteBuffers(1, &g_gl.buffers[BUFFER_TERRAIN_DISPATCH_CS]);
+
     glGenBuffers(1, &g_gl.buffers[BUFFER_TERRAIN_DRAW]);
     glBindBuffer(GL_DRAW_INDIRECT_BUFFER, g_gl.buffers[BUFFER_TERRAIN_DRAW]);
-    glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(drawArraysCmd), drawArraysCmd, GL_STATIC_DRAW);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER,
+                 sizeof(uint32_t) * drawArraysCmd.size(),
+                 &drawArraysCmd[0],
+                 GL_STATIC_DRAW);
     glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
 
     glGenBuffers(1, &g_gl.buffers[BUFFER_TERRAIN_DRAW_MS]);
@@ -1553,7 +2763,10 @@ bool LoadRenderCmdBuffer()
 
     glGenBuffers(1, &g_gl.buffers[BUFFER_TERRAIN_DRAW_CS]);
     glBindBuffer(GL_DRAW_INDIRECT_BUFFER, g_gl.buffers[BUFFER_TERRAIN_DRAW_CS]);
-    glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(drawElementsCmd), drawElementsCmd, GL_STATIC_DRAW);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER,
+                 sizeof(uint32_t) * drawElementsCmd.size(),
+                 &drawElementsCmd[0],
+                 GL_STATIC_DRAW);
     glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
 
 
@@ -1696,10 +2909,14 @@ bool LoadBuffers()
 
     if (v) v &= LoadTerrainVariables();
     if (v) v &= LoadLebBuffer();
+    if (v) v &= LoadDirtyBlockBuffers();
+    if (v) v &= LoadLeafCacheBuffer();
     if (v) v &= LoadRenderCmdBuffer();
     if (v) v &= LoadMeshletBuffers();
     if (v) v &= LoadSphereBuffers();
     if (v) v &= LoadCbtNodeCountBuffer();
+    if (v) v &= LoadHizCullCountBuffer();
+    if (v) v &= LoadNodeErrorBuffer();
 
     return v;
 }
@@ -1791,37 +3008,6 @@ bool LoadVertexArrays()
 }
 
 
-// -----------------------------------------------------------------------------
-/**
- * Load Node Count Query
- *
- */
-bool LoadNodeCountQuery()
-{
-    GLuint *query = &g_gl.queries[QUERY_NODE_COUNT];
-
-    glGenQueries(1, query);
-    glQueryCounter(*query, GL_TIMESTAMP);
-
-    return glGetError() == GL_NO_ERROR;
-}
-
-
-// -----------------------------------------------------------------------------
-/**
- * Load All Queries
- *
- */
-bool LoadQueries()
-{
-    bool success = true;
-
-    if (success) success = LoadNodeCountQuery();
-
-    return success;
-}
-
-
 // -----------------------------------------------------------------------------
 /**
  * Load the Scene Framebuffer
@@ -1911,7 +3097,6 @@ void init()
     if (v) v &= LoadFramebuffers();
     if (v) v &= LoadVertexArrays();
     if (v) v &= LoadPrograms();
-    if (v) v &= LoadQueries();
 
 
     updateCameraMatrix();
@@ -1923,6 +3108,16 @@ void release()
 {
     int i;
 
+    if (g_app.snapshot.warmStart && glIsBuffer(g_gl.buffers[BUFFER_LEB])
+        && lebTreeCount() == 1)
+        SaveLebBuffer();
+
+    if (g_terrain.reference.dmap)
+        lebt_ReleaseDmap(g_terrain.reference.dmap);
+    ReleaseDmapTiles();
+    ReleaseDmapLoader();
+    ReleaseNodeErrors();
+
     for (i = 0; i < CLOCK_COUNT; ++i)
         if (g_gl.clocks[i])
             djgc_release(g_gl.clocks[i]);
@@ -1944,9 +3139,8 @@ void release()
     for (i = 0; i < VERTEXARRAY_COUNT; ++i)
         if (glIsVertexArray(g_gl.vertexArrays[i]))
             glDeleteVertexArrays(1, &g_gl.vertexArrays[i]);
-    for (i = 0; i < QUERY_COUNT; ++i)
-        if (glIsQuery(g_gl.queries[i]))
-            glDeleteQueries(1, &g_gl.queries[i]);
+    for (i = 0; i < READBACK_COUNT; ++i)
+        glrb_Release(&g_gl.readbacks[i]);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -1964,20 +3158,26 @@ void release()
 void renderTopView()
 {
     if (g_terrain.flags.topView) {
+        GLint cbtLocation = glGetUniformLocation(g_gl.programs[PROGRAM_TOPVIEW],
+                                                 "u_CbtID");
+
         glDisable(GL_CULL_FACE);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_LEB, g_gl.buffers[BUFFER_LEB]);
+        lebBindBuffers();
         glBindBuffer(GL_DRAW_INDIRECT_BUFFER, g_gl.buffers[BUFFER_TERRAIN_DRAW]);
         glViewport(10, 10, 512, 512);
         glBindVertexArray(g_gl.vertexArrays[VERTEXARRAY_EMPTY]);
         glPatchParameteri(GL_PATCH_VERTICES, 1);
 
         glUseProgram(g_gl.programs[PROGRAM_TOPVIEW]);
-            glDrawArraysIndirect(GL_PATCHES, 0);
+        for (int i = 0; i < lebTreeCount(); ++i) {
+            glUniform1i(cbtLocation, i);
+            glDrawArraysIndirect(GL_PATCHES, BUFFER_OFFSET(16 * i));
+        }
 
         glBindVertexArray(0);
         glViewport(0, 0, g_framebuffer.w, g_framebuffer.h);
         glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_LEB, 0);
+        lebUnbindBuffers();
     }
 }
 
@@ -1987,22 +3187,65 @@ void renderTopView()
  *
  * The reduction prepass is used for counting the number of nodes and
  * dispatch the threads to the proper node. This routine is entirely
- * generic and isn't tied to a specific pipeline.
+ * generic and isn't tied to a specific pipeline. Each level of the
+ * reduction is a single dispatch for all the CBTs. The incremental
+ * reduction replaces the prepass with a reduction of the blocks that the
+ * update flagged, in all the CBTs at once, and the reduction then starts
+ * at the roots of the blocks.
  */
 // LEB reduction step
+// each reduction pass is timed by the clock of the first level it writes
+bool lebReductionTimesLevel(int level)
+{
+    int it = g_terrain.maxDepth;
+
+    if (lebUsesIncrementalReduction()) {
+        if (level == it - 1)
+            return true;
+
+        it = lebDirtyBlockDepth();
+    } else if (lebTreeCount() == 1) {
+        if (level == it - 1)
+            return true;
+
+        it-= 5;
+    }
+
+    return level < it && (it - 1 - level) % CBT_SUM_REDUCTION_LEVEL_COUNT == 0;
+}
+
 void lebReductionPass()
 {
     djgc_start(g_gl.clocks[CLOCK_REDUCTION]);
     int it = g_terrain.maxDepth;
 
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_LEB, g_gl.buffers[BUFFER_LEB]);
-    glUseProgram(g_gl.programs[PROGRAM_LEB_REDUCTION_PREPASS]);
-    if (true) {
+    lebBindBuffers();
+    if (lebUsesDirtyBlocks()) {
+        // lists the blocks the update modified and clears their flags
+        glUseProgram(g_gl.programs[PROGRAM_CBT_DIRTY_DISPATCH]);
+        glDispatchCompute(1, 1, 1);
+        glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+    }
+
+    if (lebUsesIncrementalReduction()) {
+        // one workgroup per dirty block, then the levels above the blocks
+        glUseProgram(g_gl.programs[PROGRAM_CBT_DIRTY_REDUCTION]);
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER,
+                     g_gl.buffers[BUFFER_CBT_DIRTY_BLOCK_LIST]);
+        djgc_start(g_gl.clocks[CLOCK_REDUCTION00 + it - 1]);
+        glDispatchComputeIndirect(0);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        djgc_stop(g_gl.clocks[CLOCK_REDUCTION00 + it - 1]);
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+
+        it = lebDirtyBlockDepth();
+    } else if (lebTreeCount() == 1) {
         int cnt = ((1 << it) >> 5);// / 2;
         int numGroup = (cnt >= 256) ? (cnt >> 8) : 1;
         int loc = glGetUniformLocation(g_gl.programs[PROGRAM_LEB_REDUCTION_PREPASS],
                                        "u_PassID");
 
+        glUseProgram(g_gl.programs[PROGRAM_LEB_REDUCTION_PREPASS]);
         djgc_start(g_gl.clocks[CLOCK_REDUCTION00 + it - 1]);
         glUniform1i(loc, it);
         glDispatchCompute(numGroup, 1, 1);
@@ -2012,28 +3255,78 @@ void lebReductionPass()
         it-= 5;
     }
 
+    // each pass reads the nodes at depth it and writes the levels above
     glUseProgram(g_gl.programs[PROGRAM_LEB_REDUCTION]);
-    while (--it >= 0) {
+    while (it > 0) {
         int loc = glGetUniformLocation(g_gl.programs[PROGRAM_LEB_REDUCTION], "u_PassID");
-        int cnt = 1 << it;
-        int numGroup = (cnt >= 256) ? (cnt >> 8) : 1;
+        int numGroup = std::max((1 << it) >> CBT_SUM_REDUCTION_LEVEL_COUNT, 1);
+        int numGroupX = std::min(numGroup, 1 << 15);
 
-        djgc_start(g_gl.clocks[CLOCK_REDUCTION00 + it]);
+        djgc_start(g_gl.clocks[CLOCK_REDUCTION00 + it - 1]);
         glUniform1i(loc, it);
-        glDispatchCompute(numGroup, 1, 1);
+        glDispatchCompute(numGroupX, lebTreeCount(), numGroup / numGroupX);
         glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
-        djgc_stop(g_gl.clocks[CLOCK_REDUCTION00 + it]);
+        djgc_stop(g_gl.clocks[CLOCK_REDUCTION00 + it - 1]);
+
+        it-= CBT_SUM_REDUCTION_LEVEL_COUNT;
     }
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_LEB, 0);
+    lebUnbindBuffers();
     djgc_stop(g_gl.clocks[CLOCK_REDUCTION]);
 }
 
+// -----------------------------------------------------------------------------
+/**
+ * Leaf Cache Pass
+ *
+ * The leaf cache pass writes the leaves of the CBTs to the leaf cache if
+ * they were loaded since it last ran, whichever pass needs the leaves
+ * first. After an update, the dirty leaf cache pass writes them instead,
+ * with the dispatch that the dirty dispatcher sized: it launches no
+ * workgroups if the update modified no block of any CBT, so the cache is
+ * rewritten exactly when the CBTs changed. Each row of workgroups writes
+ * the leaves of one CBT.
+ */
+void lebLeafCachePass()
+{
+    if (!lebUsesLeafCache() || !g_terrain.leafCacheIsStale)
+        return;
+
+    djgc_start(g_gl.clocks[CLOCK_LEAF_CACHE]);
+    lebBindBuffers();
+    glUseProgram(g_gl.programs[PROGRAM_LEAF_CACHE]);
+    glDispatchCompute(lebLeafCacheGroupCount(), lebTreeCount(), 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    lebUnbindBuffers();
+    djgc_stop(g_gl.clocks[CLOCK_LEAF_CACHE]);
+
+    g_terrain.leafCacheIsStale = false;
+}
+
+void lebDirtyLeafCachePass()
+{
+    if (!lebUsesLeafCache())
+        return;
+
+    djgc_start(g_gl.clocks[CLOCK_LEAF_CACHE]);
+    lebBindBuffers();
+    glUseProgram(g_gl.programs[PROGRAM_LEAF_CACHE]);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER,
+                 g_gl.buffers[BUFFER_CBT_DIRTY_BLOCK_LIST]);
+    glDispatchComputeIndirect(5 * sizeof(uint32_t));
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+    lebUnbindBuffers();
+    djgc_stop(g_gl.clocks[CLOCK_LEAF_CACHE]);
+}
+
 // -----------------------------------------------------------------------------
 /**
  * Batching Pass
  *
  * The batching pass prepares indirect draw calls for rendering the terrain.
  * This routine works for the
+ *
+ * Each workgroup prepares the draw calls of one CBT.
  */
 void lebBatchingPassTsGs()
 {
@@ -2042,7 +3335,7 @@ void lebBatchingPassTsGs()
                      BUFFER_TERRAIN_DRAW,
                      g_gl.buffers[BUFFER_TERRAIN_DRAW]);
 
-    glDispatchCompute(1, 1, 1);
+    glDispatchCompute(lebTreeCount(), 1, 1);
     glMemoryBarrier(GL_ALL_BARRIER_BITS);
 
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_TERRAIN_DRAW, 0);
@@ -2076,7 +3369,11 @@ void lebBatchingPassCs()
                      BUFFER_TERRAIN_DISPATCH_CS,
                      g_gl.buffers[BUFFER_TERRAIN_DISPATCH_CS]);
 
-    glDispatchCompute(1, 1, 1);
+    // the CBTs raise the size of the update dispatch to their own needs
+    glClearNamedBufferSubData(g_gl.buffers[BUFFER_TERRAIN_DISPATCH_CS],
+                              GL_R32UI, 0, sizeof(uint32_t),
+                              GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+    glDispatchCompute(lebTreeCount(), 1, 1);
     glMemoryBarrier(GL_ALL_BARRIER_BITS);
 
     glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_TERRAIN_DRAW, 0);
@@ -2086,7 +3383,7 @@ void lebBatchingPassCs()
 void lebBatchingPass()
 {
     djgc_start(g_gl.clocks[CLOCK_BATCH]);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_LEB, g_gl.buffers[BUFFER_LEB]);
+    lebBindBuffers();
     switch (g_terrain.method) {
     case METHOD_TS:
     case METHOD_GS:
@@ -2101,7 +3398,7 @@ void lebBatchingPass()
     default:
         break;
     }
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_LEB, 0);
+    lebUnbindBuffers();
     djgc_stop(g_gl.clocks[CLOCK_BATCH]);
 }
 
@@ -2111,10 +3408,15 @@ void lebBatchingPass()
  *
  * The update pass updates the LEB binary tree.
  * All pipelines except that the compute shader pipeline render the
- * terrain at the same time.
+ * terrain at the same time. The compute shader pipeline updates all the
+ * CBTs with a single dispatch; the others issue one draw per CBT, as the
+ * ID of the CBT indexes an array of buffers and must be uniform.
  */
 void lebUpdateAndRenderTs(int pingPong)
 {
+    GLuint glp = g_gl.programs[PROGRAM_SPLIT + pingPong];
+    GLint cbtLocation = glGetUniformLocation(glp, "u_CbtID");
+
     // set GL state
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE);
@@ -2124,8 +3426,11 @@ void lebUpdateAndRenderTs(int pingPong)
     glBindVertexArray(g_gl.vertexArrays[VERTEXARRAY_EMPTY]);
     glBindBuffer(GL_DRAW_INDIRECT_BUFFER, g_gl.buffers[BUFFER_TERRAIN_DRAW]);
     glPatchParameteri(GL_PATCH_VERTICES, 1);
-    glUseProgram(g_gl.programs[PROGRAM_SPLIT + pingPong]);
-        glDrawArraysIndirect(GL_PATCHES, 0);
+    glUseProgram(glp);
+    for (int i = 0; i < lebTreeCount(); ++i) {
+        glUniform1i(cbtLocation, i);
+        glDrawArraysIndirect(GL_PATCHES, BUFFER_OFFSET(16 * i));
+    }
     glMemoryBarrier(GL_ALL_BARRIER_BITS);
 
     // reset GL state
@@ -2136,6 +3441,9 @@ void lebUpdateAndRenderTs(int pingPong)
 }
 void lebUpdateAndRenderGs(int pingPong)
 {
+    GLuint glp = g_gl.programs[PROGRAM_SPLIT + pingPong];
+    GLint cbtLocation = glGetUniformLocation(glp, "u_CbtID");
+
     // set GL state
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE);
@@ -2144,8 +3452,11 @@ void lebUpdateAndRenderGs(int pingPong)
     // update and render
     glBindVertexArray(g_gl.vertexArrays[VERTEXARRAY_EMPTY]);
     glBindBuffer(GL_DRAW_INDIRECT_BUFFER, g_gl.buffers[BUFFER_TERRAIN_DRAW]);
-    glUseProgram(g_gl.programs[PROGRAM_SPLIT + pingPong]);
-        glDrawArraysIndirect(GL_POINTS, 0);
+    glUseProgram(glp);
+    for (int i = 0; i < lebTreeCount(); ++i) {
+        glUniform1i(cbtLocation, i);
+        glDrawArraysIndirect(GL_POINTS, BUFFER_OFFSET(16 * i));
+    }
     glMemoryBarrier(GL_ALL_BARRIER_BITS);
 
     // reset GL state
@@ -2176,22 +3487,64 @@ void lebUpdateAndRenderMs(int pingPong)
 }
 void lebUpdateCs(int pingPong)
 {
-    // set GL state
-    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER,
-                 g_gl.buffers[BUFFER_TERRAIN_DISPATCH_CS]);
+    GLuint glp = g_gl.programs[PROGRAM_SPLIT + pingPong];
+    GLint offsetLocation = glGetUniformLocation(glp, "u_NodeOffset");
+    GLint budgetLocation = glGetUniformLocation(glp, "u_NodeBudget");
+
+    glUseProgram(glp);
+    if (lebIsBudgeted()) {
+        uint32_t sliceSize = lebBudgetNodeCount();
+
+        // update the current slice
+        glUniform1ui(offsetLocation, g_terrain.budget.nodeOffset);
+        glUniform1ui(budgetLocation, sliceSize);
+        glDispatchCompute(sliceSize / 256u + 1u, lebTreeCount(), 1);
+        glMemoryBarrier(GL_ALL_BARRIER_BITS);
 
-    // update
-    glUseProgram(g_gl.programs[PROGRAM_SPLIT + pingPong]);
-    glDispatchComputeIndirect(0);
-    glMemoryBarrier(GL_ALL_BARRIER_BITS);
+        g_terrain.budget.sliceSize = sliceSize;
+        if (pingPong == 1)
+            lebAdvanceBudget();
+    } else {
+        // set GL state
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER,
+                     g_gl.buffers[BUFFER_TERRAIN_DISPATCH_CS]);
 
-    // reset GL state
-    glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+        // update
+        glUniform1ui(offsetLocation, 0u);
+        glUniform1ui(budgetLocation, 0xFFFFFFFFu);
+        glDispatchComputeIndirect(0);
+        glMemoryBarrier(GL_ALL_BARRIER_BITS);
+
+        // reset GL state
+        glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, 0);
+    }
+}
+void RetrieveHizCullCount()
+{
+    glrb_Ring *ring = &g_gl.readbacks[READBACK_HIZ_CULL_COUNT];
+    GLuint buffer = g_gl.buffers[BUFFER_HIZ_CULL_COUNT];
+    const uint32_t *cullCount = (const uint32_t *)glrb_Read(ring);
+
+    if (cullCount)
+        g_terrain.hiz.cullCount = *cullCount;
+
+    // the count of this pass is dropped if the ring is full
+    if (glrb_CanWrite(ring)) {
+        glrb_Copy(ring, buffer, 0, 0, sizeof(uint32_t));
+        glrb_Submit(ring);
+    }
+    glClearNamedBufferSubData(buffer, GL_R32UI, 0, sizeof(uint32_t),
+                              GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
 }
 void lebUpdate()
 {
     static int pingPong = 0;
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_LEB, g_gl.buffers[BUFFER_LEB]);
+
+    // the counter holds the rejections of the previous split pass
+    if (pingPong == 0 && g_terrain.flags.hiz)
+        RetrieveHizCullCount();
+
+    lebBindBuffers();
 
     djgc_start(g_gl.clocks[CLOCK_UPDATE]);
     switch (g_terrain.method) {
@@ -2212,7 +3565,7 @@ void lebUpdate()
     }
     djgc_stop(g_gl.clocks[CLOCK_UPDATE]);
 
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_LEB, 0);
+    lebUnbindBuffers();
     pingPong = 1 - pingPong;
 }
 
@@ -2228,16 +3581,20 @@ void lebRenderCs()
     glEnable(GL_CULL_FACE);
     glEnable(GL_DEPTH_TEST);
     glDepthFunc(GL_LESS);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_LEB, g_gl.buffers[BUFFER_LEB]);
+    lebBindBuffers();
     glBindBuffer(GL_DRAW_INDIRECT_BUFFER, g_gl.buffers[BUFFER_TERRAIN_DRAW_CS]);
     glBindVertexArray(g_gl.vertexArrays[VERTEXARRAY_MESHLET]);
 
     // render
     glUseProgram(g_gl.programs[PROGRAM_RENDER_ONLY]);
-    glDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, BUFFER_OFFSET(0));
+    glMultiDrawElementsIndirect(GL_TRIANGLES,
+                                GL_UNSIGNED_SHORT,
+                                BUFFER_OFFSET(0),
+                                lebTreeCount(),
+                                0);
 
     // reset GL state
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, BUFFER_LEB, 0);
+    lebUnbindBuffers();
     glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
     glBindVertexArray(0);
     glDisable(GL_CULL_FACE);
@@ -2252,15 +3609,294 @@ void lebRender()
     djgc_stop(g_gl.clocks[CLOCK_RENDER]);
 }
 
+// -----------------------------------------------------------------------------
+/**
+ * Tile Streaming Pass
+ *
+ * Each LoD pass appends the tiles it needs to a request buffer; the tiles
+ * are stamped with the current frame so that each one gets requested only
+ * once per frame. This routine reads back the requests of the most recent
+ * pass that reached the CPU (see READBACK_SLOT_COUNT), queues the missing
+ * tiles for the loader thread, coarsest first,
+ * and uploads the tiles it has loaded since. Requests of resident tiles
+ * refresh their LRU stamp, so the tiles that remain in view are never
+ * evicted.
+ */
+void ConfigureDmapFrame()
+{
+    glProgramUniform1ui(g_gl.programs[PROGRAM_SPLIT],
+                        g_gl.uniforms[UNIFORM_SPLIT_DMAP_FRAME],
+                        g_terrain.streaming.frame);
+    glProgramUniform1ui(g_gl.programs[PROGRAM_MERGE],
+                        g_gl.uniforms[UNIFORM_MERGE_DMAP_FRAME],
+                        g_terrain.streaming.frame);
+}
+
+void StreamDmapTiles()
+{
+    glrb_Ring *ring = &g_gl.readbacks[READBACK_DMAP_TILE_REQUESTS];
+    GLuint requestBuffer = g_gl.buffers[BUFFER_DMAP_TILE_REQUESTS];
+    std::vector<uint8_t> &tileStates = g_tileLoader.tileStates;
+    uint32_t frame = g_terrain.streaming.frame;
+    const uint32_t *requests = (const uint32_t *)glrb_Read(ring);
+    std::vector<int64_t> missingTiles;
+    uint32_t requestCount = 0;
+    int uploadCount = 0;
+
+    // drop the tiles the loader didn't pick up: they may be out of view now
+    if (requests) {
+        std::lock_guard<std::mutex> lock(g_tileLoader.mutex);
+
+        requestCount = std::min(requests[0], (uint32_t)DMAP_TILE_REQUEST_CAPACITY);
+        ++requests;
+        for (size_t i = 0; i < g_tileLoader.queue.size(); ++i)
+            tileStates[g_tileLoader.queue[i]] = TILE_IDLE;
+        g_tileLoader.queue.clear();
+    }
+
+    // queue the missing tiles; coarser levels have larger IDs, so
+    // sorting them in decreasing order refines the terrain progressively
+    for (uint32_t i = 0; i < requestCount; ++i) {
+        int64_t tileID = requests[i];
+
+        if (tileID < g_tileLoader.store.tileCount
+            && !dmt_TouchTile(&g_tileLoader.cache, tileID, frame)
+            && tileStates[tileID] == TILE_IDLE) {
+            tileStates[tileID] = TILE_QUEUED;
+            missingTiles.push_back(tileID);
+        }
+    }
+    std::sort(missingTiles.begin(), missingTiles.end(), std::greater<int64_t>());
+
+    // queue the requests of the last LoD pass for readback, which may
+    // recycle the slot read above
+    if (glrb_CanWrite(ring)) {
+        glrb_Copy(ring, requestBuffer, 0, 0,
+                  sizeof(uint32_t) * (1 + DMAP_TILE_REQUEST_CAPACITY));
+        glrb_Submit(ring);
+    }
+    glClearNamedBufferSubData(requestBuffer, GL_R32UI, 0, sizeof(uint32_t),
+                              GL_RED_INTEGER, GL_UNSIGNED_INT, NULL);
+
+    // upload the loaded tiles
+    {
+        std::lock_guard<std::mutex> lock(g_tileLoader.mutex);
+
+        if (requests)
+            g_tileLoader.queue.assign(missingTiles.begin(), missingTiles.end());
+        while (!g_tileLoader.loaded.empty()
+               && uploadCount < g_terrain.streaming.uploadBudget) {
+            int64_t tileID = g_tileLoader.loaded.front().first;
+            const std::vector<uint16_t> &texels = g_tileLoader.loaded.front().second;
+            int64_t evictedTileID = -1;
+            int32_t pageID = -1;
+
+            if (texels.empty()) {
+                LOG("(!) Failed to read dmap tile %li (!)\n", (long)tileID);
+                tileStates[tileID] = TILE_FAILED;
+            } else {
+                pageID = dmt_MapTile(&g_tileLoader.cache, tileID, frame, &evictedTileID);
+                tileStates[tileID] = TILE_IDLE;
+            }
+
+            // all pages may be in use, in which case the tile is dropped
+            if (pageID >= 0) {
+                if (evictedTileID >= 0) {
+                    dmapWritePageTable(evictedTileID, DMT_PAGE_NULL);
+                    tileStates[evictedTileID] = TILE_IDLE;
+                }
+                dmapUploadTile(tileID, pageID, &texels[0]);
+                ++uploadCount;
+            }
+            g_tileLoader.loaded.pop_front();
+        }
+        g_terrain.streaming.pendingCount = g_tileLoader.queue.size()
+                                         + g_tileLoader.loaded.size();
+    }
+    g_tileLoader.condition.notify_one();
+
+    // the LoD of the nodes depends on the resident tiles
+    if (uploadCount > 0)
+        lebInvalidateStaticSkip();
+
+    if (requests)
+        g_terrain.streaming.requestCount = requestCount;
+    g_terrain.streaming.residentCount = 0;
+    for (int32_t i = 0; i < g_tileLoader.cache.pageCount; ++i)
+        g_terrain.streaming.residentCount+= g_tileLoader.cache.pageTiles[i] >= 0;
+
+    ++g_terrain.streaming.frame;
+    ConfigureDmapFrame();
+}
+
+// -----------------------------------------------------------------------------
+/**
+ * Upload the Displacement Texture Levels
+ *
+ * This hands the dmap over from the loader thread (see
+ * LoadDmapTextureAsync) and uploads its levels from coarse to fine. Each
+ * frame uploads bands of rows of both the dmap and the slope map, within
+ * DMAP_LEVEL_UPLOAD_BUDGET bytes; the bands are staged in an orphaned
+ * pixel buffer so the copies don't wait on the draws that read the
+ * previous ones. The base level of the textures drops to each level as it
+ * completes, so the sampled mip chain always holds valid texels.
+ */
+void dmapCreateLevelTextures(const tbk_Header *header)
+{
+    const int textureIDs[TBK_SECTION_COUNT] = {TEXTURE_DMAP, TEXTURE_SMAP};
+    const GLenum formats[TBK_SECTION_COUNT] = {GL_RG16, GL_RG16F};
+
+    for (int section = 0; section < TBK_SECTION_COUNT; ++section) {
+        int textureID = textureIDs[section];
+
+        glGenTextures(1, &g_gl.textures[textureID]);
+        glActiveTexture(GL_TEXTURE0 + textureID);
+        glBindTexture(GL_TEXTURE_2D, g_gl.textures[textureID]);
+        glTexStorage2D(GL_TEXTURE_2D,
+                       header->levelCount,
+                       formats[section],
+                       header->width,
+                       header->height);
+        glTexParameteri(GL_TEXTURE_2D,
+                        GL_TEXTURE_BASE_LEVEL,
+                        header->levelCount - 1);
+        glTexParameteri(GL_TEXTURE_2D,
+                        GL_TEXTURE_MIN_FILTER,
+                        GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D,
+                        GL_TEXTURE_MAG_FILTER,
+                        GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D,
+                        GL_TEXTURE_WRAP_S,
+                        GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D,
+                        GL_TEXTURE_WRAP_T,
+                        GL_CLAMP_TO_EDGE);
+    }
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void dmapUploadLevelRows(int levelID, int rowID, int rowCount)
+{
+    const int textureIDs[TBK_SECTION_COUNT] = {TEXTURE_DMAP, TEXTURE_SMAP};
+    const GLenum types[TBK_SECTION_COUNT] = {GL_UNSIGNED_SHORT, GL_HALF_FLOAT};
+    const tbk_Asset *asset = &g_dmapLoader.asset;
+
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, g_dmapLoader.pbo);
+    for (int section = 0; section < TBK_SECTION_COUNT; ++section) {
+        const tbk_Level *level = &asset->header->levels[section][levelID];
+        int64_t rowByteSize = (int64_t)level->width * asset->header->bytesPerTexel;
+        int64_t byteSize = rowByteSize * rowCount;
+        const uint8_t *texels =
+            (const uint8_t *)tbk_LevelTexels(asset, section, levelID);
+        void *data;
+
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, byteSize, NULL, GL_STREAM_DRAW);
+        data = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, byteSize,
+                                GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        memcpy(data, texels + rowByteSize * rowID, byteSize);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glTextureSubImage2D(g_gl.textures[textureIDs[section]],
+                            levelID, 0, rowID, level->width, rowCount,
+                            GL_RG, types[section], BUFFER_OFFSET(0));
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+void StreamDmapLevels()
+{
+    const tbk_Asset *asset = &g_dmapLoader.asset;
+    int64_t budget = DMAP_LEVEL_UPLOAD_BUDGET;
+    bool uploaded = false;
+
+    if (g_dmapLoader.state == DMAP_LOADER_READY) {
+        g_dmapLoader.thread.join();
+
+        if (!asset->data) {
+            LOG("(!) Failed to load %s (!)\n", g_terrain.dmap.pathToFile.c_str());
+            ReleaseDmapLoader();
+
+            return;
+        }
+
+        dmapCreateLevelTextures(asset->header);
+        LoadDmapBoundsTexture(TEXTURE_DMAP_BOUNDS,
+                              g_dmapLoader.bounds,
+                              asset->header->width,
+                              asset->header->height);
+        lebt_ReleaseDmapBounds(g_dmapLoader.bounds);
+        g_dmapLoader.bounds = NULL;
+
+        // the LoD passes switch to the error table
+        LoadNodeErrors(g_dmapLoader.errors);
+        g_dmapLoader.errors = NULL;
+        LoadNodeErrorBuffer();
+        LoadTerrainPrograms();
+
+        glGenBuffers(1, &g_dmapLoader.pbo);
+        g_dmapLoader.levelID = asset->header->levelCount - 1;
+        g_dmapLoader.rowID = 0;
+        g_dmapLoader.state = DMAP_LOADER_UPLOADING;
+    }
+
+    if (g_dmapLoader.state != DMAP_LOADER_UPLOADING)
+        return;
+
+    // upload at least one band per frame, even if it exceeds the budget
+    while (g_dmapLoader.levelID >= 0 && (!uploaded || budget > 0)) {
+        int levelID = g_dmapLoader.levelID;
+        int width = asset->header->levels[TBK_SECTION_DMAP][levelID].width;
+        int height = asset->header->levels[TBK_SECTION_DMAP][levelID].height;
+        int64_t rowByteSize = (int64_t)width * asset->header->bytesPerTexel
+                            * TBK_SECTION_COUNT;
+        int rowCount = (int)std::max(budget / rowByteSize, (int64_t)1);
+
+        rowCount = std::min(rowCount, height - g_dmapLoader.rowID);
+        dmapUploadLevelRows(levelID, g_dmapLoader.rowID, rowCount);
+        budget-= rowByteSize * rowCount;
+        g_dmapLoader.rowID+= rowCount;
+        uploaded = true;
+
+        if (g_dmapLoader.rowID == height) {
+            glTextureParameteri(g_gl.textures[TEXTURE_DMAP],
+                                GL_TEXTURE_BASE_LEVEL,
+                                levelID);
+            glTextureParameteri(g_gl.textures[TEXTURE_SMAP],
+                                GL_TEXTURE_BASE_LEVEL,
+                                levelID);
+            --g_dmapLoader.levelID;
+            g_dmapLoader.rowID = 0;
+        }
+    }
+
+    // the LoD of the nodes depends on the heights
+    lebInvalidateStaticSkip();
+
+    if (g_dmapLoader.levelID < 0) {
+        LOG("Loaded {Dmap-Texture, %ix%i texels}\n",
+            asset->header->width, asset->header->height);
+        ReleaseDmapLoader();
+    }
+}
+
 // -----------------------------------------------------------------------------
 void renderTerrain()
 {
     djgc_start(g_gl.clocks[CLOCK_ALL]);
 
     LoadTerrainVariables();
-    lebUpdate();
-    lebReductionPass();
-    lebBatchingPass();
+    if (dmapIsStreamed())
+        StreamDmapTiles();
+    if (g_dmapLoader.state != DMAP_LOADER_IDLE)
+        StreamDmapLevels();
+    if (lebShouldUpdate()) {
+        lebLeafCachePass();
+        lebUpdate();
+        lebReductionPass();
+        lebDirtyLeafCachePass();
+        lebBatchingPass();
+    }
+    lebLeafCachePass();
     lebRender(); // render pass (if applicable)
 
     djgc_stop(g_gl.clocks[CLOCK_ALL]);
@@ -2310,6 +3946,121 @@ dja::mat4 cameraFrameMatrix()
             * dja::mat4::homogeneous::from_mat3(g_camera.axis);
 }
 
+// -----------------------------------------------------------------------------
+/**
+ * CPU Reference Update
+ *
+ * This procedure computes the subdivision of the current view on the CPU
+ * (see LebTerrain.h) until it converges, and compares it against the GPU
+ * subdivision. Both match once the GPU subdivision has converged as well,
+ * i.e., after the camera stopped moving for a few frames.
+ */
+void LoadReferenceDmap()
+{
+    djg_texture *djgt;
+
+    if (g_terrain.reference.dmap || g_terrain.dmap.pathToFile.empty())
+        return;
+
+    LOG("Loading {Reference-Dmap}\n");
+    djgt = djgt_create(1);
+    djgt_push_image_u16(djgt, g_terrain.dmap.pathToFile.c_str(), 1);
+    g_terrain.reference.dmap = lebt_CreateDmap((const uint16_t *)djgt->next->texels,
+                                               djgt->next->x,
+                                               djgt->next->y);
+    djgt_release(djgt);
+}
+
+bool ComputeCpuReference()
+{
+    dja::mat4 modelView = dja::inverse(cameraFrameMatrix()) * terrainModelMatrix();
+    dja::mat4 modelViewProjection = cameraProjectionMatrix() * modelView;
+    dja::vec4 cameraPosition = terrainCameraPosition();
+    float mvp[4][4];
+    lebt_Params params;
+    cbt_Tree *cbt = cbt_CreateAtDepth(g_terrain.maxDepth, 1);
+    std::vector<char> heap(cbt_HeapByteSize(cbt));
+
+    LoadReferenceDmap();
+
+    for (int i = 0; i < 4; ++i)
+    for (int j = 0; j < 4; ++j) {
+        params.modelView[i][j] = modelView[i][j];
+        mvp[i][j] = modelViewProjection[i][j];
+    }
+    lebt_LoadFrustumPlanes(mvp, params.frustumPlanes);
+    params.lodFactor = computeLodFactor();
+    params.dmapFactor = g_terrain.dmap.scale;
+    params.minLodVariance = sqr(g_terrain.minLodStdev / 64.0f / g_terrain.dmap.scale);
+    params.errorFactor = computeErrorFactor();
+    params.projection = g_camera.projection;
+    params.displace = g_terrain.flags.displace;
+    params.cull = g_terrain.flags.cull;
+    params.horizon = g_terrain.flags.horizon && !dmapIsStreamed();
+    params.dmap = g_terrain.reference.dmap;
+    params.nodeErrors = lodUsesNodeErrors() ? g_terrain.errors.patches : NULL;
+    params.cameraPosition[0] = cameraPosition.x;
+    params.cameraPosition[1] = cameraPosition.y;
+    params.cameraPosition[2] = cameraPosition.z;
+
+    g_terrain.reference.isConverged = lebt_Converge(cbt,
+                                                    &params,
+                                                    8 * (g_terrain.maxDepth + 1),
+                                                    &g_terrain.reference.passCount);
+    g_terrain.reference.nodeCount = cbt_NodeCount(cbt);
+    lebt_CountCulledLeaves(cbt, &params, g_terrain.reference.cullCounts);
+
+    glGetNamedBufferSubData(g_gl.buffers[BUFFER_LEB],
+                            0,
+                            heap.size(),
+                            &heap[0]);
+    g_terrain.reference.matchesGpu =
+        memcmp(&heap[0], cbt_GetHeap(cbt), heap.size()) == 0;
+
+    LOG("CPU reference: %li nodes after %i passes (%s GPU)\n",
+        (long)g_terrain.reference.nodeCount,
+        g_terrain.reference.passCount,
+        g_terrain.reference.matchesGpu ? "matches" : "differs from");
+    LOG("CPU reference: %li leaves culled by the frustum, %li by the horizon\n",
+        (long)g_terrain.reference.cullCounts[LEBT_CULL_FRUSTUM],
+        (long)g_terrain.reference.cullCounts[LEBT_CULL_HORIZON]);
+    cbt_Release(cbt);
+
+    return (glGetError() == GL_NO_ERROR);
+}
+
+
+// -----------------------------------------------------------------------------
+/**
+ * Hi-Z Pass
+ *
+ * This procedure builds the max-depth pyramid of the terrain, one level per
+ * dispatch, and records the transformation it was rendered with. The next
+ * LoD pass projects the bounds of its nodes with that transformation and
+ * culls those that lie behind the pyramid. It runs before the sky is
+ * drawn, whose sphere lies nearer than the far plane.
+ */
+void renderHiz()
+{
+    int mipcnt = djgt__mipcnt(g_framebuffer.w, g_framebuffer.h, 1);
+
+    glUseProgram(g_gl.programs[PROGRAM_HIZ]);
+    for (int level = 0; level < mipcnt; ++level) {
+        int w = std::max(g_framebuffer.w >> level, 1);
+        int h = std::max(g_framebuffer.h >> level, 1);
+
+        glUniform1i(g_gl.uniforms[UNIFORM_HIZ_LEVEL], level);
+        glBindImageTexture(0, g_gl.textures[TEXTURE_HIZ], level,
+                           GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glDispatchCompute((w + 15) / 16, (h + 15) / 16, 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+    }
+    glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+    g_terrain.hiz.modelViewProjection = cameraProjectionMatrix()
+                                      * dja::inverse(cameraFrameMatrix())
+                                      * terrainModelMatrix();
+}
 
 // -----------------------------------------------------------------------------
 void renderSky()
@@ -2341,21 +4092,26 @@ void renderSky()
 /**
  * Retrieve Node Count
  *
- * Retrieves the number of nodes in the CBT asynchronously.
+ * Retrieves the number of nodes in the CBTs asynchronously: the counts are
+ * copied to a ring of fenced readback slots, and the most recent slot the
+ * GPU is done with is read back, so the CPU never waits on the GPU.
  */
 void RetrieveNodeCount()
 {
-    static GLint isReady = GL_FALSE;
-    const GLuint *query = &g_gl.queries[QUERY_NODE_COUNT];
-
-    glGetQueryObjectiv(*query, GL_QUERY_RESULT_AVAILABLE, &isReady);
-
-    if (isReady) {
-        GLuint *buffer = &g_gl.buffers[BUFFER_CBT_NODE_COUNT];
+    glrb_Ring *ring = &g_gl.readbacks[READBACK_NODE_COUNT];
+    const uint32_t *nodeCounts = (const uint32_t *)glrb_Read(ring);
+
+    if (nodeCounts) {
+        g_terrain.nodeCount = 0;
+        g_terrain.tiles.maxNodeCount = 0;
+        for (int i = 0; i < lebTreeCount(); ++i) {
+            g_terrain.nodeCount+= nodeCounts[i];
+            g_terrain.tiles.maxNodeCount =
+                std::max(g_terrain.tiles.maxNodeCount, nodeCounts[i]);
+        }
+    }
 
-        g_terrain.nodeCount = *(uint32_t *)
-            glMapNamedBuffer(*buffer, GL_READ_ONLY | GL_MAP_UNSYNCHRONIZED_BIT);
-        glUnmapNamedBuffer(g_gl.buffers[BUFFER_CBT_NODE_COUNT]);
+    if (glrb_CanWrite(ring)) {
         glBindBufferBase(GL_SHADER_STORAGE_BUFFER,
                          BUFFER_CBT_NODE_COUNT,
                          g_gl.buffers[BUFFER_CBT_NODE_COUNT]);
@@ -2363,9 +4119,14 @@ void RetrieveNodeCount()
                          BUFFER_LEB,
                          g_gl.buffers[BUFFER_LEB]);
         glUseProgram(g_gl.programs[PROGRAM_CBT_NODE_COUNT]);
-        glDispatchCompute(1, 1, 1);
+        glDispatchCompute(lebTreeCount(), 1, 1);
         glMemoryBarrier(GL_ALL_BARRIER_BITS);
-        glQueryCounter(*query, GL_TIMESTAMP);
+        glrb_Copy(ring,
+                  g_gl.buffers[BUFFER_CBT_NODE_COUNT],
+                  0,
+                  0,
+                  sizeof(uint32_t) * lebTreeCount());
+        glrb_Submit(ring);
         glBindBufferBase(GL_SHADER_STORAGE_BUFFER,
                          BUFFER_CBT_NODE_COUNT,
                          0);
@@ -2385,6 +4146,8 @@ void renderScene()
 {
     renderTerrain();
     RetrieveNodeCount();
+    if (g_terrain.flags.hiz)
+        renderHiz();
     renderSky();
 }
 
@@ -2459,6 +4222,7 @@ void renderViewer()
                 LoadSceneFramebufferTexture();
                 LoadSceneFramebuffer();
                 LoadViewerProgram();
+                LoadHizProgram();
             }
             if (ImGui::SliderFloat("FOVY", &g_camera.fovy, 1.0f, 179.0f)) {
                 ConfigureTerrainPrograms();
@@ -2503,6 +4267,16 @@ void renderViewer()
             ImGui::Text("GPU: %.3f%s",
                 gpuDt < 1. ? gpuDt * 1e3 : gpuDt,
                 gpuDt < 1. ? "ms" : " s");
+            if (lebUsesLeafCache()) {
+                djgc_ticks(g_gl.clocks[CLOCK_LEAF_CACHE], &cpuDt, &gpuDt);
+                ImGui::Text("Leaf Cache  -- CPU: %.3f%s",
+                    cpuDt < 1. ? cpuDt * 1e3 : cpuDt,
+                    cpuDt < 1. ? "ms" : " s");
+                ImGui::SameLine();
+                ImGui::Text("GPU: %.3f%s",
+                    gpuDt < 1. ? gpuDt * 1e3 : gpuDt,
+                    gpuDt < 1. ? "ms" : " s");
+            }
             djgc_ticks(g_gl.clocks[CLOCK_BATCH], &cpuDt, &gpuDt);
             ImGui::Text("Dispatch    -- CPU: %.3f%s",
                 cpuDt < 1. ? cpuDt * 1e3 : cpuDt,
@@ -2542,7 +4316,7 @@ void renderViewer()
             ImGui::NewLine();
             ImGui::Text("Reduction Details:");
             for (int i = 0; i < g_terrain.maxDepth; ++i) {
-                if (i >= g_terrain.maxDepth - 5 && i < g_terrain.maxDepth - 1)
+                if (!lebReductionTimesLevel(i))
                     continue;
 
                 djgc_ticks(g_gl.clocks[CLOCK_REDUCTION00 + i], &cpuDt, &gpuDt);
@@ -2597,11 +4371,26 @@ void renderViewer()
             if (ImGui::Combo("Shading", &g_terrain.shading, &eShadings[0], BUFFER_SIZE(eShadings)))
                 LoadTerrainPrograms();
             if (ImGui::Combo("GPU Pipeline", &g_terrain.method, &ePipelines[0], ePipelines.size())) {
-                LoadTerrainPrograms();
-                LoadBatchProgram();
+                if (g_terrain.tiles.count > 1) {
+                    // the mesh shader pipeline only supports a single CBT
+                    LoadBuffers();
+                    LoadPrograms();
+                } else {
+                    // the mesh shader pipeline has no leaf cache
+                    LoadLeafCacheBuffer();
+                    LoadTerrainPrograms();
+                    LoadDirtyDispatcherProgram();
+                    LoadBatchProgram();
+                }
             } if (ImGui::Checkbox("Cull", &g_terrain.flags.cull))
                 LoadPrograms();
             ImGui::SameLine();
+            if (ImGui::Checkbox("Horizon", &g_terrain.flags.horizon))
+                LoadTerrainPrograms();
+            ImGui::SameLine();
+            if (ImGui::Checkbox("Hi-Z", &g_terrain.flags.hiz))
+                LoadTerrainPrograms();
+            ImGui::SameLine();
             if (ImGui::Checkbox("Wire", &g_terrain.flags.wire))
                 LoadTerrainPrograms();
             ImGui::SameLine();
@@ -2614,31 +4403,123 @@ void renderViewer()
                     LoadTerrainPrograms();
                     LoadTopViewProgram();
                 }
+                ImGui::SameLine();
+                if (ImGui::Checkbox("Stream", &g_terrain.streaming.enabled)) {
+                    LoadDmapTexture();
+                    LoadNodeErrorBuffer();
+                    LoadTerrainPrograms();
+                    lebInvalidateStaticSkip();
+                }
             }
             ImGui::SameLine();
             ImGui::Checkbox("TopView", &g_terrain.flags.topView);
-            if (ImGui::SliderFloat("PixelsPerEdge", &g_terrain.primitivePixelLengthTarget, 1, 32)) {
-                ConfigureTerrainPrograms();
+            if (g_terrain.method != METHOD_MS) {
+                ImGui::SameLine();
+                if (ImGui::Checkbox("Leaf Cache", &g_terrain.flags.leafCache)) {
+                    LoadLeafCacheBuffer();
+                    LoadPrograms();
+                }
+                // the blocks are flagged either way, so this needs no reload
+                ImGui::SameLine();
+                ImGui::Checkbox("Incremental", &g_terrain.flags.incremental);
+            }
+            if (g_terrain.method == METHOD_CS) {
+                if (ImGui::Checkbox("Skip Static Updates", &g_terrain.staticSkip.enabled))
+                    lebInvalidateStaticSkip();
+                ImGui::SameLine();
+                ImGui::Text("%s", g_terrain.staticSkip.pendingFrameCount > 0 ? "(updating)" : "(idle)");
+                if (ImGui::Checkbox("Budgeted Update", &g_terrain.budget.enabled))
+                    lebResetBudget();
+            }
+            if (lebIsBudgeted()) {
+                const char* eBudgets[] = {
+                    "Nodes",
+                    "Microseconds"
+                };
+                uint32_t backlog = lebBudgetBacklog();
+
+                ImGui::Combo("Budget", &g_terrain.budget.mode, &eBudgets[0], BUFFER_SIZE(eBudgets));
+                if (g_terrain.budget.mode == BUDGET_NODES) {
+                    ImGui::SliderInt("NodeBudget", &g_terrain.budget.nodeCount, 256, 1 << 22);
+                } else {
+                    ImGui::SliderFloat("TimeBudget (us)", &g_terrain.budget.microseconds, 10.0f, 16000.0f);
+                }
+                PrintLargeNumber("Backlog", (int32_t)backlog);
+                ImGui::SameLine();
+                ImGui::Text("(%.0f%% of sweep %u)",
+                            g_terrain.tiles.maxNodeCount > 0
+                                ? 100.0f * backlog / g_terrain.tiles.maxNodeCount : 0.0f,
+                            g_terrain.budget.sweepCount);
+            }
+            if (!g_terrain.dmap.pathToFile.empty()) {
+                const char* eLodMetrics[] = {
+                    "Edge Length",
+                    "Geometric Error"
+                };
+
+                if (ImGui::Combo("LoD Metric", &g_terrain.lodMetric, &eLodMetrics[0], BUFFER_SIZE(eLodMetrics)))
+                    LoadTerrainPrograms();
+            }
+            if (lodUsesNodeErrors()) {
+                if (ImGui::SliderFloat("PixelError", &g_terrain.pixelErrorTarget, 0.1f, 16.0f)) {
+                    ConfigureTerrainPrograms();
+                }
+            } else {
+                if (ImGui::SliderFloat("PixelsPerEdge", &g_terrain.primitivePixelLengthTarget, 1, 32)) {
+                    ConfigureTerrainPrograms();
+                }
             }
             if (ImGui::SliderFloat("DmapScale", &g_terrain.dmap.scale, 0.f, 1.f)) {
                 ConfigureTerrainPrograms();
                 ConfigureTopViewProgram();
             }
-            if (ImGui::SliderFloat("LodStdev", &g_terrain.minLodStdev, 0.f, 1.0f, "%.4f")) {
-                ConfigureTerrainPrograms();
+            if (!lodUsesNodeErrors()) {
+                if (ImGui::SliderFloat("LodStdev", &g_terrain.minLodStdev, 0.f, 1.0f, "%.4f")) {
+                    ConfigureTerrainPrograms();
+                }
             }
             if (ImGui::SliderInt("PatchSubdLevel", &g_terrain.gpuSubd, 0, 6)) {
                 LoadMeshletBuffers();
                 LoadMeshletVertexArray();
+                LoadNodeErrorBuffer();
                 LoadPrograms();
             }
             if (ImGui::SliderInt("MaxDepth", &g_terrain.maxDepth, 5, 29)) {
                 LoadBuffers();
                 LoadPrograms();
             }
+            // each CBT takes a shader storage block in every stage
+            if (g_terrain.method != METHOD_MS
+                && ImGui::SliderInt("Tiles", &g_terrain.tiles.count, 1, 3)) {
+                LoadBuffers();
+                LoadPrograms();
+            }
             PrintLargeNumber("CBT nodes", g_terrain.nodeCount);
+            if (g_terrain.flags.hiz)
+                PrintLargeNumber("Hi-Z culled", (int32_t)g_terrain.hiz.cullCount);
+            if (dmapIsStreamed()) {
+                ImGui::SliderInt("TileUploads", &g_terrain.streaming.uploadBudget, 1, 256);
+                ImGui::Text("Tiles: %u/%i pages, %u requested, %u pending",
+                            g_terrain.streaming.residentCount,
+                            g_tileLoader.cache.pageCount,
+                            g_terrain.streaming.requestCount,
+                            g_terrain.streaming.pendingCount);
+            }
+            if (lebTreeCount() == 1 && ImGui::Button("CPU Reference"))
+                ComputeCpuReference();
+            if (g_terrain.reference.passCount > 0) {
+                ImGui::SameLine();
+                ImGui::Text("%li nodes, %i passes%s (%s GPU)",
+                            (long)g_terrain.reference.nodeCount,
+                            g_terrain.reference.passCount,
+                            g_terrain.reference.isConverged ? "" : " (not converged)",
+                            g_terrain.reference.matchesGpu ? "matches" : "differs from");
+                ImGui::Text("Culled leaves: %li frustum, %li horizon",
+                            (long)g_terrain.reference.cullCounts[LEBT_CULL_FRUSTUM],
+                            (long)g_terrain.reference.cullCounts[LEBT_CULL_HORIZON]);
+            }
             {
-                uint32_t bufSize = cbt__HeapByteSize(g_terrain.maxDepth);
+                uint32_t bufSize = cbt__HeapByteSize(g_terrain.maxDepth) * lebTreeCount();
 
                 if (bufSize < (1 << 10)) {
                     ImGui::Text("CBT heap size: %i Bytes", bufSize);
@@ -2671,6 +4552,247 @@ void renderViewer()
     }
 }
 
+// -----------------------------------------------------------------------------
+/**
+ * Benchmark Mode
+ *
+ * The benchmark flies the camera along a path, with the same camera for
+ * each frame of each run, and runs it once per pipeline. A camera path is
+ * a text file with one key per line: the position and the two angles of
+ * the camera (see updateCameraMatrix), i.e., "x y z upAngle sideAngle";
+ * lines starting with '#' are ignored. The keys are evenly spaced over
+ * the recorded frames and interpolated with a Catmull-Rom spline.
+ * Each pipeline starts from a reset subdivision, which converges during
+ * the warmup frames at the first key. Every clock and the node count of
+ * the recorded frames are written to <output>_frames.csv, and the
+ * p50/p95/p99 times of each pipeline to <output>_summary.csv.
+ */
+bool LoadCameraPath(const char *pathToFile)
+{
+    FILE *pf = fopen(pathToFile, "r");
+    char line[256];
+
+    if (!pf) {
+        LOG("(!) Failed to open %s (!)\n", pathToFile);
+
+        return false;
+    }
+
+    g_benchmark.keys.clear();
+    while (fgets(line, sizeof(line), pf)) {
+        CameraKey key;
+
+        if (line[0] == '#')
+            continue;
+        if (sscanf(line, "%f %f %f %f %f",
+                   &key.pos.x, &key.pos.y, &key.pos.z,
+                   &key.upAngle, &key.sideAngle) == 5)
+            g_benchmark.keys.push_back(key);
+    }
+    fclose(pf);
+
+    if (g_benchmark.keys.empty()) {
+        LOG("(!) No camera keys in %s (!)\n", pathToFile);
+
+        return false;
+    }
+
+    return true;
+}
+
+float CatmullRom(float p0, float p1, float p2, float p3, float t)
+{
+    return 0.5f * (2.0f * p1
+                   + (p2 - p0) * t
+                   + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t * t
+                   + (3.0f * p1 - p0 - 3.0f * p2 + p3) * t * t * t);
+}
+
+// u ranges in [0, keyCount - 1]; the end keys are repeated
+CameraKey CameraPathKey(float u)
+{
+    const std::vector<CameraKey> &keys = g_benchmark.keys;
+    int keyCount = (int)keys.size();
+    int i1 = std::max(std::min((int)u, keyCount - 2), 0);
+    int i0 = std::max(i1 - 1, 0);
+    int i2 = std::min(i1 + 1, keyCount - 1);
+    int i3 = std::min(i1 + 2, keyCount - 1);
+    float t = std::min(u - i1, 1.0f);
+    CameraKey key;
+
+#define INTERPOLATE(x) \
+    CatmullRom(keys[i0].x, keys[i1].x, keys[i2].x, keys[i3].x, t)
+    key.pos.x = INTERPOLATE(pos.x);
+    key.pos.y = INTERPOLATE(pos.y);
+    key.pos.z = INTERPOLATE(pos.z);
+    key.upAngle = INTERPOLATE(upAngle);
+    key.sideAngle = INTERPOLATE(sideAngle);
+#undef INTERPOLATE
+
+    return key;
+}
+
+void BenchmarkStartPipeline()
+{
+    g_terrain.method = g_benchmark.methods.front();
+    LOG("Benchmarking {%s}\n", g_methodNames[g_terrain.method]);
+
+    // the first call to benchmarkFrame enters frame -warmupCount
+    LoadBuffers();
+    LoadPrograms();
+    g_benchmark.frame = -g_benchmark.warmupCount - 1;
+}
+
+// nearest-rank percentile
+double Percentile(const std::vector<double> &sortedValues, double p)
+{
+    size_t rank = (size_t)std::ceil(p * sortedValues.size());
+
+    return sortedValues[std::max(rank, (size_t)1) - 1];
+}
+
+bool WriteBenchmarkResults()
+{
+    std::string framesPath = g_benchmark.pathToOutput + "_frames.csv";
+    std::string summaryPath = g_benchmark.pathToOutput + "_summary.csv";
+    const int summaryClocks[] = {
+        CLOCK_ALL, CLOCK_BATCH, CLOCK_UPDATE, CLOCK_REDUCTION, CLOCK_RENDER,
+        CLOCK_LEAF_CACHE
+    };
+    const char *clockNames[] = {
+        "all", "batch", "update", "render", "leafCache", "reduction"
+    };
+    int reductionCount = std::min(g_terrain.maxDepth,
+                                  CLOCK_COUNT - CLOCK_REDUCTION00);
+    FILE *pf;
+
+    LOG("Writing {%s, %s}\n", framesPath.c_str(), summaryPath.c_str());
+    pf = fopen(framesPath.c_str(), "w");
+    if (!pf)
+        return false;
+    fprintf(pf, "pipeline,frame,nodeCount,frameMs");
+    for (int i = 0; i < CLOCK_REDUCTION00; ++i)
+        fprintf(pf, ",%sMs", clockNames[i]);
+    for (int i = 0; i < reductionCount; ++i)
+        fprintf(pf, ",reduction%02iMs", i);
+    fprintf(pf, "\n");
+    for (size_t i = 0; i < g_benchmark.frames.size(); ++i) {
+        const BenchmarkFrame &frame = g_benchmark.frames[i];
+
+        fprintf(pf, "%s,%i,%u,%.4f",
+                g_methodNames[frame.method],
+                frame.frame,
+                frame.nodeCount,
+                frame.frameTime * 1e3);
+        for (int j = 0; j < CLOCK_REDUCTION00 + reductionCount; ++j)
+            fprintf(pf, ",%.4f", frame.gpuTimes[j] * 1e3);
+        fprintf(pf, "\n");
+    }
+    fclose(pf);
+
+    pf = fopen(summaryPath.c_str(), "w");
+    if (!pf)
+        return false;
+    fprintf(pf, "pipeline,clock,frames,meanMs,p50Ms,p95Ms,p99Ms\n");
+    for (int method = 0; method < BUFFER_SIZE(g_methodNames); ++method)
+    for (int i = -1; i < BUFFER_SIZE(summaryClocks); ++i) {
+        std::vector<double> times;
+        double mean = 0.0;
+
+        // i = -1 stands for the CPU frame time
+        for (size_t j = 0; j < g_benchmark.frames.size(); ++j) {
+            const BenchmarkFrame &frame = g_benchmark.frames[j];
+
+            if (frame.method == method)
+                times.push_back(i < 0 ? frame.frameTime
+                                      : frame.gpuTimes[summaryClocks[i]]);
+        }
+        if (times.empty())
+            continue;
+
+        std::sort(times.begin(), times.end());
+        for (size_t j = 0; j < times.size(); ++j)
+            mean+= times[j];
+        mean/= times.size();
+
+        fprintf(pf, "%s,%s,%i,%.4f,%.4f,%.4f,%.4f\n",
+                g_methodNames[method],
+                i < 0 ? "frame" : clockNames[summaryClocks[i]],
+                (int)times.size(),
+                mean * 1e3,
+                Percentile(times, 0.50) * 1e3,
+                Percentile(times, 0.95) * 1e3,
+                Percentile(times, 0.99) * 1e3);
+        if (i < 0) {
+            LOG("%s -- frame p50: %.3fms p95: %.3fms p99: %.3fms\n",
+                g_methodNames[method],
+                Percentile(times, 0.50) * 1e3,
+                Percentile(times, 0.95) * 1e3,
+                Percentile(times, 0.99) * 1e3);
+        }
+    }
+    fclose(pf);
+
+    return true;
+}
+
+/**
+ * This routine is called once per frame, before rendering: it records the
+ * previous frame, moves on to the next pipeline once the frame limit is
+ * reached, and places the camera. It returns false once all the pipelines
+ * ran.
+ */
+bool benchmarkFrame()
+{
+    typedef std::chrono::steady_clock clock;
+    clock::time_point now = clock::now();
+    int clockCount = CLOCK_REDUCTION00
+                   + std::min(g_terrain.maxDepth, CLOCK_COUNT - CLOCK_REDUCTION00);
+    CameraKey key;
+
+    // wait until the dmap is fully uploaded
+    if (g_dmapLoader.state != DMAP_LOADER_IDLE) {
+        g_benchmark.frameStart = now;
+
+        return true;
+    }
+
+    if (g_benchmark.frame >= 0) {
+        BenchmarkFrame frame = {};
+        double cpuDt;
+
+        frame.method = g_terrain.method;
+        frame.frame = g_benchmark.frame;
+        frame.nodeCount = g_terrain.nodeCount;
+        frame.frameTime = std::chrono::duration<double>(now - g_benchmark.frameStart).count();
+        // the clocks of the other reduction levels never run
+        for (int i = 0; i < clockCount; ++i)
+            if (i < CLOCK_REDUCTION00 || lebReductionTimesLevel(i - CLOCK_REDUCTION00))
+                djgc_ticks(g_gl.clocks[i], &cpuDt, &frame.gpuTimes[i]);
+        g_benchmark.frames.push_back(frame);
+    }
+
+    if (++g_benchmark.frame == g_app.frameLimit) {
+        g_benchmark.methods.erase(g_benchmark.methods.begin());
+        if (g_benchmark.methods.empty())
+            return false;
+
+        BenchmarkStartPipeline();
+        ++g_benchmark.frame;
+    }
+
+    key = CameraPathKey(std::max(g_benchmark.frame, 0)
+                        * (g_benchmark.keys.size() - 1.0f)
+                        / std::max(g_app.frameLimit - 1, 1));
+    g_camera.pos = key.pos;
+    g_camera.upAngle = key.upAngle;
+    g_camera.sideAngle = key.sideAngle;
+    updateCameraMatrix();
+    g_benchmark.frameStart = now;
+
+    return true;
+}
+
 // -----------------------------------------------------------------------------
 /**
  * Render Everything
@@ -2790,8 +4912,89 @@ void usage(const char *app)
 
 
 // -----------------------------------------------------------------------------
-int main(int, char **)
+void Usage(const char *app)
+{
+    LOG("usage: %s [--snapshot terrain.cbts] [--benchmark camera.path] [--frames %i] "
+        "[--warmup %i] [--pipelines cs,ts,gs,ms] [--output benchmark]\n",
+        app, BENCHMARK_DEFAULT_FRAME_COUNT, BENCHMARK_DEFAULT_WARMUP_COUNT);
+}
+
+bool ParseMethods(const char *arg, std::vector<int> *methods)
+{
+    std::string list(arg);
+    size_t begin = 0;
+
+    methods->clear();
+    while (begin <= list.size()) {
+        size_t end = std::min(list.find(',', begin), list.size());
+        std::string name = list.substr(begin, end - begin);
+        int method = -1;
+
+        for (int i = 0; i < BUFFER_SIZE(g_methodNames); ++i)
+            if (name == g_methodNames[i])
+                method = i;
+        if (method < 0)
+            return false;
+
+        methods->push_back(method);
+        begin = end + 1;
+    }
+
+    return true;
+}
+
+bool ParseCommandLine(int argc, char **argv)
+{
+    const char *pathToCameraPath = NULL;
+
+    g_benchmark.methods.clear();
+    for (int i = 0; i < BUFFER_SIZE(g_methodNames); ++i)
+        g_benchmark.methods.push_back(i);
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--snapshot") && i + 1 < argc) {
+            g_app.snapshot.path = argv[++i];
+            g_app.snapshot.warmStart = true;
+        } else if (!strcmp(argv[i], "--benchmark") && i + 1 < argc) {
+            pathToCameraPath = argv[++i];
+        } else if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            g_app.frameLimit = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--warmup") && i + 1 < argc) {
+            g_benchmark.warmupCount = std::max(atoi(argv[++i]), 0);
+        } else if (!strcmp(argv[i], "--pipelines") && i + 1 < argc) {
+            if (!ParseMethods(argv[++i], &g_benchmark.methods))
+                return false;
+        } else if (!strcmp(argv[i], "--output") && i + 1 < argc) {
+            g_benchmark.pathToOutput = argv[++i];
+        } else {
+            return false;
+        }
+    }
+
+    if (pathToCameraPath) {
+        if (!LoadCameraPath(pathToCameraPath))
+            return false;
+
+        if (g_app.frameLimit <= 0)
+            g_app.frameLimit = BENCHMARK_DEFAULT_FRAME_COUNT;
+
+        // the HUD and the snapshots would change what is measured
+        g_benchmark.enabled = true;
+        g_app.viewer.hud = false;
+        g_app.snapshot.warmStart = false;
+    }
+
+    return true;
+}
+
+int main(int argc, char **argv)
 {
+    if (!ParseCommandLine(argc, argv)) {
+        Usage(argv[0]);
+
+        return EXIT_FAILURE;
+    }
+
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
@@ -2810,6 +5013,8 @@ int main(int, char **)
         return -1;
     }
     glfwMakeContextCurrent(window);
+    if (g_benchmark.enabled)
+        glfwSwapInterval(0);
     glfwSetKeyCallback(window, &keyboardCallback);
     glfwSetCursorPosCallback(window, &mouseMotionCallback);
     glfwSetMouseButtonCallback(window, &mouseButtonCallback);
@@ -2836,9 +5041,27 @@ int main(int, char **)
         init();
         LOG("-- End -- Init\n");
 
+        if (g_benchmark.enabled) {
+            // the mesh shader pipeline is only listed if supported
+            std::vector<int> &methods = g_benchmark.methods;
+
+            if (!GLAD_GL_NV_mesh_shader)
+                methods.erase(std::remove(methods.begin(), methods.end(), (int)METHOD_MS),
+                              methods.end());
+            if (methods.empty())
+                throw std::runtime_error("no pipeline to benchmark");
+            BenchmarkStartPipeline();
+        }
+
         while (!glfwWindowShouldClose(window)) {
             glfwPollEvents();
 
+            if (g_benchmark.enabled && !benchmarkFrame()) {
+                if (!WriteBenchmarkResults())
+                    throw std::runtime_error("failed to write the benchmark results");
+                break;
+            }
+
             render();
 
             glfwSwapBuffers(window);
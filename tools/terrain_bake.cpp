@@ -0,0 +1,91 @@
+// Offline baker for the terrain program's heightmap.
+//
+// Decodes a 16-bit heightmap once and writes the mip chains of the
+// displacement map (height and squared height) and of the slope map into a
+// container whose levels are page-aligned (see terrain/TerrainBake.h). The
+// terrain program maps that container and uploads its levels as they are,
+// without decoding the image or converting a single texel.
+//
+// usage: terrain_bake [--output terrain.tbk] heightmap.png
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+
+#define LOG(fmt, ...) fprintf(stderr, fmt "\n", ##__VA_ARGS__); fflush(stderr);
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#define SMAP_IMPLEMENTATION
+#define TBK_IMPLEMENTATION
+#include "TerrainBake.h"
+
+static void Usage(const char *app)
+{
+    LOG("usage: %s [--output terrain.tbk] heightmap.png", app);
+}
+
+int main(int argc, char **argv)
+{
+    typedef std::chrono::steady_clock clock;
+    const char *input = NULL;
+    const char *output = "terrain.tbk";
+    clock::time_point start = clock::now();
+    int64_t sourceByteSize;
+    uint16_t *texels;
+    int w, h, n;
+    FILE *pf;
+
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--output") && i + 1 < argc) {
+            output = argv[++i];
+        } else if (argv[i][0] != '-' && !input) {
+            input = argv[i];
+        } else {
+            Usage(argv[0]);
+
+            return EXIT_FAILURE;
+        }
+    }
+    if (!input) {
+        Usage(argv[0]);
+
+        return EXIT_FAILURE;
+    }
+
+    pf = fopen(input, "rb");
+    if (!pf) {
+        LOG("terrain_bake: failed to open '%s'", input);
+
+        return EXIT_FAILURE;
+    }
+    fseek(pf, 0, SEEK_END);
+    sourceByteSize = (int64_t)ftell(pf);
+    fclose(pf);
+
+    // same orientation as djgt_push_image_u16(..., true) in the terrain program
+    stbi_set_flip_vertically_on_load(1);
+    texels = stbi_load_16(input, &w, &h, &n, 1);
+    if (!texels) {
+        LOG("terrain_bake: failed to decode '%s' (%s)", input, stbi_failure_reason());
+
+        return EXIT_FAILURE;
+    }
+    LOG("Decoded {%ix%i texels} in %.3f s", w, h,
+        std::chrono::duration<double>(clock::now() - start).count());
+
+    start = clock::now();
+    if (!tbk_Bake(output, texels, w, h, (uint64_t)sourceByteSize)) {
+        LOG("terrain_bake: failed to write '%s'", output);
+        stbi_image_free(texels);
+
+        return EXIT_FAILURE;
+    }
+    LOG("Baked {%s, %i levels} in %.3f s", output, tbk_LevelCount(w, h),
+        std::chrono::duration<double>(clock::now() - start).count());
+    stbi_image_free(texels);
+
+    return EXIT_SUCCESS;
+}